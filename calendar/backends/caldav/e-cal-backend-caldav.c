@@ -4833,7 +4833,9 @@ caldav_start_view (ECalBackend *backend,
 	GSList			 *list, *iter;
 	const gchar               *sexp_string;
 	time_t occur_start = -1, occur_end = -1;
+	time_t priority_start = -1, priority_end = -1;
 	gboolean prunning_by_time;
+	gboolean skip_notified = FALSE;
 	cbdav = E_CAL_BACKEND_CALDAV (backend);
 
 	sexp = e_data_cal_view_get_sexp (query);
@@ -4851,6 +4853,30 @@ caldav_start_view (ECalBackend *backend,
 
 	cache = E_TIMEZONE_CACHE (backend);
 
+	/* Send what is most likely on screen first, then the rest. */
+	if (e_data_cal_view_get_priority_window (query, &priority_start, &priority_end)) {
+		list = e_cal_backend_store_get_components_occuring_in_range (
+			cbdav->priv->store, priority_start, priority_end);
+
+		for (iter = list; iter; iter = g_slist_next (iter)) {
+			ECalComponent *comp = E_CAL_COMPONENT (iter->data);
+
+			if (!do_search ||
+			    e_cal_backend_sexp_match_comp (sexp, comp, cache)) {
+				e_data_cal_view_notify_components_added_1 (query, comp);
+			}
+
+			g_object_unref (comp);
+		}
+
+		g_slist_free (list);
+
+		e_data_cal_view_notify_window_complete (
+			query, priority_start, priority_end);
+
+		skip_notified = TRUE;
+	}
+
 	list = prunning_by_time ?
 		e_cal_backend_store_get_components_occuring_in_range (cbdav->priv->store, occur_start, occur_end)
 		: e_cal_backend_store_get_components (cbdav->priv->store);
@@ -4858,6 +4884,12 @@ caldav_start_view (ECalBackend *backend,
 	for (iter = list; iter; iter = g_slist_next (iter)) {
 		ECalComponent *comp = E_CAL_COMPONENT (iter->data);
 
+		/* Skip what was already sent with the priority window. */
+		if (skip_notified && e_data_cal_view_contains_component (query, comp)) {
+			g_object_unref (comp);
+			continue;
+		}
+
 		if (!do_search ||
 		    e_cal_backend_sexp_match_comp (sexp, comp, cache)) {
 			e_data_cal_view_notify_components_added_1 (query, comp);
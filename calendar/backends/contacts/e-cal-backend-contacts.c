@@ -54,6 +54,11 @@ typedef enum
 	CAL_MINUTES
 } CalUnits;
 
+/* Tracked components are indexed by the month and day of their DTSTART,
+ * see cal_backend_contacts_match_tracked(); the last bucket holds those
+ * without a usable date. */
+#define DAY_INDEX_SIZE (12 * 31)
+
 /* Private part of the ECalBackendContacts structure */
 struct _ECalBackendContactsPrivate {
 
@@ -65,6 +70,14 @@ struct _ECalBackendContactsPrivate {
 	GHashTable *tracked_contacts;	/* UID -> ContactRecord */
 	GRecMutex tracked_contacts_lock;
 
+	/* ECalComponent-s of 'tracked_contacts' by month and day,
+	 * guarded by 'tracked_contacts_lock' */
+	GSList *day_index[DAY_INDEX_SIZE + 1];
+
+	/* Derived components from the previous run, keyed by contact
+	 * UID and revision; lets unchanged contacts skip create_component() */
+	ECalBackendStore *store;
+
 	/* properties related to track alarm settings for this backend */
 	GSettings *settings;
 	guint notifyid;
@@ -87,6 +100,7 @@ typedef struct _ContactRecord {
 	ECalBackendContacts *cbc;
 	EBookClient *book_client; /* where it comes from */
 	EContact	    *contact;
+	gchar		    *revision; /* of the fields the components derive from */
 	ECalComponent       *comp_birthday, *comp_anniversary;
 } ContactRecord;
 
@@ -95,6 +109,10 @@ typedef struct _ContactRecord {
 #define ANNIVERSARY_UID_EXT "-anniversary"
 #define BIRTHDAY_UID_EXT   "-birthday"
 
+/* Keys in the ECalBackendStore */
+#define STORE_KEY_ALARM_CONFIG "alarm-config"
+#define STORE_KEY_REVISION_PREFIX "rev:"
+
 static ECalComponent *
 		create_birthday			(ECalBackendContacts *cbc,
 						 EContact *contact);
@@ -121,6 +139,12 @@ static void	setup_alarm			(ECalBackendContacts *cbc,
 static void	book_client_connected_cb	(GObject *source_object,
 						 GAsyncResult *result,
 						 gpointer user_data);
+static void	book_view_complete_cb		(EBookClientView *book_view,
+						 const GError *error,
+						 gpointer user_data);
+static void	cal_backend_contacts_forget_contact
+						(ECalBackendContacts *cbc,
+						 const gchar *contact_uid);
 
 static gboolean
 remove_by_book (gpointer key,
@@ -130,7 +154,13 @@ remove_by_book (gpointer key,
 	ContactRecord *cr = value;
 	EBookClient *book_client = user_data;
 
-	return (cr && cr->book_client == book_client);
+	if (cr && cr->book_client == book_client) {
+		/* the address book is gone, do not keep its birthdays around */
+		cal_backend_contacts_forget_contact (cr->cbc, key);
+		return TRUE;
+	}
+
+	return FALSE;
 }
 
 static void
@@ -293,6 +323,9 @@ book_record_get_view_thread (gpointer user_data)
 	g_signal_connect (
 		book_view, "objects-modified",
 		G_CALLBACK (contacts_modified_cb), br->cbc);
+	g_signal_connect (
+		book_view, "complete",
+		G_CALLBACK (book_view_complete_cb), br->cbc);
 
 	e_book_client_view_start (book_view, NULL);
 
@@ -346,6 +379,315 @@ book_client_connected_cb (GObject *source_object,
 	g_object_unref (client);
 }
 
+/* Day index methods, the caller should hold 'tracked_contacts_lock' */
+static gint
+day_index_get_bucket (ECalComponent *comp)
+{
+	ECalComponentDateTime dt;
+	gint bucket = DAY_INDEX_SIZE;
+
+	e_cal_component_get_dtstart (comp, &dt);
+
+	if (dt.value != NULL &&
+	    dt.value->month >= 1 && dt.value->month <= 12 &&
+	    dt.value->day >= 1 && dt.value->day <= 31)
+		bucket = (dt.value->month - 1) * 31 + dt.value->day - 1;
+
+	e_cal_component_free_datetime (&dt);
+
+	return bucket;
+}
+
+static void
+day_index_add (ECalBackendContacts *cbc,
+               ECalComponent *comp)
+{
+	gint bucket = day_index_get_bucket (comp);
+
+	cbc->priv->day_index[bucket] = g_slist_prepend (
+		cbc->priv->day_index[bucket], comp);
+}
+
+static void
+day_index_remove (ECalBackendContacts *cbc,
+                  ECalComponent *comp)
+{
+	gint bucket = day_index_get_bucket (comp);
+
+	cbc->priv->day_index[bucket] = g_slist_remove (
+		cbc->priv->day_index[bucket], comp);
+}
+
+/* Store methods */
+static gchar *
+contact_record_dup_revision (EContact *contact)
+{
+	EContactDate *birthday, *anniversary;
+	const gchar *name;
+	gchar *revision;
+
+	birthday = e_contact_get (contact, E_CONTACT_BIRTH_DATE);
+	anniversary = e_contact_get (contact, E_CONTACT_ANNIVERSARY);
+
+	name = e_contact_get_const (contact, E_CONTACT_FILE_AS);
+	if (!name || !*name)
+		name = e_contact_get_const (contact, E_CONTACT_FULL_NAME);
+	if (!name || !*name)
+		name = e_contact_get_const (contact, E_CONTACT_NICKNAME);
+	if (!name)
+		name = "";
+
+	/* Everything create_birthday() and create_anniversary() read,
+	 * including the language their summaries are translated to;
+	 * the contact's own REV changes on any edit, even to a phone
+	 * number, which would needlessly rebuild its components. */
+	revision = g_strdup_printf (
+		"%04d%02d%02d/%04d%02d%02d/%s/%s",
+		birthday ? birthday->year : 0,
+		birthday ? birthday->month : 0,
+		birthday ? birthday->day : 0,
+		anniversary ? anniversary->year : 0,
+		anniversary ? anniversary->month : 0,
+		anniversary ? anniversary->day : 0,
+		g_get_language_names ()[0],
+		name);
+
+	e_contact_date_free (birthday);
+	e_contact_date_free (anniversary);
+
+	return revision;
+}
+
+static ECalComponent *
+contact_record_load_component (ECalBackendStore *store,
+                               const gchar *contact_uid,
+                               const gchar *uid_ext)
+{
+	ECalComponent *comp;
+	gchar *uid;
+
+	uid = g_strconcat (contact_uid, uid_ext, NULL);
+	comp = e_cal_backend_store_get_component (store, uid, NULL);
+	g_free (uid);
+
+	/* The instance is shared with the store until the record is
+	 * saved again, which puts a copy there.  Alarm updates modify
+	 * tracked components in place, but save each record after. */
+	return comp;
+}
+
+static void
+contact_record_store_component (ECalBackendStore *store,
+                                const gchar *contact_uid,
+                                const gchar *uid_ext,
+                                ECalComponent *comp)
+{
+	if (comp) {
+		ECalComponent *clone;
+
+		clone = e_cal_component_clone (comp);
+		e_cal_backend_store_put_component (store, clone);
+		g_object_unref (clone);
+	} else {
+		gchar *uid;
+
+		uid = g_strconcat (contact_uid, uid_ext, NULL);
+		e_cal_backend_store_remove_component (store, uid, NULL);
+		g_free (uid);
+	}
+}
+
+/* Takes the components from the store when they were derived from
+ * the same revision of the contact; returns whether it did so. */
+static gboolean
+contact_record_load_from_store (ContactRecord *cr,
+                                const gchar *contact_uid)
+{
+	ECalBackendStore *store = cr->cbc->priv->store;
+	EContactDate *birthday, *anniversary;
+	const gchar *value, *revision;
+	gboolean complete;
+	gchar *key;
+
+	if (!store)
+		return FALSE;
+
+	key = g_strconcat (STORE_KEY_REVISION_PREFIX, contact_uid, NULL);
+	value = e_cal_backend_store_get_key_value (store, key);
+	g_free (key);
+
+	/* the value is "<address book UID>\n<revision>" */
+	revision = value ? strchr (value, '\n') : NULL;
+	if (!revision || g_strcmp0 (revision + 1, cr->revision) != 0)
+		return FALSE;
+
+	cr->comp_birthday = contact_record_load_component (
+		store, contact_uid, BIRTHDAY_UID_EXT);
+	cr->comp_anniversary = contact_record_load_component (
+		store, contact_uid, ANNIVERSARY_UID_EXT);
+
+	birthday = e_contact_get (cr->contact, E_CONTACT_BIRTH_DATE);
+	anniversary = e_contact_get (cr->contact, E_CONTACT_ANNIVERSARY);
+
+	complete =
+		(!birthday == !cr->comp_birthday) &&
+		(!anniversary == !cr->comp_anniversary);
+
+	e_contact_date_free (birthday);
+	e_contact_date_free (anniversary);
+
+	if (!complete) {
+		g_clear_object (&cr->comp_birthday);
+		g_clear_object (&cr->comp_anniversary);
+	}
+
+	return complete;
+}
+
+static void
+contact_record_save_to_store (ContactRecord *cr,
+                              const gchar *contact_uid)
+{
+	ECalBackendStore *store = cr->cbc->priv->store;
+	ESource *source;
+	gchar *key, *value;
+
+	if (!store)
+		return;
+
+	contact_record_store_component (
+		store, contact_uid, BIRTHDAY_UID_EXT, cr->comp_birthday);
+	contact_record_store_component (
+		store, contact_uid, ANNIVERSARY_UID_EXT, cr->comp_anniversary);
+
+	source = e_client_get_source (E_CLIENT (cr->book_client));
+
+	key = g_strconcat (STORE_KEY_REVISION_PREFIX, contact_uid, NULL);
+	value = g_strconcat (e_source_get_uid (source), "\n", cr->revision, NULL);
+	e_cal_backend_store_put_key_value (store, key, value);
+	g_free (key);
+	g_free (value);
+}
+
+static void
+cal_backend_contacts_forget_contact (ECalBackendContacts *cbc,
+                                     const gchar *contact_uid)
+{
+	ECalBackendStore *store = cbc->priv->store;
+	gchar *key;
+
+	if (!store)
+		return;
+
+	contact_record_store_component (store, contact_uid, BIRTHDAY_UID_EXT, NULL);
+	contact_record_store_component (store, contact_uid, ANNIVERSARY_UID_EXT, NULL);
+
+	key = g_strconcat (STORE_KEY_REVISION_PREFIX, contact_uid, NULL);
+	e_cal_backend_store_put_key_value (store, key, NULL);
+	g_free (key);
+}
+
+static gchar *
+cal_backend_contacts_dup_alarm_config (ECalBackendContacts *cbc)
+{
+	return g_strdup_printf (
+		"%d:%d:%d",
+		cbc->priv->alarm_enabled ? 1 : 0,
+		cbc->priv->alarm_interval,
+		cbc->priv->alarm_units);
+}
+
+static void
+cal_backend_contacts_open_store (ECalBackendContacts *cbc)
+{
+	ECalBackendStore *store;
+	const gchar *cache_dir;
+	gchar *alarm_config;
+
+	cache_dir = e_cal_backend_get_cache_dir (E_CAL_BACKEND (cbc));
+	store = e_cal_backend_store_new (cache_dir, E_TIMEZONE_CACHE (cbc));
+	e_cal_backend_store_load (store);
+
+	/* Stored components carry the alarm they were created with,
+	 * thus drop them all when the alarm settings changed since. */
+	setup_alarm (cbc, NULL);
+
+	alarm_config = cal_backend_contacts_dup_alarm_config (cbc);
+	if (g_strcmp0 (alarm_config, e_cal_backend_store_get_key_value (store, STORE_KEY_ALARM_CONFIG)) != 0) {
+		e_cal_backend_store_clean (store);
+		e_cal_backend_store_put_key_value (store, STORE_KEY_ALARM_CONFIG, alarm_config);
+	}
+	g_free (alarm_config);
+
+	cbc->priv->store = store;
+}
+
+/* Drops stored components of contacts the address book did not
+ * report, like those deleted while the backend was not running. */
+static void
+book_view_complete_cb (EBookClientView *book_view,
+                       const GError *error,
+                       gpointer user_data)
+{
+	ECalBackendContacts *cbc = E_CAL_BACKEND_CONTACTS (user_data);
+	EBookClient *book_client;
+	GHashTable *stale;
+	GHashTableIter iter;
+	gpointer key;
+	GSList *ids, *link;
+	const gchar *source_uid;
+	gsize source_uid_len;
+
+	if (error || !cbc->priv->store)
+		return;
+
+	book_client = e_book_client_view_ref_client (book_view);
+	if (book_client == NULL)
+		return;
+
+	source_uid = e_source_get_uid (e_client_get_source (E_CLIENT (book_client)));
+	source_uid_len = strlen (source_uid);
+
+	stale = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	g_rec_mutex_lock (&cbc->priv->tracked_contacts_lock);
+
+	ids = e_cal_backend_store_get_component_ids (cbc->priv->store);
+	for (link = ids; link; link = g_slist_next (link)) {
+		ECalComponentId *id = link->data;
+		const gchar *value;
+		gchar *contact_uid, *rev_key;
+
+		if (g_str_has_suffix (id->uid, BIRTHDAY_UID_EXT))
+			contact_uid = g_strndup (id->uid, strlen (id->uid) - strlen (BIRTHDAY_UID_EXT));
+		else if (g_str_has_suffix (id->uid, ANNIVERSARY_UID_EXT))
+			contact_uid = g_strndup (id->uid, strlen (id->uid) - strlen (ANNIVERSARY_UID_EXT));
+		else
+			continue;
+
+		rev_key = g_strconcat (STORE_KEY_REVISION_PREFIX, contact_uid, NULL);
+		value = e_cal_backend_store_get_key_value (cbc->priv->store, rev_key);
+		g_free (rev_key);
+
+		if ((!value || (strncmp (value, source_uid, source_uid_len) == 0 && value[source_uid_len] == '\n')) &&
+		    !g_hash_table_contains (cbc->priv->tracked_contacts, contact_uid))
+			g_hash_table_add (stale, contact_uid);
+		else
+			g_free (contact_uid);
+	}
+
+	g_slist_free_full (ids, (GDestroyNotify) e_cal_component_free_id);
+
+	g_hash_table_iter_init (&iter, stale);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		cal_backend_contacts_forget_contact (cbc, key);
+
+	g_rec_mutex_unlock (&cbc->priv->tracked_contacts_lock);
+
+	g_hash_table_destroy (stale);
+	g_object_unref (book_client);
+}
+
 /* ContactRecord methods */
 static ContactRecord *
 contact_record_new (ECalBackendContacts *cbc,
@@ -353,18 +695,29 @@ contact_record_new (ECalBackendContacts *cbc,
                     EContact *contact)
 {
 	ContactRecord *cr = g_new0 (ContactRecord, 1);
+	const gchar *uid = e_contact_get_const (contact, E_CONTACT_UID);
 
 	cr->cbc = cbc;
 	cr->book_client = book_client;
 	cr->contact = contact;
-	cr->comp_birthday = create_birthday (cbc, contact);
-	cr->comp_anniversary = create_anniversary (cbc, contact);
+	cr->revision = contact_record_dup_revision (contact);
+
+	if (!contact_record_load_from_store (cr, uid)) {
+		cr->comp_birthday = create_birthday (cbc, contact);
+		cr->comp_anniversary = create_anniversary (cbc, contact);
 
-	if (cr->comp_birthday)
+		contact_record_save_to_store (cr, uid);
+	}
+
+	if (cr->comp_birthday) {
+		day_index_add (cbc, cr->comp_birthday);
 		e_cal_backend_notify_component_created (E_CAL_BACKEND (cbc), cr->comp_birthday);
+	}
 
-	if (cr->comp_anniversary)
+	if (cr->comp_anniversary) {
+		day_index_add (cbc, cr->comp_anniversary);
 		e_cal_backend_notify_component_created (E_CAL_BACKEND (cbc), cr->comp_anniversary);
+	}
 
 	g_object_ref (G_OBJECT (contact));
 
@@ -380,6 +733,8 @@ contact_record_free (ContactRecord *cr)
 
 	/* Remove the birthday event */
 	if (cr->comp_birthday) {
+		day_index_remove (cr->cbc, cr->comp_birthday);
+
 		id = e_cal_component_get_id (cr->comp_birthday);
 		e_cal_backend_notify_component_removed (E_CAL_BACKEND (cr->cbc), id, cr->comp_birthday, NULL);
 
@@ -389,6 +744,8 @@ contact_record_free (ContactRecord *cr)
 
 	/* Remove the anniversary event */
 	if (cr->comp_anniversary) {
+		day_index_remove (cr->cbc, cr->comp_anniversary);
+
 		id = e_cal_component_get_id (cr->comp_anniversary);
 
 		e_cal_backend_notify_component_removed (E_CAL_BACKEND (cr->cbc), id, cr->comp_anniversary, NULL);
@@ -397,6 +754,7 @@ contact_record_free (ContactRecord *cr)
 		g_object_unref (G_OBJECT (cr->comp_anniversary));
 	}
 
+	g_free (cr->revision);
 	g_free (cr);
 }
 
@@ -436,34 +794,90 @@ contact_record_cb_free (ContactRecordCB *cb_data,
 	g_free (cb_data);
 }
 
+static void
+contact_record_cb_match_comp (ContactRecordCB *cb_data,
+                              ECalComponent *comp)
+{
+	gpointer data;
+
+	if (!e_cal_backend_sexp_match_comp (cb_data->sexp, comp, E_TIMEZONE_CACHE (cb_data->cbc)))
+		return;
+
+	if (cb_data->as_string)
+		data = e_cal_component_get_as_string (comp);
+	else
+		data = comp;
+
+	cb_data->result = g_slist_prepend (cb_data->result, data);
+}
+
 static void
 contact_record_cb (gpointer key,
                    gpointer value,
                    gpointer user_data)
 {
-	ETimezoneCache *timezone_cache;
 	ContactRecordCB *cb_data = user_data;
 	ContactRecord   *record = value;
-	gpointer data;
 
-	timezone_cache = E_TIMEZONE_CACHE (cb_data->cbc);
+	if (record->comp_birthday)
+		contact_record_cb_match_comp (cb_data, record->comp_birthday);
 
-	if (record->comp_birthday && e_cal_backend_sexp_match_comp (cb_data->sexp, record->comp_birthday, timezone_cache)) {
-		if (cb_data->as_string)
-			data = e_cal_component_get_as_string (record->comp_birthday);
-		else
-			data = record->comp_birthday;
+	if (record->comp_anniversary)
+		contact_record_cb_match_comp (cb_data, record->comp_anniversary);
+}
+
+static void
+day_index_mark (gboolean *wanted,
+                time_t tt)
+{
+	struct icaltimetype itt;
+
+	itt = icaltime_from_timet_with_zone (tt, TRUE, NULL);
+	wanted[(itt.month - 1) * 31 + itt.day - 1] = TRUE;
 
-		cb_data->result = g_slist_prepend (cb_data->result, data);
+	/* February 29th recurs on the 28th or March 1st in other years */
+	if ((itt.month == 2 && itt.day == 28) || (itt.month == 3 && itt.day == 1))
+		wanted[31 + 28] = TRUE;
+}
+
+/* Matches tracked components against the query of 'cb_data'.  Every
+ * component recurs yearly without an end, so an interval index over
+ * occurrence times cannot prune anything; when the query is limited
+ * to less than a year, only components whose month and day fall into
+ * it are checked instead.  The caller should hold 'tracked_contacts_lock'. */
+static void
+cal_backend_contacts_match_tracked (ECalBackendContacts *cbc,
+                                    ContactRecordCB *cb_data)
+{
+	const time_t day = 24 * 60 * 60;
+	gboolean wanted[DAY_INDEX_SIZE + 1];
+	time_t occur_start = -1, occur_end = -1, tt;
+	gint ii;
+
+	if (!e_cal_backend_sexp_evaluate_occur_times (cb_data->sexp, &occur_start, &occur_end) ||
+	    occur_start < 0 || occur_end < occur_start ||
+	    occur_end - occur_start > 360 * day) {
+		g_hash_table_foreach (cbc->priv->tracked_contacts, contact_record_cb, cb_data);
+		return;
 	}
 
-	if (record->comp_anniversary && e_cal_backend_sexp_match_comp (cb_data->sexp, record->comp_anniversary, timezone_cache)) {
-		if (cb_data->as_string)
-			data = e_cal_component_get_as_string (record->comp_anniversary);
-		else
-			data = record->comp_anniversary;
+	memset (wanted, 0, sizeof (wanted));
+	wanted[DAY_INDEX_SIZE] = TRUE;
+
+	/* All-day components are floating, allow a day on
+	 * both sides for the timezone the query was made in. */
+	for (tt = occur_start - day; tt < occur_end + day; tt += day)
+		day_index_mark (wanted, tt);
+	day_index_mark (wanted, occur_end + day);
+
+	for (ii = 0; ii <= DAY_INDEX_SIZE; ii++) {
+		GSList *link;
 
-		cb_data->result = g_slist_prepend (cb_data->result, data);
+		if (!wanted[ii])
+			continue;
+
+		for (link = cbc->priv->day_index[ii]; link; link = g_slist_next (link))
+			contact_record_cb_match_comp (cb_data, link->data);
 	}
 }
 
@@ -509,6 +923,8 @@ cal_backend_contacts_load_sources (gpointer user_data)
 	backend = E_CAL_BACKEND (user_data);
 	registry = e_cal_backend_get_registry (backend);
 
+	cal_backend_contacts_open_store (E_CAL_BACKEND_CONTACTS (backend));
+
 	/* Query all address book sources from the registry. */
 
 	extension_name = E_SOURCE_EXTENSION_ADDRESS_BOOK;
@@ -551,18 +967,40 @@ contacts_modified_cb (EBookClientView *book_view,
 		EContact *contact = E_CONTACT (ii->data);
 		const gchar *uid = e_contact_get_const (contact, E_CONTACT_UID);
 		EContactDate *birthday, *anniversary;
-
-		/* Because this is a change of contact, then always remove old tracked data
-		 * and if possible, add with (possibly) new values.
-		*/
-		g_hash_table_remove (cbc->priv->tracked_contacts, (gchar *) uid);
+		ContactRecord *cr;
 
 		birthday = e_contact_get (contact, E_CONTACT_BIRTH_DATE);
 		anniversary = e_contact_get (contact, E_CONTACT_ANNIVERSARY);
 
+		/* Most changes do not touch the fields the components are
+		 * derived from; keep those components as they are. */
+		cr = g_hash_table_lookup (cbc->priv->tracked_contacts, uid);
+		if (cr && cr->book_client == book_client && (birthday || anniversary)) {
+			gchar *revision = contact_record_dup_revision (contact);
+
+			if (g_strcmp0 (revision, cr->revision) == 0) {
+				g_object_ref (contact);
+				g_object_unref (cr->contact);
+				cr->contact = contact;
+
+				g_free (revision);
+				e_contact_date_free (birthday);
+				e_contact_date_free (anniversary);
+				continue;
+			}
+
+			g_free (revision);
+		}
+
+		/* Otherwise remove old tracked data and
+		 * if possible, add with new values. */
+		g_hash_table_remove (cbc->priv->tracked_contacts, (gchar *) uid);
+
 		if (birthday || anniversary) {
-			ContactRecord *cr = contact_record_new (cbc, book_client, contact);
+			cr = contact_record_new (cbc, book_client, contact);
 			g_hash_table_insert (cbc->priv->tracked_contacts, g_strdup (uid), cr);
+		} else {
+			cal_backend_contacts_forget_contact (cbc, uid);
 		}
 
 		e_contact_date_free (birthday);
@@ -624,8 +1062,10 @@ contacts_removed_cb (EBookClientView *book_view,
 	g_rec_mutex_lock (&cbc->priv->tracked_contacts_lock);
 
 	/* Stop tracking these */
-	for (ii = contact_ids; ii; ii = ii->next)
+	for (ii = contact_ids; ii; ii = ii->next) {
 		g_hash_table_remove (cbc->priv->tracked_contacts, ii->data);
+		cal_backend_contacts_forget_contact (cbc, ii->data);
+	}
 
 	g_rec_mutex_unlock (&cbc->priv->tracked_contacts_lock);
 }
@@ -674,33 +1114,74 @@ manage_comp_alarm_update (ECalBackendContacts *cbc,
 	g_object_unref (old_comp);
 }
 
+typedef struct _UpdateAlarmData {
+	ECalBackendContacts *cbc;
+	gboolean has_views;
+} UpdateAlarmData;
+
 static void
 update_alarm_cb (gpointer key,
                  gpointer value,
                  gpointer user_data)
 {
-	ECalBackendContacts *cbc = user_data;
+	UpdateAlarmData *uad = user_data;
 	ContactRecord   *record = value;
 
-	g_return_if_fail (cbc != NULL);
+	g_return_if_fail (uad != NULL);
 	g_return_if_fail (record != NULL);
 
-	if (record->comp_birthday)
-		manage_comp_alarm_update (cbc, record->comp_birthday);
+	/* Without views nobody is notified, thus there is no need
+	 * for the old component and the comparison of both. */
+	if (record->comp_birthday) {
+		if (uad->has_views)
+			manage_comp_alarm_update (uad->cbc, record->comp_birthday);
+		else
+			setup_alarm (uad->cbc, record->comp_birthday);
+	}
 
-	if (record->comp_anniversary)
-		manage_comp_alarm_update (cbc, record->comp_anniversary);
+	if (record->comp_anniversary) {
+		if (uad->has_views)
+			manage_comp_alarm_update (uad->cbc, record->comp_anniversary);
+		else
+			setup_alarm (uad->cbc, record->comp_anniversary);
+	}
+
+	contact_record_save_to_store (record, key);
 }
 
 static gboolean
 update_tracked_alarms_cb (gpointer user_data)
 {
 	ECalBackendContacts *cbc = user_data;
+	UpdateAlarmData uad;
+	GList *views;
 
 	g_return_val_if_fail (cbc != NULL, FALSE);
 
+	views = e_cal_backend_list_views (E_CAL_BACKEND (cbc));
+
+	uad.cbc = cbc;
+	uad.has_views = views != NULL;
+
+	g_list_free_full (views, (GDestroyNotify) g_object_unref);
+
 	g_rec_mutex_lock (&cbc->priv->tracked_contacts_lock);
-	g_hash_table_foreach (cbc->priv->tracked_contacts, update_alarm_cb, cbc);
+
+	if (cbc->priv->store) {
+		gchar *alarm_config;
+
+		e_cal_backend_store_freeze_changes (cbc->priv->store);
+
+		alarm_config = cal_backend_contacts_dup_alarm_config (cbc);
+		e_cal_backend_store_put_key_value (cbc->priv->store, STORE_KEY_ALARM_CONFIG, alarm_config);
+		g_free (alarm_config);
+	}
+
+	g_hash_table_foreach (cbc->priv->tracked_contacts, update_alarm_cb, &uad);
+
+	if (cbc->priv->store)
+		e_cal_backend_store_thaw_changes (cbc->priv->store);
+
 	g_rec_mutex_unlock (&cbc->priv->tracked_contacts_lock);
 
 	cbc->priv->update_alarms_id = 0;
@@ -1194,7 +1675,7 @@ e_cal_backend_contacts_get_object_list (ECalBackendSync *backend,
 	cb_data = contact_record_cb_new (cbc, sexp, TRUE);
 
 	g_rec_mutex_lock (&priv->tracked_contacts_lock);
-	g_hash_table_foreach (priv->tracked_contacts, contact_record_cb, cb_data);
+	cal_backend_contacts_match_tracked (cbc, cb_data);
 	g_rec_mutex_unlock (&priv->tracked_contacts_lock);
 
 	*objects = cb_data->result;
@@ -1222,7 +1703,7 @@ e_cal_backend_contacts_start_view (ECalBackend *backend,
 	cb_data = contact_record_cb_new (cbc, sexp, FALSE);
 
 	g_rec_mutex_lock (&priv->tracked_contacts_lock);
-	g_hash_table_foreach (priv->tracked_contacts, contact_record_cb, cb_data);
+	cal_backend_contacts_match_tracked (cbc, cb_data);
 	e_data_cal_view_notify_components_added (query, cb_data->result);
 	g_rec_mutex_unlock (&priv->tracked_contacts_lock);
 
@@ -1239,6 +1720,7 @@ static void
 e_cal_backend_contacts_finalize (GObject *object)
 {
 	ECalBackendContactsPrivate *priv;
+	gint ii;
 
 	priv = E_CAL_BACKEND_CONTACTS_GET_PRIVATE (object);
 
@@ -1249,6 +1731,9 @@ e_cal_backend_contacts_finalize (GObject *object)
 
 	g_hash_table_destroy (priv->addressbooks);
 	g_hash_table_destroy (priv->tracked_contacts);
+
+	for (ii = 0; ii <= DAY_INDEX_SIZE; ii++)
+		g_slist_free (priv->day_index[ii]);
 	if (priv->notifyid)
 		g_signal_handler_disconnect (priv->settings, priv->notifyid);
 
@@ -1263,11 +1748,18 @@ e_cal_backend_contacts_finalize (GObject *object)
 static void
 e_cal_backend_contacts_dispose (GObject *object)
 {
+	ECalBackendContactsPrivate *priv;
 	ESourceRegistry *registry;
 
+	priv = E_CAL_BACKEND_CONTACTS_GET_PRIVATE (object);
+
 	registry = e_cal_backend_get_registry (E_CAL_BACKEND (object));
 	g_signal_handlers_disconnect_by_data (registry, object);
 
+	/* Release the store before the address books are, those only
+	 * go away with the backend and must stay in the store. */
+	g_clear_object (&priv->store);
+
 	/* Chain up to parent's dispose() method. */
 	G_OBJECT_CLASS (e_cal_backend_contacts_parent_class)->dispose (object);
 }
@@ -85,6 +85,11 @@ struct _ECalBackendFilePrivate {
 
 	EIntervalTree *interval_tree;
 
+	/* Busy instances of all components in 'comp', expanded within
+	 * FREE_BUSY_WINDOW_PAST/FUTURE days of the time it was created;
+	 * built on the first free/busy request, NULL until then */
+	ECalBackendFreeBusy *free_busy;
+
 	GList *comp;
 
 	/* guards refresh members */
@@ -108,6 +113,11 @@ struct _ECalBackendFilePrivate {
 
 #define d(x)
 
+/* Range of the free/busy index, in days relative to the first free/busy
+ * request; free/busy queries outside of it expand components directly */
+#define FREE_BUSY_WINDOW_PAST 366
+#define FREE_BUSY_WINDOW_FUTURE (2 * 366)
+
 static void e_cal_backend_file_dispose (GObject *object);
 static void e_cal_backend_file_finalize (GObject *object);
 
@@ -301,6 +311,8 @@ free_calendar_data (ECalBackendFile *cbfile)
 	e_intervaltree_destroy (priv->interval_tree);
 	priv->interval_tree = NULL;
 
+	g_clear_object (&priv->free_busy);
+
 	free_calendar_components (priv->comp_uid_hash, priv->icalcomp);
 	priv->comp_uid_hash = NULL;
 	priv->icalcomp = NULL;
@@ -677,6 +689,63 @@ remove_component_from_intervaltree (ECalBackendFile *cbfile,
 	return res;
 }
 
+/* Keeps the free/busy index in sync with the priv->comp list; call it
+ * whenever a component is added to the list or was modified in place */
+static void
+add_component_to_free_busy (ECalBackendFile *cbfile,
+                            ECalComponent *comp)
+{
+	ECalBackendFilePrivate *priv = cbfile->priv;
+
+	if (!priv->free_busy)
+		return;
+
+	e_cal_backend_free_busy_add_component (
+		priv->free_busy, comp,
+		resolve_tzid, priv->icalcomp,
+		icaltimezone_get_utc_timezone ());
+}
+
+/* Expands all components into a new free/busy index, unless there is
+ * one already; call with idle_save_rmutex held */
+static void
+ensure_free_busy_index (ECalBackendFile *cbfile)
+{
+	ECalBackendFilePrivate *priv = cbfile->priv;
+	time_t now;
+	GList *l;
+
+	if (priv->free_busy || !priv->icalcomp)
+		return;
+
+	now = time (NULL);
+	priv->free_busy = e_cal_backend_free_busy_new (
+		now - FREE_BUSY_WINDOW_PAST * 24 * 60 * 60,
+		now + FREE_BUSY_WINDOW_FUTURE * 24 * 60 * 60);
+
+	for (l = priv->comp; l; l = l->next)
+		add_component_to_free_busy (cbfile, l->data);
+}
+
+static void
+remove_component_from_free_busy (ECalBackendFile *cbfile,
+                                 ECalComponent *comp)
+{
+	const gchar *uid = NULL;
+	gchar *rid;
+
+	if (!cbfile->priv->free_busy)
+		return;
+
+	e_cal_component_get_uid (comp, &uid);
+	if (!uid)
+		return;
+
+	rid = e_cal_component_get_recurid_as_string (comp);
+	e_cal_backend_free_busy_remove_component (cbfile->priv->free_busy, uid, rid);
+	g_free (rid);
+}
+
 /* Tries to add an icalcomponent to the file backend.  We only store the objects
  * of the types we support; all others just remain in the toplevel component so
  * that we don't lose them.
@@ -742,6 +811,7 @@ add_component (ECalBackendFile *cbfile,
 	}
 
 	priv->comp = g_list_prepend (priv->comp, comp);
+	add_component_to_free_busy (cbfile, comp);
 
 	/* Put the object in the toplevel component if required */
 
@@ -781,6 +851,7 @@ remove_recurrence_cb (gpointer key,
 	/* remove it from our mapping */
 	l = g_list_find (priv->comp, comp);
 	priv->comp = g_list_delete_link (priv->comp, l);
+	remove_component_from_free_busy (cbfile, comp);
 
 	return TRUE;
 }
@@ -811,6 +882,7 @@ remove_component (ECalBackendFile *cbfile,
 		l = g_list_find (priv->comp, obj_data->full_object);
 		g_assert (l != NULL);
 		priv->comp = g_list_delete_link (priv->comp, l);
+		remove_component_from_free_busy (cbfile, obj_data->full_object);
 
 		if (!remove_component_from_intervaltree (cbfile, obj_data->full_object)) {
 			g_message (G_STRLOC " Could not remove component from interval tree!");
@@ -1577,8 +1649,19 @@ typedef struct {
 	ECalBackend *backend;
 	EDataCalView *view;
 	gboolean as_string;
+	gboolean skip_notified;
 } MatchObjectData;
 
+static gboolean
+match_object_already_notified (MatchObjectData *match_data,
+                               ECalComponent *comp)
+{
+	if (!match_data->skip_notified || match_data->view == NULL)
+		return FALSE;
+
+	return e_data_cal_view_contains_component (match_data->view, comp);
+}
+
 static void
 match_object_sexp_to_component (gpointer value,
                                 gpointer data)
@@ -1596,6 +1679,9 @@ match_object_sexp_to_component (gpointer value,
 
 	timezone_cache = E_TIMEZONE_CACHE (match_data->backend);
 
+	if (match_object_already_notified (match_data, comp))
+		return;
+
 	if ((!match_data->search_needed) ||
 	    (e_cal_backend_sexp_match_comp (match_data->obj_sexp, comp, timezone_cache))) {
 		if (match_data->as_string)
@@ -1616,6 +1702,9 @@ match_recurrence_sexp (gpointer key,
 
 	timezone_cache = E_TIMEZONE_CACHE (match_data->backend);
 
+	if (match_object_already_notified (match_data, comp))
+		return;
+
 	if ((!match_data->search_needed) ||
 	    (e_cal_backend_sexp_match_comp (match_data->obj_sexp, comp, timezone_cache))) {
 		if (match_data->as_string)
@@ -1636,7 +1725,8 @@ match_object_sexp (gpointer key,
 
 	timezone_cache = E_TIMEZONE_CACHE (match_data->backend);
 
-	if (obj_data->full_object) {
+	if (obj_data->full_object &&
+	    !match_object_already_notified (match_data, obj_data->full_object)) {
 		if ((!match_data->search_needed) ||
 		    (e_cal_backend_sexp_match_comp (match_data->obj_sexp,
 						    obj_data->full_object,
@@ -1853,6 +1943,7 @@ e_cal_backend_file_start_view (ECalBackend *backend,
 	ECalBackendSExp *sexp;
 	MatchObjectData match_data = { 0, };
 	time_t occur_start = -1, occur_end = -1;
+	time_t priority_start = -1, priority_end = -1;
 	gboolean prunning_by_time;
 	GList * objs_occuring_in_tw;
 	cbfile = E_CAL_BACKEND_FILE (backend);
@@ -1887,6 +1978,35 @@ e_cal_backend_file_start_view (ECalBackend *backend,
 
 	objs_occuring_in_tw = NULL;
 
+	/* Send what is most likely on screen first, then the rest. */
+	if (e_data_cal_view_get_priority_window (query, &priority_start, &priority_end)) {
+		GList *objs_in_priority_window;
+
+		g_rec_mutex_lock (&priv->idle_save_rmutex);
+		objs_in_priority_window = e_intervaltree_search (
+			priv->interval_tree, priority_start, priority_end);
+		g_list_foreach (
+			objs_in_priority_window,
+			(GFunc) match_object_sexp_to_component, &match_data);
+		g_rec_mutex_unlock (&priv->idle_save_rmutex);
+
+		if (match_data.comps_list) {
+			match_data.comps_list = g_slist_reverse (match_data.comps_list);
+			e_data_cal_view_notify_components_added (query, match_data.comps_list);
+			g_slist_free (match_data.comps_list);
+			match_data.comps_list = NULL;
+		}
+
+		g_list_free_full (objs_in_priority_window, g_object_unref);
+
+		e_data_cal_view_notify_window_complete (
+			query, priority_start, priority_end);
+
+		/* match_object_sexp() and friends skip
+		 * whatever the view already contains. */
+		match_data.skip_notified = TRUE;
+	}
+
 	g_rec_mutex_lock (&priv->idle_save_rmutex);
 
 	if (!prunning_by_time) {
@@ -1978,6 +2098,11 @@ create_user_free_busy (ECalBackendFile *cbfile,
 
 	priv = cbfile->priv;
 
+	/* answer from the index when the whole range was expanded already */
+	ensure_free_busy_index (cbfile);
+	if (priv->free_busy && e_cal_backend_free_busy_covers (priv->free_busy, start, end))
+		return e_cal_backend_free_busy_get_vfreebusy (priv->free_busy, address, cn, start, end);
+
 	/* create the (unique) VFREEBUSY object that we'll return */
 	vfb = icalcomponent_new_vfreebusy ();
 	if (address != NULL) {
@@ -2314,6 +2439,7 @@ remove_object_instance_cb (gpointer key,
 				rrdata->cbfile->priv->icalcomp,
 				e_cal_component_get_icalcomponent (instance));
 			rrdata->cbfile->priv->comp = g_list_remove (rrdata->cbfile->priv->comp, instance);
+			remove_component_from_free_busy (rrdata->cbfile, instance);
 
 			rrdata->obj_data->recurrences_list = g_list_remove (rrdata->obj_data->recurrences_list, instance);
 
@@ -2447,6 +2573,7 @@ e_cal_backend_file_modify_objects (ECalBackendSync *backend,
 						priv->icalcomp,
 						e_cal_component_get_icalcomponent (obj_data->full_object));
 					priv->comp = g_list_remove (priv->comp, obj_data->full_object);
+					remove_component_from_free_busy (cbfile, obj_data->full_object);
 
 					g_object_unref (obj_data->full_object);
 				}
@@ -2458,6 +2585,7 @@ e_cal_backend_file_modify_objects (ECalBackendSync *backend,
 					priv->icalcomp,
 					e_cal_component_get_icalcomponent (obj_data->full_object));
 				priv->comp = g_list_prepend (priv->comp, obj_data->full_object);
+				add_component_to_free_busy (cbfile, obj_data->full_object);
 				break;
 			}
 
@@ -2470,6 +2598,7 @@ e_cal_backend_file_modify_objects (ECalBackendSync *backend,
 					priv->icalcomp,
 					e_cal_component_get_icalcomponent (recurrence));
 				priv->comp = g_list_remove (priv->comp, recurrence);
+				remove_component_from_free_busy (cbfile, recurrence);
 				obj_data->recurrences_list = g_list_remove (obj_data->recurrences_list, recurrence);
 				g_hash_table_remove (obj_data->recurrences, rid);
 			} else {
@@ -2486,6 +2615,7 @@ e_cal_backend_file_modify_objects (ECalBackendSync *backend,
 				priv->icalcomp,
 				e_cal_component_get_icalcomponent (comp));
 			priv->comp = g_list_append (priv->comp, comp);
+			add_component_to_free_busy (cbfile, comp);
 			obj_data->recurrences_list = g_list_append (obj_data->recurrences_list, comp);
 			break;
 		case E_CAL_OBJ_MOD_THIS_AND_PRIOR:
@@ -2507,6 +2637,7 @@ e_cal_backend_file_modify_objects (ECalBackendSync *backend,
 					priv->icalcomp,
 					e_cal_component_get_icalcomponent (obj_data->full_object));
 				priv->comp = g_list_remove (priv->comp, obj_data->full_object);
+				remove_component_from_free_busy (cbfile, obj_data->full_object);
 			}
 
 			/* now deal with the detached recurrence */
@@ -2520,6 +2651,7 @@ e_cal_backend_file_modify_objects (ECalBackendSync *backend,
 					priv->icalcomp,
 					e_cal_component_get_icalcomponent (recurrence));
 				priv->comp = g_list_remove (priv->comp, recurrence);
+				remove_component_from_free_busy (cbfile, recurrence);
 				obj_data->recurrences_list = g_list_remove (obj_data->recurrences_list, recurrence);
 				g_hash_table_remove (obj_data->recurrences, rid);
 			} else {
@@ -2541,6 +2673,7 @@ e_cal_backend_file_modify_objects (ECalBackendSync *backend,
 					priv->icalcomp,
 					e_cal_component_get_icalcomponent (obj_data->full_object));
 				priv->comp = g_list_prepend (priv->comp, obj_data->full_object);
+				add_component_to_free_busy (cbfile, obj_data->full_object);
 			}
 
 			/* add the new detached recurrence */
@@ -2552,6 +2685,7 @@ e_cal_backend_file_modify_objects (ECalBackendSync *backend,
 				priv->icalcomp,
 				e_cal_component_get_icalcomponent (comp));
 			priv->comp = g_list_append (priv->comp, comp);
+			add_component_to_free_busy (cbfile, comp);
 			obj_data->recurrences_list = g_list_append (obj_data->recurrences_list, comp);
 			break;
 		case E_CAL_OBJ_MOD_ALL :
@@ -2586,6 +2720,7 @@ e_cal_backend_file_modify_objects (ECalBackendSync *backend,
 						g_hash_table_insert (obj_data->recurrences, e_cal_component_get_recurid_as_string (c), c);
 						icalcomponent_add_component (priv->icalcomp, e_cal_component_get_icalcomponent (c));
 						priv->comp = g_list_append (priv->comp, c);
+						add_component_to_free_busy (cbfile, c);
 						obj_data->recurrences_list = g_list_append (obj_data->recurrences_list, c);
 					}
 				}
@@ -2680,6 +2815,7 @@ remove_instance (ECalBackendFile *cbfile,
 				cbfile->priv->icalcomp,
 				e_cal_component_get_icalcomponent (comp));
 			cbfile->priv->comp = g_list_remove (cbfile->priv->comp, comp);
+			remove_component_from_free_busy (cbfile, comp);
 			obj_data->recurrences_list = g_list_remove (obj_data->recurrences_list, comp);
 			g_hash_table_remove (obj_data->recurrences, rid);
 		} else if (mod == E_CAL_OBJ_MOD_ONLY_THIS) {
@@ -2736,6 +2872,7 @@ remove_instance (ECalBackendFile *cbfile,
 			cbfile->priv->icalcomp,
 			e_cal_component_get_icalcomponent (obj_data->full_object));
 		cbfile->priv->comp = g_list_prepend (cbfile->priv->comp, obj_data->full_object);
+		add_component_to_free_busy (cbfile, obj_data->full_object);
 	} else {
 		if (!obj_data->full_object) {
 			/* Nothing to do, parent doesn't exist. Tell
@@ -2756,6 +2893,7 @@ remove_instance (ECalBackendFile *cbfile,
 			cbfile->priv->icalcomp,
 			e_cal_component_get_icalcomponent (obj_data->full_object));
 		cbfile->priv->comp = g_list_remove (cbfile->priv->comp, obj_data->full_object);
+		remove_component_from_free_busy (cbfile, obj_data->full_object);
 
 		/* remove parent, report as removal */
 		if (old_comp) {
@@ -2949,8 +3087,10 @@ e_cal_backend_file_remove_objects (ECalBackendSync *backend,
 			/* add the modified object to the beginning of the list,
 			 * so that it's always before any detached instance we
 			 * might have */
-			if (comp)
+			if (comp) {
 				priv->comp = g_list_prepend (priv->comp, comp);
+				add_component_to_free_busy (cbfile, comp);
+			}
 
 			if (obj_data->full_object) {
 				*new_components = g_slist_prepend (*new_components, e_cal_component_clone (obj_data->full_object));
@@ -3987,6 +3987,177 @@ e_cal_client_get_object_list_sync (ECalClient *client,
                                    GSList **out_icalcomps,
                                    GCancellable *cancellable,
                                    GError **error)
+{
+	GSList *strings = NULL;
+	GSList *tmp = NULL;
+	GSList *link;
+
+	g_return_val_if_fail (E_IS_CAL_CLIENT (client), FALSE);
+	g_return_val_if_fail (sexp != NULL, FALSE);
+	g_return_val_if_fail (out_icalcomps != NULL, FALSE);
+
+	if (!e_cal_client_get_object_list_as_strings_sync (
+		client, sexp, &strings, cancellable, error))
+		return FALSE;
+
+	for (link = strings; link != NULL; link = g_slist_next (link)) {
+		icalcomponent *icalcomp;
+
+		icalcomp = icalcomponent_new_from_string (link->data);
+		if (icalcomp == NULL)
+			continue;
+
+		tmp = g_slist_prepend (tmp, icalcomp);
+	}
+
+	g_slist_free_full (strings, (GDestroyNotify) g_free);
+
+	*out_icalcomps = g_slist_reverse (tmp);
+
+	return TRUE;
+}
+
+/* Helper for e_cal_client_get_object_list_as_strings() */
+static void
+cal_client_get_object_list_as_strings_thread (GSimpleAsyncResult *simple,
+                                              GObject *source_object,
+                                              GCancellable *cancellable)
+{
+	AsyncContext *async_context;
+	GError *local_error = NULL;
+
+	async_context = g_simple_async_result_get_op_res_gpointer (simple);
+
+	e_cal_client_get_object_list_as_strings_sync (
+		E_CAL_CLIENT (source_object),
+		async_context->sexp,
+		&async_context->string_list,
+		cancellable, &local_error);
+
+	if (local_error != NULL)
+		g_simple_async_result_take_error (simple, local_error);
+}
+
+/**
+ * e_cal_client_get_object_list_as_strings:
+ * @client: an #ECalClient
+ * @sexp: an S-expression representing the query
+ * @cancellable: a #GCancellable; can be %NULL
+ * @callback: callback to call when a result is ready
+ * @user_data: user data for the @callback
+ *
+ * Gets a list of objects from the calendar that match the query specified
+ * by the @sexp argument, returning matching objects as a list of iCalendar
+ * strings, exactly as the backend sent them.  Nothing is parsed, so this is
+ * the cheapest way to fetch a large result set when only some of the objects
+ * will actually be looked at; parse those on demand with
+ * icalcomponent_new_from_string().
+ * The call is finished by e_cal_client_get_object_list_as_strings_finish()
+ * from the @callback.
+ *
+ * Since: 3.10
+ **/
+void
+e_cal_client_get_object_list_as_strings (ECalClient *client,
+                                         const gchar *sexp,
+                                         GCancellable *cancellable,
+                                         GAsyncReadyCallback callback,
+                                         gpointer user_data)
+{
+	GSimpleAsyncResult *simple;
+	AsyncContext *async_context;
+
+	g_return_if_fail (E_IS_CAL_CLIENT (client));
+	g_return_if_fail (sexp != NULL);
+
+	async_context = g_slice_new0 (AsyncContext);
+	async_context->sexp = g_strdup (sexp);
+
+	simple = g_simple_async_result_new (
+		G_OBJECT (client), callback, user_data,
+		e_cal_client_get_object_list_as_strings);
+
+	g_simple_async_result_set_check_cancellable (simple, cancellable);
+
+	g_simple_async_result_set_op_res_gpointer (
+		simple, async_context, (GDestroyNotify) async_context_free);
+
+	g_simple_async_result_run_in_thread (
+		simple, cal_client_get_object_list_as_strings_thread,
+		G_PRIORITY_DEFAULT, cancellable);
+
+	g_object_unref (simple);
+}
+
+/**
+ * e_cal_client_get_object_list_as_strings_finish:
+ * @client: an #ECalClient
+ * @result: a #GAsyncResult
+ * @out_strings: (out) (element-type utf8): list of matching
+ *               iCalendar strings
+ * @error: (out): a #GError to set an error, if any
+ *
+ * Finishes previous call of e_cal_client_get_object_list_as_strings() and
+ * sets @out_strings to a matching list of iCalendar strings.
+ * This list should be freed with e_client_util_free_string_slist().
+ *
+ * Returns: %TRUE if successful, %FALSE otherwise.
+ *
+ * Since: 3.10
+ **/
+gboolean
+e_cal_client_get_object_list_as_strings_finish (ECalClient *client,
+                                                GAsyncResult *result,
+                                                GSList **out_strings,
+                                                GError **error)
+{
+	GSimpleAsyncResult *simple;
+	AsyncContext *async_context;
+
+	g_return_val_if_fail (
+		g_simple_async_result_is_valid (
+		result, G_OBJECT (client),
+		e_cal_client_get_object_list_as_strings), FALSE);
+
+	simple = G_SIMPLE_ASYNC_RESULT (result);
+	async_context = g_simple_async_result_get_op_res_gpointer (simple);
+
+	if (g_simple_async_result_propagate_error (simple, error))
+		return FALSE;
+
+	if (out_strings != NULL) {
+		*out_strings = async_context->string_list;
+		async_context->string_list = NULL;
+	}
+
+	return TRUE;
+}
+
+/**
+ * e_cal_client_get_object_list_as_strings_sync:
+ * @client: an #ECalClient
+ * @sexp: an S-expression representing the query
+ * @out_strings: (out) (element-type utf8): list of matching
+ *               iCalendar strings
+ * @cancellable: (allow-none): a #GCancellable; can be %NULL
+ * @error: (out): a #GError to set an error, if any
+ *
+ * Gets a list of objects from the calendar that match the query specified
+ * by the @sexp argument. The objects will be returned in the @out_strings
+ * argument, as unparsed iCalendar strings.  See
+ * e_cal_client_get_object_list_as_strings() for when this is useful.
+ * This list should be freed with e_client_util_free_string_slist().
+ *
+ * Returns: %TRUE if successful, %FALSE otherwise.
+ *
+ * Since: 3.10
+ **/
+gboolean
+e_cal_client_get_object_list_as_strings_sync (ECalClient *client,
+                                              const gchar *sexp,
+                                              GSList **out_strings,
+                                              GCancellable *cancellable,
+                                              GError **error)
 {
 	GSList *tmp = NULL;
 	gchar *utf8_sexp;
@@ -3996,7 +4167,7 @@ e_cal_client_get_object_list_sync (ECalClient *client,
 
 	g_return_val_if_fail (E_IS_CAL_CLIENT (client), FALSE);
 	g_return_val_if_fail (sexp != NULL, FALSE);
-	g_return_val_if_fail (out_icalcomps != NULL, FALSE);
+	g_return_val_if_fail (out_strings != NULL, FALSE);
 
 	utf8_sexp = e_util_utf8_make_valid (sexp);
 
@@ -4017,17 +4188,13 @@ e_cal_client_get_object_list_sync (ECalClient *client,
 		return FALSE;
 	}
 
-	for (ii = 0; strv[ii] != NULL; ii++) {
-		icalcomponent *icalcomp;
+	/* Hand the strings over as they are, without copying. */
+	for (ii = 0; strv[ii] != NULL; ii++)
+		tmp = g_slist_prepend (tmp, strv[ii]);
 
-		icalcomp = icalcomponent_new_from_string (strv[ii]);
-		if (icalcomp == NULL)
-			continue;
+	g_free (strv);
 
-		tmp = g_slist_prepend (tmp, icalcomp);
-	}
-
-	*out_icalcomps = g_slist_reverse (tmp);
+	*out_strings = g_slist_reverse (tmp);
 
 	return TRUE;
 }
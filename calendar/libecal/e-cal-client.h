@@ -286,6 +286,23 @@ gboolean	e_cal_client_get_object_list_as_comps_sync
 						 GSList **out_ecalcomps,
 						 GCancellable *cancellable,
 						 GError **error);
+void		e_cal_client_get_object_list_as_strings
+						(ECalClient *client,
+						 const gchar *sexp,
+						 GCancellable *cancellable,
+						 GAsyncReadyCallback callback,
+						 gpointer user_data);
+gboolean	e_cal_client_get_object_list_as_strings_finish
+						(ECalClient *client,
+						 GAsyncResult *result,
+						 GSList **out_strings,
+						 GError **error);
+gboolean	e_cal_client_get_object_list_as_strings_sync
+						(ECalClient *client,
+						 const gchar *sexp,
+						 GSList **out_strings,
+						 GCancellable *cancellable,
+						 GError **error);
 void		e_cal_client_get_free_busy	(ECalClient *client,
 						 time_t start,
 						 time_t end,
@@ -0,0 +1,624 @@
+/*-*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* e-cal-backend-free-busy.c
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION: e-cal-backend-free-busy
+ * @include: libedata-cal/libedata-cal.h
+ * @short_description: Indexed free/busy information for a calendar
+ *
+ * An #ECalBackendFreeBusy expands each component it is given within
+ * a fixed indexing window and remembers the resulting busy instances
+ * per component, so that a changed or removed component only costs
+ * its own re-expansion.  All instances are additionally kept merged
+ * into one sorted array of non-overlapping intervals, from which any
+ * VFREEBUSY inside the window is produced by a binary search and a
+ * linear walk over the matching intervals only.
+ *
+ * Queries outside the window cannot be answered from the index; use
+ * e_cal_backend_free_busy_covers() to decide whether to fall back to
+ * expanding the components directly.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "e-cal-backend-free-busy.h"
+
+#define E_CAL_BACKEND_FREE_BUSY_GET_PRIVATE(obj) \
+	(G_TYPE_INSTANCE_GET_PRIVATE \
+	((obj), E_TYPE_CAL_BACKEND_FREE_BUSY, ECalBackendFreeBusyPrivate))
+
+typedef struct _FreeBusyInterval FreeBusyInterval;
+
+struct _FreeBusyInterval {
+	time_t start;
+	time_t end;
+};
+
+struct _ECalBackendFreeBusyPrivate {
+	GMutex lock;
+
+	time_t window_start;
+	time_t window_end;
+
+	/* component key (uid[_rid]) -> GArray of FreeBusyInterval */
+	GHashTable *instances;
+
+	/* All instances, sorted by start and coalesced, so that no two
+	 * intervals overlap or touch.  Adding a component merges into
+	 * it in place; removing one only marks it for a rebuild. */
+	GArray *busy;
+	gboolean busy_dirty;
+};
+
+G_DEFINE_TYPE (ECalBackendFreeBusy, e_cal_backend_free_busy, G_TYPE_OBJECT)
+
+static gchar *
+free_busy_component_key (const gchar *uid,
+                         const gchar *rid)
+{
+	if (rid != NULL && *rid != '\0')
+		return g_strdup_printf ("%s_%s", uid, rid);
+	else
+		return g_strdup (uid);
+}
+
+static void
+free_busy_intervals_free (GArray *intervals)
+{
+	g_array_free (intervals, TRUE);
+}
+
+static gint
+free_busy_interval_compare (gconstpointer a,
+                            gconstpointer b)
+{
+	const FreeBusyInterval *ia = a;
+	const FreeBusyInterval *ib = b;
+
+	if (ia->start != ib->start)
+		return ia->start < ib->start ? -1 : 1;
+
+	if (ia->end != ib->end)
+		return ia->end < ib->end ? -1 : 1;
+
+	return 0;
+}
+
+/* Returns the index of the first interval in @busy whose end is
+ * greater than or equal to @when (or whose end is strictly greater,
+ * when @strict is set), or busy->len if there is none. */
+static guint
+free_busy_lower_bound (GArray *busy,
+                       time_t when,
+                       gboolean strict)
+{
+	guint lo = 0, hi = busy->len;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		const FreeBusyInterval *iv;
+
+		iv = &g_array_index (busy, FreeBusyInterval, mid);
+
+		if (iv->end < when || (strict && iv->end == when))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Merges @interval into the coalesced array @busy. */
+static void
+free_busy_merge_interval (GArray *busy,
+                          const FreeBusyInterval *interval)
+{
+	FreeBusyInterval merged = *interval;
+	guint first, last;
+
+	/* First interval that touches or follows the new one. */
+	first = free_busy_lower_bound (busy, merged.start, FALSE);
+
+	/* One past the last interval that starts before or at its end. */
+	for (last = first; last < busy->len; last++) {
+		const FreeBusyInterval *iv;
+
+		iv = &g_array_index (busy, FreeBusyInterval, last);
+		if (iv->start > merged.end)
+			break;
+
+		merged.start = MIN (merged.start, iv->start);
+		merged.end = MAX (merged.end, iv->end);
+	}
+
+	if (first == last) {
+		g_array_insert_val (busy, first, merged);
+	} else {
+		g_array_index (busy, FreeBusyInterval, first) = merged;
+		if (last - first > 1)
+			g_array_remove_range (busy, first + 1, last - first - 1);
+	}
+}
+
+/* Caller should hold the lock. */
+static void
+free_busy_rebuild_locked (ECalBackendFreeBusy *free_busy)
+{
+	GHashTableIter iter;
+	gpointer value;
+	GArray *all;
+	guint ii;
+
+	all = g_array_new (FALSE, FALSE, sizeof (FreeBusyInterval));
+
+	g_hash_table_iter_init (&iter, free_busy->priv->instances);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		GArray *intervals = value;
+
+		g_array_append_vals (all, intervals->data, intervals->len);
+	}
+
+	g_array_sort (all, free_busy_interval_compare);
+
+	g_array_set_size (free_busy->priv->busy, 0);
+
+	for (ii = 0; ii < all->len; ii++) {
+		const FreeBusyInterval *iv;
+		FreeBusyInterval *tail;
+		GArray *busy = free_busy->priv->busy;
+
+		iv = &g_array_index (all, FreeBusyInterval, ii);
+
+		if (busy->len > 0) {
+			tail = &g_array_index (busy, FreeBusyInterval, busy->len - 1);
+			if (iv->start <= tail->end) {
+				tail->end = MAX (tail->end, iv->end);
+				continue;
+			}
+		}
+
+		g_array_append_val (busy, *iv);
+	}
+
+	g_array_free (all, TRUE);
+
+	free_busy->priv->busy_dirty = FALSE;
+}
+
+static gboolean
+free_busy_collect_instance (ECalComponent *comp,
+                            time_t instance_start,
+                            time_t instance_end,
+                            gpointer user_data)
+{
+	GArray *intervals = user_data;
+	FreeBusyInterval iv;
+
+	/* Zero-length instances do not make anyone busy. */
+	if (instance_end <= instance_start)
+		return TRUE;
+
+	iv.start = instance_start;
+	iv.end = instance_end;
+
+	g_array_append_val (intervals, iv);
+
+	return TRUE;
+}
+
+static gboolean
+free_busy_component_is_transparent (ECalComponent *comp)
+{
+	icalcomponent *icalcomp;
+	icalproperty *prop;
+	icalproperty_transp transp;
+
+	icalcomp = e_cal_component_get_icalcomponent (comp);
+	if (icalcomp == NULL)
+		return TRUE;
+
+	prop = icalcomponent_get_first_property (icalcomp, ICAL_TRANSP_PROPERTY);
+	if (prop == NULL)
+		return FALSE;
+
+	transp = icalproperty_get_transp (prop);
+
+	return transp == ICAL_TRANSP_TRANSPARENT ||
+		transp == ICAL_TRANSP_TRANSPARENTNOCONFLICT;
+}
+
+static void
+cal_backend_free_busy_finalize (GObject *object)
+{
+	ECalBackendFreeBusyPrivate *priv;
+
+	priv = E_CAL_BACKEND_FREE_BUSY_GET_PRIVATE (object);
+
+	g_hash_table_destroy (priv->instances);
+	g_array_free (priv->busy, TRUE);
+	g_mutex_clear (&priv->lock);
+
+	/* Chain up to parent's finalize() method. */
+	G_OBJECT_CLASS (e_cal_backend_free_busy_parent_class)->
+		finalize (object);
+}
+
+static void
+e_cal_backend_free_busy_class_init (ECalBackendFreeBusyClass *class)
+{
+	GObjectClass *object_class;
+
+	g_type_class_add_private (class, sizeof (ECalBackendFreeBusyPrivate));
+
+	object_class = G_OBJECT_CLASS (class);
+	object_class->finalize = cal_backend_free_busy_finalize;
+}
+
+static void
+e_cal_backend_free_busy_init (ECalBackendFreeBusy *free_busy)
+{
+	free_busy->priv = E_CAL_BACKEND_FREE_BUSY_GET_PRIVATE (free_busy);
+
+	g_mutex_init (&free_busy->priv->lock);
+
+	free_busy->priv->instances = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) free_busy_intervals_free);
+
+	free_busy->priv->busy = g_array_new (
+		FALSE, FALSE, sizeof (FreeBusyInterval));
+}
+
+/**
+ * e_cal_backend_free_busy_new:
+ * @window_start: start of the indexing window
+ * @window_end: end of the indexing window
+ *
+ * Creates a new, empty #ECalBackendFreeBusy.  Recurring components
+ * added to it are expanded only between @window_start and @window_end,
+ * thus only queries within that window can be answered.
+ *
+ * Returns: a new #ECalBackendFreeBusy
+ *
+ * Since: 3.10
+ **/
+ECalBackendFreeBusy *
+e_cal_backend_free_busy_new (time_t window_start,
+                             time_t window_end)
+{
+	ECalBackendFreeBusy *free_busy;
+
+	g_return_val_if_fail (window_start <= window_end, NULL);
+
+	free_busy = g_object_new (E_TYPE_CAL_BACKEND_FREE_BUSY, NULL);
+	free_busy->priv->window_start = window_start;
+	free_busy->priv->window_end = window_end;
+
+	return free_busy;
+}
+
+/**
+ * e_cal_backend_free_busy_get_window:
+ * @free_busy: an #ECalBackendFreeBusy
+ * @out_start: (out) (allow-none): return location for the window start
+ * @out_end: (out) (allow-none): return location for the window end
+ *
+ * Returns the indexing window @free_busy was created with.
+ *
+ * Since: 3.10
+ **/
+void
+e_cal_backend_free_busy_get_window (ECalBackendFreeBusy *free_busy,
+                                    time_t *out_start,
+                                    time_t *out_end)
+{
+	g_return_if_fail (E_IS_CAL_BACKEND_FREE_BUSY (free_busy));
+
+	if (out_start != NULL)
+		*out_start = free_busy->priv->window_start;
+
+	if (out_end != NULL)
+		*out_end = free_busy->priv->window_end;
+}
+
+/**
+ * e_cal_backend_free_busy_covers:
+ * @free_busy: an #ECalBackendFreeBusy
+ * @start: start of the query
+ * @end: end of the query
+ *
+ * Checks whether the interval from @start to @end lies within the
+ * indexing window of @free_busy, thus whether
+ * e_cal_backend_free_busy_get_vfreebusy() can answer it.
+ *
+ * Returns: %TRUE if the interval is covered by the index
+ *
+ * Since: 3.10
+ **/
+gboolean
+e_cal_backend_free_busy_covers (ECalBackendFreeBusy *free_busy,
+                                time_t start,
+                                time_t end)
+{
+	g_return_val_if_fail (E_IS_CAL_BACKEND_FREE_BUSY (free_busy), FALSE);
+
+	return start >= free_busy->priv->window_start &&
+		end <= free_busy->priv->window_end;
+}
+
+/**
+ * e_cal_backend_free_busy_add_component:
+ * @free_busy: an #ECalBackendFreeBusy
+ * @comp: an #ECalComponent
+ * @tz_cb: (scope call): function to resolve TZIDs used by @comp
+ * @tz_cb_data: (closure tz_cb): user data for @tz_cb
+ * @default_zone: timezone to use for floating times
+ *
+ * Expands @comp within the indexing window and records its busy
+ * instances.  A component with the same UID and RECURRENCE-ID which
+ * was added before is replaced.  Transparent components are not
+ * considered busy and only remove any previous instances.
+ *
+ * Returns: %TRUE if @comp contributed any busy time
+ *
+ * Since: 3.10
+ **/
+gboolean
+e_cal_backend_free_busy_add_component (ECalBackendFreeBusy *free_busy,
+                                       ECalComponent *comp,
+                                       ECalRecurResolveTimezoneFn tz_cb,
+                                       gpointer tz_cb_data,
+                                       icaltimezone *default_zone)
+{
+	const gchar *uid = NULL;
+	gchar *rid, *key;
+	GArray *intervals;
+	guint ii;
+
+	g_return_val_if_fail (E_IS_CAL_BACKEND_FREE_BUSY (free_busy), FALSE);
+	g_return_val_if_fail (E_IS_CAL_COMPONENT (comp), FALSE);
+
+	e_cal_component_get_uid (comp, &uid);
+	g_return_val_if_fail (uid != NULL, FALSE);
+
+	rid = e_cal_component_get_recurid_as_string (comp);
+	key = free_busy_component_key (uid, rid);
+	g_free (rid);
+
+	/* Expand outside the lock; this is the expensive part. */
+	intervals = g_array_new (FALSE, FALSE, sizeof (FreeBusyInterval));
+
+	if (!free_busy_component_is_transparent (comp))
+		e_cal_recur_generate_instances (
+			comp,
+			free_busy->priv->window_start,
+			free_busy->priv->window_end,
+			free_busy_collect_instance, intervals,
+			tz_cb, tz_cb_data, default_zone);
+
+	g_mutex_lock (&free_busy->priv->lock);
+
+	if (g_hash_table_remove (free_busy->priv->instances, key))
+		free_busy->priv->busy_dirty = TRUE;
+
+	if (intervals->len == 0) {
+		g_mutex_unlock (&free_busy->priv->lock);
+
+		free_busy_intervals_free (intervals);
+		g_free (key);
+
+		return FALSE;
+	}
+
+	if (!free_busy->priv->busy_dirty) {
+		for (ii = 0; ii < intervals->len; ii++)
+			free_busy_merge_interval (
+				free_busy->priv->busy,
+				&g_array_index (intervals, FreeBusyInterval, ii));
+	}
+
+	/* The hash table takes ownership of the key and the array. */
+	g_hash_table_insert (free_busy->priv->instances, key, intervals);
+
+	g_mutex_unlock (&free_busy->priv->lock);
+
+	return TRUE;
+}
+
+/**
+ * e_cal_backend_free_busy_remove_component:
+ * @free_busy: an #ECalBackendFreeBusy
+ * @uid: UID of the component
+ * @rid: (allow-none): RECURRENCE-ID of the component, or %NULL
+ *
+ * Forgets the busy instances of the component identified by @uid
+ * and @rid.
+ *
+ * Returns: %TRUE if the component was known
+ *
+ * Since: 3.10
+ **/
+gboolean
+e_cal_backend_free_busy_remove_component (ECalBackendFreeBusy *free_busy,
+                                          const gchar *uid,
+                                          const gchar *rid)
+{
+	gchar *key;
+	gboolean removed;
+
+	g_return_val_if_fail (E_IS_CAL_BACKEND_FREE_BUSY (free_busy), FALSE);
+	g_return_val_if_fail (uid != NULL, FALSE);
+
+	key = free_busy_component_key (uid, rid);
+
+	g_mutex_lock (&free_busy->priv->lock);
+
+	removed = g_hash_table_remove (free_busy->priv->instances, key);
+	if (removed)
+		free_busy->priv->busy_dirty = TRUE;
+
+	g_mutex_unlock (&free_busy->priv->lock);
+
+	g_free (key);
+
+	return removed;
+}
+
+/**
+ * e_cal_backend_free_busy_clear:
+ * @free_busy: an #ECalBackendFreeBusy
+ *
+ * Removes all components from @free_busy.
+ *
+ * Since: 3.10
+ **/
+void
+e_cal_backend_free_busy_clear (ECalBackendFreeBusy *free_busy)
+{
+	g_return_if_fail (E_IS_CAL_BACKEND_FREE_BUSY (free_busy));
+
+	g_mutex_lock (&free_busy->priv->lock);
+
+	g_hash_table_remove_all (free_busy->priv->instances);
+	g_array_set_size (free_busy->priv->busy, 0);
+	free_busy->priv->busy_dirty = FALSE;
+
+	g_mutex_unlock (&free_busy->priv->lock);
+}
+
+/**
+ * e_cal_backend_free_busy_get_n_intervals:
+ * @free_busy: an #ECalBackendFreeBusy
+ *
+ * Returns the number of disjoint busy intervals currently held by
+ * @free_busy, after merging overlapping instances.
+ *
+ * Returns: number of busy intervals
+ *
+ * Since: 3.10
+ **/
+guint
+e_cal_backend_free_busy_get_n_intervals (ECalBackendFreeBusy *free_busy)
+{
+	guint n_intervals;
+
+	g_return_val_if_fail (E_IS_CAL_BACKEND_FREE_BUSY (free_busy), 0);
+
+	g_mutex_lock (&free_busy->priv->lock);
+
+	if (free_busy->priv->busy_dirty)
+		free_busy_rebuild_locked (free_busy);
+
+	n_intervals = free_busy->priv->busy->len;
+
+	g_mutex_unlock (&free_busy->priv->lock);
+
+	return n_intervals;
+}
+
+/**
+ * e_cal_backend_free_busy_get_vfreebusy:
+ * @free_busy: an #ECalBackendFreeBusy
+ * @address: (allow-none): organizer address for the result, or %NULL
+ * @cn: (allow-none): common name of the organizer, or %NULL
+ * @start: start of the query
+ * @end: end of the query
+ *
+ * Creates a VFREEBUSY component describing busy time between @start
+ * and @end.  Overlapping and adjacent instances are reported as one
+ * FREEBUSY period, and periods are clipped to the query.  The caller
+ * should check e_cal_backend_free_busy_covers() first; parts of the
+ * query outside the indexing window are reported as free.
+ *
+ * Returns: a new VFREEBUSY #icalcomponent; free it with
+ * icalcomponent_free() when done with it
+ *
+ * Since: 3.10
+ **/
+icalcomponent *
+e_cal_backend_free_busy_get_vfreebusy (ECalBackendFreeBusy *free_busy,
+                                       const gchar *address,
+                                       const gchar *cn,
+                                       time_t start,
+                                       time_t end)
+{
+	icalcomponent *vfb;
+	icaltimezone *utc_zone;
+	GArray *busy;
+	guint ii;
+
+	g_return_val_if_fail (E_IS_CAL_BACKEND_FREE_BUSY (free_busy), NULL);
+
+	utc_zone = icaltimezone_get_utc_timezone ();
+
+	vfb = icalcomponent_new_vfreebusy ();
+	if (address != NULL) {
+		icalproperty *prop;
+		icalparameter *param;
+
+		prop = icalproperty_new_organizer (address);
+		if (prop != NULL && cn != NULL) {
+			param = icalparameter_new_cn (cn);
+			icalproperty_add_parameter (prop, param);
+		}
+		if (prop != NULL)
+			icalcomponent_add_property (vfb, prop);
+	}
+	icalcomponent_set_dtstart (vfb, icaltime_from_timet_with_zone (start, FALSE, utc_zone));
+	icalcomponent_set_dtend (vfb, icaltime_from_timet_with_zone (end, FALSE, utc_zone));
+
+	g_mutex_lock (&free_busy->priv->lock);
+
+	if (free_busy->priv->busy_dirty)
+		free_busy_rebuild_locked (free_busy);
+
+	busy = free_busy->priv->busy;
+
+	for (ii = free_busy_lower_bound (busy, start, TRUE); ii < busy->len; ii++) {
+		const FreeBusyInterval *iv;
+		struct icalperiodtype ipt;
+		icalproperty *prop;
+		icalparameter *param;
+
+		iv = &g_array_index (busy, FreeBusyInterval, ii);
+		if (iv->start >= end)
+			break;
+
+		ipt.start = icaltime_from_timet_with_zone (MAX (iv->start, start), FALSE, utc_zone);
+		ipt.end = icaltime_from_timet_with_zone (MIN (iv->end, end), FALSE, utc_zone);
+		ipt.duration = icaldurationtype_null_duration ();
+
+		prop = icalproperty_new (ICAL_FREEBUSY_PROPERTY);
+		icalproperty_set_freebusy (prop, ipt);
+
+		param = icalparameter_new_fbtype (ICAL_FBTYPE_BUSY);
+		icalproperty_add_parameter (prop, param);
+
+		icalcomponent_add_property (vfb, prop);
+	}
+
+	g_mutex_unlock (&free_busy->priv->lock);
+
+	return vfb;
+}
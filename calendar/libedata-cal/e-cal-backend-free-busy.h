@@ -0,0 +1,105 @@
+/*-*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* e-cal-backend-free-busy.h
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#if !defined (__LIBEDATA_CAL_H_INSIDE__) && !defined (LIBEDATA_CAL_COMPILATION)
+#error "Only <libedata-cal/libedata-cal.h> should be included directly."
+#endif
+
+#ifndef E_CAL_BACKEND_FREE_BUSY_H
+#define E_CAL_BACKEND_FREE_BUSY_H
+
+#include <libecal/libecal.h>
+
+/* Standard GObject macros */
+#define E_TYPE_CAL_BACKEND_FREE_BUSY \
+	(e_cal_backend_free_busy_get_type ())
+#define E_CAL_BACKEND_FREE_BUSY(obj) \
+	(G_TYPE_CHECK_INSTANCE_CAST \
+	((obj), E_TYPE_CAL_BACKEND_FREE_BUSY, ECalBackendFreeBusy))
+#define E_CAL_BACKEND_FREE_BUSY_CLASS(cls) \
+	(G_TYPE_CHECK_CLASS_CAST \
+	((cls), E_TYPE_CAL_BACKEND_FREE_BUSY, ECalBackendFreeBusyClass))
+#define E_IS_CAL_BACKEND_FREE_BUSY(obj) \
+	(G_TYPE_CHECK_INSTANCE_TYPE \
+	((obj), E_TYPE_CAL_BACKEND_FREE_BUSY))
+#define E_IS_CAL_BACKEND_FREE_BUSY_CLASS(cls) \
+	(G_TYPE_CHECK_CLASS_TYPE \
+	((cls), E_TYPE_CAL_BACKEND_FREE_BUSY))
+#define E_CAL_BACKEND_FREE_BUSY_GET_CLASS(obj) \
+	(G_TYPE_INSTANCE_GET_CLASS \
+	((obj), E_TYPE_CAL_BACKEND_FREE_BUSY, ECalBackendFreeBusyClass))
+
+G_BEGIN_DECLS
+
+typedef struct _ECalBackendFreeBusy ECalBackendFreeBusy;
+typedef struct _ECalBackendFreeBusyClass ECalBackendFreeBusyClass;
+typedef struct _ECalBackendFreeBusyPrivate ECalBackendFreeBusyPrivate;
+
+/**
+ * ECalBackendFreeBusy:
+ *
+ * An index of busy time for one calendar.  Components are expanded
+ * once, when they are added, within a fixed indexing window; the
+ * resulting instances are kept merged and sorted so that VFREEBUSY
+ * queries for any sub-window can be answered by binary search.
+ *
+ * Since: 3.10
+ **/
+struct _ECalBackendFreeBusy {
+	GObject parent;
+	ECalBackendFreeBusyPrivate *priv;
+};
+
+struct _ECalBackendFreeBusyClass {
+	GObjectClass parent_class;
+};
+
+GType		e_cal_backend_free_busy_get_type
+						(void) G_GNUC_CONST;
+ECalBackendFreeBusy *
+		e_cal_backend_free_busy_new	(time_t window_start,
+						 time_t window_end);
+void		e_cal_backend_free_busy_get_window
+						(ECalBackendFreeBusy *free_busy,
+						 time_t *out_start,
+						 time_t *out_end);
+gboolean	e_cal_backend_free_busy_covers	(ECalBackendFreeBusy *free_busy,
+						 time_t start,
+						 time_t end);
+gboolean	e_cal_backend_free_busy_add_component
+						(ECalBackendFreeBusy *free_busy,
+						 ECalComponent *comp,
+						 ECalRecurResolveTimezoneFn tz_cb,
+						 gpointer tz_cb_data,
+						 icaltimezone *default_zone);
+gboolean	e_cal_backend_free_busy_remove_component
+						(ECalBackendFreeBusy *free_busy,
+						 const gchar *uid,
+						 const gchar *rid);
+void		e_cal_backend_free_busy_clear	(ECalBackendFreeBusy *free_busy);
+guint		e_cal_backend_free_busy_get_n_intervals
+						(ECalBackendFreeBusy *free_busy);
+icalcomponent *	e_cal_backend_free_busy_get_vfreebusy
+						(ECalBackendFreeBusy *free_busy,
+						 const gchar *address,
+						 const gchar *cn,
+						 time_t start,
+						 time_t end);
+
+G_END_DECLS
+
+#endif /* E_CAL_BACKEND_FREE_BUSY_H */
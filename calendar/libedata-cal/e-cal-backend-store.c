@@ -27,6 +27,7 @@
 #include <libebackend/libebackend.h>
 
 #include "e-cal-backend-intervaltree.h"
+#include "e-cal-backend-util.h"
 
 #define E_CAL_BACKEND_STORE_GET_PRIVATE(obj) \
 	(G_TYPE_INSTANCE_GET_PRIVATE \
@@ -102,12 +103,6 @@ destroy_full_object (FullCompObject *obj)
 	g_free (obj);
 }
 
-static void
-cal_backend_store_free_zone (icaltimezone *zone)
-{
-	icaltimezone_free (zone, 1);
-}
-
 static void
 cal_backend_store_add_timezone (ECalBackendStore *store,
                                 icalcomponent *vtzcomp)
@@ -127,18 +122,13 @@ cal_backend_store_add_timezone (ECalBackendStore *store,
 	if (e_timezone_cache_get_timezone (timezone_cache, tzid) != NULL)
 		goto exit;
 
-	zone = icaltimezone_new ();
-
-	vtzcomp = icalcomponent_new_clone (vtzcomp);
-	if (!icaltimezone_set_component (zone, vtzcomp)) {
-		icaltimezone_free (zone, TRUE);
-		icalcomponent_free (vtzcomp);
+	zone = e_cal_backend_intern_timezone_component (vtzcomp);
+	if (zone == NULL)
 		goto exit;
-	}
 
 	e_timezone_cache_add_timezone (timezone_cache, zone);
 
-	icaltimezone_free (zone, TRUE);
+	e_cal_backend_release_timezone (zone);
 
 exit:
 	g_object_unref (timezone_cache);
@@ -380,7 +370,7 @@ cal_backend_store_save_cache_timeout_cb (gpointer user_data)
 
 	g_list_free_full (
 		timezones_to_save,
-		(GDestroyNotify) cal_backend_store_free_zone);
+		(GDestroyNotify) e_cal_backend_release_timezone);
 
 	return FALSE;
 }
@@ -394,20 +384,14 @@ cal_backend_store_save_cache (ECalBackendStore *store)
 	timezone_cache = e_cal_backend_store_ref_timezone_cache (store);
 	g_return_if_fail (timezone_cache != NULL);
 
-	/* Clone the icaltimezone structs in case
-	 * the timeout outlives the ETimezoneCache. */
+	/* Reference the shared icaltimezones in case the
+	 * timeout outlives the ETimezoneCache.  Time zones
+	 * from an ECalBackend are already shared, so this
+	 * does not copy anything. */
 	list = e_timezone_cache_list_timezones (timezone_cache);
-	for (link = list; link != NULL; link = g_list_next (link)) {
-		icaltimezone *tz;
-		icalcomponent *tzcomp;
-
-		tz = icaltimezone_new ();
-		tzcomp = icaltimezone_get_component (link->data);
-		tzcomp = icalcomponent_new_clone (tzcomp);
-		icaltimezone_set_component (tz, tzcomp);
-
-		link->data = tz;
-	}
+	for (link = list; link != NULL; link = g_list_next (link))
+		link->data = e_cal_backend_intern_timezone (link->data);
+	list = g_list_remove_all (list, NULL);
 
 	g_object_unref (timezone_cache);
 
@@ -422,7 +406,7 @@ cal_backend_store_save_cache (ECalBackendStore *store)
 
 	g_list_free_full (
 		store->priv->timezones_to_save,
-		(GDestroyNotify) cal_backend_store_free_zone);
+		(GDestroyNotify) e_cal_backend_release_timezone);
 
 	store->priv->timezones_to_save = list;  /* takes ownership */
 
@@ -534,7 +518,7 @@ cal_backend_store_dispose (GObject *object)
 			timezones_to_save);
 		g_list_free_full (
 			timezones_to_save,
-			(GDestroyNotify) cal_backend_store_free_zone);
+			(GDestroyNotify) e_cal_backend_release_timezone);
 	}
 
 	timezone_cache = g_weak_ref_get (&priv->timezone_cache);
@@ -241,3 +241,218 @@ e_cal_backend_user_declined (ESourceRegistry *registry,
 	return declined;
 }
 
+
+/*
+ * Process-wide timezone registry
+ *
+ * Every calendar backend in a factory process used to keep its own
+ * deep copy of every VTIMEZONE it encountered, and ECalBackendStore
+ * cloned them all again on each scheduled save.  Since the same few
+ * VTIMEZONE definitions show up in almost every calendar, they are
+ * now interned here once, keyed by their serialized content (which
+ * includes the TZID), and shared by reference.
+ */
+
+typedef struct _InternedZone InternedZone;
+
+struct _InternedZone {
+	gchar *key;
+	icaltimezone *zone;
+	volatile gint ref_count;
+};
+
+static GRWLock timezone_registry_lock;
+static GHashTable *timezone_registry_by_key;   /* key -> InternedZone */
+static GHashTable *timezone_registry_by_zone;  /* zone -> InternedZone */
+
+static void
+interned_zone_free (InternedZone *interned)
+{
+	icaltimezone_free (interned->zone, 1);
+	g_free (interned->key);
+
+	g_slice_free (InternedZone, interned);
+}
+
+static void
+timezone_registry_ensure (void)
+{
+	static volatile gsize initialized = 0;
+
+	if (g_once_init_enter (&initialized)) {
+		timezone_registry_by_key = g_hash_table_new (
+			(GHashFunc) g_str_hash,
+			(GEqualFunc) g_str_equal);
+		timezone_registry_by_zone = g_hash_table_new (
+			(GHashFunc) g_direct_hash,
+			(GEqualFunc) g_direct_equal);
+		g_once_init_leave (&initialized, 1);
+	}
+}
+
+/* Must be called with the registry lock held, in either mode. */
+static InternedZone *
+timezone_registry_lookup_zone (icaltimezone *zone)
+{
+	return g_hash_table_lookup (timezone_registry_by_zone, zone);
+}
+
+/**
+ * e_cal_backend_intern_timezone_component:
+ * @vtimezone: a VTIMEZONE #icalcomponent
+ *
+ * Returns the process-wide shared #icaltimezone for @vtimezone.  Two
+ * VTIMEZONE components with the same content, TZID included, always
+ * yield the same #icaltimezone, so backends and stores in a factory
+ * process can hold on to time zones without keeping private copies.
+ * @vtimezone itself is not consumed; it is only copied the first time
+ * its content is seen.
+ *
+ * Once a given VTIMEZONE has been interned, further lookups only take
+ * a shared reader lock and never contend with each other.
+ *
+ * Release the returned time zone with e_cal_backend_release_timezone().
+ *
+ * Returns: a shared #icaltimezone, or %NULL if @vtimezone is invalid
+ *
+ * Since: 3.10
+ **/
+icaltimezone *
+e_cal_backend_intern_timezone_component (icalcomponent *vtimezone)
+{
+	InternedZone *interned;
+	icalcomponent *clone;
+	icaltimezone *zone;
+	gchar *key;
+
+	g_return_val_if_fail (vtimezone != NULL, NULL);
+
+	if (icalcomponent_isa (vtimezone) != ICAL_VTIMEZONE_COMPONENT)
+		return NULL;
+
+	timezone_registry_ensure ();
+
+	key = icalcomponent_as_ical_string_r (vtimezone);
+	g_return_val_if_fail (key != NULL, NULL);
+
+	g_rw_lock_reader_lock (&timezone_registry_lock);
+	interned = g_hash_table_lookup (timezone_registry_by_key, key);
+	if (interned != NULL)
+		g_atomic_int_inc (&interned->ref_count);
+	g_rw_lock_reader_unlock (&timezone_registry_lock);
+
+	if (interned != NULL) {
+		g_free (key);
+		return interned->zone;
+	}
+
+	g_rw_lock_writer_lock (&timezone_registry_lock);
+
+	/* Somebody may have beaten us to it. */
+	interned = g_hash_table_lookup (timezone_registry_by_key, key);
+	if (interned != NULL) {
+		g_atomic_int_inc (&interned->ref_count);
+		zone = interned->zone;
+		g_free (key);
+		goto exit;
+	}
+
+	zone = icaltimezone_new ();
+	clone = icalcomponent_new_clone (vtimezone);
+	if (!icaltimezone_set_component (zone, clone)) {
+		icalcomponent_free (clone);
+		icaltimezone_free (zone, 1);
+		g_free (key);
+		zone = NULL;
+		goto exit;
+	}
+
+	interned = g_slice_new0 (InternedZone);
+	interned->key = key;  /* takes ownership */
+	interned->zone = zone;
+	interned->ref_count = 1;
+
+	g_hash_table_insert (timezone_registry_by_key, interned->key, interned);
+	g_hash_table_insert (timezone_registry_by_zone, interned->zone, interned);
+
+exit:
+	g_rw_lock_writer_unlock (&timezone_registry_lock);
+
+	return zone;
+}
+
+/**
+ * e_cal_backend_intern_timezone:
+ * @zone: an #icaltimezone
+ *
+ * Like e_cal_backend_intern_timezone_component(), but takes an existing
+ * #icaltimezone.  If @zone already is a shared time zone, this merely
+ * adds a reference to it.  Time zones without a VTIMEZONE component,
+ * such as the UTC time zone, are owned by libical and live as long as
+ * the process does; they are returned as they are.
+ *
+ * Release the returned time zone with e_cal_backend_release_timezone().
+ *
+ * Returns: a shared #icaltimezone, or %NULL if @zone is invalid
+ *
+ * Since: 3.10
+ **/
+icaltimezone *
+e_cal_backend_intern_timezone (icaltimezone *zone)
+{
+	InternedZone *interned;
+	icalcomponent *vtimezone;
+
+	g_return_val_if_fail (zone != NULL, NULL);
+
+	timezone_registry_ensure ();
+
+	g_rw_lock_reader_lock (&timezone_registry_lock);
+	interned = timezone_registry_lookup_zone (zone);
+	if (interned != NULL)
+		g_atomic_int_inc (&interned->ref_count);
+	g_rw_lock_reader_unlock (&timezone_registry_lock);
+
+	if (interned != NULL)
+		return zone;
+
+	vtimezone = icaltimezone_get_component (zone);
+	if (vtimezone == NULL)
+		return zone;
+
+	return e_cal_backend_intern_timezone_component (vtimezone);
+}
+
+/**
+ * e_cal_backend_release_timezone:
+ * @zone: an #icaltimezone returned by e_cal_backend_intern_timezone()
+ *        or e_cal_backend_intern_timezone_component()
+ *
+ * Drops a reference to a shared time zone.  The time zone is freed
+ * once nothing in the process refers to it anymore.  Time zones which
+ * are not shared are ignored.
+ *
+ * Since: 3.10
+ **/
+void
+e_cal_backend_release_timezone (icaltimezone *zone)
+{
+	InternedZone *interned;
+
+	g_return_if_fail (zone != NULL);
+
+	timezone_registry_ensure ();
+
+	/* Take the writer lock so nobody can revive the
+	 * entry between the last unref and its removal. */
+	g_rw_lock_writer_lock (&timezone_registry_lock);
+
+	interned = timezone_registry_lookup_zone (zone);
+	if (interned != NULL && g_atomic_int_dec_and_test (&interned->ref_count)) {
+		g_hash_table_remove (timezone_registry_by_key, interned->key);
+		g_hash_table_remove (timezone_registry_by_zone, interned->zone);
+		interned_zone_free (interned);
+	}
+
+	g_rw_lock_writer_unlock (&timezone_registry_lock);
+}
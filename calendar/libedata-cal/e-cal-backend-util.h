@@ -47,6 +47,15 @@ gboolean	e_cal_backend_mail_account_is_valid
 gboolean	e_cal_backend_user_declined	(ESourceRegistry *registry,
                                                  icalcomponent *icalcomp);
 
+/*
+ * Process-wide shared time zones
+ */
+
+icaltimezone *	e_cal_backend_intern_timezone	(icaltimezone *zone);
+icaltimezone *	e_cal_backend_intern_timezone_component
+						(icalcomponent *vtimezone);
+void		e_cal_backend_release_timezone	(icaltimezone *zone);
+
 G_END_DECLS
 
 #endif /* E_CAL_BACKEND_UTIL_H */
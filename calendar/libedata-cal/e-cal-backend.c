@@ -22,6 +22,7 @@
 
 #include "e-cal-backend.h"
 #include "e-cal-backend-cache.h"
+#include "e-cal-backend-util.h"
 
 #define E_CAL_BACKEND_GET_PRIVATE(obj) \
 	(G_TYPE_INSTANCE_GET_PRIVATE \
@@ -176,12 +177,6 @@ signal_closure_free (SignalClosure *signal_closure)
 	g_slice_free (SignalClosure, signal_closure);
 }
 
-static void
-cal_backend_free_zone (icaltimezone *zone)
-{
-	icaltimezone_free (zone, 1);
-}
-
 static void
 cal_backend_push_operation (ECalBackend *backend,
                             GSimpleAsyncResult *simple,
@@ -630,13 +625,13 @@ cal_backend_add_cached_timezone (ETimezoneCache *cache,
 		GSource *idle_source;
 		GMainContext *main_context;
 		SignalClosure *signal_closure;
-		icalcomponent *icalcomp;
 		icaltimezone *cached_zone;
 
-		cached_zone = icaltimezone_new ();
-		icalcomp = icaltimezone_get_component (zone);
-		icalcomp = icalcomponent_new_clone (icalcomp);
-		icaltimezone_set_component (cached_zone, icalcomp);
+		/* Share the icaltimezone with every other backend
+		 * in the process rather than keeping a deep copy. */
+		cached_zone = e_cal_backend_intern_timezone (zone);
+		if (cached_zone == NULL)
+			goto exit;
 
 		g_hash_table_insert (
 			priv->zone_cache,
@@ -663,6 +658,7 @@ cal_backend_add_cached_timezone (ETimezoneCache *cache,
 		g_main_context_unref (main_context);
 	}
 
+exit:
 	g_mutex_unlock (&priv->zone_cache_lock);
 }
 
@@ -726,17 +722,14 @@ cal_backend_get_cached_timezone (ETimezoneCache *cache,
 	}
 
 	if (icalcomp != NULL) {
-		zone = icaltimezone_new ();
-		if (icaltimezone_set_component (zone, icalcomp)) {
+		zone = e_cal_backend_intern_timezone_component (icalcomp);
+		if (zone != NULL) {
 			tzid = icaltimezone_get_tzid (zone);
 			g_hash_table_insert (
 				priv->zone_cache,
 				g_strdup (tzid), zone);
-		} else {
-			icalcomponent_free (icalcomp);
-			icaltimezone_free (zone, 1);
-			zone = NULL;
 		}
+		icalcomponent_free (icalcomp);
 	}
 
 exit:
@@ -886,7 +879,7 @@ e_cal_backend_init (ECalBackend *backend)
 		(GHashFunc) g_str_hash,
 		(GEqualFunc) g_str_equal,
 		(GDestroyNotify) g_free,
-		(GDestroyNotify) cal_backend_free_zone);
+		(GDestroyNotify) e_cal_backend_release_timezone);
 
 	backend->priv = E_CAL_BACKEND_GET_PRIVATE (backend);
 
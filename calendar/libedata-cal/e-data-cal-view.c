@@ -42,6 +42,9 @@
 /* how long to wait until notifications are propagated to UI; in seconds */
 #define THRESHOLD_SECONDS 2
 
+/* how much of a view's time range to populate first; in seconds */
+#define PRIORITY_WINDOW_SECONDS (7 * 24 * 60 * 60)
+
 struct _EDataCalViewPrivate {
 	GDBusConnection *connection;
 	EGdbusCalView *gdbus_object;
@@ -81,6 +84,13 @@ enum {
 	PROP_SEXP
 };
 
+enum {
+	WINDOW_COMPLETE,
+	LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
 /* Forward Declarations */
 static void	e_data_cal_view_initable_init	(GInitableIface *interface);
 
@@ -542,6 +552,29 @@ e_data_cal_view_class_init (EDataCalViewClass *class)
 			G_PARAM_READWRITE |
 			G_PARAM_CONSTRUCT_ONLY |
 			G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * EDataCalView::window-complete:
+	 * @view: the #EDataCalView which emitted the signal
+	 * @window_start: start of the populated time window
+	 * @window_end: end of the populated time window
+	 *
+	 * Emitted by e_data_cal_view_notify_window_complete(), once all
+	 * matching components occurring within the given time window have
+	 * been sent to the view's listeners, while the rest of the view
+	 * is still being populated.
+	 *
+	 * Since: 3.10
+	 **/
+	signals[WINDOW_COMPLETE] = g_signal_new (
+		"window-complete",
+		G_OBJECT_CLASS_TYPE (object_class),
+		G_SIGNAL_RUN_LAST,
+		0,
+		NULL, NULL, NULL,
+		G_TYPE_NONE, 2,
+		G_TYPE_INT64,
+		G_TYPE_INT64);
 }
 
 static void
@@ -707,16 +740,18 @@ notify_add_component (EDataCalView *view,
                       /* const */ ECalComponent *comp)
 {
 	ECalClientViewFlags flags;
-	gchar *obj;
-
-	obj = e_data_cal_view_get_component_string (view, comp);
 
 	send_pending_changes (view);
 	send_pending_removes (view);
 
-	/* Do not send component add notifications during initial stage */
+	/* Do not send component add notifications during initial stage,
+	 * and do not bother serializing the component in that case. */
 	flags = e_data_cal_view_get_flags (view);
 	if (view->priv->complete || (flags & E_CAL_CLIENT_VIEW_FLAGS_NOTIFY_INITIAL) != 0) {
+		gchar *obj;
+
+		obj = e_data_cal_view_get_component_string (view, comp);
+
 		if (view->priv->adds->len == THRESHOLD_ITEMS)
 			send_pending_adds (view);
 		g_array_append_val (view->priv->adds, obj);
@@ -1348,6 +1383,168 @@ e_data_cal_view_notify_progress (EDataCalView *view,
 	g_free (gdbus_message);
 }
 
+/**
+ * e_data_cal_view_get_priority_window:
+ * @view: an #EDataCalView
+ * @out_start: (out): return location for the window start
+ * @out_end: (out): return location for the window end
+ *
+ * Backends which can search their components by time may populate a
+ * view in two passes: first the components occurring in the window
+ * returned here, which covers the week starting at local midnight today
+ * (or the first week of the view's time range, if that does not include
+ * today), followed by e_data_cal_view_notify_window_complete(), and then
+ * all the remaining matching components.  Both passes run one after the
+ * other in the thread the view was started in; the difference is that
+ * the first one is sent to clients as soon as it is done, rather than
+ * batched with the rest, so they can show the part of a large calendar
+ * that is most likely on screen right away.
+ *
+ * Returns: %TRUE if the view is worth populating in two passes, and
+ *          @out_start and @out_end were set; %FALSE if the view's time
+ *          range is not larger than the priority window
+ *
+ * Since: 3.10
+ **/
+gboolean
+e_data_cal_view_get_priority_window (EDataCalView *view,
+                                     time_t *out_start,
+                                     time_t *out_end)
+{
+	time_t occur_start = -1, occur_end = -1;
+	time_t start, end;
+	GDateTime *now, *today;
+	gboolean bounded;
+
+	g_return_val_if_fail (E_IS_DATA_CAL_VIEW (view), FALSE);
+	g_return_val_if_fail (out_start != NULL, FALSE);
+	g_return_val_if_fail (out_end != NULL, FALSE);
+
+	bounded = e_cal_backend_sexp_evaluate_occur_times (
+		view->priv->sexp, &occur_start, &occur_end);
+
+	/* Views carry no time zone of their own; the factory runs in the
+	 * user's session, so its local zone is the one clients show. */
+	now = g_date_time_new_now_local ();
+	today = g_date_time_new_local (
+		g_date_time_get_year (now),
+		g_date_time_get_month (now),
+		g_date_time_get_day_of_month (now),
+		0, 0, 0);
+	start = (time_t) g_date_time_to_unix (today);
+	end = start + PRIORITY_WINDOW_SECONDS;
+	g_date_time_unref (today);
+	g_date_time_unref (now);
+
+	if (bounded) {
+		if (occur_end - occur_start <= PRIORITY_WINDOW_SECONDS)
+			return FALSE;
+
+		if (start < occur_start || start >= occur_end) {
+			start = occur_start;
+			end = start + PRIORITY_WINDOW_SECONDS;
+		}
+
+		end = MIN (end, occur_end);
+	}
+
+	*out_start = start;
+	*out_end = end;
+
+	return TRUE;
+}
+
+/**
+ * e_data_cal_view_contains_component:
+ * @view: an #EDataCalView
+ * @component: an #ECalComponent
+ *
+ * Checks whether a component with the same UID and RECURRENCE-ID as
+ * @component has already been
+ * sent to the view's listeners as an added component.  Backends use
+ * this to avoid notifying a component twice when populating a view
+ * in several passes.
+ *
+ * Returns: whether the component is already part of @view
+ *
+ * Since: 3.10
+ **/
+gboolean
+e_data_cal_view_contains_component (EDataCalView *view,
+                                    ECalComponent *component)
+{
+	ECalComponentId *id;
+	gboolean contains;
+
+	g_return_val_if_fail (E_IS_DATA_CAL_VIEW (view), FALSE);
+	g_return_val_if_fail (E_IS_CAL_COMPONENT (component), FALSE);
+
+	id = e_cal_component_get_id (component);
+	if (id == NULL)
+		return FALSE;
+
+	g_mutex_lock (&view->priv->pending_mutex);
+	contains = g_hash_table_contains (view->priv->ids, id);
+	g_mutex_unlock (&view->priv->pending_mutex);
+
+	e_cal_component_free_id (id);
+
+	return contains;
+}
+
+/**
+ * e_data_cal_view_notify_window_complete:
+ * @view: an #EDataCalView
+ * @window_start: start of the populated time window
+ * @window_end: end of the populated time window
+ *
+ * Notifies all view listeners that every matching component occurring
+ * within the given time window has been added, while the view as a
+ * whole is not complete yet.  Pending notifications are sent right
+ * away instead of waiting for the usual batching threshold, a progress
+ * notification is emitted and so is the #EDataCalView::window-complete
+ * signal.
+ *
+ * See e_data_cal_view_get_priority_window().
+ *
+ * Since: 3.10
+ **/
+void
+e_data_cal_view_notify_window_complete (EDataCalView *view,
+                                        time_t window_start,
+                                        time_t window_end)
+{
+	time_t occur_start = -1, occur_end = -1;
+	guint percent = 0;
+
+	g_return_if_fail (E_IS_DATA_CAL_VIEW (view));
+
+	if (!view->priv->started || view->priv->stopped)
+		return;
+
+	g_mutex_lock (&view->priv->pending_mutex);
+
+	send_pending_adds (view);
+	send_pending_changes (view);
+	send_pending_removes (view);
+
+	g_mutex_unlock (&view->priv->pending_mutex);
+
+	/* Report how much of the view's time range is done. */
+	if (e_cal_backend_sexp_evaluate_occur_times (
+		view->priv->sexp, &occur_start, &occur_end) &&
+	    occur_end > occur_start)
+		percent = CLAMP (
+			100.0 * (window_end - window_start) /
+			(occur_end - occur_start), 0, 100);
+
+	e_data_cal_view_notify_progress (view, percent, NULL);
+
+	g_signal_emit (
+		view, signals[WINDOW_COMPLETE], 0,
+		(gint64) window_start, (gint64) window_end);
+}
+
 /**
  * e_data_cal_view_notify_complete:
  * @view: an #EDataCalView
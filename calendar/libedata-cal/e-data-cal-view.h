@@ -116,6 +116,17 @@ void		e_data_cal_view_notify_objects_removed_1
 void		e_data_cal_view_notify_progress	(EDataCalView *view,
 						 gint percent,
 						 const gchar *message);
+gboolean	e_data_cal_view_get_priority_window
+						(EDataCalView *view,
+						 time_t *out_start,
+						 time_t *out_end);
+gboolean	e_data_cal_view_contains_component
+						(EDataCalView *view,
+						 ECalComponent *component);
+void		e_data_cal_view_notify_window_complete
+						(EDataCalView *view,
+						 time_t window_start,
+						 time_t window_end);
 void		e_data_cal_view_notify_complete	(EDataCalView *view,
 						 const GError *error);
 
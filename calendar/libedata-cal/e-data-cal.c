@@ -205,6 +205,28 @@ construct_calview_path (void)
 		getpid (), counter);
 }
 
+/* Like e_util_utf8_make_valid(), but takes ownership of @str and
+ * returns it as it is when it is valid already, which is the usual
+ * case for backend results, instead of copying it.  Like that, it
+ * returns an empty string for NULL, thus never ends a string vector
+ * early. */
+static gchar *
+data_cal_take_utf8_valid (gchar *str)
+{
+	gchar *valid;
+
+	if (str == NULL)
+		return g_strdup ("");
+
+	if (g_utf8_validate (str, -1, NULL))
+		return str;
+
+	valid = e_util_utf8_make_valid (str);
+	g_free (str);
+
+	return valid;
+}
+
 static void
 data_cal_convert_to_client_error (GError *error)
 {
@@ -670,9 +692,7 @@ data_cal_complete_get_object_list_cb (GObject *source_object,
 
 			calobj = g_queue_pop_head (&queue);
 
-			strv[ii++] = e_util_utf8_make_valid (calobj);
-
-			g_free (calobj);
+			strv[ii++] = data_cal_take_utf8_valid (calobj);
 		}
 
 		e_dbus_calendar_complete_get_object_list (
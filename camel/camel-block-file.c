@@ -33,11 +33,24 @@
 
 #include <glib/gstdio.h>
 
+#ifndef G_OS_WIN32
+#include <sys/mman.h>
+#define BLOCK_FILE_USE_MMAP
+#endif
+
 #include "camel-block-file.h"
+#include "camel-debug.h"
 #include "camel-file-utils.h"
 
 #define d(x) /*(printf("%s(%d):%s: ",  __FILE__, __LINE__, __PRETTY_FUNCTION__),(x))*/
 
+/* smallest mapping, it is grown by doubling */
+#define BLOCK_FILE_MAP_MIN (256 * 1024)
+
+/* lookups after which the block cache size is reconsidered */
+#define BLOCK_FILE_CACHE_WINDOW (1024)
+#define BLOCK_FILE_CACHE_MAX_BOOST (4)
+
 /* Locks must be obtained in the order defined */
 
 struct _CamelBlockFilePrivate {
@@ -48,6 +61,26 @@ struct _CamelBlockFilePrivate {
 	GMutex io_lock; /* for all io ops */
 
 	guint deleted : 1;
+	guint map_failed : 1;
+
+	/* The file mapped shared, when that works.  Blocks are copied in
+	 * and out of the mapping instead of read () and write (), the OS
+	 * does the paging, and the pages written to are msync'd together
+	 * when the file is synced.  Protected by io_lock. */
+	guchar *map;
+	gsize map_size;		/* length of the mapping */
+	goffset file_size;	/* how much of it the file covers */
+	GHashTable *dirty_pages;
+
+	/* see camel_block_file_get_stats ().  Protected by cache_lock,
+	 * which every path writing blocks out holds as well. */
+	guint hits, misses, writes, syncs;
+
+	/* Without a mapping every miss is a read (), so the cache is
+	 * allowed to grow to a multiple of block_cache_limit while most
+	 * lookups miss.  Protected by cache_lock. */
+	guint window_lookups, window_misses;
+	gint cache_boost;
 };
 
 #define CAMEL_BLOCK_FILE_LOCK(kf, lock) (g_mutex_lock(&(kf)->priv->lock))
@@ -68,6 +101,18 @@ static gint block_file_threshhold = 10;
 
 static gint sync_nolock (CamelBlockFile *bs);
 static gint sync_block_nolock (CamelBlockFile *bs, CamelBlock *bl);
+static gint block_file_sync_block_locked (CamelBlockFile *bs, CamelBlock *bl);
+
+#ifdef BLOCK_FILE_USE_MMAP
+static gsize block_file_page_size;
+
+static void block_file_unmap (CamelBlockFile *bs);
+#else
+#define block_file_unmap(bs)
+#define block_file_map_read(bs, bl) (FALSE)
+#define block_file_map_write(bs, bl) (0)
+#define block_file_map_sync(bs) (0)
+#endif
 
 G_DEFINE_TYPE (CamelBlockFile, camel_block_file, CAMEL_TYPE_OBJECT)
 
@@ -169,6 +214,17 @@ block_file_finalize (GObject *object)
 
 	if (bs->root_block)
 		camel_block_file_unref_block (bs, bs->root_block);
+
+	if (camel_debug ("block-file"))
+		printf (
+			"%s: %u hits, %u misses, %u writes, %u syncs%s\n",
+			bs->path, bs->priv->hits, bs->priv->misses,
+			bs->priv->writes, bs->priv->syncs,
+			bs->priv->map ? ", mapped" : "");
+
+	block_file_unmap (bs);
+	g_hash_table_destroy (bs->priv->dirty_pages);
+
 	g_free (bs->path);
 	if (bs->fd != -1)
 		close (bs->fd);
@@ -193,6 +249,10 @@ camel_block_file_class_init (CamelBlockFileClass *class)
 
 	class->validate_root = block_file_validate_root;
 	class->init_root = block_file_init_root;
+
+#ifdef BLOCK_FILE_USE_MMAP
+	block_file_page_size = sysconf (_SC_PAGESIZE);
+#endif
 }
 
 static guint
@@ -214,6 +274,8 @@ camel_block_file_init (CamelBlockFile *bs)
 
 	bs->priv = g_malloc0 (sizeof (*bs->priv));
 	bs->priv->base = bs;
+	bs->priv->dirty_pages = g_hash_table_new (NULL, NULL);
+	bs->priv->cache_boost = 1;
 
 	g_mutex_init (&bs->priv->root_lock);
 	g_mutex_init (&bs->priv->cache_lock);
@@ -321,6 +383,243 @@ block_file_unuse (CamelBlockFile *bs)
 	CAMEL_BLOCK_FILE_UNLOCK (bs, io_lock);
 }
 
+#ifdef BLOCK_FILE_USE_MMAP
+
+/* Modified pages of a shared mapping are already in the page cache,
+ * so nothing is lost by unmapping before they are msync'd. */
+static void
+block_file_unmap (CamelBlockFile *bs)
+{
+	CamelBlockFilePrivate *p = bs->priv;
+
+	if (p->map != NULL) {
+		munmap (p->map, p->map_size);
+		p->map = NULL;
+		p->map_size = 0;
+	}
+
+	p->file_size = 0;
+	g_hash_table_remove_all (p->dirty_pages);
+}
+
+/* Makes sure the mapping is at least @size bytes long, mapping or
+ * remapping the file as needed.  Call with io_lock held and the
+ * file open. */
+static gboolean
+block_file_map (CamelBlockFile *bs,
+                goffset size)
+{
+	CamelBlockFilePrivate *p = bs->priv;
+	struct stat st;
+	gpointer map;
+	gsize length;
+	gint prot;
+
+	if (p->map_failed)
+		return FALSE;
+
+	if (p->map != NULL && size <= p->map_size)
+		return TRUE;
+
+	if (fstat (bs->fd, &st) == -1)
+		return FALSE;
+
+	/* mapping past the end of the file is fine, only touching it is
+	 * not, so leave room for the file to grow into */
+	length = MAX (p->map_size, BLOCK_FILE_MAP_MIN);
+	while (length < size || length < st.st_size)
+		length *= 2;
+
+	if (p->map != NULL)
+		munmap (p->map, p->map_size);
+
+	prot = PROT_READ;
+	if ((bs->flags & O_ACCMODE) != O_RDONLY)
+		prot |= PROT_WRITE;
+
+	map = mmap (NULL, length, prot, MAP_SHARED, bs->fd, 0);
+	if (map == MAP_FAILED) {
+		d (printf ("Could not map block file %s: %s\n", bs->path, g_strerror (errno)));
+		p->map = NULL;
+		p->map_size = 0;
+		p->map_failed = TRUE;
+		return FALSE;
+	}
+
+	p->map = map;
+	p->map_size = length;
+	p->file_size = st.st_size;
+
+	return TRUE;
+}
+
+/* Copies a block in from the mapping, a block past the end of
+ * the file reads as zeroes like it does with read ().  Call with
+ * io_lock held and the file open. */
+static gboolean
+block_file_map_read (CamelBlockFile *bs,
+                     CamelBlock *bl)
+{
+	CamelBlockFilePrivate *p = bs->priv;
+	goffset avail;
+
+	if (!block_file_map (bs, (goffset) bl->id + CAMEL_BLOCK_SIZE))
+		return FALSE;
+
+	avail = CLAMP (p->file_size - (goffset) bl->id, 0, CAMEL_BLOCK_SIZE);
+	memcpy (bl->data, p->map + bl->id, avail);
+	memset (bl->data + avail, 0, CAMEL_BLOCK_SIZE - avail);
+
+	return TRUE;
+}
+
+/* Grows the file with write () to end with @bl, zero filling any gap
+ * left by blocks not written out yet.  Growing it with ftruncate ()
+ * instead would leave pages the file system only allocates once they
+ * are touched through the mapping, and a full disk would then raise
+ * SIGBUS rather than fail a write.  Call with io_lock held. */
+static gboolean
+block_file_map_append (CamelBlockFile *bs,
+                       CamelBlock *bl)
+{
+	static const gchar zeroes[CAMEL_BLOCK_SIZE];
+	CamelBlockFilePrivate *p = bs->priv;
+	goffset offset;
+
+	if (lseek (bs->fd, p->file_size, SEEK_SET) == -1)
+		return FALSE;
+
+	for (offset = p->file_size; offset < bl->id; ) {
+		gsize len = MIN (CAMEL_BLOCK_SIZE, bl->id - offset);
+
+		if (write (bs->fd, zeroes, len) != len)
+			return FALSE;
+		offset += len;
+	}
+
+	if (write (bs->fd, bl->data, CAMEL_BLOCK_SIZE) != CAMEL_BLOCK_SIZE)
+		return FALSE;
+
+	p->file_size = (goffset) bl->id + CAMEL_BLOCK_SIZE;
+
+	return TRUE;
+}
+
+/* Copies a block out to the mapping, or appends it to the file when
+ * it is past the end.  Returns 1 when written, 0 when there is no
+ * mapping and the caller has to write () it, -1 on error.  Call with
+ * io_lock held and the file open. */
+static gint
+block_file_map_write (CamelBlockFile *bs,
+                      CamelBlock *bl)
+{
+	CamelBlockFilePrivate *p = bs->priv;
+	goffset end = (goffset) bl->id + CAMEL_BLOCK_SIZE;
+	gsize page;
+
+	if (!block_file_map (bs, end))
+		return 0;
+
+	if (end > p->file_size)
+		return block_file_map_append (bs, bl) ? 1 : -1;
+
+	memcpy (p->map + bl->id, bl->data, CAMEL_BLOCK_SIZE);
+
+	for (page = bl->id / block_file_page_size; page <= (end - 1) / block_file_page_size; page++)
+		g_hash_table_add (p->dirty_pages, GSIZE_TO_POINTER (page));
+
+	return 1;
+}
+
+static gint
+block_file_compare_page (gconstpointer a,
+                         gconstpointer b)
+{
+	gsize pa = GPOINTER_TO_SIZE (a);
+	gsize pb = GPOINTER_TO_SIZE (b);
+
+	return pa < pb ? -1 : pa > pb ? 1 : 0;
+}
+
+/* Starts writeback of the pages written to since the last sync, one
+ * msync () per run of adjacent pages.  Call with io_lock held. */
+static gint
+block_file_map_sync (CamelBlockFile *bs)
+{
+	CamelBlockFilePrivate *p = bs->priv;
+	GList *pages, *link;
+	gsize first, last, page = 0;
+	gint ret = 0;
+
+	if (p->map == NULL || g_hash_table_size (p->dirty_pages) == 0)
+		return 0;
+
+	pages = g_list_sort (
+		g_hash_table_get_keys (p->dirty_pages),
+		block_file_compare_page);
+
+	first = last = GPOINTER_TO_SIZE (pages->data);
+	for (link = pages->next; ; link = g_list_next (link)) {
+		if (link != NULL) {
+			page = GPOINTER_TO_SIZE (link->data);
+			if (page == last + 1) {
+				last = page;
+				continue;
+			}
+		}
+
+		if (msync (
+			p->map + first * block_file_page_size,
+			(last - first + 1) * block_file_page_size,
+			MS_ASYNC) == -1)
+			ret = -1;
+
+		if (link == NULL)
+			break;
+
+		first = last = page;
+	}
+
+	g_list_free (pages);
+	g_hash_table_remove_all (p->dirty_pages);
+
+	return ret;
+}
+
+#endif /* BLOCK_FILE_USE_MMAP */
+
+/* Counts a cache lookup and, every so many of them, grows or shrinks
+ * the cache when there is no mapping to make misses cheap.  Call with
+ * cache_lock held. */
+static void
+block_file_count_lookup (CamelBlockFile *bs,
+                         gboolean hit)
+{
+	CamelBlockFilePrivate *p = bs->priv;
+
+	if (hit) {
+		p->hits++;
+	} else {
+		p->misses++;
+		p->window_misses++;
+	}
+
+	if (++p->window_lookups < BLOCK_FILE_CACHE_WINDOW)
+		return;
+
+	if (p->map != NULL)
+		p->cache_boost = 1;
+	else if (p->window_misses > BLOCK_FILE_CACHE_WINDOW / 2
+		 && p->cache_boost < BLOCK_FILE_CACHE_MAX_BOOST)
+		p->cache_boost *= 2;
+	else if (p->window_misses < BLOCK_FILE_CACHE_WINDOW / 32
+		 && p->cache_boost > 1)
+		p->cache_boost /= 2;
+
+	p->window_lookups = 0;
+	p->window_misses = 0;
+}
+
 /*
  * o = camel_cache_get (c, key);
  * camel_cache_unref (c, key);
@@ -385,6 +684,8 @@ camel_block_file_new (const gchar *path,
 			g_object_unref (bs);
 			return NULL;
 		}
+		/* the mapping may now reach past the end of the file */
+		block_file_unmap (bs);
 		block_file_unuse (bs);
 	}
 
@@ -442,6 +743,8 @@ camel_block_file_delete (CamelBlockFile *bs)
 		bs->fd = -1;
 	}
 
+	block_file_unmap (bs);
+
 	bs->priv->deleted = TRUE;
 	ret = g_unlink (bs->path);
 
@@ -566,10 +869,13 @@ camel_block_file_get_block (CamelBlockFile *bs,
 			return NULL;
 		}
 
+		block_file_count_lookup (bs, FALSE);
+
 		bl = g_malloc0 (sizeof (*bl));
 		bl->id = id;
-		if (lseek (bs->fd, id, SEEK_SET) == -1 ||
-		    camel_read (bs->fd, (gchar *) bl->data, CAMEL_BLOCK_SIZE, NULL, NULL) == -1) {
+		if (!block_file_map_read (bs, bl)
+		    && (lseek (bs->fd, id, SEEK_SET) == -1 ||
+		    camel_read (bs->fd, (gchar *) bl->data, CAMEL_BLOCK_SIZE, NULL, NULL) == -1)) {
 			block_file_unuse (bs);
 			CAMEL_BLOCK_FILE_UNLOCK (bs, cache_lock);
 			g_free (bl);
@@ -582,7 +888,7 @@ camel_block_file_get_block (CamelBlockFile *bs,
 		/* flush old blocks */
 		link = g_queue_peek_tail_link (&bs->block_cache);
 
-		while (link != NULL && bs->block_cache_count > bs->block_cache_limit) {
+		while (link != NULL && bs->block_cache_count > bs->block_cache_limit * bs->priv->cache_boost) {
 			CamelBlock *flush = link->data;
 
 			if (flush->refcount == 0) {
@@ -605,6 +911,7 @@ camel_block_file_get_block (CamelBlockFile *bs,
 		/* UNLOCK io_lock */
 		block_file_unuse (bs);
 	} else {
+		block_file_count_lookup (bs, TRUE);
 		g_queue_remove (&bs->block_cache, bl);
 	}
 
@@ -691,7 +998,7 @@ camel_block_file_touch_block (CamelBlockFile *bs,
 		d (printf ("turning off sync flag\n"));
 		bs->root->flags &= ~CAMEL_BLOCK_FILE_SYNC;
 		bs->root_block->flags |= CAMEL_BLOCK_DIRTY;
-		camel_block_file_sync_block (bs, bs->root_block);
+		block_file_sync_block_locked (bs, bs->root_block);
 	}
 
 	CAMEL_BLOCK_FILE_UNLOCK (bs, cache_lock);
@@ -733,11 +1040,16 @@ sync_block_nolock (CamelBlockFile *bs,
 	d (printf ("Sync block %08x: %s\n", bl->id, (bl->flags & CAMEL_BLOCK_DIRTY)?"dirty":"clean"));
 
 	if (bl->flags & CAMEL_BLOCK_DIRTY) {
-		if (lseek (bs->fd, bl->id, SEEK_SET) == -1
-		    || write (bs->fd, bl->data, CAMEL_BLOCK_SIZE) != CAMEL_BLOCK_SIZE) {
+		gint mapped = block_file_map_write (bs, bl);
+
+		if (mapped == -1
+		    || (mapped == 0
+		    && (lseek (bs->fd, bl->id, SEEK_SET) == -1
+		    || write (bs->fd, bl->data, CAMEL_BLOCK_SIZE) != CAMEL_BLOCK_SIZE))) {
 			return -1;
 		}
 		bl->flags &= ~CAMEL_BLOCK_DIRTY;
+		bs->priv->writes++;
 	}
 
 	return 0;
@@ -761,17 +1073,43 @@ sync_nolock (CamelBlockFile *bs)
 		}
 	}
 
+	/* blocks written out when they expired from the cache are
+	 * still waiting for their msync () */
 	if (!work
 	    && (bs->root_block->flags & CAMEL_BLOCK_DIRTY) == 0
 	    && (bs->root->flags & CAMEL_BLOCK_FILE_SYNC) != 0)
-		return 0;
+		return block_file_map_sync (bs);
 
 	d (printf ("turning on sync flag\n"));
 
 	bs->root->flags |= CAMEL_BLOCK_FILE_SYNC;
 	bs->root_block->flags |= CAMEL_BLOCK_DIRTY;
 
-	return sync_block_nolock (bs, bs->root_block);
+	if (sync_block_nolock (bs, bs->root_block) == -1)
+		return -1;
+
+	bs->priv->syncs++;
+
+	return block_file_map_sync (bs);
+}
+
+/* Writes out one block.  Call with cache_lock held, which guards the
+ * block's flags and the statistics. */
+static gint
+block_file_sync_block_locked (CamelBlockFile *bs,
+                              CamelBlock *bl)
+{
+	gint ret;
+
+	/* LOCK io_lock */
+	if (block_file_use (bs) == -1)
+		return -1;
+
+	ret = sync_block_nolock (bs, bl);
+
+	block_file_unuse (bs);
+
+	return ret;
 }
 
 /**
@@ -793,13 +1131,9 @@ camel_block_file_sync_block (CamelBlockFile *bs,
 	g_return_val_if_fail (CAMEL_IS_BLOCK_FILE (bs), -1);
 	g_return_val_if_fail (bl != NULL, -1);
 
-	/* LOCK io_lock */
-	if (block_file_use (bs) == -1)
-		return -1;
-
-	ret = sync_block_nolock (bs, bl);
-
-	block_file_unuse (bs);
+	CAMEL_BLOCK_FILE_LOCK (bs, cache_lock);
+	ret = block_file_sync_block_locked (bs, bl);
+	CAMEL_BLOCK_FILE_UNLOCK (bs, cache_lock);
 
 	return ret;
 }
@@ -836,6 +1170,43 @@ camel_block_file_sync (CamelBlockFile *bs)
 	return ret;
 }
 
+/**
+ * camel_block_file_get_stats:
+ * @bs: a #CamelBlockFile
+ * @hits: (out) (allow-none): blocks found in the block cache
+ * @misses: (out) (allow-none): blocks read from the file
+ * @writes: (out) (allow-none): dirty blocks written back to the file
+ * @syncs: (out) (allow-none): syncs which had dirty blocks to write
+ *
+ * Reports how well the block cache of @bs is doing.  The same numbers
+ * are printed when @bs is finalized and CAMEL_DEBUG includes
+ * "block-file".
+ *
+ * Since: 3.10
+ **/
+void
+camel_block_file_get_stats (CamelBlockFile *bs,
+                            guint *hits,
+                            guint *misses,
+                            guint *writes,
+                            guint *syncs)
+{
+	g_return_if_fail (CAMEL_IS_BLOCK_FILE (bs));
+
+	CAMEL_BLOCK_FILE_LOCK (bs, cache_lock);
+
+	if (hits)
+		*hits = bs->priv->hits;
+	if (misses)
+		*misses = bs->priv->misses;
+	if (writes)
+		*writes = bs->priv->writes;
+	if (syncs)
+		*syncs = bs->priv->syncs;
+
+	CAMEL_BLOCK_FILE_UNLOCK (bs, cache_lock);
+}
+
 /* ********************************************************************** */
 
 struct _CamelKeyFilePrivate {
@@ -1250,3 +1621,207 @@ fail:
 
 	return ret;
 }
+
+/* Packed records are stored as the difference to the previous record,
+ * seven bits per byte, least significant bits first. */
+#define KEY_FILE_PACKED_MAX (1024)
+
+static guchar *
+key_file_encode_uint (guchar *out,
+                      guint32 value)
+{
+	while (value >= 0x80) {
+		*out++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*out++ = value;
+
+	return out;
+}
+
+static const guchar *
+key_file_decode_uint (const guchar *in,
+                      const guchar *end,
+                      guint32 *value)
+{
+	guint32 v = 0;
+	gint shift = 0;
+
+	while (in < end && shift < 32) {
+		v |= (guint32) (*in & 0x7f) << shift;
+		if ((*in++ & 0x80) == 0) {
+			*value = v;
+			return in;
+		}
+		shift += 7;
+	}
+
+	return NULL;
+}
+
+/**
+ * camel_key_file_write_packed:
+ * @kf: a #CamelKeyFile
+ * @parent: the record pointer of the previous block, set to the new one
+ * @len: number of records, at most 1024
+ * @records: the records, sorted in ascending order
+ *
+ * Like camel_key_file_write(), but stores the records delta encoded, so
+ * that close keys take one or two bytes each instead of four.  The block
+ * can only be read back with camel_key_file_read_packed().
+ *
+ * Returns: -1 on io error.  The key file will remain unchanged.
+ *
+ * Since: 3.10
+ **/
+gint
+camel_key_file_write_packed (CamelKeyFile *kf,
+                             camel_block_t *parent,
+                             gsize len,
+                             const camel_key_t *records)
+{
+	camel_block_t next;
+	guint32 size, bytes;
+	guchar *buffer, *out;
+	camel_key_t last = 0;
+	gsize ii;
+	gint ret = -1;
+
+	g_return_val_if_fail (CAMEL_IS_KEY_FILE (kf), -1);
+	g_return_val_if_fail (parent != NULL, -1);
+	g_return_val_if_fail (records != NULL, -1);
+	g_return_val_if_fail (len <= KEY_FILE_PACKED_MAX, -1);
+
+	if (len == 0)
+		return 0;
+
+	buffer = g_malloc (len * 5);
+	out = buffer;
+	for (ii = 0; ii < len; ii++) {
+		g_warn_if_fail (ii == 0 || records[ii] > last);
+		out = key_file_encode_uint (out, records[ii] - last);
+		last = records[ii];
+	}
+
+	size = len;
+	bytes = out - buffer;
+
+	/* LOCK */
+	if (key_file_use (kf) == -1) {
+		g_free (buffer);
+		return -1;
+	}
+
+	next = kf->last;
+	fseek (kf->fp, kf->last, SEEK_SET);
+	fwrite (parent, sizeof (*parent), 1, kf->fp);
+	fwrite (&size, sizeof (size), 1, kf->fp);
+	fwrite (&bytes, sizeof (bytes), 1, kf->fp);
+	fwrite (buffer, 1, bytes, kf->fp);
+
+	if (ferror (kf->fp)) {
+		clearerr (kf->fp);
+	} else {
+		kf->last = ftell (kf->fp);
+		*parent = next;
+		ret = len;
+	}
+
+	/* UNLOCK */
+	key_file_unuse (kf);
+
+	g_free (buffer);
+
+	return ret;
+}
+
+/**
+ * camel_key_file_read_packed:
+ * @kf: a #CamelKeyFile
+ * @start: the record pointer, set to the next record pointer on success
+ * @len: number of records read, if != NULL
+ * @records: records, allocated, must be freed with g_free, if != NULL
+ *
+ * Reads a block written by camel_key_file_write_packed().  The records
+ * are returned in ascending order.
+ *
+ * Returns: -1 on io error or if the block is corrupt.
+ *
+ * Since: 3.10
+ **/
+gint
+camel_key_file_read_packed (CamelKeyFile *kf,
+                            camel_block_t *start,
+                            gsize *len,
+                            camel_key_t **records)
+{
+	guint32 size, bytes;
+	glong pos;
+	camel_block_t next;
+	guchar *buffer = NULL;
+	gint ret = -1;
+
+	g_return_val_if_fail (CAMEL_IS_KEY_FILE (kf), -1);
+	g_return_val_if_fail (start != NULL, -1);
+
+	pos = *start;
+	if (pos == 0)
+		return 0;
+
+	/* LOCK */
+	if (key_file_use (kf) == -1)
+		return -1;
+
+	if (fseek (kf->fp, pos, SEEK_SET) == -1
+	    || fread (&next, sizeof (next), 1, kf->fp) != 1
+	    || fread (&size, sizeof (size), 1, kf->fp) != 1
+	    || fread (&bytes, sizeof (bytes), 1, kf->fp) != 1
+	    || size > KEY_FILE_PACKED_MAX
+	    || bytes > size * 5) {
+		clearerr (kf->fp);
+		goto fail;
+	}
+
+	if (records) {
+		buffer = g_malloc (bytes);
+		if (fread (buffer, 1, bytes, kf->fp) != bytes) {
+			clearerr (kf->fp);
+			goto fail;
+		}
+	}
+
+	ret = 0;
+fail:
+	/* UNLOCK */
+	key_file_unuse (kf);
+
+	if (ret == 0 && records) {
+		camel_key_t *keys = g_malloc (size * sizeof (camel_key_t));
+		const guchar *in = buffer, *end = buffer + bytes;
+		camel_key_t last = 0;
+		guint32 ii, delta;
+
+		for (ii = 0; ii < size && in != NULL; ii++) {
+			in = key_file_decode_uint (in, end, &delta);
+			last += delta;
+			keys[ii] = last;
+		}
+
+		if (in == NULL) {
+			g_free (keys);
+			ret = -1;
+		} else {
+			*records = keys;
+		}
+	}
+
+	g_free (buffer);
+
+	if (ret == 0) {
+		if (len)
+			*len = size;
+		*start = next;
+	}
+
+	return ret;
+}
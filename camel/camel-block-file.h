@@ -162,6 +162,11 @@ void		camel_block_file_unref_block	(CamelBlockFile *bs,
 gint		camel_block_file_sync_block	(CamelBlockFile *bs,
 						 CamelBlock *bl);
 gint		camel_block_file_sync		(CamelBlockFile *bs);
+void		camel_block_file_get_stats	(CamelBlockFile *bs,
+						 guint *hits,
+						 guint *misses,
+						 guint *writes,
+						 guint *syncs);
 
 /* ********************************************************************** */
 
@@ -191,6 +196,8 @@ gint	       camel_key_file_delete (CamelKeyFile *kf);
 
 gint            camel_key_file_write (CamelKeyFile *kf, camel_block_t *parent, gsize len, camel_key_t *records);
 gint            camel_key_file_read (CamelKeyFile *kf, camel_block_t *start, gsize *len, camel_key_t **records);
+gint            camel_key_file_write_packed (CamelKeyFile *kf, camel_block_t *parent, gsize len, const camel_key_t *records);
+gint            camel_key_file_read_packed (CamelKeyFile *kf, camel_block_t *start, gsize *len, camel_key_t **records);
 
 G_END_DECLS
 
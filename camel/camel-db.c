@@ -41,6 +41,19 @@
 /* how long to wait before invoking sync on the file */
 #define SYNC_TIMEOUT_SECONDS 5
 
+/* how many prepared statements to keep per connection; each folder
+ * uses a handful of them, the cache is emptied when it fills up */
+#define STMT_CACHE_SIZE 64
+
+/* when the database is locked by another connection, wait between
+ * BUSY_WAIT_MIN_USEC and BUSY_WAIT_MAX_USEC, doubling each time, and
+ * give up after BUSY_MAX_RETRIES waits or BUSY_MAX_USEC in total
+ * (about ten seconds either way) */
+#define BUSY_WAIT_MIN_USEC 1000
+#define BUSY_WAIT_MAX_USEC (100 * 1000)
+#define BUSY_MAX_RETRIES 110
+#define BUSY_MAX_USEC (10 * G_USEC_PER_SEC)
+
 #define READER_LOCK(cdb) g_rw_lock_reader_lock (&cdb->priv->rwlock)
 #define READER_UNLOCK(cdb) g_rw_lock_reader_unlock (&cdb->priv->rwlock)
 #define WRITER_LOCK(cdb) g_rw_lock_writer_lock (&cdb->priv->rwlock)
@@ -206,6 +219,32 @@ def_subclassed (xFileControl, (sqlite3_file *pFile, gint op, gpointer pArg), (cF
 def_subclassed (xSectorSize, (sqlite3_file *pFile), (cFile->old_vfs_file))
 def_subclassed (xDeviceCharacteristics, (sqlite3_file *pFile), (cFile->old_vfs_file))
 
+/* shared memory methods, which WAL mode needs */
+#if SQLITE_VERSION_NUMBER >= 3007000
+def_subclassed (xShmMap, (sqlite3_file *pFile, gint iPg, gint pgsz, gint bExtend, void volatile **pp), (cFile->old_vfs_file, iPg, pgsz, bExtend, pp))
+def_subclassed (xShmLock, (sqlite3_file *pFile, gint offset, gint n, gint flags), (cFile->old_vfs_file, offset, n, flags))
+def_subclassed (xShmUnmap, (sqlite3_file *pFile, gint deleteFlag), (cFile->old_vfs_file, deleteFlag))
+
+static void
+camel_sqlite3_file_xShmBarrier (sqlite3_file *pFile)
+{
+	CamelSqlite3File *cFile;
+
+	g_return_if_fail (old_vfs != NULL);
+	g_return_if_fail (pFile != NULL);
+
+	cFile = (CamelSqlite3File *) pFile;
+	g_return_if_fail (cFile->old_vfs_file->pMethods != NULL);
+
+	cFile->old_vfs_file->pMethods->xShmBarrier (cFile->old_vfs_file);
+}
+#endif
+
+#if SQLITE_VERSION_NUMBER >= 3007017
+def_subclassed (xFetch, (sqlite3_file *pFile, sqlite3_int64 iOfst, gint iAmt, gpointer *pp), (cFile->old_vfs_file, iOfst, iAmt, pp))
+def_subclassed (xUnfetch, (sqlite3_file *pFile, sqlite3_int64 iOfst, gpointer p), (cFile->old_vfs_file, iOfst, p))
+#endif
+
 #undef def_subclassed
 
 static gint
@@ -328,8 +367,17 @@ camel_sqlite3_vfs_xOpen (sqlite3_vfs *pVfs,
 	/* cFile->old_vfs_file->pMethods is NULL when open failed for some reason,
 	 * thus do not initialize our structure when do not know the version */
 	if (io_methods.xClose == NULL && cFile->old_vfs_file->pMethods) {
-		/* initialize our subclass function only once */
+		/* initialize our subclass function only once; never claim
+		 * a version whose methods we don't pass through, sqlite
+		 * would call them through NULL pointers */
 		io_methods.iVersion = cFile->old_vfs_file->pMethods->iVersion;
+		#if SQLITE_VERSION_NUMBER >= 3007017
+		io_methods.iVersion = MIN (io_methods.iVersion, 3);
+		#elif SQLITE_VERSION_NUMBER >= 3007000
+		io_methods.iVersion = MIN (io_methods.iVersion, 2);
+		#else
+		io_methods.iVersion = MIN (io_methods.iVersion, 1);
+		#endif
 
 		/* check version in compile time */
 		#if SQLITE_VERSION_NUMBER < 3006000
@@ -350,6 +398,20 @@ camel_sqlite3_vfs_xOpen (sqlite3_vfs *pVfs,
 		use_subclassed (xFileControl);
 		use_subclassed (xSectorSize);
 		use_subclassed (xDeviceCharacteristics);
+		#if SQLITE_VERSION_NUMBER >= 3007000
+		if (io_methods.iVersion >= 2) {
+			use_subclassed (xShmMap);
+			use_subclassed (xShmLock);
+			use_subclassed (xShmBarrier);
+			use_subclassed (xShmUnmap);
+		}
+		#endif
+		#if SQLITE_VERSION_NUMBER >= 3007017
+		if (io_methods.iVersion >= 3) {
+			use_subclassed (xFetch);
+			use_subclassed (xUnfetch);
+		}
+		#endif
 		#undef use_subclassed
 	}
 
@@ -424,18 +486,94 @@ struct _CamelDBPrivate {
 	GRWLock rwlock;
 	gchar *file_name;
 	gboolean transaction_is_on;
+
+	/* SQL text -> idle sqlite3_stmt, the SQL includes the table
+	 * name.  Readers share the rwlock, hence the extra mutex. */
+	GHashTable *stmt_cache;
+	GMutex stmt_lock;
+
+	/* waits for other connections' locks, under busy_lock */
+	GMutex busy_lock;
+	guint busy_waits;
+	guint64 busy_wait_time;
+
+	/* folder names with a body index, under the writer lock */
+	GHashTable *body_index_folders;
 };
 
+/* Sleeps before retrying an operation on a locked database,
+ * longer with each attempt, and counts the time spent */
+static void
+cdb_busy_wait (CamelDB *cdb,
+               gint attempt)
+{
+	gulong delay;
+
+	delay = BUSY_WAIT_MIN_USEC << MIN (attempt, 7);
+	delay = MIN (delay, BUSY_WAIT_MAX_USEC);
+
+	g_usleep (delay);
+
+	g_mutex_lock (&cdb->priv->busy_lock);
+	cdb->priv->busy_waits++;
+	cdb->priv->busy_wait_time += delay;
+	g_mutex_unlock (&cdb->priv->busy_lock);
+}
+
+/* Called by sqlite when the database is locked by another connection,
+ * like the other one of a store's reader and writer */
+static gint
+cdb_busy_handler (gpointer user_data,
+                  gint n_calls)
+{
+	CamelDB *cdb = user_data;
+
+	if (n_calls >= BUSY_MAX_RETRIES) {
+		d (g_print ("Giving up waiting for a locked database after %d tries\n", n_calls));
+		return 0;
+	}
+
+	cdb_busy_wait (cdb, n_calls);
+
+	return 1;
+}
+
+/* Whether to retry a statement which failed with 'ret' because the
+ * database was locked, after waiting for it.  SQLITE_BUSY can come
+ * without the busy handler being called (to avoid a deadlock), and
+ * there is no handler for SQLITE_LOCKED (shared cache), so this waits
+ * for both; 'started' is the monotonic time of the first attempt. */
+static gboolean
+cdb_busy_retry (CamelDB *cdb,
+                gint ret,
+                gint *attempt,
+                gint64 started)
+{
+	if (ret != SQLITE_BUSY && ret != SQLITE_LOCKED)
+		return FALSE;
+
+	if (*attempt >= BUSY_MAX_RETRIES ||
+	    g_get_monotonic_time () - started >= BUSY_MAX_USEC) {
+		d (g_print ("Giving up retrying on a locked database after %d tries\n", *attempt));
+		return FALSE;
+	}
+
+	cdb_busy_wait (cdb, *attempt);
+	(*attempt)++;
+
+	return TRUE;
+}
+
 /**
  * cdb_sql_exec 
- * @db: 
+ * @cdb: 
  * @stmt: 
  * @error: 
  * 
  * Callers should hold the lock
  **/
 static gint
-cdb_sql_exec (sqlite3 *db,
+cdb_sql_exec (CamelDB *cdb,
               const gchar *stmt,
               gint (*callback)(gpointer ,gint,gchar **,gchar **),
               gpointer data,
@@ -443,23 +581,29 @@ cdb_sql_exec (sqlite3 *db,
 {
 	gchar *errmsg = NULL;
 	gint   ret = -1;
+	gint   attempt = 0;
+	gint64 started;
 
 	d (g_print ("Camel SQL Exec:\n%s\n", stmt));
 
-	ret = sqlite3_exec (db, stmt, callback, data, &errmsg);
-	while (ret == SQLITE_BUSY || ret == SQLITE_LOCKED || ret == -1) {
+	started = g_get_monotonic_time ();
+
+	ret = sqlite3_exec (cdb->db, stmt, callback, data, &errmsg);
+	while (cdb_busy_retry (cdb, ret, &attempt, started)) {
 		if (errmsg) {
 			sqlite3_free (errmsg);
 			errmsg = NULL;
 		}
-		ret = sqlite3_exec (db, stmt, NULL, NULL, &errmsg);
+
+		ret = sqlite3_exec (cdb->db, stmt, callback, data, &errmsg);
 	}
 
 	if (ret != SQLITE_OK) {
 		d (g_print ("Error in SQL EXEC statement: %s [%s].\n", stmt, errmsg));
 		g_set_error (
 			error, CAMEL_ERROR,
-			CAMEL_ERROR_GENERIC, "%s", errmsg);
+			CAMEL_ERROR_GENERIC, "%s",
+			errmsg ? errmsg : sqlite3_errmsg (cdb->db));
 		sqlite3_free (errmsg);
 		errmsg = NULL;
 		return -1;
@@ -473,6 +617,206 @@ cdb_sql_exec (sqlite3 *db,
 	return 0;
 }
 
+/* Takes the prepared statement for 'sql' out of the cache, or
+ * prepares it if there is none; it goes back with cdb_stmt_run().
+ * Taking it out lets several threads, or a select callback, run
+ * the same SQL at once without any lock held while stepping. */
+static sqlite3_stmt *
+cdb_stmt_take (CamelDB *cdb,
+               const gchar *sql,
+               GError **error)
+{
+	sqlite3_stmt *stmt = NULL;
+	gpointer key, value;
+	gint ret, attempt = 0;
+	gint64 started;
+
+	g_mutex_lock (&cdb->priv->stmt_lock);
+	if (g_hash_table_lookup_extended (cdb->priv->stmt_cache, sql, &key, &value)) {
+		g_hash_table_steal (cdb->priv->stmt_cache, sql);
+		g_free (key);
+		stmt = value;
+	}
+	g_mutex_unlock (&cdb->priv->stmt_lock);
+
+	if (stmt)
+		return stmt;
+
+	d (g_print ("Camel SQL Prepare:\n%s\n", sql));
+
+	started = g_get_monotonic_time ();
+
+	do {
+		ret = sqlite3_prepare_v2 (cdb->db, sql, -1, &stmt, NULL);
+	} while (cdb_busy_retry (cdb, ret, &attempt, started));
+
+	if (ret != SQLITE_OK) {
+		d (g_print ("Error in SQL PREPARE statement: %s [%s].\n", sql, sqlite3_errmsg (cdb->db)));
+		g_set_error (
+			error, CAMEL_ERROR,
+			CAMEL_ERROR_GENERIC, "%s", sqlite3_errmsg (cdb->db));
+		sqlite3_finalize (stmt);
+		return NULL;
+	}
+
+	return stmt;
+}
+
+static void
+cdb_stmt_release (CamelDB *cdb,
+                  sqlite3_stmt *stmt)
+{
+	const gchar *sql = sqlite3_sql (stmt);
+
+	sqlite3_reset (stmt);
+	sqlite3_clear_bindings (stmt);
+
+	g_mutex_lock (&cdb->priv->stmt_lock);
+
+	if (g_hash_table_lookup (cdb->priv->stmt_cache, sql)) {
+		/* somebody else put back one for the same SQL */
+		sqlite3_finalize (stmt);
+	} else {
+		if (g_hash_table_size (cdb->priv->stmt_cache) >= STMT_CACHE_SIZE)
+			g_hash_table_remove_all (cdb->priv->stmt_cache);
+
+		g_hash_table_insert (cdb->priv->stmt_cache, g_strdup (sql), stmt);
+	}
+
+	g_mutex_unlock (&cdb->priv->stmt_lock);
+}
+
+/* Steps 'stmt' to completion, passing each row to 'callback' the
+ * way sqlite3_exec() does, then returns it to the cache.
+ * Callers should hold the lock */
+static gint
+cdb_stmt_run (CamelDB *cdb,
+              sqlite3_stmt *stmt,
+              CamelDBSelectCB callback,
+              gpointer data,
+              GError **error)
+{
+	gchar **cols = NULL, **names = NULL;
+	gint ncol = 0, ii, ret;
+	gint attempt = 0;
+	gboolean had_rows = FALSE;
+	gint64 started;
+
+	if (callback) {
+		ncol = sqlite3_column_count (stmt);
+		cols = g_new0 (gchar *, ncol);
+		names = g_new0 (gchar *, ncol);
+
+		for (ii = 0; ii < ncol; ii++)
+			names[ii] = (gchar *) sqlite3_column_name (stmt, ii);
+	}
+
+	started = g_get_monotonic_time ();
+
+	while (TRUE) {
+		ret = sqlite3_step (stmt);
+
+		if (ret == SQLITE_ROW) {
+			had_rows = TRUE;
+
+			if (!callback)
+				continue;
+
+			for (ii = 0; ii < ncol; ii++)
+				cols[ii] = (gchar *) sqlite3_column_text (stmt, ii);
+
+			if (callback (data, ncol, cols, names) != 0) {
+				ret = SQLITE_ABORT;
+				break;
+			}
+		} else if (!had_rows && cdb_busy_retry (cdb, ret, &attempt, started)) {
+			/* Restarting after some rows were passed on
+			 * would pass them again, so only retry until
+			 * the first one. */
+			sqlite3_reset (stmt);
+		} else {
+			break;
+		}
+	}
+
+	g_free (cols);
+	g_free (names);
+
+	if (ret == SQLITE_ABORT) {
+		g_set_error (
+			error, CAMEL_ERROR,
+			CAMEL_ERROR_GENERIC, "%s",
+			"callback requested query abort");
+	} else if (ret != SQLITE_DONE) {
+		d (g_print ("Error in SQL STEP statement: %s [%s].\n", sqlite3_sql (stmt), sqlite3_errmsg (cdb->db)));
+		g_set_error (
+			error, CAMEL_ERROR,
+			CAMEL_ERROR_GENERIC, "%s", sqlite3_errmsg (cdb->db));
+
+		/* Don't keep a statement around which may be stale,
+		 * like one for a table which was dropped meanwhile. */
+		sqlite3_finalize (stmt);
+		return -1;
+	}
+
+	cdb_stmt_release (cdb, stmt);
+
+	return ret == SQLITE_DONE ? 0 : -1;
+}
+
+static void
+cdb_stmt_bind_text (sqlite3_stmt *stmt,
+                    gint index,
+                    const gchar *value)
+{
+	/* same as what %Q does for NULL */
+	if (value)
+		sqlite3_bind_text (stmt, index, value, -1, SQLITE_STATIC);
+	else
+		sqlite3_bind_null (stmt, index);
+}
+
+static void
+cdb_stmt_cache_clear (CamelDB *cdb)
+{
+	g_mutex_lock (&cdb->priv->stmt_lock);
+	g_hash_table_remove_all (cdb->priv->stmt_cache);
+	g_mutex_unlock (&cdb->priv->stmt_lock);
+}
+
+/* Like camel_db_select(), with a cached statement, and with 'param',
+ * if not NULL, bound to its first parameter */
+static gint
+cdb_select_cached (CamelDB *cdb,
+                   const gchar *sql,
+                   const gchar *param,
+                   CamelDBSelectCB callback,
+                   gpointer data,
+                   GError **error)
+{
+	sqlite3_stmt *stmt;
+	gint ret = -1;
+
+	if (!cdb)
+		return ret;
+
+	READER_LOCK (cdb);
+
+	START (sql);
+	stmt = cdb_stmt_take (cdb, sql, error);
+	if (stmt) {
+		if (param)
+			cdb_stmt_bind_text (stmt, 1, param);
+		ret = cdb_stmt_run (cdb, stmt, callback, data, error);
+	}
+	END;
+
+	READER_UNLOCK (cdb);
+	CAMEL_DB_RELEASE_SQLITE_MEMORY;
+
+	return ret;
+}
+
 /* checks whether string 'where' contains whole word 'what',
  * case insensitively (ascii, not utf8, same as 'LIKE' in SQLite3)
 */
@@ -560,6 +904,15 @@ camel_db_open (const gchar *path,
 	cdb->priv->file_name = g_strdup (path);
 	g_rw_lock_init (&cdb->priv->rwlock);
 	cdb->priv->timer = NULL;
+	cdb->priv->stmt_cache = g_hash_table_new_full (
+		g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify) sqlite3_finalize);
+	g_mutex_init (&cdb->priv->stmt_lock);
+	g_mutex_init (&cdb->priv->busy_lock);
+	cdb->priv->busy_waits = 0;
+	cdb->priv->busy_wait_time = 0;
+	cdb->priv->body_index_folders = g_hash_table_new_full (
+		g_str_hash, g_str_equal, g_free, NULL);
 	d (g_print ("\nDatabase succesfully opened  \n"));
 
 	sqlite3_create_function (db, "MATCH", 2, SQLITE_UTF8, NULL, cdb_match_func, NULL, NULL);
@@ -579,9 +932,16 @@ camel_db_open (const gchar *path,
 		/* Optionally turn off Journaling, this gets over fsync issues, but could be risky */
 		camel_db_command (cdb, "PRAGMA main.journal_mode = off", NULL);
 		camel_db_command (cdb, "PRAGMA temp_store = memory", NULL);
+	} else {
+		/* With a write-ahead log readers don't block the writer
+		 * and the writer doesn't block readers, which lets the
+		 * store use separate connections for each.  The mode is
+		 * persistent; sqlite keeps the old one where WAL can't
+		 * work, like on some network file systems. */
+		camel_db_command (cdb, "PRAGMA main.journal_mode = WAL", NULL);
 	}
 
-	sqlite3_busy_timeout (cdb->db, CAMEL_DB_SLEEP_INTERVAL);
+	sqlite3_busy_handler (cdb->db, cdb_busy_handler, cdb);
 
 	return cdb;
 }
@@ -607,6 +967,11 @@ void
 camel_db_close (CamelDB *cdb)
 {
 	if (cdb) {
+		/* statements must be finalized before the close */
+		g_hash_table_destroy (cdb->priv->stmt_cache);
+		g_hash_table_destroy (cdb->priv->body_index_folders);
+		g_mutex_clear (&cdb->priv->stmt_lock);
+		g_mutex_clear (&cdb->priv->busy_lock);
 		sqlite3_close (cdb->db);
 		g_rw_lock_clear (&cdb->priv->rwlock);
 		g_free (cdb->priv->file_name);
@@ -641,6 +1006,37 @@ camel_db_set_collate (CamelDB *cdb,
 		return ret;
 }
 
+/**
+ * camel_db_get_busy_stats:
+ * @cdb: a #CamelDB
+ * @out_n_waits: (out) (allow-none): return location for the number of
+ *               waits, or %NULL
+ * @out_wait_time: (out) (allow-none): return location for the total time
+ *                 spent waiting, in microseconds, or %NULL
+ *
+ * Returns how often, and for how long in total, operations on @cdb
+ * had to wait for the database to be unlocked by another connection.
+ *
+ * Since: 3.10
+ **/
+void
+camel_db_get_busy_stats (CamelDB *cdb,
+                         guint *out_n_waits,
+                         guint64 *out_wait_time)
+{
+	g_return_if_fail (cdb != NULL);
+
+	g_mutex_lock (&cdb->priv->busy_lock);
+
+	if (out_n_waits)
+		*out_n_waits = cdb->priv->busy_waits;
+
+	if (out_wait_time)
+		*out_wait_time = cdb->priv->busy_wait_time;
+
+	g_mutex_unlock (&cdb->priv->busy_lock);
+}
+
 /**
  * camel_db_command:
  *
@@ -659,7 +1055,7 @@ camel_db_command (CamelDB *cdb,
 	WRITER_LOCK (cdb);
 
 	START (stmt);
-	ret = cdb_sql_exec (cdb->db, stmt, NULL, NULL, error);
+	ret = cdb_sql_exec (cdb, stmt, NULL, NULL, error);
 	END;
 
 	WRITER_UNLOCK (cdb);
@@ -684,7 +1080,7 @@ camel_db_begin_transaction (CamelDB *cdb,
 
 	cdb->priv->transaction_is_on = TRUE;
 
-	return (cdb_sql_exec (cdb->db, "BEGIN", NULL, NULL, error));
+	return (cdb_sql_exec (cdb, "BEGIN", NULL, NULL, error));
 }
 
 /**
@@ -700,7 +1096,7 @@ camel_db_end_transaction (CamelDB *cdb,
 	if (!cdb)
 		return -1;
 
-	ret = cdb_sql_exec (cdb->db, "COMMIT", NULL, NULL, error);
+	ret = cdb_sql_exec (cdb, "COMMIT", NULL, NULL, error);
 	cdb->priv->transaction_is_on = FALSE;
 
 	ENDTS;
@@ -721,9 +1117,12 @@ camel_db_abort_transaction (CamelDB *cdb,
 {
 	gint ret;
 
-	ret = cdb_sql_exec (cdb->db, "ROLLBACK", NULL, NULL, error);
+	ret = cdb_sql_exec (cdb, "ROLLBACK", NULL, NULL, error);
 	cdb->priv->transaction_is_on = FALSE;
 
+	/* body index tables created in the transaction are gone */
+	g_hash_table_remove_all (cdb->priv->body_index_folders);
+
 	WRITER_UNLOCK (cdb);
 	CAMEL_DB_RELEASE_SQLITE_MEMORY;
 
@@ -745,7 +1144,7 @@ camel_db_add_to_transaction (CamelDB *cdb,
 
 	g_assert (cdb->priv->transaction_is_on == TRUE);
 
-	return (cdb_sql_exec (cdb->db, stmt, NULL, NULL, error));
+	return (cdb_sql_exec (cdb, stmt, NULL, NULL, error));
 }
 
 /**
@@ -767,19 +1166,19 @@ camel_db_transaction_command (CamelDB *cdb,
 	WRITER_LOCK (cdb);
 
 	STARTTS ("BEGIN");
-	ret = cdb_sql_exec (cdb->db, "BEGIN", NULL, NULL, error);
+	ret = cdb_sql_exec (cdb, "BEGIN", NULL, NULL, error);
 	if (ret)
 		goto end;
 
 	while (qry_list) {
 		query = qry_list->data;
-		ret = cdb_sql_exec (cdb->db, query, NULL, NULL, error);
+		ret = cdb_sql_exec (cdb, query, NULL, NULL, error);
 		if (ret)
 			goto end;
 		qry_list = g_list_next (qry_list);
 	}
 
-	ret = cdb_sql_exec (cdb->db, "COMMIT", NULL, NULL, error);
+	ret = cdb_sql_exec (cdb, "COMMIT", NULL, NULL, error);
 	ENDTS;
 end:
 	WRITER_UNLOCK (cdb);
@@ -803,6 +1202,27 @@ count_cb (gpointer data,
 	return 0;
 }
 
+static gint
+cdb_count_cached (CamelDB *cdb,
+                  const gchar *table_name,
+                  const gchar *where,
+                  guint32 *count,
+                  GError **error)
+{
+	gint ret;
+	gchar *query;
+
+	if (!cdb)
+		return -1;
+
+	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q WHERE %s", table_name, where);
+
+	ret = cdb_select_cached (cdb, query, NULL, count_cb, count, error);
+	sqlite3_free (query);
+
+	return ret;
+}
+
 /**
  * camel_db_count_message_info:
  *
@@ -819,7 +1239,7 @@ camel_db_count_message_info (CamelDB *cdb,
 	READER_LOCK (cdb);
 
 	START (query);
-	ret = cdb_sql_exec (cdb->db, query, count_cb, count, error);
+	ret = cdb_sql_exec (cdb, query, count_cb, count, error);
 	END;
 
 	READER_UNLOCK (cdb);
@@ -840,18 +1260,8 @@ camel_db_count_junk_message_info (CamelDB *cdb,
                                   guint32 *count,
                                   GError **error)
 {
-	gint ret;
-	gchar *query;
-
-	if (!cdb)
-		return -1;
-
-	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q WHERE junk = 1", table_name);
-
-	ret = camel_db_count_message_info (cdb, query, count, error);
-	sqlite3_free (query);
-
-	return ret;
+	return cdb_count_cached (
+		cdb, table_name, "junk = 1", count, error);
 }
 
 /**
@@ -865,18 +1275,8 @@ camel_db_count_unread_message_info (CamelDB *cdb,
                                     guint32 *count,
                                     GError **error)
 {
-	gint ret;
-	gchar *query;
-
-	if (!cdb)
-		return -1;
-
-	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q WHERE read = 0", table_name);
-
-	ret = camel_db_count_message_info (cdb, query, count, error);
-	sqlite3_free (query);
-
-	return ret;
+	return cdb_count_cached (
+		cdb, table_name, "read = 0", count, error);
 }
 
 /**
@@ -890,18 +1290,8 @@ camel_db_count_visible_unread_message_info (CamelDB *cdb,
                                             guint32 *count,
                                             GError **error)
 {
-	gint ret;
-	gchar *query;
-
-	if (!cdb)
-		return -1;
-
-	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q WHERE read = 0 AND junk = 0 AND deleted = 0", table_name);
-
-	ret = camel_db_count_message_info (cdb, query, count, error);
-	sqlite3_free (query);
-
-	return ret;
+	return cdb_count_cached (
+		cdb, table_name, "read = 0 AND junk = 0 AND deleted = 0", count, error);
 }
 
 /**
@@ -915,18 +1305,8 @@ camel_db_count_visible_message_info (CamelDB *cdb,
                                      guint32 *count,
                                      GError **error)
 {
-	gint ret;
-	gchar *query;
-
-	if (!cdb)
-		return -1;
-
-	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q WHERE junk = 0 AND deleted = 0", table_name);
-
-	ret = camel_db_count_message_info (cdb, query, count, error);
-	sqlite3_free (query);
-
-	return ret;
+	return cdb_count_cached (
+		cdb, table_name, "junk = 0 AND deleted = 0", count, error);
 }
 
 /**
@@ -940,18 +1320,8 @@ camel_db_count_junk_not_deleted_message_info (CamelDB *cdb,
                                               guint32 *count,
                                               GError **error)
 {
-	gint ret;
-	gchar *query;
-
-	if (!cdb)
-		return -1;
-
-	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q WHERE junk = 1 AND deleted = 0", table_name);
-
-	ret = camel_db_count_message_info (cdb, query, count, error);
-	sqlite3_free (query);
-
-	return ret;
+	return cdb_count_cached (
+		cdb, table_name, "junk = 1 AND deleted = 0", count, error);
 }
 
 /**
@@ -965,18 +1335,8 @@ camel_db_count_deleted_message_info (CamelDB *cdb,
                                      guint32 *count,
                                      GError **error)
 {
-	gint ret;
-	gchar *query;
-
-	if (!cdb)
-		return -1;
-
-	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q WHERE deleted = 1", table_name);
-
-	ret = camel_db_count_message_info (cdb, query, count, error);
-	sqlite3_free (query);
-
-	return ret;
+	return cdb_count_cached (
+		cdb, table_name, "deleted = 1", count, error);
 }
 
 /**
@@ -990,19 +1350,8 @@ camel_db_count_total_message_info (CamelDB *cdb,
                                    guint32 *count,
                                    GError **error)
 {
-
-	gint ret;
-	gchar *query;
-
-	if (!cdb)
-		return -1;
-
-	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q where read=0 or read=1", table_name);
-
-	ret = camel_db_count_message_info (cdb, query, count, error);
-	sqlite3_free (query);
-
-	return ret;
+	return cdb_count_cached (
+		cdb, table_name, "read = 0 OR read = 1", count, error);
 }
 
 /**
@@ -1026,7 +1375,7 @@ camel_db_select (CamelDB *cdb,
 	READER_LOCK (cdb);
 
 	START (stmt);
-	ret = cdb_sql_exec (cdb->db, stmt, callback, data, error);
+	ret = cdb_sql_exec (cdb, stmt, callback, data, error);
 	END;
 
 	READER_UNLOCK (cdb);
@@ -1048,205 +1397,899 @@ read_uids_callback (gpointer ref_array,
 	if (cols[0])
 		g_ptr_array_add (array, (gchar *) (camel_pstring_strdup (cols[0])));
 
-	return 0;
+	return 0;
+}
+
+static gint
+read_uids_to_hash_callback (gpointer ref_hash,
+                            gint ncol,
+                            gchar **cols,
+                            gchar **name)
+{
+	GHashTable *hash = ref_hash;
+
+	g_return_val_if_fail (ncol == 2, 0);
+
+	if (cols[0])
+		g_hash_table_insert (hash, (gchar *) camel_pstring_strdup (cols[0]), GUINT_TO_POINTER (cols[1] ? strtoul (cols[1], NULL, 10) : 0));
+
+	return 0;
+}
+
+/**
+ * camel_db_get_folder_uids:
+ *
+ * Fills hash with uid->GUINT_TO_POINTER (flag)
+ *
+ * Since: 2.24
+ **/
+gint
+camel_db_get_folder_uids (CamelDB *db,
+                          const gchar *folder_name,
+                          const gchar *sort_by,
+                          const gchar *collate,
+                          GHashTable *hash,
+                          GError **error)
+{
+	 gchar *sel_query;
+	 gint ret;
+
+		sel_query = sqlite3_mprintf (
+		"SELECT uid,flags FROM %Q%s%s%s%s",
+		folder_name,
+		sort_by ? " order by " : "",
+		sort_by ? sort_by : "",
+		(sort_by && collate) ? " collate " : "",
+		(sort_by && collate) ? collate : "");
+
+	 ret = camel_db_select (db, sel_query, read_uids_to_hash_callback, hash, error);
+	 sqlite3_free (sel_query);
+
+	 return ret;
+}
+
+static gboolean
+cdb_is_column_name (const gchar *name)
+{
+	const gchar *ptr;
+
+	if (name == NULL || *name == '\0')
+		return FALSE;
+
+	for (ptr = name; *ptr; ptr++) {
+		if (!g_ascii_isalnum (*ptr) && *ptr != '_')
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * camel_db_get_folder_uids_range:
+ * @db: a #CamelDB
+ * @folder_name: full name of the folder
+ * @sort_by: (allow-none): a column to sort by, or %NULL to sort by uid
+ * @collate: (allow-none): a collation to sort with, or %NULL
+ * @ascending: whether to sort in ascending order
+ * @after_uid: (allow-none): the last uid of the previous range, or %NULL
+ *             to start at the beginning
+ * @after_value: (allow-none): the @sort_by value of @after_uid, or %NULL
+ * @limit: the maximum number of uids to return
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns at most @limit uids of @folder_name, ordered by @sort_by and
+ * then by uid, starting right after @after_uid.  Passing the last uid of
+ * one range as @after_uid of the next call walks the folder a window at
+ * a time, like a cursor.  With an index on @sort_by, as there is on the
+ * dates, each window is read from the index without visiting the rows
+ * before it, thus the first screen of a large folder can be shown
+ * without reading all its uids.
+ *
+ * The position of @after_uid in the order is looked up in the folder.
+ * If the message was removed since, @after_value is used instead; when
+ * that is %NULL too, this fails rather than return an empty range.
+ *
+ * Returns: (element-type utf8) (transfer full): a #GPtrArray of uids from
+ * the string pool, or %NULL on error.  Free with g_ptr_array_unref().
+ *
+ * Since: 3.10
+ **/
+GPtrArray *
+camel_db_get_folder_uids_range (CamelDB *db,
+                                const gchar *folder_name,
+                                const gchar *sort_by,
+                                const gchar *collate,
+                                gboolean ascending,
+                                const gchar *after_uid,
+                                const gchar *after_value,
+                                guint limit,
+                                GError **error)
+{
+	GPtrArray *array;
+	sqlite3_stmt *stmt;
+	const gchar *op = ascending ? ">" : "<";
+	const gchar *dir = ascending ? "ASC" : "DESC";
+	gchar *sel_query, *column;
+	gint ret = -1;
+
+	g_return_val_if_fail (folder_name != NULL, NULL);
+	g_return_val_if_fail (sort_by == NULL || cdb_is_column_name (sort_by), NULL);
+	g_return_val_if_fail (collate == NULL || cdb_is_column_name (collate), NULL);
+
+	if (sort_by == NULL || g_strcmp0 (sort_by, "uid") == 0) {
+		sort_by = NULL;
+		column = g_strdup ("uid");
+	} else if (collate != NULL) {
+		column = g_strdup_printf ("%s COLLATE %s", sort_by, collate);
+	} else {
+		column = g_strdup (sort_by);
+	}
+
+	if (after_uid == NULL) {
+		sel_query = sqlite3_mprintf (
+			"SELECT uid FROM %Q ORDER BY %s %s%s%s LIMIT %u",
+			folder_name, column, dir,
+			sort_by ? ", uid " : "",
+			sort_by ? dir : "",
+			limit);
+	} else if (sort_by == NULL) {
+		sel_query = sqlite3_mprintf (
+			"SELECT uid FROM %Q WHERE uid %s ?1 "
+			"ORDER BY uid %s LIMIT %u",
+			folder_name, op, dir, limit);
+	} else {
+		/* ?2 stands in for the value of a removed anchor */
+		sel_query = sqlite3_mprintf (
+			"SELECT uid FROM %Q WHERE "
+			"%s %s COALESCE ((SELECT %s FROM %Q WHERE uid = ?1), ?2) OR "
+			"(%s = COALESCE ((SELECT %s FROM %Q WHERE uid = ?1), ?2) AND uid %s ?1) "
+			"ORDER BY %s %s, uid %s LIMIT %u",
+			folder_name,
+			column, op, sort_by, folder_name,
+			column, sort_by, folder_name, op,
+			column, dir, dir, limit);
+	}
+
+	array = g_ptr_array_new_with_free_func ((GDestroyNotify) camel_pstring_free);
+
+	READER_LOCK (db);
+
+	START (sel_query);
+	stmt = cdb_stmt_take (db, sel_query, error);
+	if (stmt) {
+		if (after_uid)
+			cdb_stmt_bind_text (stmt, 1, after_uid);
+		if (after_uid && sort_by)
+			cdb_stmt_bind_text (stmt, 2, after_value);
+		ret = cdb_stmt_run (db, stmt, read_uids_callback, array, error);
+	}
+	END;
+
+	READER_UNLOCK (db);
+	CAMEL_DB_RELEASE_SQLITE_MEMORY;
+
+	sqlite3_free (sel_query);
+	g_free (column);
+
+	/* Without the anchor's value every comparison is NULL, which
+	 * would look like the end of the folder. */
+	if (ret == 0 && array->len == 0 && after_uid && sort_by && !after_value) {
+		gchar *count_query;
+		guint32 count = 0;
+
+		count_query = sqlite3_mprintf (
+			"SELECT COUNT (*) FROM %Q WHERE uid = ?1", folder_name);
+		ret = cdb_select_cached (db, count_query, after_uid, count_cb, &count, error);
+		sqlite3_free (count_query);
+
+		if (ret == 0 && count == 0) {
+			g_set_error (
+				error, CAMEL_ERROR, CAMEL_ERROR_GENERIC,
+				_("Message '%s' is no longer in folder '%s'"),
+				after_uid, folder_name);
+			ret = -1;
+		}
+	}
+
+	if (ret != 0) {
+		g_ptr_array_unref (array);
+		return NULL;
+	}
+
+	return array;
+}
+
+/**
+ * camel_db_get_folder_uid_columns:
+ * @db: a #CamelDB
+ * @folder_name: full name of the folder
+ * @sort_by: (allow-none): a column to sort by, or %NULL
+ * @collate: (allow-none): a collation to sort with, or %NULL
+ * @callback: function to call for every message
+ * @user_data: data to pass to @callback
+ * @error: return location for a #GError, or %NULL
+ *
+ * Calls @callback for every message of @folder_name with the columns
+ * uid, flags, size, dsent and dreceived, in that order.
+ *
+ * Returns: 0 on success, -1 on error
+ *
+ * Since: 3.10
+ **/
+gint
+camel_db_get_folder_uid_columns (CamelDB *db,
+                                 const gchar *folder_name,
+                                 const gchar *sort_by,
+                                 const gchar *collate,
+                                 CamelDBSelectCB callback,
+                                 gpointer user_data,
+                                 GError **error)
+{
+	gchar *sel_query;
+	gint ret;
+
+	sel_query = sqlite3_mprintf (
+		"SELECT uid, flags, size, dsent, dreceived FROM %Q%s%s%s%s",
+		folder_name,
+		sort_by ? " order by " : "",
+		sort_by ? sort_by : "",
+		(sort_by && collate) ? " collate " : "",
+		(sort_by && collate) ? collate : "");
+
+	ret = camel_db_select (db, sel_query, callback, user_data, error);
+	sqlite3_free (sel_query);
+
+	return ret;
+}
+
+/**
+ * camel_db_get_folder_junk_uids:
+ *
+ * Since: 2.24
+ **/
+GPtrArray *
+camel_db_get_folder_junk_uids (CamelDB *db,
+                               gchar *folder_name,
+                               GError **error)
+{
+	 gchar *sel_query;
+	 gint ret;
+	 GPtrArray *array = g_ptr_array_new ();
+
+	 sel_query = sqlite3_mprintf ("SELECT uid FROM %Q where junk=1", folder_name);
+
+	 ret = camel_db_select (db, sel_query, read_uids_callback, array, error);
+
+	 sqlite3_free (sel_query);
+
+	 if (!array->len || ret != 0) {
+		 g_ptr_array_free (array, TRUE);
+		 array = NULL;
+	 }
+	 return array;
+}
+
+/**
+ * camel_db_get_folder_deleted_uids:
+ *
+ * Since: 2.24
+ **/
+GPtrArray *
+camel_db_get_folder_deleted_uids (CamelDB *db,
+                                  const gchar *folder_name,
+                                  GError **error)
+{
+	 gchar *sel_query;
+	 gint ret;
+	 GPtrArray *array = g_ptr_array_new ();
+
+	 sel_query = sqlite3_mprintf ("SELECT uid FROM %Q where deleted=1", folder_name);
+
+	 ret = camel_db_select (db, sel_query, read_uids_callback, array, error);
+	 sqlite3_free (sel_query);
+
+	 if (!array->len || ret != 0) {
+		 g_ptr_array_free (array, TRUE);
+		 array = NULL;
+	 }
+
+	 return array;
+}
+
+struct ReadPreviewData
+{
+	GHashTable *columns_hash;
+	GHashTable *hash;
+};
+
+static gint
+read_preview_callback (gpointer ref,
+                       gint ncol,
+                       gchar **cols,
+                       gchar **name)
+{
+	struct ReadPreviewData *rpd = ref;
+	const gchar *uid = NULL;
+	gchar *msg = NULL;
+	gint i;
+
+	for (i = 0; i < ncol; ++i) {
+		if (!name[i] || !cols[i])
+			continue;
+
+		switch (camel_db_get_column_ident (&rpd->columns_hash, i, ncol, name)) {
+			case CAMEL_DB_COLUMN_UID:
+				uid = camel_pstring_strdup (cols[i]);
+				break;
+			case CAMEL_DB_COLUMN_PREVIEW:
+				msg = g_strdup (cols[i]);
+				break;
+			default:
+				g_warn_if_reached ();
+				break;
+		}
+	}
+
+	g_hash_table_insert (rpd->hash, (gchar *) uid, msg);
+
+	return 0;
+}
+
+/**
+ * camel_db_get_folder_preview:
+ *
+ * Since: 2.28
+ **/
+GHashTable *
+camel_db_get_folder_preview (CamelDB *db,
+                             const gchar *folder_name,
+                             GError **error)
+{
+	gchar *sel_query;
+	gint ret;
+	struct ReadPreviewData rpd;
+	GHashTable *hash = g_hash_table_new (g_str_hash, g_str_equal);
+
+	sel_query = sqlite3_mprintf ("SELECT uid, preview FROM '%q_preview'", folder_name);
+
+	rpd.columns_hash = NULL;
+	rpd.hash = hash;
+
+	ret = camel_db_select (db, sel_query, read_preview_callback, &rpd, error);
+	sqlite3_free (sel_query);
+
+	if (rpd.columns_hash)
+		g_hash_table_destroy (rpd.columns_hash);
+
+	if (!g_hash_table_size (hash) || ret != 0) {
+		g_hash_table_destroy (hash);
+		hash = NULL;
+	}
+
+	return hash;
+}
+
+/**
+ * camel_db_write_preview_record:
+ *
+ * Since: 2.28
+ **/
+gint
+camel_db_write_preview_record (CamelDB *db,
+                               const gchar *folder_name,
+                               const gchar *uid,
+                               const gchar *msg,
+                               GError **error)
+{
+	gchar *query;
+	gint ret;
+
+	query = sqlite3_mprintf ("INSERT OR REPLACE INTO '%q_preview' VALUES(%Q,%Q)", folder_name, uid, msg);
+
+	ret = camel_db_add_to_transaction (db, query, error);
+	sqlite3_free (query);
+
+	return ret;
+}
+
+/* The body index of a folder is an FTS table of message texts keyed
+ * by docid, with the uid of each docid in a plain table, which makes
+ * the lookups by uid cheap, and an fts4aux table listing the indexed
+ * words.  Callers hold the writer lock. */
+static gboolean
+cdb_body_index_exists (CamelDB *cdb,
+                       const gchar *folder_name)
+{
+	sqlite3_stmt *stmt;
+	gchar *table_name;
+	guint32 count = 0;
+
+	if (g_hash_table_contains (cdb->priv->body_index_folders, folder_name))
+		return TRUE;
+
+	stmt = cdb_stmt_take (
+		cdb,
+		"SELECT COUNT (*) FROM sqlite_master "
+		"WHERE type = 'table' AND name = ?1", NULL);
+	if (stmt == NULL)
+		return FALSE;
+
+	table_name = g_strdup_printf ("%s_bodyterms", folder_name);
+	cdb_stmt_bind_text (stmt, 1, table_name);
+	cdb_stmt_run (cdb, stmt, count_cb, &count, NULL);
+	g_free (table_name);
+
+	if (count > 0)
+		g_hash_table_add (cdb->priv->body_index_folders, g_strdup (folder_name));
+
+	return count > 0;
+}
+
+static gint
+cdb_body_terms_create (CamelDB *cdb,
+                       const gchar *folder_name,
+                       GError **error)
+{
+	gchar *query;
+	gint ret;
+
+	query = sqlite3_mprintf (
+		"CREATE VIRTUAL TABLE '%q_bodyterms' "
+		"USING fts4aux ('%q_bodyindex')",
+		folder_name, folder_name);
+	ret = cdb_sql_exec (cdb, query, NULL, NULL, error);
+	sqlite3_free (query);
+
+	return ret;
+}
+
+static gint
+cdb_body_index_create (CamelDB *cdb,
+                       const gchar *folder_name,
+                       GError **error)
+{
+	gchar *query;
+	gint ret;
+
+	if (cdb_body_index_exists (cdb, folder_name))
+		return 0;
+
+	/* An index without the list of words was split into words
+	 * differently; start over, messages are indexed again as they
+	 * are downloaded. */
+	query = sqlite3_mprintf (
+		"DROP TABLE IF EXISTS '%q_bodyindex'; "
+		"DROP TABLE IF EXISTS '%q_bodyuids'",
+		folder_name, folder_name);
+	ret = cdb_sql_exec (cdb, query, NULL, NULL, error);
+	sqlite3_free (query);
+
+	/* The simple tokenizer folds ASCII case only and keeps all
+	 * other characters, thus a word is found in a text exactly
+	 * when it is found in one of the text's indexed words, which
+	 * is how searches use the index. */
+	if (ret == 0) {
+		query = sqlite3_mprintf (
+			"CREATE VIRTUAL TABLE '%q_bodyindex' "
+			"USING fts4 (body)", folder_name);
+		ret = cdb_sql_exec (cdb, query, NULL, NULL, error);
+		sqlite3_free (query);
+	}
+
+	if (ret == 0) {
+		query = sqlite3_mprintf (
+			"CREATE TABLE '%q_bodyuids' "
+			"(docid INTEGER PRIMARY KEY, uid TEXT UNIQUE)",
+			folder_name);
+		ret = cdb_sql_exec (cdb, query, NULL, NULL, error);
+		sqlite3_free (query);
+	}
+
+	if (ret == 0)
+		ret = cdb_body_terms_create (cdb, folder_name, error);
+
+	if (ret == 0)
+		g_hash_table_add (cdb->priv->body_index_folders, g_strdup (folder_name));
+
+	return ret;
+}
+
+/* 'where' selects the uids to drop from the body index, or is NULL
+ * to drop all of them; no-op when the folder has no body index */
+static gint
+cdb_body_index_delete (CamelDB *cdb,
+                       const gchar *folder_name,
+                       const gchar *where,
+                       GError **error)
+{
+	gchar *query;
+	gint ret;
+
+	if (!cdb_body_index_exists (cdb, folder_name))
+		return 0;
+
+	if (where != NULL)
+		query = sqlite3_mprintf (
+			"DELETE FROM '%q_bodyindex' WHERE docid IN "
+			"(SELECT docid FROM '%q_bodyuids' WHERE %s)",
+			folder_name, folder_name, where);
+	else
+		query = sqlite3_mprintf (
+			"DELETE FROM '%q_bodyindex'", folder_name);
+	ret = camel_db_add_to_transaction (cdb, query, error);
+	sqlite3_free (query);
+
+	if (ret == 0) {
+		query = sqlite3_mprintf (
+			"DELETE FROM '%q_bodyuids'%s%s",
+			folder_name,
+			where ? " WHERE " : "",
+			where ? where : "");
+		ret = camel_db_add_to_transaction (cdb, query, error);
+		sqlite3_free (query);
+	}
+
+	return ret;
+}
+
+/**
+ * camel_db_write_body_index_record:
+ * @cdb: a #CamelDB
+ * @folder_name: full name of the folder
+ * @uid: uid of the message
+ * @text: the text of the message body, in UTF-8
+ * @error: return location for a #GError, or %NULL
+ *
+ * Adds @text to the full-text index of message bodies of @folder_name,
+ * replacing any text indexed for @uid before, and creates the index
+ * if the folder has none yet.  This must be called in a transaction.
+ *
+ * Returns: 0 on success, -1 on error, like when the SQLite in use was
+ * built without full-text search
+ *
+ * Since: 3.10
+ **/
+gint
+camel_db_write_body_index_record (CamelDB *cdb,
+                                  const gchar *folder_name,
+                                  const gchar *uid,
+                                  const gchar *text,
+                                  GError **error)
+{
+	sqlite3_stmt *stmt;
+	gchar *query;
+	gint ret;
+
+	g_return_val_if_fail (folder_name != NULL, -1);
+	g_return_val_if_fail (uid != NULL, -1);
+
+	if (!cdb)
+		return -1;
+
+	g_assert (cdb->priv->transaction_is_on == TRUE);
+
+	ret = cdb_body_index_create (cdb, folder_name, error);
+	if (ret != 0)
+		return ret;
+
+	query = sqlite3_mprintf (
+		"DELETE FROM '%q_bodyindex' WHERE docid = "
+		"(SELECT docid FROM '%q_bodyuids' WHERE uid = ?1)",
+		folder_name, folder_name);
+	stmt = cdb_stmt_take (cdb, query, error);
+	if (stmt) {
+		cdb_stmt_bind_text (stmt, 1, uid);
+		ret = cdb_stmt_run (cdb, stmt, NULL, NULL, error);
+	} else {
+		ret = -1;
+	}
+	sqlite3_free (query);
+
+	if (ret == 0) {
+		/* gives the uid a new docid */
+		query = sqlite3_mprintf (
+			"INSERT OR REPLACE INTO '%q_bodyuids' (uid) VALUES (?1)",
+			folder_name);
+		stmt = cdb_stmt_take (cdb, query, error);
+		if (stmt) {
+			cdb_stmt_bind_text (stmt, 1, uid);
+			ret = cdb_stmt_run (cdb, stmt, NULL, NULL, error);
+		} else {
+			ret = -1;
+		}
+		sqlite3_free (query);
+	}
+
+	if (ret == 0) {
+		query = sqlite3_mprintf (
+			"INSERT INTO '%q_bodyindex' (docid, body) "
+			"VALUES (last_insert_rowid (), ?1)",
+			folder_name);
+		stmt = cdb_stmt_take (cdb, query, error);
+		if (stmt) {
+			cdb_stmt_bind_text (stmt, 1, text ? text : "");
+			ret = cdb_stmt_run (cdb, stmt, NULL, NULL, error);
+		} else {
+			ret = -1;
+		}
+		sqlite3_free (query);
+	}
+
+	return ret;
 }
 
-static gint
-read_uids_to_hash_callback (gpointer ref_hash,
-                            gint ncol,
-                            gchar **cols,
-                            gchar **name)
+/**
+ * camel_db_has_body_index_record:
+ * @cdb: a #CamelDB
+ * @folder_name: full name of the folder
+ * @uid: uid of the message
+ *
+ * Returns: whether the body of the message @uid of @folder_name is
+ * in the full-text index of message bodies
+ *
+ * Since: 3.10
+ **/
+gboolean
+camel_db_has_body_index_record (CamelDB *cdb,
+                                const gchar *folder_name,
+                                const gchar *uid)
 {
-	GHashTable *hash = ref_hash;
+	gchar *query;
+	guint32 count = 0;
 
-	g_return_val_if_fail (ncol == 2, 0);
+	g_return_val_if_fail (folder_name != NULL, FALSE);
+	g_return_val_if_fail (uid != NULL, FALSE);
 
-	if (cols[0])
-		g_hash_table_insert (hash, (gchar *) camel_pstring_strdup (cols[0]), GUINT_TO_POINTER (cols[1] ? strtoul (cols[1], NULL, 10) : 0));
+	query = sqlite3_mprintf (
+		"SELECT COUNT (*) FROM '%q_bodyuids' WHERE uid = ?1",
+		folder_name);
+	/* fails with no such table when there is no index yet */
+	cdb_select_cached (cdb, query, uid, count_cb, &count, NULL);
+	sqlite3_free (query);
 
-	return 0;
+	return count > 0;
 }
 
 /**
- * camel_db_get_folder_uids:
+ * camel_db_get_body_index_uids:
+ * @cdb: a #CamelDB
+ * @folder_name: full name of the folder
+ * @hash: a #GHashTable to fill
+ * @error: return location for a #GError, or %NULL
  *
- * Fills hash with uid->GUINT_TO_POINTER (flag)
+ * Fills @hash with the uids of @folder_name whose bodies are in the
+ * full-text index of message bodies, as keys from the string pool.
  *
- * Since: 2.24
+ * Returns: 0 on success, -1 on error, which includes the folder not
+ * having a body index at all
+ *
+ * Since: 3.10
  **/
 gint
-camel_db_get_folder_uids (CamelDB *db,
-                          const gchar *folder_name,
-                          const gchar *sort_by,
-                          const gchar *collate,
-                          GHashTable *hash,
-                          GError **error)
+camel_db_get_body_index_uids (CamelDB *cdb,
+                              const gchar *folder_name,
+                              GHashTable *hash,
+                              GError **error)
 {
-	 gchar *sel_query;
-	 gint ret;
+	gchar *query;
+	gint ret;
 
-		sel_query = sqlite3_mprintf (
-		"SELECT uid,flags FROM %Q%s%s%s%s",
-		folder_name,
-		sort_by ? " order by " : "",
-		sort_by ? sort_by : "",
-		(sort_by && collate) ? " collate " : "",
-		(sort_by && collate) ? collate : "");
+	g_return_val_if_fail (folder_name != NULL, -1);
+	g_return_val_if_fail (hash != NULL, -1);
 
-	 ret = camel_db_select (db, sel_query, read_uids_to_hash_callback, hash, error);
-	 sqlite3_free (sel_query);
+	query = sqlite3_mprintf (
+		"SELECT uid, 1 FROM '%q_bodyuids'", folder_name);
+	ret = cdb_select_cached (cdb, query, NULL, read_uids_to_hash_callback, hash, error);
+	sqlite3_free (query);
 
-	 return ret;
+	return ret;
 }
 
 /**
- * camel_db_get_folder_junk_uids:
+ * camel_db_search_body_index:
+ * @cdb: a #CamelDB
+ * @folder_name: full name of the folder
+ * @match: a full-text query, in the syntax of SQLite's FTS4 MATCH
+ * @error: return location for a #GError, or %NULL
  *
- * Since: 2.24
+ * Looks up the messages of @folder_name whose indexed bodies match
+ * @match, like <literal>"first" "sec*"</literal> for the messages
+ * with the word "first" and a word beginning with "sec".
+ *
+ * Returns: (element-type utf8) (transfer full): a #GPtrArray of uids
+ * from the string pool, or %NULL on error, which includes the folder
+ * not having a body index.  Free with g_ptr_array_unref().
+ *
+ * Since: 3.10
  **/
 GPtrArray *
-camel_db_get_folder_junk_uids (CamelDB *db,
-                               gchar *folder_name,
-                               GError **error)
+camel_db_search_body_index (CamelDB *cdb,
+                            const gchar *folder_name,
+                            const gchar *match,
+                            GError **error)
 {
-	 gchar *sel_query;
-	 gint ret;
-	 GPtrArray *array = g_ptr_array_new ();
+	GPtrArray *array;
+	gchar *query;
+	gint ret;
 
-	 sel_query = sqlite3_mprintf ("SELECT uid FROM %Q where junk=1", folder_name);
+	g_return_val_if_fail (folder_name != NULL, NULL);
+	g_return_val_if_fail (match != NULL, NULL);
 
-	 ret = camel_db_select (db, sel_query, read_uids_callback, array, error);
+	query = sqlite3_mprintf (
+		"SELECT uid FROM '%q_bodyuids' WHERE docid IN "
+		"(SELECT docid FROM '%q_bodyindex' WHERE body MATCH ?1)",
+		folder_name, folder_name);
 
-	 sqlite3_free (sel_query);
+	array = g_ptr_array_new_with_free_func ((GDestroyNotify) camel_pstring_free);
 
-	 if (!array->len || ret != 0) {
-		 g_ptr_array_free (array, TRUE);
-		 array = NULL;
-	 }
-	 return array;
+	ret = cdb_select_cached (cdb, query, match, read_uids_callback, array, error);
+	sqlite3_free (query);
+
+	if (ret != 0) {
+		g_ptr_array_unref (array);
+		return NULL;
+	}
+
+	return array;
 }
 
 /**
- * camel_db_get_folder_deleted_uids:
+ * camel_db_get_body_index_missing_uids:
+ * @cdb: a #CamelDB
+ * @folder_name: full name of the folder
+ * @hash: a #GHashTable to fill
+ * @error: return location for a #GError, or %NULL
  *
- * Since: 2.24
+ * Fills @hash with the uids of the messages of @folder_name whose
+ * bodies are not in the full-text index of message bodies, as keys
+ * from the string pool.  Only messages saved in @cdb are considered.
+ *
+ * Returns: 0 on success, -1 on error, which includes the folder not
+ * having a body index at all
+ *
+ * Since: 3.10
  **/
-GPtrArray *
-camel_db_get_folder_deleted_uids (CamelDB *db,
-                                  const gchar *folder_name,
-                                  GError **error)
+gint
+camel_db_get_body_index_missing_uids (CamelDB *cdb,
+                                      const gchar *folder_name,
+                                      GHashTable *hash,
+                                      GError **error)
 {
-	 gchar *sel_query;
-	 gint ret;
-	 GPtrArray *array = g_ptr_array_new ();
-
-	 sel_query = sqlite3_mprintf ("SELECT uid FROM %Q where deleted=1", folder_name);
+	gchar *query;
+	gint ret;
 
-	 ret = camel_db_select (db, sel_query, read_uids_callback, array, error);
-	 sqlite3_free (sel_query);
+	g_return_val_if_fail (folder_name != NULL, -1);
+	g_return_val_if_fail (hash != NULL, -1);
 
-	 if (!array->len || ret != 0) {
-		 g_ptr_array_free (array, TRUE);
-		 array = NULL;
-	 }
+	query = sqlite3_mprintf (
+		"SELECT uid, 1 FROM %Q WHERE uid NOT IN "
+		"(SELECT uid FROM '%q_bodyuids')",
+		folder_name, folder_name);
+	ret = cdb_select_cached (cdb, query, NULL, read_uids_to_hash_callback, hash, error);
+	sqlite3_free (query);
 
-	 return array;
+	return ret;
 }
 
-struct ReadPreviewData
-{
-	GHashTable *columns_hash;
-	GHashTable *hash;
-};
-
 static gint
-read_preview_callback (gpointer ref,
+read_strings_callback (gpointer ref_array,
                        gint ncol,
                        gchar **cols,
                        gchar **name)
 {
-	struct ReadPreviewData *rpd = ref;
-	const gchar *uid = NULL;
-	gchar *msg = NULL;
-	gint i;
-
-	for (i = 0; i < ncol; ++i) {
-		if (!name[i] || !cols[i])
-			continue;
+	GPtrArray *array = ref_array;
 
-		switch (camel_db_get_column_ident (&rpd->columns_hash, i, ncol, name)) {
-			case CAMEL_DB_COLUMN_UID:
-				uid = camel_pstring_strdup (cols[i]);
-				break;
-			case CAMEL_DB_COLUMN_PREVIEW:
-				msg = g_strdup (cols[i]);
-				break;
-			default:
-				g_warn_if_reached ();
-				break;
-		}
-	}
+	g_return_val_if_fail (ncol == 1, 0);
 
-	g_hash_table_insert (rpd->hash, (gchar *) uid, msg);
+	if (cols[0])
+		g_ptr_array_add (array, g_strdup (cols[0]));
 
 	return 0;
 }
 
 /**
- * camel_db_get_folder_preview:
+ * camel_db_get_body_index_words:
+ * @cdb: a #CamelDB
+ * @folder_name: full name of the folder
+ * @error: return location for a #GError, or %NULL
  *
- * Since: 2.28
+ * Lists the distinct words in the full-text index of message bodies of
+ * @folder_name.  The index splits texts into words at ASCII characters
+ * other than letters and digits, and keeps the words in lower case as
+ * far as ASCII goes.  Looking up the messages with one of the words
+ * which contain a string, with camel_db_search_body_index(), finds the
+ * messages whose text contains that string, provided it is made of
+ * word characters only.
+ *
+ * Returns: (element-type utf8) (transfer full): a #GPtrArray of words,
+ * or %NULL on error, which includes the folder not having a body index.
+ * Free with g_ptr_array_unref().
+ *
+ * Since: 3.10
  **/
-GHashTable *
-camel_db_get_folder_preview (CamelDB *db,
-                             const gchar *folder_name,
-                             GError **error)
+GPtrArray *
+camel_db_get_body_index_words (CamelDB *cdb,
+                               const gchar *folder_name,
+                               GError **error)
 {
-	gchar *sel_query;
+	GPtrArray *array;
+	gchar *query;
 	gint ret;
-	struct ReadPreviewData rpd;
-	GHashTable *hash = g_hash_table_new (g_str_hash, g_str_equal);
 
-	sel_query = sqlite3_mprintf ("SELECT uid, preview FROM '%q_preview'", folder_name);
+	g_return_val_if_fail (folder_name != NULL, NULL);
 
-	rpd.columns_hash = NULL;
-	rpd.hash = hash;
+	query = sqlite3_mprintf (
+		"SELECT term FROM '%q_bodyterms' WHERE col = '*'",
+		folder_name);
 
-	ret = camel_db_select (db, sel_query, read_preview_callback, &rpd, error);
-	sqlite3_free (sel_query);
+	array = g_ptr_array_new_with_free_func (g_free);
 
-	if (rpd.columns_hash)
-		g_hash_table_destroy (rpd.columns_hash);
+	ret = cdb_select_cached (cdb, query, NULL, read_strings_callback, array, error);
+	sqlite3_free (query);
 
-	if (!g_hash_table_size (hash) || ret != 0) {
-		g_hash_table_destroy (hash);
-		hash = NULL;
+	if (ret != 0) {
+		g_ptr_array_unref (array);
+		return NULL;
 	}
 
-	return hash;
+	return array;
+}
+
+static gint
+read_text_callback (gpointer ref,
+                    gint ncol,
+                    gchar **cols,
+                    gchar **name)
+{
+	gchar **text = ref;
+
+	g_return_val_if_fail (ncol == 1, 0);
+
+	if (*text == NULL)
+		*text = g_strdup (cols[0] ? cols[0] : "");
+
+	return 0;
 }
 
 /**
- * camel_db_write_preview_record:
+ * camel_db_read_body_index_text:
+ * @cdb: a #CamelDB
+ * @folder_name: full name of the folder
+ * @uid: uid of the message
+ * @error: return location for a #GError, or %NULL
  *
- * Since: 2.28
+ * Reads the text of the message @uid of @folder_name, as it was given
+ * to camel_db_write_body_index_record().  This lets a search check an
+ * indexed message for strings which the words of the index cannot
+ * answer for, without opening the message.
+ *
+ * Returns: the text, or %NULL if the message is not in the index or on
+ * error.  Free with g_free().
+ *
+ * Since: 3.10
  **/
-gint
-camel_db_write_preview_record (CamelDB *db,
+gchar *
+camel_db_read_body_index_text (CamelDB *cdb,
                                const gchar *folder_name,
                                const gchar *uid,
-                               const gchar *msg,
                                GError **error)
 {
-	gchar *query;
-	gint ret;
+	gchar *query, *text = NULL;
 
-	query = sqlite3_mprintf ("INSERT OR REPLACE INTO '%q_preview' VALUES(%Q,%Q)", folder_name, uid, msg);
+	g_return_val_if_fail (folder_name != NULL, NULL);
+	g_return_val_if_fail (uid != NULL, NULL);
 
-	ret = camel_db_add_to_transaction (db, query, error);
+	query = sqlite3_mprintf (
+		"SELECT body FROM '%q_bodyindex' WHERE docid = "
+		"(SELECT docid FROM '%q_bodyuids' WHERE uid = ?1)",
+		folder_name, folder_name);
+	if (cdb_select_cached (cdb, query, uid, read_text_callback, &text, error) != 0) {
+		g_free (text);
+		text = NULL;
+	}
 	sqlite3_free (query);
 
-	return ret;
+	return text;
 }
 
 /**
@@ -1370,6 +2413,19 @@ camel_db_create_message_info_table (CamelDB *cdb,
 	g_free (safe_index);
 	sqlite3_free (table_creation_query);
 
+	/* Indexes on dates, for camel_db_get_folder_uids_range() */
+	safe_index = g_strdup_printf ("DSENTINDEX-%s", folder_name);
+	table_creation_query = sqlite3_mprintf ("CREATE INDEX IF NOT EXISTS %Q ON %Q (dsent, uid)", safe_index, folder_name);
+	ret = camel_db_add_to_transaction (cdb, table_creation_query, error);
+	g_free (safe_index);
+	sqlite3_free (table_creation_query);
+
+	safe_index = g_strdup_printf ("DRECEIVEDINDEX-%s", folder_name);
+	table_creation_query = sqlite3_mprintf ("CREATE INDEX IF NOT EXISTS %Q ON %Q (dreceived, uid)", safe_index, folder_name);
+	ret = camel_db_add_to_transaction (cdb, table_creation_query, error);
+	g_free (safe_index);
+	sqlite3_free (table_creation_query);
+
 	return ret;
 }
 
@@ -1652,59 +2708,78 @@ write_mir (CamelDB *cdb,
            GError **error,
            gboolean delete_old_record)
 {
-	gint ret;
-	/*char *del_query;*/
+	sqlite3_stmt *stmt;
+	gint ret = -1;
 	gchar *ins_query;
 
-	/* FIXME: We should migrate from this DELETE followed by INSERT model to an INSERT OR REPLACE model as pointed out by pvanhoof */
+	if (!cdb)
+		return -1;
+
+	g_assert (cdb->priv->transaction_is_on == TRUE);
 
 	/* NB: UGLIEST Hack. We can't modify the schema now. We are using dirty (an unsed one to notify of FLAGGED/Dirty infos */
 
+	/* The statements are prepared once per folder and reused with
+	 * new values bound; this is what most of a summary save is. */
 	ins_query = sqlite3_mprintf (
 		"INSERT OR REPLACE INTO %Q VALUES ("
-		"%Q, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, "
-		"%lld, %lld, %Q, %Q, %Q, %Q, %Q, %Q, %Q, %Q, "
-		"%Q, %Q, %Q, %Q, %Q, "
+		"?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, "
+		"?, ?, ?, ?, ?, ?, ?, ?, ?, ?, "
+		"?, ?, ?, ?, ?, "
 		"strftime(\"%%s\", 'now'), "
 		"strftime(\"%%s\", 'now') )",
-		folder_name,
-		record->uid,
-		record->flags,
-		record->msg_type,
-		record->read,
-		record->deleted,
-		record->replied,
-		record->important,
-		record->junk,
-		record->attachment,
-		record->dirty,
-		record->size,
-		(gint64) record->dsent,
-		(gint64) record->dreceived,
-		record->subject,
-		record->from,
-		record->to,
-		record->cc,
-		record->mlist,
-		record->followup_flag,
-		record->followup_completed_on,
-		record->followup_due_by,
-		record->part,
-		record->labels,
-		record->usertags,
-		record->cinfo,
-		record->bdata);
-
-	ret = camel_db_add_to_transaction (cdb, ins_query, error);
+		folder_name);
+
+	stmt = cdb_stmt_take (cdb, ins_query, error);
+	if (stmt) {
+		cdb_stmt_bind_text (stmt, 1, record->uid);
+		sqlite3_bind_int (stmt, 2, record->flags);
+		sqlite3_bind_int (stmt, 3, record->msg_type);
+		sqlite3_bind_int (stmt, 4, record->read);
+		sqlite3_bind_int (stmt, 5, record->deleted);
+		sqlite3_bind_int (stmt, 6, record->replied);
+		sqlite3_bind_int (stmt, 7, record->important);
+		sqlite3_bind_int (stmt, 8, record->junk);
+		sqlite3_bind_int (stmt, 9, record->attachment);
+		sqlite3_bind_int (stmt, 10, record->dirty);
+		sqlite3_bind_int (stmt, 11, record->size);
+		sqlite3_bind_int64 (stmt, 12, (gint64) record->dsent);
+		sqlite3_bind_int64 (stmt, 13, (gint64) record->dreceived);
+		cdb_stmt_bind_text (stmt, 14, record->subject);
+		cdb_stmt_bind_text (stmt, 15, record->from);
+		cdb_stmt_bind_text (stmt, 16, record->to);
+		cdb_stmt_bind_text (stmt, 17, record->cc);
+		cdb_stmt_bind_text (stmt, 18, record->mlist);
+		cdb_stmt_bind_text (stmt, 19, record->followup_flag);
+		cdb_stmt_bind_text (stmt, 20, record->followup_completed_on);
+		cdb_stmt_bind_text (stmt, 21, record->followup_due_by);
+		cdb_stmt_bind_text (stmt, 22, record->part);
+		cdb_stmt_bind_text (stmt, 23, record->labels);
+		cdb_stmt_bind_text (stmt, 24, record->usertags);
+		cdb_stmt_bind_text (stmt, 25, record->cinfo);
+		cdb_stmt_bind_text (stmt, 26, record->bdata);
+
+		ret = cdb_stmt_run (cdb, stmt, NULL, NULL, error);
+	}
 
 	sqlite3_free (ins_query);
 
 	if (ret == 0) {
 		ins_query = sqlite3_mprintf (
 			"INSERT OR REPLACE INTO "
-			"'%q_bodystructure' VALUES (%Q, %Q )",
-			folder_name, record->uid, record->bodystructure);
-		ret = camel_db_add_to_transaction (cdb, ins_query, error);
+			"'%q_bodystructure' VALUES (?, ?)",
+			folder_name);
+
+		stmt = cdb_stmt_take (cdb, ins_query, error);
+		if (stmt) {
+			cdb_stmt_bind_text (stmt, 1, record->uid);
+			cdb_stmt_bind_text (stmt, 2, record->bodystructure);
+
+			ret = cdb_stmt_run (cdb, stmt, NULL, NULL, error);
+		} else {
+			ret = -1;
+		}
+
 		sqlite3_free (ins_query);
 	}
 
@@ -1739,6 +2814,78 @@ camel_db_write_message_info_record (CamelDB *cdb,
 	return write_mir (cdb, folder_name, record, error, TRUE);
 }
 
+/**
+ * camel_db_update_message_info_record:
+ * @cdb: a #CamelDB
+ * @folder_name: full name of the folder
+ * @record: a #CamelMIRecord
+ * @error: return location for a #GError, or %NULL
+ *
+ * Like camel_db_write_message_info_record(), but only updates those
+ * columns of an already stored message which change with its flags,
+ * user flags, tags, size and provider data, leaving its headers,
+ * references, content info and body structure alone.  If the message
+ * is not stored yet, the whole @record is written.
+ *
+ * Returns: 0 on success, -1 on error
+ *
+ * Since: 3.10
+ **/
+gint
+camel_db_update_message_info_record (CamelDB *cdb,
+                                     const gchar *folder_name,
+                                     CamelMIRecord *record,
+                                     GError **error)
+{
+	sqlite3_stmt *stmt;
+	gchar *upd_query;
+	gint ret = -1;
+
+	if (!cdb)
+		return -1;
+
+	g_assert (cdb->priv->transaction_is_on == TRUE);
+
+	upd_query = sqlite3_mprintf (
+		"UPDATE %Q SET "
+		"flags = ?, read = ?, deleted = ?, replied = ?, "
+		"important = ?, junk = ?, attachment = ?, dirty = ?, "
+		"size = ?, followup_flag = ?, followup_completed_on = ?, "
+		"followup_due_by = ?, labels = ?, usertags = ?, bdata = ?, "
+		"modified = strftime(\"%%s\", 'now') "
+		"WHERE uid = ?",
+		folder_name);
+
+	stmt = cdb_stmt_take (cdb, upd_query, error);
+	if (stmt) {
+		sqlite3_bind_int (stmt, 1, record->flags);
+		sqlite3_bind_int (stmt, 2, record->read);
+		sqlite3_bind_int (stmt, 3, record->deleted);
+		sqlite3_bind_int (stmt, 4, record->replied);
+		sqlite3_bind_int (stmt, 5, record->important);
+		sqlite3_bind_int (stmt, 6, record->junk);
+		sqlite3_bind_int (stmt, 7, record->attachment);
+		sqlite3_bind_int (stmt, 8, record->dirty);
+		sqlite3_bind_int (stmt, 9, record->size);
+		cdb_stmt_bind_text (stmt, 10, record->followup_flag);
+		cdb_stmt_bind_text (stmt, 11, record->followup_completed_on);
+		cdb_stmt_bind_text (stmt, 12, record->followup_due_by);
+		cdb_stmt_bind_text (stmt, 13, record->labels);
+		cdb_stmt_bind_text (stmt, 14, record->usertags);
+		cdb_stmt_bind_text (stmt, 15, record->bdata);
+		cdb_stmt_bind_text (stmt, 16, record->uid);
+
+		ret = cdb_stmt_run (cdb, stmt, NULL, NULL, error);
+	}
+
+	sqlite3_free (upd_query);
+
+	if (ret == 0 && sqlite3_changes (cdb->db) == 0)
+		ret = write_mir (cdb, folder_name, record, error, TRUE);
+
+	return ret;
+}
+
 /**
  * camel_db_write_folder_info_record:
  *
@@ -1861,15 +3008,14 @@ camel_db_read_folder_info_record (CamelDB *cdb,
                                   GError **error)
 {
 	struct ReadFirData rfd;
-	gchar *query;
 	gint ret;
 
 	rfd.columns_hash = NULL;
 	rfd.record = record;
 
-	query = sqlite3_mprintf ("SELECT * FROM folders WHERE folder_name = %Q", folder_name);
-	ret = camel_db_select (cdb, query, read_fir_callback, &rfd, error);
-	sqlite3_free (query);
+	ret = cdb_select_cached (
+		cdb, "SELECT * FROM folders WHERE folder_name = ?",
+		folder_name, read_fir_callback, &rfd, error);
 
 	if (rfd.columns_hash)
 		g_hash_table_destroy (rfd.columns_hash);
@@ -1896,9 +3042,9 @@ camel_db_read_message_info_record_with_uid (CamelDB *cdb,
 	query = sqlite3_mprintf (
 		"SELECT uid, flags, size, dsent, dreceived, subject, "
 		"mail_from, mail_to, mail_cc, mlist, part, labels, "
-		"usertags, cinfo, bdata FROM %Q WHERE uid = %Q",
-		folder_name, uid);
-	ret = camel_db_select (cdb, query, read_mir_callback, p, error);
+		"usertags, cinfo, bdata FROM %Q WHERE uid = ?",
+		folder_name);
+	ret = cdb_select_cached (cdb, query, uid, read_mir_callback, p, error);
 	sqlite3_free (query);
 
 	return (ret);
@@ -1923,7 +3069,7 @@ camel_db_read_message_info_records (CamelDB *cdb,
 		"SELECT uid, flags, size, dsent, dreceived, subject, "
 		"mail_from, mail_to, mail_cc, mlist, part, labels, "
 		"usertags, cinfo, bdata FROM %Q ", folder_name);
-	ret = camel_db_select (cdb, query, read_mir_callback, p, error);
+	ret = cdb_select_cached (cdb, query, NULL, read_mir_callback, p, error);
 	sqlite3_free (query);
 
 	return (ret);
@@ -1995,6 +3141,10 @@ camel_db_delete_uid (CamelDB *cdb,
 	ret = camel_db_add_to_transaction (cdb, tab, error);
 	sqlite3_free (tab);
 
+	tab = sqlite3_mprintf ("uid = %Q", uid);
+	ret = cdb_body_index_delete (cdb, folder, tab, error);
+	sqlite3_free (tab);
+
 	tab = sqlite3_mprintf ("DELETE FROM %Q WHERE uid = %Q", folder, uid);
 	ret = camel_db_add_to_transaction (cdb, tab, error);
 	sqlite3_free (tab);
@@ -2020,6 +3170,7 @@ cdb_delete_ids (CamelDB *cdb,
 	GString *str = g_string_new ("DELETE FROM ");
 	GList *iterator;
 	GString *ins_str = NULL;
+	gsize where_start;
 
 	if (strcmp (field, "vuid") != 0)
 		ins_str = g_string_new ("INSERT OR REPLACE INTO Deletes (uid, mailbox, time) SELECT uid, ");
@@ -2035,10 +3186,13 @@ cdb_delete_ids (CamelDB *cdb,
 		sqlite3_free (tab);
 	}
 
-	tmp = sqlite3_mprintf ("%Q WHERE %s IN (", folder_name, field);
-	g_string_append_printf (str, "%s ", tmp);
+	tmp = sqlite3_mprintf ("%Q WHERE ", folder_name);
+	g_string_append (str, tmp);
 	sqlite3_free (tmp);
 
+	where_start = str->len;
+	g_string_append_printf (str, "%s IN ( ", field);
+
 	iterator = uids;
 
 	while (iterator) {
@@ -2068,6 +3222,9 @@ cdb_delete_ids (CamelDB *cdb,
 		ret = camel_db_trim_deleted_table (cdb, error);
 	}
 
+	if (strcmp (field, "uid") == 0)
+		ret = cdb_body_index_delete (cdb, folder_name, str->str + where_start, error);
+
 	ret = camel_db_add_to_transaction (cdb, str->str, error);
 
 	ret = camel_db_end_transaction (cdb, error);
@@ -2135,6 +3292,7 @@ camel_db_clear_folder_summary (CamelDB *cdb,
 	camel_db_add_to_transaction (cdb, msginfo_del, error);
 	camel_db_add_to_transaction (cdb, folders_del, error);
 	camel_db_add_to_transaction (cdb, bstruct_del, error);
+	cdb_body_index_delete (cdb, folder, NULL, error);
 
 	ret = camel_db_end_transaction (cdb, error);
 
@@ -2176,6 +3334,8 @@ camel_db_delete_folder (CamelDB *cdb,
 	ret = camel_db_add_to_transaction (cdb, del, error);
 	sqlite3_free (del);
 
+	cdb_stmt_cache_clear (cdb);
+
 	del = sqlite3_mprintf ("DROP TABLE %Q ", folder);
 	ret = camel_db_add_to_transaction (cdb, del, error);
 	sqlite3_free (del);
@@ -2184,6 +3344,22 @@ camel_db_delete_folder (CamelDB *cdb,
 	ret = camel_db_add_to_transaction (cdb, del, error);
 	sqlite3_free (del);
 
+	if (cdb_body_index_exists (cdb, folder)) {
+		del = sqlite3_mprintf ("DROP TABLE '%q_bodyterms' ", folder);
+		ret = camel_db_add_to_transaction (cdb, del, error);
+		sqlite3_free (del);
+
+		del = sqlite3_mprintf ("DROP TABLE '%q_bodyindex' ", folder);
+		ret = camel_db_add_to_transaction (cdb, del, error);
+		sqlite3_free (del);
+
+		del = sqlite3_mprintf ("DROP TABLE '%q_bodyuids' ", folder);
+		ret = camel_db_add_to_transaction (cdb, del, error);
+		sqlite3_free (del);
+
+		g_hash_table_remove (cdb->priv->body_index_folders, folder);
+	}
+
 	ret = camel_db_end_transaction (cdb, error);
 
 	CAMEL_DB_RELEASE_SQLITE_MEMORY;
@@ -2217,6 +3393,8 @@ camel_db_rename_folder (CamelDB *cdb,
 
 	ret = camel_db_trim_deleted_table (cdb, error);
 
+	cdb_stmt_cache_clear (cdb);
+
 	cmd = sqlite3_mprintf ("ALTER TABLE %Q RENAME TO  %Q", old_folder, new_folder);
 	ret = camel_db_add_to_transaction (cdb, cmd, error);
 	sqlite3_free (cmd);
@@ -2225,6 +3403,25 @@ camel_db_rename_folder (CamelDB *cdb,
 	ret = camel_db_add_to_transaction (cdb, cmd, error);
 	sqlite3_free (cmd);
 
+	if (cdb_body_index_exists (cdb, old_folder)) {
+		/* the list of words refers to the index by name */
+		cmd = sqlite3_mprintf ("DROP TABLE '%q_bodyterms'", old_folder);
+		ret = camel_db_add_to_transaction (cdb, cmd, error);
+		sqlite3_free (cmd);
+
+		cmd = sqlite3_mprintf ("ALTER TABLE '%q_bodyindex' RENAME TO '%q_bodyindex'", old_folder, new_folder);
+		ret = camel_db_add_to_transaction (cdb, cmd, error);
+		sqlite3_free (cmd);
+
+		cmd = sqlite3_mprintf ("ALTER TABLE '%q_bodyuids' RENAME TO '%q_bodyuids'", old_folder, new_folder);
+		ret = camel_db_add_to_transaction (cdb, cmd, error);
+		sqlite3_free (cmd);
+
+		ret = cdb_body_terms_create (cdb, new_folder, error);
+
+		g_hash_table_remove (cdb->priv->body_index_folders, old_folder);
+	}
+
 	cmd = sqlite3_mprintf ("UPDATE %Q SET modified=strftime(\"%%s\", 'now'), created=strftime(\"%%s\", 'now')", new_folder);
 	ret = camel_db_add_to_transaction (cdb, cmd, error);
 	sqlite3_free (cmd);
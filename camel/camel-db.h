@@ -261,6 +261,7 @@ CamelDB * camel_db_open (const gchar *path, GError **error);
 CamelDB * camel_db_clone (CamelDB *cdb, GError **error);
 void camel_db_close (CamelDB *cdb);
 gint camel_db_command (CamelDB *cdb, const gchar *stmt, GError **error);
+void camel_db_get_busy_stats (CamelDB *cdb, guint *out_n_waits, guint64 *out_wait_time);
 
 gint camel_db_transaction_command (CamelDB *cdb, GList *qry_list, GError **error);
 
@@ -285,6 +286,7 @@ gint camel_db_read_folder_info_record (CamelDB *cdb, const gchar *folder_name, C
 gint camel_db_prepare_message_info_table (CamelDB *cdb, const gchar *folder_name, GError **error);
 
 gint camel_db_write_message_info_record (CamelDB *cdb, const gchar *folder_name, CamelMIRecord *record, GError **error);
+gint camel_db_update_message_info_record (CamelDB *cdb, const gchar *folder_name, CamelMIRecord *record, GError **error);
 gint camel_db_write_fresh_message_info_record (CamelDB *cdb, const gchar *folder_name, CamelMIRecord *record, GError **error);
 gint camel_db_read_message_info_records (CamelDB *cdb, const gchar *folder_name, gpointer p, CamelDBSelectCB read_mir_callback, GError **error);
 gint camel_db_read_message_info_record_with_uid (CamelDB *cdb, const gchar *folder_name, const gchar *uid, gpointer p, CamelDBSelectCB read_mir_callback, GError **error);
@@ -302,6 +304,8 @@ gint camel_db_count_message_info (CamelDB *cdb, const gchar *query, guint32 *cou
 void camel_db_camel_mir_free (CamelMIRecord *record);
 
 gint camel_db_get_folder_uids (CamelDB *db, const gchar *folder_name, const gchar *sort_by, const gchar *collate, GHashTable *hash, GError **error);
+GPtrArray * camel_db_get_folder_uids_range (CamelDB *db, const gchar *folder_name, const gchar *sort_by, const gchar *collate, gboolean ascending, const gchar *after_uid, const gchar *after_value, guint limit, GError **error);
+gint camel_db_get_folder_uid_columns (CamelDB *db, const gchar *folder_name, const gchar *sort_by, const gchar *collate, CamelDBSelectCB callback, gpointer user_data, GError **error);
 
 GPtrArray * camel_db_get_folder_junk_uids (CamelDB *db, gchar *folder_name, GError **error);
 GPtrArray * camel_db_get_folder_deleted_uids (CamelDB *db, const gchar *folder_name, GError **error);
@@ -319,6 +323,14 @@ GHashTable *
 camel_db_get_folder_preview (CamelDB *db, const gchar *folder_name, GError **error);
 gint camel_db_write_preview_record (CamelDB *db, const gchar *folder_name, const gchar *uid, const gchar *msg, GError **error);
 
+gint camel_db_write_body_index_record (CamelDB *cdb, const gchar *folder_name, const gchar *uid, const gchar *text, GError **error);
+gboolean camel_db_has_body_index_record (CamelDB *cdb, const gchar *folder_name, const gchar *uid);
+gint camel_db_get_body_index_uids (CamelDB *cdb, const gchar *folder_name, GHashTable *hash, GError **error);
+GPtrArray * camel_db_search_body_index (CamelDB *cdb, const gchar *folder_name, const gchar *match, GError **error);
+gint camel_db_get_body_index_missing_uids (CamelDB *cdb, const gchar *folder_name, GHashTable *hash, GError **error);
+GPtrArray * camel_db_get_body_index_words (CamelDB *cdb, const gchar *folder_name, GError **error);
+gchar * camel_db_read_body_index_text (CamelDB *cdb, const gchar *folder_name, const gchar *uid, GError **error);
+
 gint
 camel_db_reset_folder_version (CamelDB *cdb, const gchar *folder_name, gint reset_version, GError **error);
 
@@ -51,6 +51,7 @@
 #include "camel-vee-folder.h"
 #include "camel-string-utils.h"
 #include "camel-search-sql-sexp.h"
+#include "camel-text-index.h"
 
 #define d(x)
 #define r(x)
@@ -66,6 +67,12 @@ struct _CamelFolderSearchPrivate {
 
 	CamelFolderThread *threads;
 	GHashTable *threads_hash;
+
+	/* the body index of the CamelDB, read by the first body-contains */
+	gboolean body_index_loaded;
+	GHashTable *body_index_missing;	/* uids the index cannot answer for, or NULL */
+	GPtrArray *body_index_words;	/* the distinct words in the index */
+	GHashTable *body_index_matches;	/* term -> indexed uids matching it, or NULL */
 };
 
 typedef enum {
@@ -444,6 +451,27 @@ match_words_index (CamelFolderSearch *search,
 	if (g_cancellable_set_error_if_cancelled (cancellable, error))
 		return result;
 
+	if (CAMEL_IS_TEXT_INDEX (search->body_index)) {
+		GPtrArray *names;
+		const gchar **terms;
+
+		terms = g_new0 (const gchar *, words->len + 1);
+		for (i = 0; i < words->len; i++)
+			terms[i] = words->words[i]->word;
+
+		names = camel_text_index_find_all (
+			CAMEL_TEXT_INDEX (search->body_index), terms);
+		for (i = 0; i < names->len; i++)
+			g_ptr_array_add (
+				result, (gchar *) camel_pstring_peek (
+				g_ptr_array_index (names, i)));
+
+		g_ptr_array_unref (names);
+		g_free (terms);
+
+		return result;
+	}
+
 	/* we can have a maximum of 32 words, as we use it as the AND mask */
 
 	wc = camel_index_words (search->body_index);
@@ -562,6 +590,214 @@ match_words_message (CamelFolder *folder,
 	return truth;
 }
 
+/* The full-text index of message bodies in the CamelDB splits the texts
+ * into words, while body-contains looks for strings anywhere in the text.
+ * A string of word characters is thus in the messages with any indexed
+ * word containing it; strings with other characters are looked for in
+ * the indexed texts of the messages with all their word parts. */
+
+/* more indexed words containing a search word make a slow query */
+#define BODY_INDEX_MAX_WORDS 256
+
+static void
+body_index_matches_free (gpointer matches)
+{
+	if (matches != NULL)
+		g_hash_table_destroy (matches);
+}
+
+/* Returns the uids the body index cannot answer for, or NULL when the
+ * folder has no body index */
+static GHashTable *
+body_index_get_missing (CamelFolderSearch *search)
+{
+	CamelFolderSearchPrivate *p = search->priv;
+	CamelStore *parent_store;
+
+	if (p->body_index_loaded)
+		return p->body_index_missing;
+
+	p->body_index_loaded = TRUE;
+
+	if (search->folder == NULL || search->folder->summary == NULL)
+		return NULL;
+
+	p->body_index_missing = camel_folder_summary_get_unindexed_uids (search->folder->summary);
+	if (p->body_index_missing == NULL)
+		return NULL;
+
+	parent_store = camel_folder_get_parent_store (search->folder);
+	p->body_index_words = camel_db_get_body_index_words (
+		parent_store->cdb_r,
+		camel_folder_get_full_name (search->folder), NULL);
+
+	if (p->body_index_words != NULL) {
+		p->body_index_matches = g_hash_table_new_full (
+			g_str_hash, g_str_equal, g_free, body_index_matches_free);
+	} else {
+		g_hash_table_destroy (p->body_index_missing);
+		p->body_index_missing = NULL;
+	}
+
+	return p->body_index_missing;
+}
+
+/* Returns the indexed uids whose text contains 'word', which has word
+ * characters only, or NULL when too many indexed words contain it */
+static GHashTable *
+body_index_find_word (CamelFolderSearch *search,
+                      struct _camel_search_word *word)
+{
+	CamelFolderSearchPrivate *p = search->priv;
+	CamelStore *parent_store;
+	GHashTable *uids;
+	GPtrArray *found;
+	GString *match;
+	gint ii, n_words = 0;
+
+	/* any of the indexed words: "one" OR "someone" */
+	match = g_string_new ("");
+	for (ii = 0; ii < p->body_index_words->len; ii++) {
+		const gchar *indexed = p->body_index_words->pdata[ii];
+
+		/* both are in lower case as far as ASCII goes */
+		if ((word->type & CAMEL_SEARCH_WORD_8BIT) != 0 ?
+		    camel_ustrstrcase (indexed, word->word) == NULL :
+		    strstr (indexed, word->word) == NULL)
+			continue;
+
+		if (++n_words > BODY_INDEX_MAX_WORDS) {
+			g_string_free (match, TRUE);
+			return NULL;
+		}
+
+		if (match->len > 0)
+			g_string_append (match, " OR ");
+		g_string_append_printf (match, "\"%s\"", indexed);
+	}
+
+	uids = g_hash_table_new_full (
+		g_str_hash, g_str_equal,
+		(GDestroyNotify) camel_pstring_free, NULL);
+
+	if (n_words == 0) {
+		g_string_free (match, TRUE);
+		return uids;
+	}
+
+	parent_store = camel_folder_get_parent_store (search->folder);
+	found = camel_db_search_body_index (
+		parent_store->cdb_r,
+		camel_folder_get_full_name (search->folder),
+		match->str, NULL);
+	g_string_free (match, TRUE);
+
+	if (found == NULL) {
+		g_hash_table_destroy (uids);
+		return NULL;
+	}
+
+	for (ii = 0; ii < found->len; ii++)
+		g_hash_table_add (
+			uids, (gpointer)
+			camel_pstring_strdup (found->pdata[ii]));
+
+	g_ptr_array_unref (found);
+
+	return uids;
+}
+
+/* Drops the uids from 'matches' whose indexed texts lack any of the
+ * words of 'words' with other than word characters */
+static void
+body_index_check_texts (CamelFolderSearch *search,
+                        struct _camel_search_words *words,
+                        GHashTable *matches)
+{
+	CamelStore *parent_store;
+	GHashTableIter iter;
+	gpointer key;
+	const gchar *full_name;
+
+	full_name = camel_folder_get_full_name (search->folder);
+	parent_store = camel_folder_get_parent_store (search->folder);
+
+	g_hash_table_iter_init (&iter, matches);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		gboolean truth;
+		gchar *text;
+		gint ii;
+
+		text = camel_db_read_body_index_text (parent_store->cdb_r, full_name, key, NULL);
+
+		truth = text != NULL;
+		for (ii = 0; ii < words->len && truth; ii++) {
+			if ((words->words[ii]->type & CAMEL_SEARCH_WORD_COMPLEX) != 0)
+				truth = camel_ustrstrcase (text, words->words[ii]->word) != NULL;
+		}
+
+		if (!truth)
+			g_hash_table_iter_remove (&iter);
+
+		g_free (text);
+	}
+}
+
+/* Returns the indexed uids whose text contains all words of 'term', or
+ * NULL when the index cannot answer; asks the index once per term and
+ * search */
+static GHashTable *
+body_index_get_matches (CamelFolderSearch *search,
+                        const gchar *term)
+{
+	CamelFolderSearchPrivate *p = search->priv;
+	struct _camel_search_words *words, *simple;
+	GHashTable *matches = NULL;
+	gpointer value;
+	gint ii;
+
+	if (g_hash_table_lookup_extended (p->body_index_matches, term, NULL, &value))
+		return value;
+
+	words = camel_search_words_split ((const guchar *) term);
+	simple = camel_search_words_simple (words);
+
+	for (ii = 0; ii < simple->len; ii++) {
+		GHashTable *found;
+		GHashTableIter iter;
+		gpointer key;
+
+		found = body_index_find_word (search, simple->words[ii]);
+		if (found == NULL) {
+			body_index_matches_free (matches);
+			matches = NULL;
+			break;
+		}
+
+		if (matches == NULL) {
+			matches = found;
+			continue;
+		}
+
+		g_hash_table_iter_init (&iter, matches);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			if (!g_hash_table_contains (found, key))
+				g_hash_table_iter_remove (&iter);
+		}
+		g_hash_table_destroy (found);
+	}
+
+	if (matches != NULL && (words->type & CAMEL_SEARCH_WORD_COMPLEX) != 0)
+		body_index_check_texts (search, words, matches);
+
+	camel_search_words_free (simple);
+	camel_search_words_free (words);
+
+	g_hash_table_insert (p->body_index_matches, g_strdup (term), matches);
+
+	return matches;
+}
+
 static GPtrArray *
 match_words_messages (CamelFolderSearch *search,
                       struct _camel_search_words *words,
@@ -1069,6 +1305,55 @@ folder_search_match_threads (CamelSExp *sexp,
 	return r;
 }
 
+/* Like match_words_messages(), answering from the body index for the
+ * indexed messages and only opening or looking up the 'missing' ones */
+static GPtrArray *
+match_words_body_index (CamelFolderSearch *search,
+                        struct _camel_search_words *words,
+                        GHashTable *missing,
+                        GHashTable *index_matches,
+                        GCancellable *cancellable,
+                        GError **error)
+{
+	GPtrArray *v = search->summary_set ? search->summary_set : search->summary;
+	GPtrArray *matches, *unindexed;
+	gint i;
+
+	matches = g_ptr_array_new ();
+	unindexed = g_ptr_array_new ();
+
+	for (i = 0; i < v->len; i++) {
+		gchar *uid = g_ptr_array_index (v, i);
+
+		if (g_hash_table_contains (missing, uid))
+			g_ptr_array_add (unindexed, uid);
+		else if (g_hash_table_contains (index_matches, uid))
+			g_ptr_array_add (matches, uid);
+	}
+
+	if (unindexed->len > 0) {
+		GPtrArray *summary_set = search->summary_set, *rest;
+
+		search->summary_set = unindexed;
+		if ((words->type & CAMEL_SEARCH_WORD_COMPLEX) == 0 && search->body_index)
+			rest = match_words_index (search, words, cancellable, error);
+		else
+			rest = match_words_messages (search, words, cancellable, error);
+		search->summary_set = summary_set;
+
+		/* a body index may report indexed messages too */
+		for (i = 0; i < rest->len; i++) {
+			if (g_hash_table_contains (missing, rest->pdata[i]))
+				g_ptr_array_add (matches, rest->pdata[i]);
+		}
+		g_ptr_array_free (rest, TRUE);
+	}
+
+	g_ptr_array_free (unindexed, TRUE);
+
+	return matches;
+}
+
 static CamelSExpResult *
 folder_search_body_contains (CamelSExp *sexp,
                              gint argc,
@@ -1080,6 +1365,7 @@ folder_search_body_contains (CamelSExp *sexp,
 	struct _camel_search_words *words;
 	CamelSExpResult *r;
 	struct IterData lambdafoo;
+	GHashTable *missing, *index_matches;
 
 	if (search->current) {
 		gint truth = FALSE;
@@ -1087,11 +1373,21 @@ folder_search_body_contains (CamelSExp *sexp,
 		if (argc == 1 && argv[0]->value.string[0] == 0) {
 			truth = TRUE;
 		} else {
+			const gchar *uid = camel_message_info_uid (search->current);
+
+			missing = body_index_get_missing (search);
+
 			for (i = 0; i < argc && !truth && !g_cancellable_is_cancelled (search->priv->cancellable); i++) {
 				if (argv[i]->type == CAMEL_SEXP_RES_STRING) {
+					index_matches = NULL;
+					if (missing && !g_hash_table_contains (missing, uid))
+						index_matches = body_index_get_matches (search, argv[i]->value.string);
+
 					words = camel_search_words_split ((const guchar *) argv[i]->value.string);
 					truth = TRUE;
-					if ((words->type & CAMEL_SEARCH_WORD_COMPLEX) == 0 && search->body_index) {
+					if (index_matches) {
+						truth = g_hash_table_contains (index_matches, uid);
+					} else if ((words->type & CAMEL_SEARCH_WORD_COMPLEX) == 0 && search->body_index) {
 						for (j = 0; j < words->len && truth; j++)
 							truth = match_message_index (
 								search->body_index,
@@ -1129,10 +1425,20 @@ folder_search_body_contains (CamelSExp *sexp,
 			GHashTable *ht = g_hash_table_new (g_str_hash, g_str_equal);
 			GPtrArray *matches;
 
+			missing = body_index_get_missing (search);
+
 			for (i = 0; i < argc && !g_cancellable_is_cancelled (search->priv->cancellable); i++) {
 				if (argv[i]->type == CAMEL_SEXP_RES_STRING) {
+					index_matches = NULL;
+					if (missing)
+						index_matches = body_index_get_matches (search, argv[i]->value.string);
+
 					words = camel_search_words_split ((const guchar *) argv[i]->value.string);
-					if ((words->type & CAMEL_SEARCH_WORD_COMPLEX) == 0 && search->body_index) {
+					if (index_matches) {
+						matches = match_words_body_index (
+							search, words, missing, index_matches,
+							search->priv->cancellable, error);
+					} else if ((words->type & CAMEL_SEARCH_WORD_COMPLEX) == 0 && search->body_index) {
 						matches = match_words_index (search, words, search->priv->cancellable, error);
 					} else {
 						matches = match_words_messages (search, words, search->priv->cancellable, error);
@@ -2003,6 +2309,12 @@ fail:
 		camel_folder_thread_messages_unref (p->threads);
 	if (p->threads_hash)
 		g_hash_table_destroy (p->threads_hash);
+	if (p->body_index_missing)
+		g_hash_table_destroy (p->body_index_missing);
+	if (p->body_index_words)
+		g_ptr_array_unref (p->body_index_words);
+	if (p->body_index_matches)
+		g_hash_table_destroy (p->body_index_matches);
 	if (search->summary_set)
 		g_ptr_array_free (search->summary_set, TRUE);
 	if (search->summary)
@@ -2012,6 +2324,10 @@ fail:
 	p->error = NULL;
 	p->threads = NULL;
 	p->threads_hash = NULL;
+	p->body_index_loaded = FALSE;
+	p->body_index_missing = NULL;
+	p->body_index_words = NULL;
+	p->body_index_matches = NULL;
 	search->folder = NULL;
 	search->summary = NULL;
 	search->summary_set = NULL;
@@ -2175,6 +2491,12 @@ fail:
 		camel_folder_thread_messages_unref (p->threads);
 	if (p->threads_hash)
 		g_hash_table_destroy (p->threads_hash);
+	if (p->body_index_missing)
+		g_hash_table_destroy (p->body_index_missing);
+	if (p->body_index_words)
+		g_ptr_array_unref (p->body_index_words);
+	if (p->body_index_matches)
+		g_hash_table_destroy (p->body_index_matches);
 	if (search->summary_set)
 		g_ptr_array_free (search->summary_set, TRUE);
 	if (search->summary)
@@ -2184,6 +2506,10 @@ fail:
 	p->error = NULL;
 	p->threads = NULL;
 	p->threads_hash = NULL;
+	p->body_index_loaded = FALSE;
+	p->body_index_missing = NULL;
+	p->body_index_words = NULL;
+	p->body_index_matches = NULL;
 	search->folder = NULL;
 	search->summary = NULL;
 	search->summary_set = NULL;
@@ -45,6 +45,7 @@
 #include "camel-mime-filter-charset.h"
 #include "camel-mime-filter-html.h"
 #include "camel-mime-filter-index.h"
+#include "camel-mime-filter-save.h"
 #include "camel-mime-filter.h"
 #include "camel-mime-message.h"
 #include "camel-multipart.h"
@@ -54,6 +55,7 @@
 #include "camel-stream-null.h"
 #include "camel-string-utils.h"
 #include "camel-store.h"
+#include "camel-utf8.h"
 #include "camel-vee-folder.h"
 #include "camel-vtrash-folder.h"
 #include "camel-mime-part-utils.h"
@@ -64,6 +66,15 @@
 
 /* Make 5 minutes as default cache drop */
 #define SUMMARY_CACHE_DROP 300
+
+/* How many message infos all summaries together keep loaded by default;
+ * can be overridden with the CAMEL_SUMMARY_CACHE_LIMIT variable */
+#define SUMMARY_CACHE_LIMIT 50000
+
+/* How much of a message body goes into the body index, and how much
+ * text may wait for a save before the summary is saved to write it */
+#define BODY_INDEX_MAX_TEXT (256 * 1024)
+#define BODY_INDEX_MAX_PENDING (4 * 1024 * 1024)
 #define dd(x) if (camel_debug("sync")) x
 
 struct _CamelFolderSummaryPrivate {
@@ -80,6 +91,12 @@ struct _CamelFolderSummaryPrivate {
 
 	struct _CamelIndex *index;
 
+	struct _CamelStream *body_stream;	/* text of the message being parsed, through 'filter_save' */
+	gboolean collect_body;			/* whether to pass text parts through 'filter_save' */
+	gboolean body_index_failed;		/* the body index cannot be written, stop collecting */
+	GHashTable *body_texts;			/* uid -> gchar *, texts waiting for the body index */
+	gsize body_texts_size;
+
 	GRecMutex summary_lock;	/* for the summary hashtable/array */
 	GRecMutex io_lock;	/* load/save lock, for access to saved_count, etc */
 	GRecMutex filter_lock;	/* for accessing any of the filtering/indexing stuff, since we share them */
@@ -99,16 +116,43 @@ struct _CamelFolderSummaryPrivate {
 
 	gboolean build_content;	/* do we try and parse/index the content, or not? */
 
-	GHashTable *uids; /* uids of all known message infos; the 'value' are used flags for the message info */
+	GHashTable *uids; /* uids of all known message infos; the 'value' is the row of the message in the columns below, plus one */
+	GPtrArray *col_uid;		/* const gchar *, the key in 'uids' */
+	GArray *col_flags;		/* guint32 */
+	GArray *col_date_sent;		/* gint64 */
+	GArray *col_date_received;	/* gint64 */
+	GArray *col_size;		/* guint32 */
+	GPtrArray *uids_snapshot;	/* shared copy of 'col_uid', dropped on changes */
 	GHashTable *loaded_infos; /* uid->CamelMessageInfo *, those currently in memory */
 
 	struct _CamelFolder *folder; /* parent folder, for events */
 	time_t cache_load_time;
 	guint timeout_handle;
+
+	GQueue lru;		/* loaded infos, the most recently used first */
+	GHashTable *lru_links;	/* CamelMessageInfo * -> its link in 'lru' */
+	GWeakRef *cache_ref;	/* this summary's entry in cache_registry */
+
+	GHashTable *dirty_infos;	/* CamelMessageInfo * -> DIRTY_INFO_*, loaded infos to save */
 };
 
+/* How much of a dirty info has to be written */
+#define DIRTY_INFO_CHANGED	1	/* flags, user flags, tags, size or provider data */
+#define DIRTY_INFO_NEW		2	/* everything */
+
 static GMutex info_lock;
 
+/* The loaded infos of all summaries share one budget; these are
+ * the process-wide counters for it, guarded by atomic operations */
+static GMutex cache_registry_lock;
+static GSList *cache_registry;	/* GWeakRef * of every summary */
+static volatile gint cache_n_summaries;
+static volatile gint cache_loaded;
+static volatile gint cache_hits;
+static volatile gint cache_misses;
+static volatile gint cache_evictions;
+static volatile gint cache_trim_pending;
+
 /* this lock is ONLY for the standalone messageinfo stuff */
 #define GLOBAL_INFO_LOCK(i) g_mutex_lock(&info_lock)
 #define GLOBAL_INFO_UNLOCK(i) g_mutex_unlock(&info_lock)
@@ -128,6 +172,9 @@ struct _node {
 };
 
 static void cfs_schedule_info_release_timer (CamelFolderSummary *summary);
+static void cfs_cache_forget (CamelFolderSummary *summary, CamelMessageInfo *info);
+static void cfs_cache_forget_all (CamelFolderSummary *summary);
+static void cfs_dirty_add (CamelFolderSummary *summary, CamelMessageInfo *info, guint kind);
 
 static struct _node *my_list_append (struct _node **list, struct _node *n);
 static gint my_list_size (struct _node **list);
@@ -142,7 +189,7 @@ static CamelMessageContentInfo * content_info_new_from_parser (CamelFolderSummar
 static CamelMessageContentInfo * content_info_new_from_message (CamelFolderSummary *summary, CamelMimePart *mp);
 static void			 content_info_free (CamelFolderSummary *, CamelMessageContentInfo *);
 
-static gint save_message_infos_to_db (CamelFolderSummary *summary, gboolean fresh_mir, GError **error);
+static gint save_message_infos_to_db (CamelFolderSummary *summary, CamelDB *cdb, const gchar *full_name, GSList **saved_infos, GError **error);
 static gint camel_read_mir_callback (gpointer  ref, gint ncol, gchar ** cols, gchar ** name);
 
 static gchar *next_uid_string (CamelFolderSummary *summary);
@@ -190,6 +237,7 @@ remove_all_loaded (CamelFolderSummary *summary)
 
 	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_REF_LOCK);
 	g_hash_table_foreach_remove (summary->priv->loaded_infos, remove_each_item, &to_remove_infos);
+	cfs_cache_forget_all (summary);
 	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_REF_LOCK);
 
 	g_slist_foreach (to_remove_infos, (GFunc) camel_message_info_free, NULL);
@@ -256,6 +304,11 @@ folder_summary_dispose (GObject *object)
 		priv->filter_stream = NULL;
 	}
 
+	if (priv->body_stream != NULL) {
+		g_object_unref (priv->body_stream);
+		priv->body_stream = NULL;
+	}
+
 	if (priv->index != NULL) {
 		g_object_unref (priv->index);
 		priv->index = NULL;
@@ -277,8 +330,26 @@ folder_summary_finalize (GObject *object)
 	CamelFolderSummaryPrivate *priv = summary->priv;
 
 	g_hash_table_destroy (priv->uids);
+	g_ptr_array_free (priv->col_uid, TRUE);
+	g_array_free (priv->col_flags, TRUE);
+	g_array_free (priv->col_date_sent, TRUE);
+	g_array_free (priv->col_date_received, TRUE);
+	g_array_free (priv->col_size, TRUE);
+	if (priv->uids_snapshot != NULL)
+		g_ptr_array_unref (priv->uids_snapshot);
 	remove_all_loaded (summary);
 	g_hash_table_destroy (priv->loaded_infos);
+	g_hash_table_destroy (priv->lru_links);
+	g_hash_table_destroy (priv->dirty_infos);
+	g_hash_table_destroy (priv->body_texts);
+
+	g_mutex_lock (&cache_registry_lock);
+	cache_registry = g_slist_remove (cache_registry, priv->cache_ref);
+	g_mutex_unlock (&cache_registry_lock);
+
+	g_atomic_int_add (&cache_n_summaries, -1);
+	g_weak_ref_clear (priv->cache_ref);
+	g_free (priv->cache_ref);
 
 	g_hash_table_foreach (priv->filter_charset, free_o_name, NULL);
 	g_hash_table_destroy (priv->filter_charset);
@@ -410,6 +481,672 @@ is_in_memory_summary (CamelFolderSummary *summary)
 	return (summary->flags & CAMEL_FOLDER_SUMMARY_IN_MEMORY_ONLY) != 0;
 }
 
+static guint
+cfs_cache_get_limit (void)
+{
+	static gsize limit = 0;
+
+	if (g_once_init_enter (&limit)) {
+		const gchar *env = g_getenv ("CAMEL_SUMMARY_CACHE_LIMIT");
+		guint64 value = 0;
+
+		if (env)
+			value = g_ascii_strtoull (env, NULL, 10);
+
+		if (value == 0)
+			value = SUMMARY_CACHE_LIMIT;
+
+		g_once_init_leave (&limit, (gsize) MIN (value, G_MAXINT));
+	}
+
+	return (guint) limit;
+}
+
+/* Infos of in-memory summaries cannot be read back, and vFolders
+ * only hold references to the infos of their source folders,
+ * thus neither of them counts against the cache budget. */
+static gboolean
+cfs_cache_tracks (CamelFolderSummary *summary)
+{
+	return summary->priv->folder != NULL &&
+		!CAMEL_IS_VEE_FOLDER (summary->priv->folder) &&
+		!is_in_memory_summary (summary);
+}
+
+/* Dirty infos are pinned until they are saved; those still referenced
+ * by someone else than the summary cannot be released either. */
+static gboolean
+cfs_info_is_evictable (CamelMessageInfoBase *info)
+{
+	return info->refcount == 1 && !info->dirty &&
+		(info->flags & CAMEL_MESSAGE_FOLDER_FLAGGED) == 0;
+}
+
+/* Call with SUMMARY_LOCK held */
+static void
+cfs_cache_add (CamelFolderSummary *summary,
+               CamelMessageInfo *info)
+{
+	CamelFolderSummaryPrivate *priv = summary->priv;
+	CamelMessageInfo *old_info;
+	GList *link;
+
+	old_info = g_hash_table_lookup (priv->loaded_infos, camel_message_info_uid (info));
+	if (old_info != NULL && old_info != info)
+		cfs_cache_forget (summary, old_info);
+
+	/* Summary always holds a ref for the loaded infos */
+	g_hash_table_insert (priv->loaded_infos, (gpointer) camel_message_info_uid (info), info);
+
+	link = g_hash_table_lookup (priv->lru_links, info);
+	if (link != NULL) {
+		g_queue_unlink (&priv->lru, link);
+		g_queue_push_head_link (&priv->lru, link);
+	} else if (cfs_cache_tracks (summary)) {
+		g_queue_push_head (&priv->lru, info);
+		g_hash_table_insert (priv->lru_links, info, priv->lru.head);
+		g_atomic_int_inc (&cache_loaded);
+	}
+}
+
+/* Call with SUMMARY_LOCK held */
+static void
+cfs_cache_forget (CamelFolderSummary *summary,
+                  CamelMessageInfo *info)
+{
+	CamelFolderSummaryPrivate *priv = summary->priv;
+	GList *link;
+
+	g_hash_table_remove (priv->dirty_infos, info);
+
+	link = g_hash_table_lookup (priv->lru_links, info);
+	if (link == NULL)
+		return;
+
+	g_queue_delete_link (&priv->lru, link);
+	g_hash_table_remove (priv->lru_links, info);
+	g_atomic_int_add (&cache_loaded, -1);
+}
+
+/* Call with SUMMARY_LOCK held */
+static void
+cfs_cache_forget_all (CamelFolderSummary *summary)
+{
+	CamelFolderSummaryPrivate *priv = summary->priv;
+	guint length;
+
+	g_hash_table_remove_all (priv->dirty_infos);
+
+	length = g_queue_get_length (&priv->lru);
+	if (length == 0)
+		return;
+
+	g_queue_clear (&priv->lru);
+	g_hash_table_remove_all (priv->lru_links);
+	g_atomic_int_add (&cache_loaded, -(gint) length);
+}
+
+/* Call with SUMMARY_LOCK held */
+static void
+cfs_cache_touch (CamelFolderSummary *summary,
+                 CamelMessageInfo *info)
+{
+	CamelFolderSummaryPrivate *priv = summary->priv;
+	GList *link;
+
+	link = g_hash_table_lookup (priv->lru_links, info);
+	if (link == NULL || link == priv->lru.head)
+		return;
+
+	g_queue_unlink (&priv->lru, link);
+	g_queue_push_head_link (&priv->lru, link);
+}
+
+/* Remembers @info to be written by the next save; only the info loaded
+ * for its uid is saved, never copies of it. */
+static void
+cfs_dirty_add (CamelFolderSummary *summary,
+               CamelMessageInfo *info,
+               guint kind)
+{
+	CamelFolderSummaryPrivate *priv = summary->priv;
+	const gchar *uid = camel_message_info_uid (info);
+
+	if (uid == NULL || is_in_memory_summary (summary))
+		return;
+
+	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	if (g_hash_table_lookup (priv->loaded_infos, uid) == info) {
+		guint old_kind;
+
+		old_kind = GPOINTER_TO_UINT (g_hash_table_lookup (priv->dirty_infos, info));
+		if (kind > old_kind)
+			g_hash_table_insert (priv->dirty_infos, info, GUINT_TO_POINTER (kind));
+	}
+
+	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+}
+
+/* Releases evictable infos, the least recently used first, until at
+ * most @keep of them remain loaded.  Call with SUMMARY_LOCK held. */
+static guint
+cfs_cache_evict (CamelFolderSummary *summary,
+                 guint keep)
+{
+	CamelFolderSummaryPrivate *priv = summary->priv;
+	GSList *to_remove_infos = NULL;
+	GList *link;
+	guint evicted = 0;
+
+	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_REF_LOCK);
+
+	link = priv->lru.tail;
+	while (link != NULL && g_queue_get_length (&priv->lru) > keep) {
+		CamelMessageInfoBase *info = link->data;
+		GList *prev = link->prev;
+
+		if (cfs_info_is_evictable (info)) {
+			g_hash_table_remove (priv->loaded_infos, info->uid);
+			cfs_cache_forget (summary, (CamelMessageInfo *) info);
+			to_remove_infos = g_slist_prepend (to_remove_infos, info);
+			evicted++;
+		}
+
+		link = prev;
+	}
+
+	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_REF_LOCK);
+
+	g_slist_foreach (to_remove_infos, (GFunc) camel_message_info_free, NULL);
+	g_slist_free (to_remove_infos);
+
+	if (evicted > 0)
+		g_atomic_int_add (&cache_evictions, evicted);
+
+	return evicted;
+}
+
+static void
+cfs_cache_trim_others (CamelSession *session,
+                       GCancellable *cancellable,
+                       CamelFolderSummary *spare,
+                       GError **error)
+{
+	GSList *summaries = NULL, *link;
+	guint limit, low_water, share;
+
+	g_mutex_lock (&cache_registry_lock);
+	for (link = cache_registry; link != NULL; link = g_slist_next (link)) {
+		CamelFolderSummary *summary = g_weak_ref_get (link->data);
+
+		if (summary != NULL)
+			summaries = g_slist_prepend (summaries, summary);
+	}
+	g_mutex_unlock (&cache_registry_lock);
+
+	limit = cfs_cache_get_limit ();
+	low_water = limit - limit / 10;
+	share = limit / MAX (g_slist_length (summaries), 1);
+
+	for (link = summaries; link != NULL; link = g_slist_next (link)) {
+		CamelFolderSummary *summary = link->data;
+
+		if (g_atomic_int_get (&cache_loaded) <= (gint) low_water)
+			break;
+
+		if (summary == spare)
+			continue;
+
+		camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+		if (g_queue_get_length (&summary->priv->lru) > share)
+			cfs_cache_evict (summary, share);
+		camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+	}
+
+	g_slist_free_full (summaries, (GDestroyNotify) g_object_unref);
+}
+
+static void
+cfs_cache_trim_done (CamelFolderSummary *spare)
+{
+	g_atomic_int_set (&cache_trim_pending, 0);
+	g_object_unref (spare);
+}
+
+/* Brings the number of loaded infos of all summaries back under the
+ * budget.  This summary gives up the infos it holds over its fair share
+ * of the budget right away, unless @trim_self is FALSE; other summaries
+ * are trimmed from a session job, because their locks cannot be taken
+ * while holding this one.  Call with SUMMARY_LOCK held. */
+static void
+cfs_cache_enforce_limit (CamelFolderSummary *summary,
+                         gboolean trim_self)
+{
+	CamelStore *parent_store;
+	CamelSession *session;
+	guint limit, low_water, loaded;
+
+	if (!cfs_cache_tracks (summary))
+		return;
+
+	limit = cfs_cache_get_limit ();
+	loaded = g_atomic_int_get (&cache_loaded);
+
+	if (loaded <= limit)
+		return;
+
+	if (trim_self) {
+		guint share, length, excess, keep;
+
+		low_water = limit - limit / 10;
+		share = limit / MAX (g_atomic_int_get (&cache_n_summaries), 1);
+		length = g_queue_get_length (&summary->priv->lru);
+		excess = loaded - low_water;
+		keep = length > excess ? length - excess : 0;
+
+		if (length > share) {
+			cfs_cache_evict (summary, MAX (keep, share));
+
+			if (g_atomic_int_get (&cache_loaded) <= (gint) limit)
+				return;
+		}
+	}
+
+	if (!g_atomic_int_compare_and_exchange (&cache_trim_pending, 0, 1))
+		return;
+
+	parent_store = camel_folder_get_parent_store (summary->priv->folder);
+	session = camel_service_ref_session (CAMEL_SERVICE (parent_store));
+
+	camel_session_submit_job (
+		session,
+		(CamelSessionCallback) cfs_cache_trim_others,
+		g_object_ref (summary),
+		(GDestroyNotify) cfs_cache_trim_done);
+
+	g_object_unref (session);
+}
+
+/* Every known message, loaded or not, has a row in the columns of the
+ * summary, holding the fields most often needed for counting, filtering
+ * and sorting the whole folder.  Rows are kept dense; removing one moves
+ * the last row into its place.  Call all of these with SUMMARY_LOCK held. */
+
+/* Arrays handed out by camel_folder_summary_ref_array() are never
+ * changed; a change of the set of uids only drops the summary's ref */
+static void
+cfs_uids_snapshot_drop (CamelFolderSummary *summary)
+{
+	if (summary->priv->uids_snapshot != NULL) {
+		g_ptr_array_unref (summary->priv->uids_snapshot);
+		summary->priv->uids_snapshot = NULL;
+	}
+}
+
+/* Message texts for the full-text index of CamelDB.  They wait in
+ * 'body_texts' and are written with the next save, as part of its
+ * transaction.  Call with SUMMARY_LOCK held, unless noted. */
+
+static gboolean
+cfs_body_index_wanted (CamelFolderSummary *summary)
+{
+	return summary->priv->folder != NULL &&
+		!summary->priv->body_index_failed &&
+		!is_in_memory_summary (summary);
+}
+
+static void
+cfs_body_index_forget (CamelFolderSummary *summary,
+                       const gchar *uid)
+{
+	CamelFolderSummaryPrivate *priv = summary->priv;
+	const gchar *text;
+
+	text = g_hash_table_lookup (priv->body_texts, uid);
+	if (text != NULL) {
+		priv->body_texts_size -= strlen (text);
+		g_hash_table_remove (priv->body_texts, uid);
+	}
+}
+
+/* Returns NULL for texts too long to index; searches look into
+ * those messages themselves rather than see only a part of them */
+static gchar *
+cfs_body_text_from_bytes (GByteArray *bytes)
+{
+	gchar *raw, *text;
+
+	if (bytes->len == 0)
+		return g_strdup ("");
+
+	if (bytes->len > BODY_INDEX_MAX_TEXT)
+		return NULL;
+
+	raw = g_strndup ((const gchar *) bytes->data, bytes->len);
+	text = camel_utf8_make_valid (raw);
+	g_free (raw);
+
+	return text;
+}
+
+/* Appends the decoded text parts of 'part' to 'stream', one per line */
+static void
+cfs_body_text_append (CamelMimePart *part,
+                      CamelStream *stream)
+{
+	CamelDataWrapper *containee;
+	CamelContentType *ct;
+
+	containee = camel_medium_get_content (CAMEL_MEDIUM (part));
+	if (containee == NULL)
+		return;
+
+	ct = containee->mime_type;
+
+	if (CAMEL_IS_MULTIPART (containee)) {
+		gint ii, parts;
+
+		parts = camel_multipart_get_number (CAMEL_MULTIPART (containee));
+		for (ii = 0; ii < parts; ii++)
+			cfs_body_text_append (
+				camel_multipart_get_part (CAMEL_MULTIPART (containee), ii),
+				stream);
+	} else if (CAMEL_IS_MIME_MESSAGE (containee)) {
+		cfs_body_text_append (CAMEL_MIME_PART (containee), stream);
+	} else if (camel_content_type_is (ct, "text", "*")) {
+		CamelStream *filter_stream;
+		CamelMimeFilter *filter;
+		const gchar *charset;
+
+		filter_stream = camel_stream_filter_new (stream);
+
+		charset = camel_content_type_param (ct, "charset");
+		if (charset != NULL &&
+		    g_ascii_strcasecmp (charset, "us-ascii") != 0 &&
+		    g_ascii_strcasecmp (charset, "utf-8") != 0) {
+			filter = camel_mime_filter_charset_new (charset, "UTF-8");
+			if (filter != NULL) {
+				camel_stream_filter_add (CAMEL_STREAM_FILTER (filter_stream), filter);
+				g_object_unref (filter);
+			}
+		}
+
+		if (camel_content_type_is (ct, "text", "html")) {
+			filter = camel_mime_filter_html_new ();
+			camel_stream_filter_add (CAMEL_STREAM_FILTER (filter_stream), filter);
+			g_object_unref (filter);
+		}
+
+		camel_data_wrapper_decode_to_stream_sync (
+			containee, filter_stream, NULL, NULL);
+		camel_stream_flush (filter_stream, NULL, NULL);
+		g_object_unref (filter_stream);
+
+		camel_stream_write_string (stream, "\n", NULL, NULL);
+	}
+}
+
+/* Takes 'text', which may be NULL; need not hold SUMMARY_LOCK,
+ * it may save the summary */
+static void
+cfs_body_index_add (CamelFolderSummary *summary,
+                    const gchar *uid,
+                    gchar *text)
+{
+	CamelFolderSummaryPrivate *priv = summary->priv;
+	gboolean flush;
+
+	if (text == NULL)
+		return;
+
+	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	cfs_body_index_forget (summary, uid);
+	g_hash_table_insert (priv->body_texts, (gpointer) camel_pstring_strdup (uid), text);
+	priv->body_texts_size += strlen (text);
+	flush = priv->body_texts_size > BODY_INDEX_MAX_PENDING;
+
+	camel_folder_summary_touch (summary);
+
+	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	if (flush)
+		camel_folder_summary_save_to_db (summary, NULL);
+}
+
+/* Called in the save transaction; the texts are dropped after it
+ * commits.  A failure here does not fail the save. */
+static void
+save_body_texts_to_db (CamelFolderSummary *summary,
+                       CamelDB *cdb,
+                       const gchar *full_name)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	GError *local_error = NULL;
+
+	g_hash_table_iter_init (&iter, summary->priv->body_texts);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (camel_db_write_body_index_record (cdb, full_name, key, value, &local_error) != 0) {
+			g_warning (
+				"Cannot index message bodies of '%s': %s",
+				full_name, local_error ? local_error->message : "Unknown error");
+			g_clear_error (&local_error);
+
+			summary->priv->body_index_failed = TRUE;
+			break;
+		}
+	}
+}
+
+static gboolean
+cfs_columns_lookup (CamelFolderSummary *summary,
+                    const gchar *uid,
+                    guint *out_row)
+{
+	gpointer value;
+
+	value = g_hash_table_lookup (summary->priv->uids, uid);
+	if (value == NULL)
+		return FALSE;
+
+	*out_row = GPOINTER_TO_UINT (value) - 1;
+
+	return TRUE;
+}
+
+static guint
+cfs_columns_ensure_row (CamelFolderSummary *summary,
+                        const gchar *uid)
+{
+	CamelFolderSummaryPrivate *priv = summary->priv;
+	const gchar *key;
+	guint row;
+
+	if (cfs_columns_lookup (summary, uid, &row))
+		return row;
+
+	cfs_uids_snapshot_drop (summary);
+
+	key = camel_pstring_strdup (uid);
+	row = priv->col_uid->len;
+
+	g_hash_table_insert (priv->uids, (gpointer) key, GUINT_TO_POINTER (row + 1));
+	g_ptr_array_add (priv->col_uid, (gpointer) key);
+
+	/* new elements are cleared */
+	g_array_set_size (priv->col_flags, row + 1);
+	g_array_set_size (priv->col_date_sent, row + 1);
+	g_array_set_size (priv->col_date_received, row + 1);
+	g_array_set_size (priv->col_size, row + 1);
+
+	return row;
+}
+
+static void
+cfs_columns_set (CamelFolderSummary *summary,
+                 const gchar *uid,
+                 guint32 flags,
+                 gint64 date_sent,
+                 gint64 date_received,
+                 guint32 size)
+{
+	CamelFolderSummaryPrivate *priv = summary->priv;
+	guint row;
+
+	row = cfs_columns_ensure_row (summary, uid);
+
+	g_array_index (priv->col_flags, guint32, row) = flags;
+	g_array_index (priv->col_date_sent, gint64, row) = date_sent;
+	g_array_index (priv->col_date_received, gint64, row) = date_received;
+	g_array_index (priv->col_size, guint32, row) = size;
+}
+
+static void
+cfs_columns_set_from_info (CamelFolderSummary *summary,
+                           CamelMessageInfo *info)
+{
+	const gchar *uid = camel_message_info_uid (info);
+	guint row;
+
+	/* The fields of vFolder infos are read from the infos of their
+	 * source folders, which would load each of them; keep only the
+	 * flags of those, which are always needed. */
+	if (summary->priv->folder && CAMEL_IS_VEE_FOLDER (summary->priv->folder)) {
+		row = cfs_columns_ensure_row (summary, uid);
+		g_array_index (summary->priv->col_flags, guint32, row) = camel_message_info_flags (info);
+		return;
+	}
+
+	cfs_columns_set (
+		summary, uid,
+		camel_message_info_flags (info),
+		camel_message_info_date_sent (info),
+		camel_message_info_date_received (info),
+		camel_message_info_size (info));
+}
+
+static guint32
+cfs_columns_get_flags (CamelFolderSummary *summary,
+                       const gchar *uid)
+{
+	guint row;
+
+	if (!cfs_columns_lookup (summary, uid, &row))
+		return 0;
+
+	return g_array_index (summary->priv->col_flags, guint32, row);
+}
+
+static void
+cfs_columns_set_flags (CamelFolderSummary *summary,
+                       const gchar *uid,
+                       guint32 flags)
+{
+	guint row;
+
+	row = cfs_columns_ensure_row (summary, uid);
+	g_array_index (summary->priv->col_flags, guint32, row) = flags;
+}
+
+static gboolean
+cfs_columns_remove (CamelFolderSummary *summary,
+                    const gchar *uid,
+                    guint32 *out_flags)
+{
+	CamelFolderSummaryPrivate *priv = summary->priv;
+	const gchar *key;
+	guint row, last;
+
+	if (!cfs_columns_lookup (summary, uid, &row))
+		return FALSE;
+
+	if (out_flags)
+		*out_flags = g_array_index (priv->col_flags, guint32, row);
+
+	cfs_uids_snapshot_drop (summary);
+
+	if (g_hash_table_size (priv->body_texts) > 0)
+		cfs_body_index_forget (summary, uid);
+
+	key = g_ptr_array_index (priv->col_uid, row);
+	last = priv->col_uid->len - 1;
+
+	if (row != last) {
+		const gchar *moved_key;
+
+		moved_key = g_ptr_array_index (priv->col_uid, last);
+
+		g_ptr_array_index (priv->col_uid, row) = (gpointer) moved_key;
+		g_array_index (priv->col_flags, guint32, row) =
+			g_array_index (priv->col_flags, guint32, last);
+		g_array_index (priv->col_date_sent, gint64, row) =
+			g_array_index (priv->col_date_sent, gint64, last);
+		g_array_index (priv->col_date_received, gint64, row) =
+			g_array_index (priv->col_date_received, gint64, last);
+		g_array_index (priv->col_size, guint32, row) =
+			g_array_index (priv->col_size, guint32, last);
+
+		/* the hash table keeps its key and frees the new one */
+		g_hash_table_insert (
+			priv->uids,
+			(gpointer) camel_pstring_strdup (moved_key),
+			GUINT_TO_POINTER (row + 1));
+	}
+
+	g_ptr_array_set_size (priv->col_uid, last);
+	g_array_set_size (priv->col_flags, last);
+	g_array_set_size (priv->col_date_sent, last);
+	g_array_set_size (priv->col_date_received, last);
+	g_array_set_size (priv->col_size, last);
+
+	/* this frees the key */
+	g_hash_table_remove (priv->uids, key);
+
+	return TRUE;
+}
+
+static void
+cfs_columns_clear (CamelFolderSummary *summary)
+{
+	CamelFolderSummaryPrivate *priv = summary->priv;
+
+	cfs_uids_snapshot_drop (summary);
+
+	g_hash_table_remove_all (priv->body_texts);
+	priv->body_texts_size = 0;
+
+	g_ptr_array_set_size (priv->col_uid, 0);
+	g_array_set_size (priv->col_flags, 0);
+	g_array_set_size (priv->col_date_sent, 0);
+	g_array_set_size (priv->col_date_received, 0);
+	g_array_set_size (priv->col_size, 0);
+
+	g_hash_table_remove_all (priv->uids);
+}
+
+static gint
+cfs_read_columns_cb (gpointer ref,
+                     gint ncol,
+                     gchar **cols,
+                     gchar **name)
+{
+	CamelFolderSummary *summary = ref;
+
+	if (ncol < 5 || cols[0] == NULL)
+		return 0;
+
+	cfs_columns_set (
+		summary, cols[0],
+		cols[1] ? strtoul (cols[1], NULL, 10) : 0,
+		cols[3] ? g_ascii_strtoll (cols[3], NULL, 10) : 0,
+		cols[4] ? g_ascii_strtoll (cols[4], NULL, 10) : 0,
+		cols[2] ? strtoul (cols[2], NULL, 10) : 0);
+
+	return 0;
+}
+
 #define UPDATE_COUNTS_ADD		(1)
 #define UPDATE_COUNTS_SUB		(2)
 #define UPDATE_COUNTS_ADD_WITHOUT_TOTAL (3)
@@ -897,7 +1634,7 @@ camel_folder_summary_replace_flags (CamelFolderSummary *summary,
 	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
 	g_object_freeze_notify (summary_object);
 
-	old_flags = GPOINTER_TO_UINT (g_hash_table_lookup (summary->priv->uids, camel_message_info_uid (info)));
+	old_flags = cfs_columns_get_flags (summary, camel_message_info_uid (info));
 	new_flags = camel_message_info_flags (info);
 
 	if ((old_flags & ~CAMEL_MESSAGE_FOLDER_FLAGGED) == (new_flags & ~CAMEL_MESSAGE_FOLDER_FLAGGED)) {
@@ -940,10 +1677,7 @@ camel_folder_summary_replace_flags (CamelFolderSummary *summary,
 	changed = folder_summary_update_counts_by_flags (summary, added_flags, UPDATE_COUNTS_ADD_WITHOUT_TOTAL) || changed;
 
 	/* update current flags on the summary */
-	g_hash_table_insert (
-		summary->priv->uids,
-		(gpointer) camel_pstring_strdup (camel_message_info_uid (info)),
-		GUINT_TO_POINTER (new_flags));
+	cfs_columns_set_flags (summary, camel_message_info_uid (info), new_flags);
 
 	g_object_thaw_notify (summary_object);
 	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
@@ -1094,6 +1828,7 @@ info_set_user_flag (CamelMessageInfo *info,
 
 		mi->flags |= CAMEL_MESSAGE_FOLDER_FLAGGED;
 		mi->dirty = TRUE;
+		cfs_dirty_add (mi->summary, info, DIRTY_INFO_CHANGED);
 		camel_folder_summary_touch (mi->summary);
 		camel_folder_change_info_change_uid (changes, camel_message_info_uid (info));
 		camel_folder_changed (mi->summary->priv->folder, changes);
@@ -1119,6 +1854,7 @@ info_set_user_tag (CamelMessageInfo *info,
 
 		mi->flags |= CAMEL_MESSAGE_FOLDER_FLAGGED;
 		mi->dirty = TRUE;
+		cfs_dirty_add (mi->summary, info, DIRTY_INFO_CHANGED);
 		camel_folder_summary_touch (mi->summary);
 		camel_folder_change_info_change_uid (changes, camel_message_info_uid (info));
 		camel_folder_changed (mi->summary->priv->folder, changes);
@@ -1142,8 +1878,10 @@ info_set_flags (CamelMessageInfo *info,
 	if (old != mi->flags) {
 		mi->flags |= CAMEL_MESSAGE_FOLDER_FLAGGED;
 		mi->dirty = TRUE;
-		if (mi->summary)
+		if (mi->summary) {
+			cfs_dirty_add (mi->summary, info, DIRTY_INFO_CHANGED);
 			camel_folder_summary_touch (mi->summary);
+		}
 	}
 
 	if (mi->summary) {
@@ -1377,8 +2115,29 @@ camel_folder_summary_init (CamelFolderSummary *summary)
 
 	summary->priv->nextuid = 1;
 	summary->priv->uids = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify) camel_pstring_free, NULL);
+	summary->priv->col_uid = g_ptr_array_new ();
+	summary->priv->col_flags = g_array_new (FALSE, TRUE, sizeof (guint32));
+	summary->priv->col_date_sent = g_array_new (FALSE, TRUE, sizeof (gint64));
+	summary->priv->col_date_received = g_array_new (FALSE, TRUE, sizeof (gint64));
+	summary->priv->col_size = g_array_new (FALSE, TRUE, sizeof (guint32));
 	summary->priv->loaded_infos = g_hash_table_new (g_str_hash, g_str_equal);
 
+	g_queue_init (&summary->priv->lru);
+	summary->priv->lru_links = g_hash_table_new (g_direct_hash, g_direct_equal);
+	summary->priv->dirty_infos = g_hash_table_new (g_direct_hash, g_direct_equal);
+	summary->priv->body_texts = g_hash_table_new_full (
+		g_str_hash, g_str_equal,
+		(GDestroyNotify) camel_pstring_free, g_free);
+
+	summary->priv->cache_ref = g_new0 (GWeakRef, 1);
+	g_weak_ref_init (summary->priv->cache_ref, summary);
+
+	g_mutex_lock (&cache_registry_lock);
+	cache_registry = g_slist_prepend (cache_registry, summary->priv->cache_ref);
+	g_mutex_unlock (&cache_registry_lock);
+
+	g_atomic_int_inc (&cache_n_summaries);
+
 	g_rec_mutex_init (&summary->priv->summary_lock);
 	g_rec_mutex_init (&summary->priv->io_lock);
 	g_rec_mutex_init (&summary->priv->filter_lock);
@@ -1556,6 +2315,126 @@ camel_folder_summary_get_index (CamelFolderSummary *summary)
 	return summary->priv->index;
 }
 
+/**
+ * camel_folder_summary_index_message:
+ * @summary: a #CamelFolderSummary object
+ * @uid: uid of the message
+ * @message: the #CamelMimeMessage of @uid
+ *
+ * Adds the text parts of @message to the full-text index of message
+ * bodies which the #CamelDB of the folder keeps, unless they are in
+ * it already.  body-contains searches answer from this index for
+ * indexed messages, without opening them.  The text is written with
+ * the next camel_folder_summary_save_to_db().
+ *
+ * Messages parsed by camel_folder_summary_add_from_parser() are
+ * indexed this way whenever the summary has a #CamelIndex set.
+ *
+ * Since: 3.10
+ **/
+void
+camel_folder_summary_index_message (CamelFolderSummary *summary,
+                                    const gchar *uid,
+                                    CamelMimeMessage *message)
+{
+	CamelStore *parent_store;
+	CamelStream *stream;
+	const gchar *full_name;
+	gboolean pending;
+
+	g_return_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary));
+	g_return_if_fail (uid != NULL);
+	g_return_if_fail (CAMEL_IS_MIME_MESSAGE (message));
+
+	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+	pending = !cfs_body_index_wanted (summary) ||
+		g_hash_table_contains (summary->priv->body_texts, uid);
+	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	if (pending)
+		return;
+
+	full_name = camel_folder_get_full_name (summary->priv->folder);
+	parent_store = camel_folder_get_parent_store (summary->priv->folder);
+
+	if (camel_db_has_body_index_record (parent_store->cdb_r, full_name, uid))
+		return;
+
+	stream = camel_stream_mem_new ();
+	cfs_body_text_append (CAMEL_MIME_PART (message), stream);
+	cfs_body_index_add (
+		summary, uid,
+		cfs_body_text_from_bytes (
+		camel_stream_mem_get_byte_array (CAMEL_STREAM_MEM (stream))));
+	g_object_unref (stream);
+}
+
+/**
+ * camel_folder_summary_get_unindexed_uids:
+ * @summary: a #CamelFolderSummary object
+ *
+ * Finds the messages of @summary whose bodies cannot be looked up in
+ * the full-text index of the #CamelDB, because they were not indexed,
+ * or because they or their texts were not saved yet.  Searches use
+ * the index for the other messages only.
+ *
+ * Returns: (transfer full): a #GHashTable with the uids as keys from
+ * the string pool, or %NULL if the folder has no body index.  Free with
+ * g_hash_table_destroy().
+ *
+ * Since: 3.10
+ **/
+GHashTable *
+camel_folder_summary_get_unindexed_uids (CamelFolderSummary *summary)
+{
+	CamelFolderSummaryPrivate *priv;
+	CamelStore *parent_store;
+	GHashTable *uids;
+	GHashTableIter iter;
+	gpointer key, value;
+	const gchar *full_name;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), NULL);
+
+	priv = summary->priv;
+
+	if (priv->folder == NULL || is_in_memory_summary (summary))
+		return NULL;
+
+	full_name = camel_folder_get_full_name (priv->folder);
+	parent_store = camel_folder_get_parent_store (priv->folder);
+
+	uids = g_hash_table_new_full (
+		g_str_hash, g_str_equal,
+		(GDestroyNotify) camel_pstring_free, NULL);
+
+	/* A save holds the lock while it writes, thus the database
+	 * and what waits for the next save agree with each other. */
+	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	if (camel_db_get_body_index_missing_uids (parent_store->cdb_r, full_name, uids, NULL) != 0) {
+		camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+		g_hash_table_destroy (uids);
+		return NULL;
+	}
+
+	g_hash_table_iter_init (&iter, priv->dirty_infos);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (GPOINTER_TO_UINT (value) == DIRTY_INFO_NEW)
+			g_hash_table_add (
+				uids, (gpointer) camel_pstring_strdup (
+				camel_message_info_uid (key)));
+	}
+
+	g_hash_table_iter_init (&iter, priv->body_texts);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		g_hash_table_add (uids, (gpointer) camel_pstring_strdup (key));
+
+	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	return uids;
+}
+
 /**
  * camel_folder_summary_set_build_content:
  * @summary: a #CamelFolderSummary object
@@ -1734,87 +2613,304 @@ camel_folder_summary_count (CamelFolderSummary *summary)
 /**
  * camel_folder_summary_check_uid
  * @summary: a #CamelFolderSummary object
- * @uid: a uid
+ * @uid: a uid
+ *
+ * Check if the uid is valid. This isn't very efficient, so it shouldn't be called iteratively.
+ *
+ *
+ * Returns: if the uid is present in the summary or not  (%TRUE or %FALSE)
+ *
+ * Since: 2.24
+ **/
+gboolean
+camel_folder_summary_check_uid (CamelFolderSummary *summary,
+                                const gchar *uid)
+{
+	gboolean ret;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), FALSE);
+	g_return_val_if_fail (uid != NULL, FALSE);
+
+	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	ret = g_hash_table_lookup_extended (summary->priv->uids, uid, NULL, NULL);
+
+	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	return ret;
+}
+
+/**
+ * camel_folder_summary_get_array:
+ * @summary: a #CamelFolderSummary object
+ *
+ * Obtain a copy of the summary array.  This is done atomically,
+ * so cannot contain empty entries.
+ *
+ * Free with camel_folder_summary_free_array()
+ *
+ * Returns: a #GPtrArray of uids
+ *
+ * Since: 3.4
+ **/
+GPtrArray *
+camel_folder_summary_get_array (CamelFolderSummary *summary)
+{
+	GPtrArray *col_uid, *res;
+	guint ii;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), NULL);
+
+	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	col_uid = summary->priv->col_uid;
+	res = g_ptr_array_sized_new (col_uid->len);
+
+	for (ii = 0; ii < col_uid->len; ii++)
+		g_ptr_array_add (res, (gpointer) camel_pstring_strdup (col_uid->pdata[ii]));
+
+	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	return res;
+}
+
+/**
+ * camel_folder_summary_free_array:
+ * @array: a #GPtrArray returned from camel_folder_summary_get_array()
+ *
+ * Free's array and its elements returned from camel_folder_summary_get_array().
+ *
+ * Since: 3.4
+ **/
+void
+camel_folder_summary_free_array (GPtrArray *array)
+{
+	if (!array)
+		return;
+
+	g_ptr_array_foreach (array, (GFunc) camel_pstring_free, NULL);
+	g_ptr_array_free (array, TRUE);
+}
+
+/**
+ * camel_folder_summary_ref_array:
+ * @summary: a #CamelFolderSummary object
+ *
+ * Like camel_folder_summary_get_array(), but the array is shared by
+ * all callers until the set of messages in @summary changes, instead
+ * of being copied for each.  Such a change never modifies an array
+ * already handed out; the next call returns a new one instead.  The
+ * array must not be modified.
+ *
+ * Free with g_ptr_array_unref()
+ *
+ * Returns: (element-type utf8) (transfer full): a #GPtrArray of uids
+ *
+ * Since: 3.10
+ **/
+GPtrArray *
+camel_folder_summary_ref_array (CamelFolderSummary *summary)
+{
+	CamelFolderSummaryPrivate *priv;
+	GPtrArray *array;
+	guint ii;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), NULL);
+
+	priv = summary->priv;
+
+	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	if (priv->uids_snapshot == NULL) {
+		priv->uids_snapshot = g_ptr_array_new_full (
+			priv->col_uid->len, (GDestroyNotify) camel_pstring_free);
+
+		for (ii = 0; ii < priv->col_uid->len; ii++)
+			g_ptr_array_add (
+				priv->uids_snapshot,
+				(gpointer) camel_pstring_strdup (priv->col_uid->pdata[ii]));
+	}
+
+	array = g_ptr_array_ref (priv->uids_snapshot);
+
+	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	return array;
+}
+
+/**
+ * camel_folder_summary_count_by_flags:
+ * @summary: a #CamelFolderSummary object
+ * @mask: the #CamelMessageFlags to look at
+ * @value: the expected value of the flags in @mask
+ *
+ * Counts the messages in @summary whose flags, masked with @mask,
+ * are equal to @value.  None of the message infos is loaded for it.
+ *
+ * Returns: the number of matching messages
+ *
+ * Since: 3.10
+ **/
+guint
+camel_folder_summary_count_by_flags (CamelFolderSummary *summary,
+                                     guint32 mask,
+                                     guint32 value)
+{
+	const guint32 *flags;
+	guint ii, len, count = 0;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), 0);
+
+	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	flags = (const guint32 *) summary->priv->col_flags->data;
+	len = summary->priv->col_flags->len;
+
+	for (ii = 0; ii < len; ii++) {
+		if ((flags[ii] & mask) == value)
+			count++;
+	}
+
+	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	return count;
+}
+
+/**
+ * camel_folder_summary_get_array_by_flags:
+ * @summary: a #CamelFolderSummary object
+ * @mask: the #CamelMessageFlags to look at
+ * @value: the expected value of the flags in @mask
  *
- * Check if the uid is valid. This isn't very efficient, so it shouldn't be called iteratively.
+ * Like camel_folder_summary_get_array(), only returns uids of those
+ * messages whose flags, masked with @mask, are equal to @value.
+ * None of the message infos is loaded for it.
  *
+ * Free with camel_folder_summary_free_array()
  *
- * Returns: if the uid is present in the summary or not  (%TRUE or %FALSE)
+ * Returns: (element-type utf8) (transfer full): a #GPtrArray of uids
  *
- * Since: 2.24
+ * Since: 3.10
  **/
-gboolean
-camel_folder_summary_check_uid (CamelFolderSummary *summary,
-                                const gchar *uid)
+GPtrArray *
+camel_folder_summary_get_array_by_flags (CamelFolderSummary *summary,
+                                         guint32 mask,
+                                         guint32 value)
 {
-	gboolean ret;
+	GPtrArray *col_uid, *res;
+	const guint32 *flags;
+	guint ii;
 
-	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), FALSE);
-	g_return_val_if_fail (uid != NULL, FALSE);
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), NULL);
 
 	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
 
-	ret = g_hash_table_lookup_extended (summary->priv->uids, uid, NULL, NULL);
+	col_uid = summary->priv->col_uid;
+	flags = (const guint32 *) summary->priv->col_flags->data;
+	res = g_ptr_array_new ();
+
+	for (ii = 0; ii < col_uid->len; ii++) {
+		if ((flags[ii] & mask) == value)
+			g_ptr_array_add (res, (gpointer) camel_pstring_strdup (col_uid->pdata[ii]));
+	}
 
 	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
 
-	return ret;
+	return res;
 }
 
-static void
-folder_summary_dupe_uids_to_array (gpointer key_uid,
-                                   gpointer value_flags,
-                                   gpointer user_data)
+struct _sort_rows_data {
+	CamelFolderSummaryPrivate *priv;
+	CamelFolderSummarySortField field;
+	gint direction;
+};
+
+static gint
+cfs_compare_rows (gconstpointer a,
+                  gconstpointer b,
+                  gpointer user_data)
 {
-	g_ptr_array_add (user_data, (gpointer) camel_pstring_strdup (key_uid));
+	struct _sort_rows_data *data = user_data;
+	guint row_a = *((const guint *) a);
+	guint row_b = *((const guint *) b);
+	gint64 value_a, value_b;
+
+	switch (data->field) {
+	case CAMEL_FOLDER_SUMMARY_SORT_DATE_SENT:
+		value_a = g_array_index (data->priv->col_date_sent, gint64, row_a);
+		value_b = g_array_index (data->priv->col_date_sent, gint64, row_b);
+		break;
+	case CAMEL_FOLDER_SUMMARY_SORT_DATE_RECEIVED:
+		value_a = g_array_index (data->priv->col_date_received, gint64, row_a);
+		value_b = g_array_index (data->priv->col_date_received, gint64, row_b);
+		break;
+	case CAMEL_FOLDER_SUMMARY_SORT_SIZE:
+	default:
+		value_a = g_array_index (data->priv->col_size, guint32, row_a);
+		value_b = g_array_index (data->priv->col_size, guint32, row_b);
+		break;
+	}
+
+	if (value_a != value_b)
+		return value_a < value_b ? -data->direction : data->direction;
+
+	/* keep the sort stable */
+	return row_a < row_b ? -1 : row_a > row_b ? 1 : 0;
 }
 
 /**
- * camel_folder_summary_get_array:
+ * camel_folder_summary_get_sorted_array:
  * @summary: a #CamelFolderSummary object
+ * @field: a #CamelFolderSummarySortField to sort by
+ * @ascending: whether to sort in ascending order
  *
- * Obtain a copy of the summary array.  This is done atomically,
- * so cannot contain empty entries.
+ * Like camel_folder_summary_get_array(), only the uids are sorted by
+ * @field.  None of the message infos is loaded for it.  Virtual folders
+ * do not know the dates and sizes of their messages, their uids are
+ * returned in the order they were added.
  *
  * Free with camel_folder_summary_free_array()
  *
- * Returns: a #GPtrArray of uids
+ * Returns: (element-type utf8) (transfer full): a #GPtrArray of uids
  *
- * Since: 3.4
+ * Since: 3.10
  **/
 GPtrArray *
-camel_folder_summary_get_array (CamelFolderSummary *summary)
+camel_folder_summary_get_sorted_array (CamelFolderSummary *summary,
+                                       CamelFolderSummarySortField field,
+                                       gboolean ascending)
 {
-	GPtrArray *res;
+	struct _sort_rows_data data;
+	GPtrArray *col_uid, *res;
+	guint *rows;
+	guint ii;
 
 	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), NULL);
 
 	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
 
-	res = g_ptr_array_sized_new (g_hash_table_size (summary->priv->uids));
-	g_hash_table_foreach (summary->priv->uids, folder_summary_dupe_uids_to_array, res);
+	col_uid = summary->priv->col_uid;
+	rows = g_new (guint, col_uid->len + 1);
 
-	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+	for (ii = 0; ii < col_uid->len; ii++)
+		rows[ii] = ii;
 
-	return res;
-}
+	data.priv = summary->priv;
+	data.field = field;
+	data.direction = ascending ? 1 : -1;
 
-/**
- * camel_folder_summary_free_array:
- * @array: a #GPtrArray returned from camel_folder_summary_get_array()
- *
- * Free's array and its elements returned from camel_folder_summary_get_array().
- *
- * Since: 3.4
- **/
-void
-camel_folder_summary_free_array (GPtrArray *array)
-{
-	if (!array)
-		return;
+	g_qsort_with_data (rows, col_uid->len, sizeof (guint), cfs_compare_rows, &data);
 
-	g_ptr_array_foreach (array, (GFunc) camel_pstring_free, NULL);
-	g_ptr_array_free (array, TRUE);
+	res = g_ptr_array_sized_new (col_uid->len);
+
+	for (ii = 0; ii < col_uid->len; ii++)
+		g_ptr_array_add (res, (gpointer) camel_pstring_strdup (col_uid->pdata[rows[ii]]));
+
+	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
+	g_free (rows);
+
+	return res;
 }
 
 static void
@@ -1871,10 +2967,16 @@ camel_folder_summary_peek_loaded (CamelFolderSummary *summary,
 
 	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), NULL);
 
+	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+
 	info = g_hash_table_lookup (summary->priv->loaded_infos, uid);
 
-	if (info)
+	if (info) {
+		cfs_cache_touch (summary, info);
 		camel_message_info_ref (info);
+	}
+
+	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
 
 	return info;
 }
@@ -1896,7 +2998,12 @@ message_info_from_uid (CamelFolderSummary *summary,
 
 	info = g_hash_table_lookup (summary->priv->loaded_infos, uid);
 
-	if (!info) {
+	if (info) {
+		if (cfs_cache_tracks (summary))
+			g_atomic_int_inc (&cache_hits);
+
+		cfs_cache_touch (summary, info);
+	} else {
 		CamelDB *cdb;
 		CamelStore *parent_store;
 		const gchar *folder_name;
@@ -1922,6 +3029,9 @@ message_info_from_uid (CamelFolderSummary *summary,
 		data.summary = summary;
 		data.add = FALSE;
 
+		if (cfs_cache_tracks (summary))
+			g_atomic_int_inc (&cache_misses);
+
 		ret = camel_db_read_message_info_record_with_uid (
 			cdb, folder_name, uid, &data,
 			camel_read_mir_callback, NULL);
@@ -1938,10 +3048,16 @@ message_info_from_uid (CamelFolderSummary *summary,
 		info = g_hash_table_lookup (summary->priv->loaded_infos, uid);
 
 		cfs_schedule_info_release_timer (summary);
-	}
 
-	if (info)
+		if (info) {
+			/* Reference it before making room for it,
+			 * so that it is not evicted right away */
+			camel_message_info_ref (info);
+			cfs_cache_enforce_limit (summary, TRUE);
+		}
+	} else {
 		camel_message_info_ref (info);
+	}
 
 	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
 
@@ -2040,33 +3156,12 @@ camel_folder_summary_get_changed (CamelFolderSummary *summary)
 	return res;
 }
 
-static void
-count_changed_uids (gchar *key,
-                    CamelMessageInfoBase *info,
-                    gint *count)
-{
-	if (info->dirty)
-		(*count)++;
-}
-
-static gint
-cfs_count_dirty (CamelFolderSummary *summary)
-{
-	gint count = 0;
-
-	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
-	g_hash_table_foreach (summary->priv->loaded_infos, (GHFunc) count_changed_uids, &count);
-	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
-
-	return count;
-}
-
 static gboolean
 remove_item (gchar *uid,
              CamelMessageInfoBase *info,
              GSList **to_remove_infos)
 {
-	if (info->refcount == 1 && !info->dirty && (info->flags & CAMEL_MESSAGE_FOLDER_FLAGGED) == 0) {
+	if (cfs_info_is_evictable (info)) {
 		*to_remove_infos = g_slist_prepend (*to_remove_infos, info);
 		return TRUE;
 	}
@@ -2080,7 +3175,7 @@ remove_cache (CamelSession *session,
               CamelFolderSummary *summary,
               GError **error)
 {
-	GSList *to_remove_infos = NULL;
+	GSList *to_remove_infos = NULL, *link;
 
 	CAMEL_DB_RELEASE_SQLITE_MEMORY;
 
@@ -2093,6 +3188,12 @@ remove_cache (CamelSession *session,
 	g_hash_table_foreach_remove (summary->priv->loaded_infos, (GHRFunc) remove_item, &to_remove_infos);
 	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_REF_LOCK);
 
+	for (link = to_remove_infos; link != NULL; link = g_slist_next (link)) {
+		if (g_hash_table_contains (summary->priv->lru_links, link->data))
+			g_atomic_int_inc (&cache_evictions);
+		cfs_cache_forget (summary, link->data);
+	}
+
 	g_slist_foreach (to_remove_infos, (GFunc) camel_message_info_free, NULL);
 	g_slist_free (to_remove_infos);
 
@@ -2151,7 +3252,8 @@ cfs_schedule_info_release_timer (CamelFolderSummary *summary)
 			know_can_do = TRUE;
 		}
 
-		/* FIXME[disk-summary] LRU please and not timeouts */
+		/* The LRU keeps the loaded infos within the cache budget,
+		 * this only drops what is left unused for a long time */
 		if (can_do) {
 			summary->priv->timeout_handle = g_timeout_add_seconds (
 				SUMMARY_CACHE_DROP,
@@ -2319,6 +3421,10 @@ cfs_reload_from_db (CamelFolderSummary *summary,
 
 	cfs_schedule_info_release_timer (summary);
 
+	/* Everything was loaded on purpose, thus make
+	 * room for it in other summaries only */
+	cfs_cache_enforce_limit (summary, FALSE);
+
 	if (summary->priv->need_preview)
 		camel_session_submit_job (
 			session,
@@ -2379,6 +3485,46 @@ camel_folder_summary_prepare_fetch_all (CamelFolderSummary *summary,
 	summary->priv->cache_load_time = time (NULL);
 }
 
+/**
+ * camel_folder_summary_get_cache_stats:
+ * @out_loaded: (out) (allow-none): return location for the number of
+ *              message infos currently loaded, or %NULL
+ * @out_hits: (out) (allow-none): return location for the number of
+ *            lookups served from memory, or %NULL
+ * @out_misses: (out) (allow-none): return location for the number of
+ *              lookups which had to read the info from the database,
+ *              or %NULL
+ * @out_evictions: (out) (allow-none): return location for the number of
+ *                 infos released to stay within the cache budget, or %NULL
+ *
+ * Returns statistics of the message info cache, which all summaries
+ * in the process share.  The number of loaded message infos is kept
+ * under the limit given by the CAMEL_SUMMARY_CACHE_LIMIT environment
+ * variable, or 50000 when it is not set, by releasing the least
+ * recently used ones without unsaved changes.  Infos of in-memory
+ * summaries and of virtual folders are not counted.
+ *
+ * Since: 3.10
+ **/
+void
+camel_folder_summary_get_cache_stats (guint *out_loaded,
+                                      guint *out_hits,
+                                      guint *out_misses,
+                                      guint *out_evictions)
+{
+	if (out_loaded)
+		*out_loaded = g_atomic_int_get (&cache_loaded);
+
+	if (out_hits)
+		*out_hits = g_atomic_int_get (&cache_hits);
+
+	if (out_misses)
+		*out_misses = g_atomic_int_get (&cache_misses);
+
+	if (out_evictions)
+		*out_evictions = g_atomic_int_get (&cache_evictions);
+}
+
 /**
  * camel_folder_summary_load_from_db:
  *
@@ -2414,9 +3560,9 @@ camel_folder_summary_load_from_db (CamelFolderSummary *summary,
 
 	cdb = parent_store->cdb_r;
 
-	ret = camel_db_get_folder_uids (
+	ret = camel_db_get_folder_uid_columns (
 		cdb, full_name, summary->sort_by, summary->collate,
-		summary->priv->uids, &local_error);
+		cfs_read_columns_cb, summary, &local_error);
 
 	if (local_error != NULL && local_error->message != NULL &&
 	    strstr (local_error->message, "no such table") != NULL) {
@@ -2618,108 +3764,51 @@ perform_content_info_save_to_db (CamelFolderSummary *summary,
 	return TRUE;
 }
 
-typedef struct {
-	GError **error;
-	gboolean migration;
-	gint progress;
-} SaveToDBArgs;
-
-static void
-save_to_db_cb (gpointer key,
-               gpointer value,
-               gpointer data)
-{
-	SaveToDBArgs *args = (SaveToDBArgs *) data;
-	GError **error = args->error;
-	CamelMessageInfoBase *mi = (CamelMessageInfoBase *) value;
-	CamelFolderSummary *summary = (CamelFolderSummary *) mi->summary;
-	CamelStore *parent_store;
-	const gchar *full_name;
-	CamelDB *cdb;
-	CamelMIRecord *mir;
-
-	full_name = camel_folder_get_full_name (summary->priv->folder);
-	parent_store = camel_folder_get_parent_store (summary->priv->folder);
-	cdb = parent_store->cdb_w;
-
-	if (!args->migration && !mi->dirty)
-		return;
-
-	mir = CAMEL_FOLDER_SUMMARY_GET_CLASS (summary)->message_info_to_db (summary, (CamelMessageInfo *) mi);
-
-	if (mir && summary->priv->build_content) {
-		if (!perform_content_info_save_to_db (summary, ((CamelMessageInfoBase *) mi)->content, mir)) {
-			g_warning ("unable to save mir+cinfo for uid: %s\n", mir->uid);
-			camel_db_camel_mir_free (mir);
-			/* FIXME: Add exception here */
-			return;
-		}
-	}
-
-	g_return_if_fail (mir != NULL);
-
-	if (!args->migration) {
-		if (camel_db_write_message_info_record (cdb, full_name, mir, error) != 0) {
-			camel_db_camel_mir_free (mir);
-			return;
-		}
-	} else {
-		if (camel_db_write_fresh_message_info_record (cdb, CAMEL_DB_IN_MEMORY_TABLE, mir, error) != 0) {
-			camel_db_camel_mir_free (mir);
-			return;
-		}
-
-		if (args->progress > CAMEL_DB_IN_MEMORY_TABLE_LIMIT) {
-		    g_print ("BULK INsert limit reached \n");
-			camel_db_flush_in_memory_transactions (cdb, full_name, error);
-			camel_db_start_in_memory_transactions (cdb, error);
-			args->progress = 0;
-		} else {
-			args->progress++;
-		}
-	}
-
-	/* Reset the dirty flag which decides if the changes are synced to the DB or not.
-	The FOLDER_FLAGGED should be used to check if the changes are synced to the server.
-	So, dont unset the FOLDER_FLAGGED flag */
-	mi->dirty = FALSE;
-
-	camel_db_camel_mir_free (mir);
-}
-
+/* Writes every info of the dirty set, those which were only changed
+ * since they were stored just with the columns such changes affect.
+ * The caller has begun a transaction; the infos are only marked as
+ * saved after it is committed, thus they are returned in saved_infos. */
 static gint
 save_message_infos_to_db (CamelFolderSummary *summary,
-                          gboolean fresh_mirs,
+                          CamelDB *cdb,
+                          const gchar *full_name,
+                          GSList **saved_infos,
                           GError **error)
 {
-	CamelStore *parent_store;
-	CamelDB *cdb;
-	const gchar *full_name;
-	SaveToDBArgs args;
+	GHashTableIter iter;
+	gpointer key, value;
 
-	if (is_in_memory_summary (summary))
-		return 0;
+	g_hash_table_iter_init (&iter, summary->priv->dirty_infos);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		CamelMessageInfoBase *mi = key;
+		CamelMIRecord *mir;
+		gint ret;
 
-	args.error = error;
-	args.migration = fresh_mirs;
-	args.progress = 0;
+		mir = CAMEL_FOLDER_SUMMARY_GET_CLASS (summary)->message_info_to_db (summary, (CamelMessageInfo *) mi);
+		g_return_val_if_fail (mir != NULL, -1);
 
-	full_name = camel_folder_get_full_name (summary->priv->folder);
-	parent_store = camel_folder_get_parent_store (summary->priv->folder);
-	cdb = parent_store->cdb_w;
+		if (summary->priv->build_content) {
+			if (!perform_content_info_save_to_db (summary, mi->content, mir)) {
+				g_warning ("unable to save mir+cinfo for uid: %s\n", mir->uid);
+				camel_db_camel_mir_free (mir);
+				/* FIXME: Add exception here */
+				continue;
+			}
+		}
 
-	if (camel_db_prepare_message_info_table (cdb, full_name, error) != 0)
-		return -1;
+		/* The content info is saved with the whole record only */
+		if (GPOINTER_TO_UINT (value) == DIRTY_INFO_CHANGED && !summary->priv->build_content)
+			ret = camel_db_update_message_info_record (cdb, full_name, mir, error);
+		else
+			ret = camel_db_write_message_info_record (cdb, full_name, mir, error);
 
-	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
+		camel_db_camel_mir_free (mir);
 
-	/* Push MessageInfo-es */
-	camel_db_begin_transaction (cdb, NULL);
-	g_hash_table_foreach (summary->priv->loaded_infos, save_to_db_cb, &args);
-	camel_db_end_transaction (cdb, NULL);
+		if (ret != 0)
+			return -1;
 
-	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
-	cfs_schedule_info_release_timer (summary);
+		*saved_infos = g_slist_prepend (*saved_infos, mi);
+	}
 
 	return 0;
 }
@@ -2739,6 +3828,56 @@ msg_save_preview (const gchar *uid,
 		parent_store->cdb_w, full_name, uid, (gchar *) value, NULL);
 }
 
+/* Previews, message infos and the folder record go into a single
+ * transaction, which is either committed or rolled back as a whole;
+ * the caller forgets the pending previews and body texts only once
+ * it was committed */
+static gint
+folder_summary_save_in_transaction (CamelFolderSummary *summary,
+                                    CamelDB *cdb,
+                                    const gchar *full_name,
+                                    GSList **saved_infos,
+                                    GError **error)
+{
+	CamelFIRecord *record;
+	gint ret;
+
+	if (g_hash_table_size (summary->priv->dirty_infos) > 0 &&
+	    camel_db_prepare_message_info_table (cdb, full_name, error) != 0)
+		return -1;
+
+	camel_db_begin_transaction (cdb, NULL);
+
+	if (summary->priv->need_preview && g_hash_table_size (summary->priv->preview_updates)) {
+		g_hash_table_foreach (summary->priv->preview_updates, (GHFunc) msg_save_preview, summary->priv->folder);
+	}
+
+	if (g_hash_table_size (summary->priv->body_texts) > 0)
+		save_body_texts_to_db (summary, cdb, full_name);
+
+	ret = save_message_infos_to_db (summary, cdb, full_name, saved_infos, error);
+
+	if (ret == 0) {
+		record = CAMEL_FOLDER_SUMMARY_GET_CLASS (summary)->summary_header_to_db (summary, error);
+		if (record) {
+			ret = camel_db_write_folder_info_record (cdb, record, error);
+			g_free (record->folder_name);
+			g_free (record->bdata);
+			g_free (record);
+		} else {
+			ret = -1;
+		}
+	}
+
+	if (ret == 0) {
+		ret = camel_db_end_transaction (cdb, error);
+	} else {
+		camel_db_abort_transaction (cdb, NULL);
+	}
+
+	return ret;
+}
+
 /**
  * camel_folder_summary_save_to_db:
  *
@@ -2750,8 +3889,9 @@ camel_folder_summary_save_to_db (CamelFolderSummary *summary,
 {
 	CamelStore *parent_store;
 	CamelDB *cdb;
-	CamelFIRecord *record;
-	gint ret, count;
+	const gchar *full_name;
+	GSList *saved_infos = NULL, *link;
+	gint ret;
 
 	g_return_val_if_fail (summary != NULL, FALSE);
 
@@ -2759,81 +3899,60 @@ camel_folder_summary_save_to_db (CamelFolderSummary *summary,
 	    is_in_memory_summary (summary))
 		return TRUE;
 
+	full_name = camel_folder_get_full_name (summary->priv->folder);
 	parent_store = camel_folder_get_parent_store (summary->priv->folder);
 	cdb = parent_store->cdb_w;
 
 	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
 
 	d (printf ("\ncamel_folder_summary_save_to_db called \n"));
-	if (summary->priv->need_preview && g_hash_table_size (summary->priv->preview_updates)) {
-		camel_db_begin_transaction (parent_store->cdb_w, NULL);
-		g_hash_table_foreach (summary->priv->preview_updates, (GHFunc) msg_save_preview, summary->priv->folder);
-		g_hash_table_remove_all (summary->priv->preview_updates);
-		camel_db_end_transaction (parent_store->cdb_w, NULL);
-	}
 
 	summary->flags &= ~CAMEL_FOLDER_SUMMARY_DIRTY;
 
-	count = cfs_count_dirty (summary);
-	if (!count) {
-		gboolean res = camel_folder_summary_header_save_to_db (summary, error);
-		camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
-		return res;
-	}
-
-	ret = save_message_infos_to_db (summary, FALSE, error);
-	if (ret != 0) {
-		/* Failed, so lets reset the flag */
-		summary->flags |= CAMEL_FOLDER_SUMMARY_DIRTY;
-		camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
-		return FALSE;
-	}
-
-	/* XXX So... if an error is set, how do we even reach this point
-	 *     given the above error check?  Oye vey this logic is nasty. */
-	if (error != NULL && *error != NULL &&
-		strstr ((*error)->message, "26 columns but 28 values") != NULL) {
-		const gchar *full_name;
+	ret = folder_summary_save_in_transaction (summary, cdb, full_name, &saved_infos, error);
 
-		full_name = camel_folder_get_full_name (summary->priv->folder);
+	if (ret != 0 && error != NULL && *error != NULL &&
+	    strstr ((*error)->message, "26 columns but 28 values") != NULL) {
 		g_warning ("Fixing up a broken summary migration on %s\n", full_name);
+		g_clear_error (error);
+
+		g_slist_free (saved_infos);
+		saved_infos = NULL;
 
 		/* Begin everything again. */
 		camel_db_begin_transaction (cdb, NULL);
 		camel_db_reset_folder_version (cdb, full_name, 0, NULL);
 		camel_db_end_transaction (cdb, NULL);
 
-		ret = save_message_infos_to_db (summary, FALSE, error);
-		if (ret != 0) {
-			summary->flags |= CAMEL_FOLDER_SUMMARY_DIRTY;
-			camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
-			return FALSE;
-		}
+		ret = folder_summary_save_in_transaction (summary, cdb, full_name, &saved_infos, error);
 	}
 
-	record = CAMEL_FOLDER_SUMMARY_GET_CLASS (summary)->summary_header_to_db (summary, error);
-	if (!record) {
-		summary->flags |= CAMEL_FOLDER_SUMMARY_DIRTY;
-		camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
-		return FALSE;
-	}
+	if (ret == 0) {
+		/* Reset the dirty flag which decides if the changes are synced to the DB or not.
+		 * The FOLDER_FLAGGED should be used to check if the changes are synced to the server.
+		 * So, dont unset the FOLDER_FLAGGED flag */
+		for (link = saved_infos; link != NULL; link = g_slist_next (link)) {
+			CamelMessageInfoBase *mi = link->data;
 
-	camel_db_begin_transaction (cdb, NULL);
-	ret = camel_db_write_folder_info_record (cdb, record, error);
-	g_free (record->folder_name);
-	g_free (record->bdata);
-	g_free (record);
+			mi->dirty = FALSE;
+			g_hash_table_remove (summary->priv->dirty_infos, mi);
+		}
 
-	if (ret != 0) {
-		camel_db_abort_transaction (cdb, NULL);
+		g_hash_table_remove_all (summary->priv->preview_updates);
+		g_hash_table_remove_all (summary->priv->body_texts);
+		summary->priv->body_texts_size = 0;
+	} else {
+		/* Failed, so lets reset the flag */
 		summary->flags |= CAMEL_FOLDER_SUMMARY_DIRTY;
-		camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
-		return FALSE;
 	}
 
-	camel_db_end_transaction (cdb, NULL);
 	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
 
+	if (saved_infos != NULL) {
+		g_slist_free (saved_infos);
+		cfs_schedule_info_release_timer (summary);
+	}
+
 	return ret == 0;
 }
 
@@ -2994,13 +4113,10 @@ camel_folder_summary_add (CamelFolderSummary *summary,
 	base_info->flags |= CAMEL_MESSAGE_FOLDER_FLAGGED;
 	base_info->dirty = TRUE;
 
-	g_hash_table_insert (
-		summary->priv->uids,
-		(gpointer) camel_pstring_strdup (camel_message_info_uid (info)),
-		GUINT_TO_POINTER (camel_message_info_flags (info)));
+	cfs_columns_set_from_info (summary, info);
 
-	/* Summary always holds a ref for the loaded infos */
-	g_hash_table_insert (summary->priv->loaded_infos, (gpointer) camel_message_info_uid (info), info);
+	cfs_cache_add (summary, info);
+	cfs_dirty_add (summary, info, DIRTY_INFO_NEW);
 
 	camel_folder_summary_touch (summary);
 
@@ -3031,16 +4147,15 @@ camel_folder_summary_insert (CamelFolderSummary *summary,
 		base_info->flags |= CAMEL_MESSAGE_FOLDER_FLAGGED;
 		base_info->dirty = TRUE;
 
-		g_hash_table_insert (
-			summary->priv->uids,
-			(gpointer) camel_pstring_strdup (camel_message_info_uid (info)),
-			GUINT_TO_POINTER (camel_message_info_flags (info)));
+		cfs_columns_set_from_info (summary, info);
 
 		camel_folder_summary_touch (summary);
 	}
 
-	/* Summary always holds a ref for the loaded infos */
-	g_hash_table_insert (summary->priv->loaded_infos, (gchar *) camel_message_info_uid (info), info);
+	cfs_cache_add (summary, info);
+
+	if (!load)
+		cfs_dirty_add (summary, info, DIRTY_INFO_NEW);
 
 	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
 }
@@ -3177,6 +4292,7 @@ camel_folder_summary_info_new_from_parser (CamelFolderSummary *summary,
 	CamelFolderSummaryPrivate *p = summary->priv;
 	goffset start;
 	CamelIndexName *name = NULL;
+	gchar *body_text = NULL;
 
 	/* should this check the parser is in the right state, or assume it is?? */
 
@@ -3199,6 +4315,15 @@ camel_folder_summary_info_new_from_parser (CamelFolderSummary *summary,
 			camel_index_delete_name (p->index, camel_message_info_uid (info));
 			name = camel_index_add_name (p->index, camel_message_info_uid (info));
 			camel_mime_filter_index_set_name (CAMEL_MIME_FILTER_INDEX (p->filter_index), name);
+
+			/* the body index of the CamelDB goes along */
+			if (cfs_body_index_wanted (summary)) {
+				if (p->body_stream == NULL) {
+					p->body_stream = camel_stream_mem_new ();
+					p->filter_save = camel_mime_filter_save_new (p->body_stream);
+				}
+				p->collect_body = TRUE;
+			}
 		}
 
 		/* always scan the content info, even if we dont save it */
@@ -3211,8 +4336,22 @@ camel_folder_summary_info_new_from_parser (CamelFolderSummary *summary,
 				CAMEL_MIME_FILTER_INDEX (p->filter_index), NULL);
 		}
 
+		if (p->collect_body) {
+			GByteArray *bytes;
+
+			bytes = camel_stream_mem_get_byte_array (CAMEL_STREAM_MEM (p->body_stream));
+			body_text = cfs_body_text_from_bytes (bytes);
+			g_byte_array_set_size (bytes, 0);
+			g_seekable_seek (G_SEEKABLE (p->body_stream), 0, G_SEEK_SET, NULL, NULL);
+
+			p->collect_body = FALSE;
+		}
+
 		camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_FILTER_LOCK);
 
+		if (body_text != NULL)
+			cfs_body_index_add (summary, camel_message_info_uid (info), body_text);
+
 		((CamelMessageInfoBase *) info)->size = camel_mime_parser_tell (mp) - start;
 	}
 	return info;
@@ -3274,6 +4413,18 @@ camel_folder_summary_info_new_from_message (CamelFolderSummary *summary,
 
 	camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_FILTER_LOCK);
 
+	if (p->index && cfs_body_index_wanted (summary)) {
+		CamelStream *stream;
+
+		stream = camel_stream_mem_new ();
+		cfs_body_text_append (CAMEL_MIME_PART (msg), stream);
+		cfs_body_index_add (
+			summary, camel_message_info_uid (info),
+			cfs_body_text_from_bytes (
+			camel_stream_mem_get_byte_array (CAMEL_STREAM_MEM (stream))));
+		g_object_unref (stream);
+	}
+
 	return info;
 }
 
@@ -3338,7 +4489,7 @@ camel_folder_summary_clear (CamelFolderSummary *summary,
 		return TRUE;
 	}
 
-	g_hash_table_remove_all (summary->priv->uids);
+	cfs_columns_clear (summary);
 	remove_all_loaded (summary);
 	g_hash_table_remove_all (summary->priv->loaded_infos);
 
@@ -3412,25 +4563,31 @@ gboolean
 camel_folder_summary_remove_uid (CamelFolderSummary *summary,
                                  const gchar *uid)
 {
-	gpointer ptr_uid = NULL, ptr_flags = NULL;
+	CamelMessageInfo *info;
 	CamelStore *parent_store;
 	const gchar *full_name;
 	const gchar *uid_copy;
+	guint32 flags = 0;
 	gboolean res = TRUE;
 
 	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), FALSE);
 	g_return_val_if_fail (uid != NULL, FALSE);
 
 	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
-	if (!g_hash_table_lookup_extended (summary->priv->uids, uid, &ptr_uid, &ptr_flags)) {
+
+	uid_copy = camel_pstring_strdup (uid);
+
+	if (!cfs_columns_remove (summary, uid_copy, &flags)) {
+		camel_pstring_free (uid_copy);
 		camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
 		return FALSE;
 	}
 
-	folder_summary_update_counts_by_flags (summary, GPOINTER_TO_UINT (ptr_flags), UPDATE_COUNTS_SUB);
+	folder_summary_update_counts_by_flags (summary, flags, UPDATE_COUNTS_SUB);
 
-	uid_copy = camel_pstring_strdup (uid);
-	g_hash_table_remove (summary->priv->uids, uid_copy);
+	info = g_hash_table_lookup (summary->priv->loaded_infos, uid_copy);
+	if (info != NULL)
+		cfs_cache_forget (summary, info);
 	g_hash_table_remove (summary->priv->loaded_infos, uid_copy);
 
 	if (!is_in_memory_summary (summary)) {
@@ -3475,21 +4632,24 @@ camel_folder_summary_remove_uids (CamelFolderSummary *summary,
 	camel_folder_summary_lock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
 
 	for (l = g_list_first (uids); l; l = g_list_next (l)) {
-		gpointer ptr_uid = NULL, ptr_flags = NULL;
-		if (g_hash_table_lookup_extended (summary->priv->uids, l->data, &ptr_uid, &ptr_flags)) {
-			const gchar *uid_copy = camel_pstring_strdup (l->data);
+		const gchar *uid_copy = camel_pstring_strdup (l->data);
+		guint32 flags = 0;
+
+		if (cfs_columns_remove (summary, uid_copy, &flags)) {
 			CamelMessageInfo *mi;
 
-			folder_summary_update_counts_by_flags (summary, GPOINTER_TO_UINT (ptr_flags), UPDATE_COUNTS_SUB);
-			g_hash_table_remove (summary->priv->uids, uid_copy);
+			folder_summary_update_counts_by_flags (summary, flags, UPDATE_COUNTS_SUB);
 
 			mi = g_hash_table_lookup (summary->priv->loaded_infos, uid_copy);
 			g_hash_table_remove (summary->priv->loaded_infos, uid_copy);
 
-			if (mi)
+			if (mi) {
+				cfs_cache_forget (summary, mi);
 				camel_message_info_free (mi);
-			camel_pstring_free (uid_copy);
+			}
 		}
+
+		camel_pstring_free (uid_copy);
 	}
 
 	if (!is_in_memory_summary (summary)) {
@@ -3800,6 +4960,7 @@ message_info_free (CamelFolderSummary *summary,
 			if (g_hash_table_lookup (summary->priv->loaded_infos, mi->uid) == mi) {
 				g_hash_table_remove (summary->priv->loaded_infos, mi->uid);
 			}
+			cfs_cache_forget (summary, info);
 			camel_folder_summary_unlock (summary, CAMEL_FOLDER_SUMMARY_SUMMARY_LOCK);
 		}
 		camel_pstring_free (mi->uid);
@@ -3880,7 +5041,7 @@ summary_build_content_info (CamelFolderSummary *summary,
 	gchar *buffer;
 	CamelMessageContentInfo *info = NULL;
 	CamelContentType *ct;
-	gint enc_id = -1, chr_id = -1, html_id = -1, idx_id = -1;
+	gint enc_id = -1, chr_id = -1, html_id = -1, idx_id = -1, save_id = -1;
 	CamelFolderSummaryPrivate *p = summary->priv;
 	CamelMimeFilter *mfc;
 	CamelMessageContentInfo *part;
@@ -3917,7 +5078,7 @@ summary_build_content_info (CamelFolderSummary *summary,
 		if (calendar_header || camel_content_type_is (ct, "text", "calendar"))
 			camel_message_info_set_user_flag (msginfo, "$has_cal", TRUE);
 
-		if (p->index && camel_content_type_is (ct, "text", "*")) {
+		if ((p->index || p->collect_body) && camel_content_type_is (ct, "text", "*")) {
 			gchar *encoding;
 			const gchar *charset;
 
@@ -3983,7 +5144,11 @@ summary_build_content_info (CamelFolderSummary *summary,
 			}
 
 			/* and this filter actually does the indexing */
-			idx_id = camel_mime_parser_filter_add (mp, p->filter_index);
+			if (p->index)
+				idx_id = camel_mime_parser_filter_add (mp, p->filter_index);
+			/* while this one keeps the text for the body index */
+			if (p->collect_body)
+				save_id = camel_mime_parser_filter_add (mp, p->filter_save);
 		}
 		/* and scan/index everything */
 		while (camel_mime_parser_step (mp, &buffer, &len) != CAMEL_MIME_PARSER_STATE_BODY_END)
@@ -3993,6 +5158,9 @@ summary_build_content_info (CamelFolderSummary *summary,
 		camel_mime_parser_filter_remove (mp, chr_id);
 		camel_mime_parser_filter_remove (mp, html_id);
 		camel_mime_parser_filter_remove (mp, idx_id);
+		camel_mime_parser_filter_remove (mp, save_id);
+		if (save_id != -1)
+			camel_stream_write_string (p->body_stream, "\n", NULL, NULL);
 		break;
 	case CAMEL_MIME_PARSER_STATE_MULTIPART:
 		d (printf ("Summarising multipart\n"));
@@ -4608,6 +5776,11 @@ camel_message_info_free (gpointer o)
 	g_return_if_fail (mi != NULL);
 
 	if (mi->summary) {
+		/* Infos got from the summary are sometimes changed and marked
+		 * dirty directly; pick those up while still holding a ref */
+		if (mi->dirty)
+			cfs_dirty_add (mi->summary, mi, DIRTY_INFO_CHANGED);
+
 		camel_folder_summary_lock (mi->summary, CAMEL_FOLDER_SUMMARY_REF_LOCK);
 
 		if (mi->refcount >= 1)
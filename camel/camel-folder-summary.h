@@ -227,6 +227,25 @@ typedef enum {
 	CAMEL_FOLDER_SUMMARY_IN_MEMORY_ONLY	= 1 << 1
 } CamelFolderSummaryFlags;
 
+/**
+ * CamelFolderSummarySortField:
+ * @CAMEL_FOLDER_SUMMARY_SORT_DATE_SENT:
+ *    Sort by the date the message was sent.
+ * @CAMEL_FOLDER_SUMMARY_SORT_DATE_RECEIVED:
+ *    Sort by the date the message was received.
+ * @CAMEL_FOLDER_SUMMARY_SORT_SIZE:
+ *    Sort by the size of the message.
+ *
+ * Fields camel_folder_summary_get_sorted_array() can sort by.
+ *
+ * Since: 3.10
+ **/
+typedef enum {
+	CAMEL_FOLDER_SUMMARY_SORT_DATE_SENT,
+	CAMEL_FOLDER_SUMMARY_SORT_DATE_RECEIVED,
+	CAMEL_FOLDER_SUMMARY_SORT_SIZE
+} CamelFolderSummarySortField;
+
 /**
  * CamelFolderSummaryLock:
  *
@@ -325,6 +344,12 @@ guint32			camel_folder_summary_get_visible_count
 void			camel_folder_summary_set_index	(CamelFolderSummary *summary,
 							 CamelIndex *index);
 CamelIndex *		camel_folder_summary_get_index	(CamelFolderSummary *summary);
+void			camel_folder_summary_index_message
+							(CamelFolderSummary *summary,
+							 const gchar *uid,
+							 CamelMimeMessage *message);
+GHashTable *		camel_folder_summary_get_unindexed_uids
+							(CamelFolderSummary *summary);
 void			camel_folder_summary_set_build_content
 							(CamelFolderSummary *summary,
 							 gboolean state);
@@ -427,6 +452,19 @@ CamelMessageInfo *	camel_folder_summary_get	(CamelFolderSummary *summary,
 							 const gchar *uid);
 GPtrArray *		camel_folder_summary_get_array	(CamelFolderSummary *summary);
 void			camel_folder_summary_free_array	(GPtrArray *array);
+GPtrArray *		camel_folder_summary_ref_array	(CamelFolderSummary *summary);
+guint			camel_folder_summary_count_by_flags
+							(CamelFolderSummary *summary,
+							 guint32 mask,
+							 guint32 value);
+GPtrArray *		camel_folder_summary_get_array_by_flags
+							(CamelFolderSummary *summary,
+							 guint32 mask,
+							 guint32 value);
+GPtrArray *		camel_folder_summary_get_sorted_array
+							(CamelFolderSummary *summary,
+							 CamelFolderSummarySortField field,
+							 gboolean ascending);
 
 GHashTable *		camel_folder_summary_get_hash	(CamelFolderSummary *summary);
 
@@ -448,6 +486,13 @@ void			camel_folder_summary_prepare_fetch_all
 							(CamelFolderSummary *summary,
 							 GError **error);
 
+/* statistics of the loaded message infos, shared by all summaries */
+void			camel_folder_summary_get_cache_stats
+							(guint *out_loaded,
+							 guint *out_hits,
+							 guint *out_misses,
+							 guint *out_evictions);
+
 /* summary locking */
 void			camel_folder_summary_lock	(CamelFolderSummary *summary,
 							 CamelFolderSummaryLock lock);
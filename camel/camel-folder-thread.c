@@ -642,7 +642,7 @@ camel_folder_thread_messages_new (CamelFolder *folder,
 
 	/* prefer given order from the summary order */
 	if (!uids) {
-		fsummary = camel_folder_summary_get_array (folder->summary);
+		fsummary = camel_folder_summary_ref_array (folder->summary);
 		uids = fsummary;
 	}
 
@@ -657,7 +657,7 @@ camel_folder_thread_messages_new (CamelFolder *folder,
 	}
 
 	if (fsummary)
-		camel_folder_summary_free_array (fsummary);
+		g_ptr_array_unref (fsummary);
 
 	thread_summary (thread, summary);
 
@@ -50,6 +50,10 @@
 #define d(x)
 #define w(x)
 
+/* How many messages to fetch from another store before
+ * appending them all to the destination folder at once. */
+#define TRANSFER_BATCH_SIZE 16
+
 typedef struct _AsyncContext AsyncContext;
 typedef struct _SignalClosure SignalClosure;
 typedef struct _FolderFilterData FolderFilterData;
@@ -449,24 +453,21 @@ cmp_array_uids (gconstpointer a,
 	return camel_folder_cmp_uids (folder, uid1, uid2);
 }
 
-static void
-folder_transfer_message_to (CamelFolder *source,
-                            const gchar *uid,
-                            CamelFolder *dest,
-                            gchar **transferred_uid,
-                            gboolean delete_original,
-                            GCancellable *cancellable,
-                            GError **error)
+/* Default implementation: gets a message to be transferred,
+ * and the message info to append it with. */
+static CamelMimeMessage *
+folder_transfer_get_message (CamelFolder *source,
+                             const gchar *uid,
+                             CamelMessageInfo **out_info,
+                             GCancellable *cancellable,
+                             GError **error)
 {
 	CamelMimeMessage *msg;
 	CamelMessageInfo *minfo, *info;
-	GError *local_error = NULL;
-
-	/* Default implementation. */
 
 	msg = camel_folder_get_message_sync (source, uid, cancellable, error);
 	if (!msg)
-		return;
+		return NULL;
 
 	/* if its deleted we poke the flags, so we need to copy the messageinfo */
 	if ((source->folder_flags & CAMEL_FOLDER_HAS_SUMMARY_CAPABILITY)
@@ -483,19 +484,9 @@ folder_transfer_message_to (CamelFolder *source,
 	if ((source->folder_flags & CAMEL_FOLDER_IS_JUNK) != 0)
 		camel_message_info_set_flags (info, CAMEL_MESSAGE_JUNK, 0);
 
-	camel_folder_append_message_sync (
-		dest, msg, info, transferred_uid,
-		cancellable, &local_error);
-	g_object_unref (msg);
-
-	if (local_error != NULL)
-		g_propagate_error (error, local_error);
-	else if (delete_original)
-		camel_folder_set_message_flags (
-			source, uid, CAMEL_MESSAGE_DELETED |
-			CAMEL_MESSAGE_SEEN, ~0);
+	*out_info = info;
 
-	camel_message_info_free (info);
+	return msg;
 }
 
 static gboolean
@@ -980,6 +971,43 @@ folder_refresh_info_sync (CamelFolder *folder,
 	return TRUE;
 }
 
+static gboolean
+folder_append_messages_sync (CamelFolder *folder,
+                             GPtrArray *messages,
+                             GPtrArray *infos,
+                             GPtrArray **appended_uids,
+                             GCancellable *cancellable,
+                             GError **error)
+{
+	CamelFolderClass *class;
+	gboolean success = TRUE;
+	guint ii;
+
+	/* Default implementation, one message at a time. */
+
+	class = CAMEL_FOLDER_GET_CLASS (folder);
+	g_return_val_if_fail (class->append_message_sync != NULL, FALSE);
+
+	if (appended_uids != NULL)
+		*appended_uids = g_ptr_array_new_with_free_func (g_free);
+
+	for (ii = 0; ii < messages->len && success; ii++) {
+		gchar *appended_uid = NULL;
+
+		success = class->append_message_sync (
+			folder, messages->pdata[ii],
+			infos != NULL ? infos->pdata[ii] : NULL,
+			&appended_uid, cancellable, error);
+
+		if (appended_uids != NULL)
+			g_ptr_array_add (*appended_uids, appended_uid);
+		else
+			g_free (appended_uid);
+	}
+
+	return success;
+}
+
 static gboolean
 folder_transfer_messages_to_sync (CamelFolder *source,
                                   GPtrArray *uids,
@@ -989,8 +1017,8 @@ folder_transfer_messages_to_sync (CamelFolder *source,
                                   GCancellable *cancellable,
                                   GError **error)
 {
-	gchar **ret_uid = NULL;
-	gint i;
+	GPtrArray *messages, *infos;
+	guint i, j, batch = 0;
 	GError *local_error = NULL;
 	GCancellable *local_cancellable = camel_operation_new ();
 	gulong handler_id = 0;
@@ -1017,16 +1045,75 @@ folder_transfer_messages_to_sync (CamelFolder *source,
 			camel_folder_freeze (source);
 	}
 
-	for (i = 0; i < uids->len && local_error == NULL; i++) {
-		if (transferred_uids)
-			ret_uid = (gchar **) &((*transferred_uids)->pdata[i]);
-		folder_transfer_message_to (
-			source, uids->pdata[i], dest, ret_uid,
-			delete_originals, local_cancellable, &local_error);
+	messages = g_ptr_array_new_with_free_func (g_object_unref);
+	infos = g_ptr_array_new_with_free_func (
+		(GDestroyNotify) camel_message_info_free);
+
+	/* Append in batches, so stores which can upload several
+	 * messages at once get to do so. */
+	for (i = 0; i < uids->len && local_error == NULL; i += batch) {
+		GPtrArray *appended_uids = NULL;
+		GError *fetch_error = NULL;
+
+		batch = MIN (TRANSFER_BATCH_SIZE, uids->len - i);
+
+		for (j = 0; j < batch; j++) {
+			CamelMimeMessage *msg;
+			CamelMessageInfo *info = NULL;
+
+			msg = folder_transfer_get_message (
+				source, uids->pdata[i + j], &info,
+				local_cancellable, &fetch_error);
+			if (msg == NULL)
+				break;
+
+			g_ptr_array_add (messages, msg);
+			g_ptr_array_add (infos, info);
+		}
+
+		/* Still append what was fetched before an error. */
+		if (messages->len > 0)
+			camel_folder_append_messages_sync (
+				dest, messages, infos,
+				transferred_uids ? &appended_uids : NULL,
+				local_cancellable, &local_error);
+
+		if (local_error == NULL) {
+			for (j = 0; j < messages->len; j++) {
+				if (appended_uids != NULL) {
+					(*transferred_uids)->pdata[i + j] =
+						appended_uids->pdata[j];
+					appended_uids->pdata[j] = NULL;
+				}
+
+				if (delete_originals)
+					camel_folder_set_message_flags (
+						source, uids->pdata[i + j],
+						CAMEL_MESSAGE_DELETED |
+						CAMEL_MESSAGE_SEEN, ~0);
+			}
+		}
+
+		if (appended_uids != NULL)
+			g_ptr_array_unref (appended_uids);
+
+		if (fetch_error != NULL) {
+			if (local_error == NULL)
+				g_propagate_error (&local_error, fetch_error);
+			else
+				g_error_free (fetch_error);
+		}
+
+		g_ptr_array_set_size (messages, 0);
+		g_ptr_array_set_size (infos, 0);
+
 		camel_operation_progress (
-			cancellable, i * 100 / uids->len);
+			cancellable, (i + batch) * 100 / uids->len);
 	}
 
+	g_ptr_array_unref (messages);
+	g_ptr_array_unref (infos);
+
 	if (uids->len > 1) {
 		camel_folder_thaw (dest);
 		if (delete_originals)
@@ -1858,6 +1945,7 @@ camel_folder_class_init (CamelFolderClass *class)
 	class->refresh_info_sync = folder_refresh_info_sync;
 	class->transfer_messages_to_sync = folder_transfer_messages_to_sync;
 	class->changed = folder_changed;
+	class->append_messages_sync = folder_append_messages_sync;
 
 	class->append_message = folder_append_message;
 	class->append_message_finish = folder_append_message_finish;
@@ -3458,6 +3546,81 @@ camel_folder_append_message_sync (CamelFolder *folder,
 	return success;
 }
 
+/**
+ * camel_folder_append_messages_sync:
+ * @folder: a #CamelFolder
+ * @messages: an array of #CamelMimeMessage
+ * @infos: (allow-none): an array of #CamelMessageInfo with the same
+ *         length as @messages, or %NULL
+ * @appended_uids: (out) (allow-none): return location for an array of
+ *                 the new message UIDs, or %NULL
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Appends all of @messages to @folder, as if by calling
+ * camel_folder_append_message_sync() for each of them, but letting
+ * stores which can upload several messages at once do so.
+ *
+ * On success, @appended_uids has an element for each of @messages,
+ * which is %NULL if the new UID is not known.  Free the array with
+ * g_ptr_array_unref().  On error it is set to %NULL, and some of the
+ * messages may have been appended already.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ *
+ * Since: 3.10
+ **/
+gboolean
+camel_folder_append_messages_sync (CamelFolder *folder,
+                                   GPtrArray *messages,
+                                   GPtrArray *infos,
+                                   GPtrArray **appended_uids,
+                                   GCancellable *cancellable,
+                                   GError **error)
+{
+	CamelFolderClass *class;
+	CamelStore *parent_store;
+	gboolean success;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), FALSE);
+	g_return_val_if_fail (messages != NULL, FALSE);
+	g_return_val_if_fail (infos == NULL || infos->len == messages->len, FALSE);
+
+	if (appended_uids != NULL)
+		*appended_uids = NULL;
+
+	class = CAMEL_FOLDER_GET_CLASS (folder);
+	g_return_val_if_fail (class->append_messages_sync != NULL, FALSE);
+
+	/* Need to connect the service before we can append. */
+	parent_store = camel_folder_get_parent_store (folder);
+	success = camel_service_connect_sync (
+		CAMEL_SERVICE (parent_store), cancellable, error);
+	if (!success)
+		return FALSE;
+
+	camel_folder_lock (folder, CAMEL_FOLDER_REC_LOCK);
+
+	/* Check for cancellation after locking. */
+	if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+		camel_folder_unlock (folder, CAMEL_FOLDER_REC_LOCK);
+		return FALSE;
+	}
+
+	success = class->append_messages_sync (
+		folder, messages, infos, appended_uids, cancellable, error);
+	CAMEL_CHECK_GERROR (folder, append_messages_sync, success, error);
+
+	camel_folder_unlock (folder, CAMEL_FOLDER_REC_LOCK);
+
+	if (!success && appended_uids != NULL && *appended_uids != NULL) {
+		g_ptr_array_unref (*appended_uids);
+		*appended_uids = NULL;
+	}
+
+	return success;
+}
+
 /**
  * camel_folder_append_message:
  * @folder a #CamelFolder
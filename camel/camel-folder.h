@@ -384,6 +384,14 @@ struct _CamelFolderClass {
 	void		(*deleted)		(CamelFolder *folder);
 	void		(*renamed)		(CamelFolder *folder,
 						 const gchar *old_name);
+
+	/* Synchronous I/O Methods added later (all have defaults) */
+	gboolean	(*append_messages_sync)	(CamelFolder *folder,
+						 GPtrArray *messages,
+						 GPtrArray *infos,
+						 GPtrArray **appended_uids,
+						 GCancellable *cancellable,
+						 GError **error);
 };
 
 GType		camel_folder_get_type		(void);
@@ -526,6 +534,13 @@ gboolean	camel_folder_append_message_sync
 						 gchar **appended_uid,
 						 GCancellable *cancellable,
 						 GError **error);
+gboolean	camel_folder_append_messages_sync
+						(CamelFolder *folder,
+						 GPtrArray *messages,
+						 GPtrArray *infos,
+						 GPtrArray **appended_uids,
+						 GCancellable *cancellable,
+						 GError **error);
 void		camel_folder_append_message	(CamelFolder *folder,
 						 CamelMimeMessage *message,
 						 CamelMessageInfo *info,
@@ -87,6 +87,9 @@ struct _CamelIMAPXCommand {
 
 	/* Responsible for free'ing the command. */
 	CamelIMAPXCommandFunc complete;
+
+	/* Monotonic time the command was sent, for latency statistics. */
+	gint64 start_time;
 };
 
 CamelIMAPXCommand *
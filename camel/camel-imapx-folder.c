@@ -47,6 +47,9 @@ struct _CamelIMAPXFolderPrivate {
 	GMutex property_lock;
 	gchar **quota_root_names;
 
+	/* refreshes since the last full flags scan */
+	guint windowed_scans;
+
 	GMutex move_to_hash_table_lock;
 	GHashTable *move_to_real_junk_uids;
 	GHashTable *move_to_real_trash_uids;
@@ -317,7 +320,9 @@ imapx_search_by_uids (CamelFolder *folder,
 	store = camel_folder_get_parent_store (folder);
 
 	imapx_store = CAMEL_IMAPX_STORE (store);
-	imapx_server = camel_imapx_store_ref_server (imapx_store, NULL);
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, camel_folder_get_full_name (folder),
+		cancellable, NULL);
 
 	g_mutex_lock (&imapx_folder->search_lock);
 
@@ -355,7 +360,9 @@ imapx_count_by_expression (CamelFolder *folder,
 	store = camel_folder_get_parent_store (folder);
 
 	imapx_store = CAMEL_IMAPX_STORE (store);
-	imapx_server = camel_imapx_store_ref_server (imapx_store, NULL);
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, camel_folder_get_full_name (folder),
+		cancellable, NULL);
 
 	g_mutex_lock (&imapx_folder->search_lock);
 
@@ -393,7 +400,9 @@ imapx_search_by_expression (CamelFolder *folder,
 	store = camel_folder_get_parent_store (folder);
 
 	imapx_store = CAMEL_IMAPX_STORE (store);
-	imapx_server = camel_imapx_store_ref_server (imapx_store, NULL);
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, camel_folder_get_full_name (folder),
+		cancellable, NULL);
 
 	g_mutex_lock (&imapx_folder->search_lock);
 
@@ -443,7 +452,9 @@ imapx_append_message_sync (CamelFolder *folder,
 	store = camel_folder_get_parent_store (folder);
 
 	imapx_store = CAMEL_IMAPX_STORE (store);
-	imapx_server = camel_imapx_store_ref_server (imapx_store, error);
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, camel_folder_get_full_name (folder),
+		cancellable, error);
 
 	if (appended_uid != NULL)
 		*appended_uid = NULL;
@@ -459,6 +470,37 @@ imapx_append_message_sync (CamelFolder *folder,
 	return success;
 }
 
+static gboolean
+imapx_append_messages_sync (CamelFolder *folder,
+                            GPtrArray *messages,
+                            GPtrArray *infos,
+                            GPtrArray **appended_uids,
+                            GCancellable *cancellable,
+                            GError **error)
+{
+	CamelStore *store;
+	CamelIMAPXStore *imapx_store;
+	CamelIMAPXServer *imapx_server;
+	gboolean success = FALSE;
+
+	store = camel_folder_get_parent_store (folder);
+
+	imapx_store = CAMEL_IMAPX_STORE (store);
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, camel_folder_get_full_name (folder),
+		cancellable, error);
+
+	if (imapx_server != NULL) {
+		success = camel_imapx_server_append_messages (
+			imapx_server, folder, messages, infos,
+			appended_uids, cancellable, error);
+	}
+
+	g_clear_object (&imapx_server);
+
+	return success;
+}
+
 static gboolean
 imapx_expunge_sync (CamelFolder *folder,
                     GCancellable *cancellable,
@@ -472,7 +514,9 @@ imapx_expunge_sync (CamelFolder *folder,
 	store = camel_folder_get_parent_store (folder);
 
 	imapx_store = CAMEL_IMAPX_STORE (store);
-	imapx_server = camel_imapx_store_ref_server (imapx_store, error);
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, camel_folder_get_full_name (folder),
+		cancellable, error);
 
 	if (imapx_server != NULL) {
 		success = camel_imapx_server_expunge (
@@ -499,7 +543,9 @@ imapx_fetch_messages_sync (CamelFolder *folder,
 	store = camel_folder_get_parent_store (folder);
 
 	imapx_store = CAMEL_IMAPX_STORE (store);
-	imapx_server = camel_imapx_store_ref_server (imapx_store, error);
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, camel_folder_get_full_name (folder),
+		cancellable, error);
 
 	if (imapx_server != NULL) {
 		success = camel_imapx_server_fetch_messages (
@@ -546,8 +592,10 @@ imapx_get_message_sync (CamelFolder *folder,
 			return NULL;
 		}
 
-		imapx_server = camel_imapx_store_ref_server (
-			CAMEL_IMAPX_STORE (store), error);
+		imapx_server = camel_imapx_store_ref_server_for_folder (
+			CAMEL_IMAPX_STORE (store),
+			camel_folder_get_full_name (folder),
+			cancellable, error);
 
 		if (imapx_server != NULL) {
 			stream = camel_imapx_server_get_message (
@@ -592,6 +640,10 @@ imapx_get_message_sync (CamelFolder *folder,
 
 			camel_message_info_free (mi);
 		}
+
+		/* Offline messages get their real uid on the next sync */
+		if (!offline_message)
+			camel_folder_summary_index_message (folder->summary, uid, msg);
 	}
 
 	return msg;
@@ -614,7 +666,9 @@ imapx_get_quota_info_sync (CamelFolder *folder,
 	folder_name = camel_folder_get_full_name (folder);
 
 	imapx_store = CAMEL_IMAPX_STORE (store);
-	imapx_server = camel_imapx_store_ref_server (imapx_store, error);
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, camel_folder_get_full_name (folder),
+		cancellable, error);
 
 	if (imapx_server != NULL) {
 		success = camel_imapx_server_update_quota_info (
@@ -670,7 +724,9 @@ imapx_refresh_info_sync (CamelFolder *folder,
 	store = camel_folder_get_parent_store (folder);
 
 	imapx_store = CAMEL_IMAPX_STORE (store);
-	imapx_server = camel_imapx_store_ref_server (imapx_store, error);
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, camel_folder_get_full_name (folder),
+		cancellable, error);
 
 	if (imapx_server != NULL) {
 		success = camel_imapx_server_refresh_info (
@@ -844,7 +900,9 @@ imapx_synchronize_sync (CamelFolder *folder,
 	store = camel_folder_get_parent_store (folder);
 
 	imapx_store = CAMEL_IMAPX_STORE (store);
-	imapx_server = camel_imapx_store_ref_server (imapx_store, error);
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, camel_folder_get_full_name (folder),
+		cancellable, error);
 
 	if (imapx_server != NULL) {
 		gboolean need_to_expunge;
@@ -893,7 +951,9 @@ imapx_synchronize_message_sync (CamelFolder *folder,
 	store = camel_folder_get_parent_store (folder);
 
 	imapx_store = CAMEL_IMAPX_STORE (store);
-	imapx_server = camel_imapx_store_ref_server (imapx_store, error);
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, camel_folder_get_full_name (folder),
+		cancellable, error);
 
 	if (imapx_server != NULL) {
 		success = camel_imapx_server_sync_message (
@@ -922,7 +982,9 @@ imapx_transfer_messages_to_sync (CamelFolder *source,
 	store = camel_folder_get_parent_store (source);
 
 	imapx_store = CAMEL_IMAPX_STORE (store);
-	imapx_server = camel_imapx_store_ref_server (imapx_store, error);
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, camel_folder_get_full_name (source),
+		cancellable, error);
 
 	if (imapx_server != NULL) {
 		success = camel_imapx_server_copy_message (
@@ -989,6 +1051,7 @@ camel_imapx_folder_class_init (CamelIMAPXFolderClass *class)
 	folder_class->search_free = imapx_search_free;
 	folder_class->get_filename = imapx_get_filename;
 	folder_class->append_message_sync = imapx_append_message_sync;
+	folder_class->append_messages_sync = imapx_append_messages_sync;
 	folder_class->expunge_sync = imapx_expunge_sync;
 	folder_class->fetch_messages_sync = imapx_fetch_messages_sync;
 	folder_class->get_message_sync = imapx_get_message_sync;
@@ -1200,6 +1263,53 @@ camel_imapx_folder_set_quota_root_names (CamelIMAPXFolder *folder,
 	g_object_notify (G_OBJECT (folder), "quota-root-names");
 }
 
+/**
+ * camel_imapx_folder_get_windowed_scans:
+ * @folder: a #CamelIMAPXFolder
+ *
+ * Returns how many refreshes of @folder only scanned the flags of its
+ * most recent messages since the whole folder was last scanned.
+ *
+ * Returns: the number of windowed flag scans
+ *
+ * Since: 3.10
+ **/
+guint
+camel_imapx_folder_get_windowed_scans (CamelIMAPXFolder *folder)
+{
+	guint windowed_scans;
+
+	g_return_val_if_fail (CAMEL_IS_IMAPX_FOLDER (folder), 0);
+
+	g_mutex_lock (&folder->priv->property_lock);
+	windowed_scans = folder->priv->windowed_scans;
+	g_mutex_unlock (&folder->priv->property_lock);
+
+	return windowed_scans;
+}
+
+/**
+ * camel_imapx_folder_set_windowed_scans:
+ * @folder: a #CamelIMAPXFolder
+ * @windowed_scans: the number of windowed flag scans
+ *
+ * Sets how many refreshes of @folder only scanned the flags of its
+ * most recent messages since the whole folder was last scanned.
+ * Pass 0 after a full scan.
+ *
+ * Since: 3.10
+ **/
+void
+camel_imapx_folder_set_windowed_scans (CamelIMAPXFolder *folder,
+                                       guint windowed_scans)
+{
+	g_return_if_fail (CAMEL_IS_IMAPX_FOLDER (folder));
+
+	g_mutex_lock (&folder->priv->property_lock);
+	folder->priv->windowed_scans = windowed_scans;
+	g_mutex_unlock (&folder->priv->property_lock);
+}
+
 /**
  * camel_imapx_folder_add_move_to_real_junk:
  * @folder: a #CamelIMAPXFolder
@@ -1289,7 +1399,7 @@ camel_imapx_folder_invalidate_local_cache (CamelIMAPXFolder *folder,
 	summary = CAMEL_FOLDER (folder)->summary;
 
 	changes = camel_folder_change_info_new ();
-	array = camel_folder_summary_get_array (summary);
+	array = camel_folder_summary_ref_array (summary);
 
 	for (ii = 0; ii < array->len; ii++) {
 		const gchar *uid = array->pdata[ii];
@@ -1306,7 +1416,7 @@ camel_imapx_folder_invalidate_local_cache (CamelIMAPXFolder *folder,
 	camel_folder_changed (CAMEL_FOLDER (folder), changes);
 
 	camel_folder_change_info_free (changes);
-	camel_folder_summary_free_array (array);
+	g_ptr_array_unref (array);
 }
 
 /**
@@ -96,6 +96,11 @@ gchar **	camel_imapx_folder_dup_quota_root_names
 void		camel_imapx_folder_set_quota_root_names
 						(CamelIMAPXFolder *folder,
 						 const gchar **quota_root_names);
+guint		camel_imapx_folder_get_windowed_scans
+						(CamelIMAPXFolder *folder);
+void		camel_imapx_folder_set_windowed_scans
+						(CamelIMAPXFolder *folder,
+						 guint windowed_scans);
 void		camel_imapx_folder_add_move_to_real_junk
 						(CamelIMAPXFolder *folder,
 						 const gchar *message_uid);
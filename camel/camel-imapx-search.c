@@ -18,6 +18,9 @@
 
 #include "camel-imapx-search.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "camel-offline-store.h"
 #include "camel-search-private.h"
 
@@ -25,8 +28,19 @@
 	(G_TYPE_INSTANCE_GET_PRIVATE \
 	((obj), CAMEL_TYPE_IMAPX_SEARCH, CamelIMAPXSearchPrivate))
 
+/* Longest UID set we send to restrict a search to the messages being
+ * matched; beyond that the whole folder is searched instead. */
+#define MAX_UID_SET_LENGTH 8192
+
 struct _CamelIMAPXSearchPrivate {
 	GWeakRef server;
+
+	/* Server-side results for the last criteria, so that
+	 * matching messages one at a time, as (match-all ...)
+	 * does, costs one UID SEARCH instead of one each. */
+	gchar *cached_criteria;
+	GPtrArray *cached_uids;
+	GHashTable *cached_matches;
 };
 
 enum {
@@ -74,6 +88,23 @@ imapx_search_get_property (GObject *object,
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
 }
 
+static void
+imapx_search_clear_cache (CamelIMAPXSearch *search)
+{
+	g_free (search->priv->cached_criteria);
+	search->priv->cached_criteria = NULL;
+
+	if (search->priv->cached_matches != NULL) {
+		g_hash_table_destroy (search->priv->cached_matches);
+		search->priv->cached_matches = NULL;
+	}
+
+	if (search->priv->cached_uids != NULL) {
+		g_ptr_array_unref (search->priv->cached_uids);
+		search->priv->cached_uids = NULL;
+	}
+}
+
 static void
 imapx_search_dispose (GObject *object)
 {
@@ -83,22 +114,87 @@ imapx_search_dispose (GObject *object)
 
 	g_weak_ref_set (&priv->server, NULL);
 
+	imapx_search_clear_cache (CAMEL_IMAPX_SEARCH (object));
+
 	/* Chain up to parent's dispose() method. */
 	G_OBJECT_CLASS (camel_imapx_search_parent_class)->dispose (object);
 }
 
+static gint
+imapx_search_compare_uids (gconstpointer a,
+                           gconstpointer b)
+{
+	guint32 uid_a = *(const guint32 *) a;
+	guint32 uid_b = *(const guint32 *) b;
+
+	return (uid_a < uid_b) ? -1 : (uid_a > uid_b) ? 1 : 0;
+}
+
+/* Builds a compact UID set such as "1:40,42,50:90" from an array
+ * of UID strings, or returns NULL if it would get too long. */
+static gchar *
+imapx_search_build_uid_set (GPtrArray *uids)
+{
+	GString *uid_set;
+	GArray *numbers;
+	guint ii;
+
+	numbers = g_array_sized_new (FALSE, FALSE, sizeof (guint32), uids->len);
+
+	for (ii = 0; ii < uids->len; ii++) {
+		guint32 uid = strtoul (uids->pdata[ii], NULL, 10);
+		g_array_append_val (numbers, uid);
+	}
+
+	g_array_sort (numbers, imapx_search_compare_uids);
+
+	uid_set = g_string_sized_new (128);
+
+	for (ii = 0; ii < numbers->len; ii++) {
+		guint32 first, last;
+
+		first = last = g_array_index (numbers, guint32, ii);
+
+		while (ii + 1 < numbers->len &&
+		       g_array_index (numbers, guint32, ii + 1) <= last + 1)
+			last = g_array_index (numbers, guint32, ++ii);
+
+		if (uid_set->len > 0)
+			g_string_append_c (uid_set, ',');
+
+		if (first == last)
+			g_string_append_printf (uid_set, "%u", first);
+		else
+			g_string_append_printf (uid_set, "%u:%u", first, last);
+
+		if (uid_set->len > MAX_UID_SET_LENGTH)
+			break;
+	}
+
+	g_array_free (numbers, TRUE);
+
+	if (uid_set->len == 0 || uid_set->len > MAX_UID_SET_LENGTH) {
+		g_string_free (uid_set, TRUE);
+		return NULL;
+	}
+
+	return g_string_free (uid_set, FALSE);
+}
+
 static CamelSExpResult *
 imapx_search_body_contains (CamelSExp *sexp,
                             gint argc,
                             CamelSExpResult **argv,
                             CamelFolderSearch *search)
 {
+	CamelIMAPXSearch *imapx_search = CAMEL_IMAPX_SEARCH (search);
 	CamelIMAPXServer *server;
 	CamelSExpResult *result;
 	CamelSExpResultType type;
 	GString *criteria;
 	GPtrArray *uids;
 	gint ii, jj;
+	gboolean search_failed = FALSE;
 	GError *error = NULL;
 
 	/* Match everything if argv = [""] */
@@ -119,14 +215,6 @@ imapx_search_body_contains (CamelSExp *sexp,
 
 	criteria = g_string_sized_new (128);
 
-	if (search->current != NULL) {
-		const gchar *uid;
-
-		/* Limit the search to a single UID. */
-		uid = camel_message_info_uid (search->current);
-		g_string_append_printf (criteria, "UID %s", uid);
-	}
-
 	for (ii = 0; ii < argc; ii++) {
 		struct _camel_search_words *words;
 		const guchar *term;
@@ -155,6 +243,41 @@ imapx_search_body_contains (CamelSExp *sexp,
 
 			g_string_append_c (criteria, '"');
 		}
+
+		camel_search_words_free (words);
+	}
+
+	/* Matching one message at a time, reuse the results for all the
+	 * messages being matched, which one UID SEARCH limited to those
+	 * messages gave us. */
+	if (search->current != NULL &&
+	    g_strcmp0 (imapx_search->priv->cached_criteria, criteria->str) == 0) {
+		const gchar *uid = camel_message_info_uid (search->current);
+
+		type = CAMEL_SEXP_RES_BOOL;
+		result = camel_sexp_result_new (sexp, type);
+		result->value.boolean = g_hash_table_contains (
+			imapx_search->priv->cached_matches, uid);
+
+		g_string_free (criteria, TRUE);
+		g_object_unref (server);
+
+		return result;
+	}
+
+	if (search->current != NULL) {
+		GPtrArray *v;
+		gchar *uid_set;
+
+		v = search->summary_set ? search->summary_set : search->summary;
+		uid_set = imapx_search_build_uid_set (v);
+
+		if (uid_set != NULL) {
+			g_string_prepend_c (criteria, ' ');
+			g_string_prepend (criteria, uid_set);
+			g_string_prepend (criteria, "UID ");
+			g_free (uid_set);
+		}
 	}
 
 	uids = camel_imapx_server_uid_search (
@@ -173,13 +296,33 @@ imapx_search_body_contains (CamelSExp *sexp,
 			"%s: (UID SEARCH %s): %s",
 			G_STRFUNC, criteria->str, error->message);
 		uids = g_ptr_array_new ();
-		g_error_free (error);
+		g_clear_error (&error);
+		search_failed = TRUE;
 	}
 
 	if (search->current != NULL) {
+		const gchar *uid = camel_message_info_uid (search->current);
+		GHashTable *matches;
+
+		matches = g_hash_table_new (g_str_hash, g_str_equal);
+		for (ii = 0; ii < uids->len; ii++)
+			g_hash_table_add (matches, uids->pdata[ii]);
+
 		type = CAMEL_SEXP_RES_BOOL;
 		result = camel_sexp_result_new (sexp, type);
-		result->value.boolean = (uids->len > 0);
+		result->value.boolean = g_hash_table_contains (matches, uid);
+
+		/* Do not cache failed searches. */
+		imapx_search_clear_cache (imapx_search);
+		if (!search_failed) {
+			imapx_search->priv->cached_criteria =
+				g_strdup (criteria->str);
+			imapx_search->priv->cached_uids =
+				g_ptr_array_ref (uids);
+			imapx_search->priv->cached_matches = matches;
+		} else {
+			g_hash_table_destroy (matches);
+		}
 	} else {
 		type = CAMEL_SEXP_RES_ARRAY_PTR;
 		result = camel_sexp_result_new (sexp, type);
@@ -328,6 +471,9 @@ camel_imapx_search_set_server (CamelIMAPXSearch *search,
 
 	g_weak_ref_set (&search->priv->server, server);
 
+	/* Cached results are only valid for one search. */
+	imapx_search_clear_cache (search);
+
 	g_object_notify (G_OBJECT (search), "server");
 }
 
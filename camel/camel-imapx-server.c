@@ -60,6 +60,47 @@
 
 #define MAX_COMMAND_LEN 1000
 
+/* Header fetches during a refresh are batched adaptively: batches
+ * start small so the message list fills quickly, double while doing
+ * so still raises the throughput, and shrink again on errors or when
+ * a batch takes longer than FETCH_BATCH_TARGET_TIME.  The batch size
+ * never exceeds the "batch-fetch-count" setting. */
+#define FETCH_BATCH_INITIAL 64
+#define FETCH_BATCH_MIN 16
+#define FETCH_BATCH_TARGET_TIME (3 * G_USEC_PER_SEC)
+
+/* How many header batches to keep queued at once, so the next one
+ * is already on the wire while the server streams the current one. */
+#define FETCH_PIPELINE_DEPTH 2
+
+/* Without CONDSTORE a refresh only compares the flags of the newest
+ * SCAN_WINDOW_SIZE messages, and the whole folder every
+ * FULL_SCAN_INTERVAL refreshes or when the message count shows that
+ * something outside the window went away. */
+#define SCAN_WINDOW_SIZE 1000
+#define FULL_SCAN_INTERVAL 10
+
+/* Without NOTIFY, folders other than the one being refreshed are
+ * polled with STATUS along with it, in pipelined batches of up to
+ * STATUS_SWEEP_BATCH, and at most once per STATUS_SWEEP_INTERVAL
+ * seconds each. */
+#define STATUS_SWEEP_BATCH 20
+#define STATUS_SWEEP_INTERVAL 60
+
+/* With NOTIFY, a folder's counts are trusted without asking again
+ * for at most this many seconds after its last STATUS, in case the
+ * server silently dropped some events. */
+#define STATUS_NOTIFY_MAX_AGE 600
+
+/* Callers asking for messages, flag changes, copies or uploads are
+ * made to wait once this many jobs are pending on one connection,
+ * so that a burst (a filter run, say) can't queue without bound. */
+#define MAX_PENDING_JOBS 64
+
+/* How many messages to upload with a single MULTIAPPEND command.
+ * The server stores them atomically, so keep the batches modest. */
+#define MULTIAPPEND_BATCH_SIZE 32
+
 extern gint camel_application_is_exiting;
 
 /* Job-specific structs */
@@ -67,6 +108,7 @@ typedef struct _GetMessageData GetMessageData;
 typedef struct _RefreshInfoData RefreshInfoData;
 typedef struct _SyncChangesData SyncChangesData;
 typedef struct _AppendMessageData AppendMessageData;
+typedef struct _AppendMessagesData AppendMessagesData;
 typedef struct _CopyMessagesData CopyMessagesData;
 typedef struct _ListData ListData;
 typedef struct _ManageSubscriptionsData ManageSubscriptionsData;
@@ -89,19 +131,36 @@ struct _GetMessageData {
 	gboolean use_multi_fetch;
 };
 
+/* How a refresh compares the server's flags with the summary. */
+typedef enum {
+	IMAPX_SCAN_FULL,
+	IMAPX_SCAN_WINDOW,
+	IMAPX_SCAN_CHANGEDSINCE
+} IMAPXScanMode;
+
 struct _RefreshInfoData {
 	/* array of refresh info's */
 	GArray *infos;
 	/* used for building uidset stuff */
 	gint index;
-	gint last_index;
 	gint fetch_msg_limit;
 	CamelFetchType fetch_type;
 	gboolean update_unseen;
 	gboolean scan_changes;
+	IMAPXScanMode scan_mode;
+	/* lowest UID covered by a windowed scan */
+	guint32 scan_from;
 	struct _uidset_state uidset;
 	/* changes during refresh */
 	CamelFolderChangeInfo *changes;
+	/* header batches queued and not yet completed, and the
+	 * index of the first info each of their commands fetches */
+	guint batches_in_flight;
+	GHashTable *batch_starts;
+	gboolean batch_failed;
+	/* time and stream position of the last batch completion */
+	gint64 batch_mark_time;
+	guint64 batch_mark_bytes;
 };
 
 struct _SyncChangesData {
@@ -125,11 +184,20 @@ struct _AppendMessageData {
 	gchar *appended_uid;
 };
 
+struct _AppendMessagesData {
+	/* in: AppendMessageData for each message */
+	GPtrArray *messages;
+
+	/* CamelIMAPXCommand -> index of its first message */
+	GHashTable *batches;
+};
+
 struct _CopyMessagesData {
 	CamelFolder *dest;
 	GPtrArray *uids;
 	gboolean delete_originals;
 	gboolean use_move_command;
+	gboolean use_uid_expunge;
 	gint index;
 	gint last_index;
 	struct _uidset_state uidset;
@@ -207,6 +275,10 @@ static gboolean	imapx_untagged_capability	(CamelIMAPXServer *is,
 						 CamelIMAPXStream *stream,
 						 GCancellable *cancellable,
 						 GError **error);
+static gboolean	imapx_untagged_esearch		(CamelIMAPXServer *is,
+						 CamelIMAPXStream *stream,
+						 GCancellable *cancellable,
+						 GError **error);
 static gboolean	imapx_untagged_exists		(CamelIMAPXServer *is,
 						 CamelIMAPXStream *stream,
 						 GCancellable *cancellable,
@@ -272,6 +344,7 @@ enum {
 	IMAPX_UNTAGGED_ID_BAD = 0,
 	IMAPX_UNTAGGED_ID_BYE,
 	IMAPX_UNTAGGED_ID_CAPABILITY,
+	IMAPX_UNTAGGED_ID_ESEARCH,
 	IMAPX_UNTAGGED_ID_EXISTS,
 	IMAPX_UNTAGGED_ID_EXPUNGE,
 	IMAPX_UNTAGGED_ID_FETCH,
@@ -295,6 +368,7 @@ static const CamelIMAPXUntaggedRespHandlerDesc _untagged_descr[] = {
 	{CAMEL_IMAPX_UNTAGGED_BAD, imapx_untagged_ok_no_bad, NULL, FALSE},
 	{CAMEL_IMAPX_UNTAGGED_BYE, imapx_untagged_bye, NULL, FALSE},
 	{CAMEL_IMAPX_UNTAGGED_CAPABILITY, imapx_untagged_capability, NULL, FALSE},
+	{CAMEL_IMAPX_UNTAGGED_ESEARCH, imapx_untagged_esearch, NULL, FALSE},
 	{CAMEL_IMAPX_UNTAGGED_EXISTS, imapx_untagged_exists, NULL, TRUE},
 	{CAMEL_IMAPX_UNTAGGED_EXPUNGE, imapx_untagged_expunge, NULL, TRUE},
 	{CAMEL_IMAPX_UNTAGGED_FETCH, imapx_untagged_fetch, NULL, TRUE},
@@ -334,6 +408,41 @@ struct _CamelIMAPXServerPrivate {
 
 	GHashTable *known_alerts;
 	GMutex known_alerts_lock;
+
+	/* Command round-trip statistics, in microseconds.
+	 * Protected by the queue lock. */
+	gint64 latency_average;
+	gint64 latency_max;
+
+	/* Adaptive header batching, only used from the parser thread.
+	 * The throughput is in bytes per second. */
+	guint fetch_batch_size;
+	gdouble fetch_throughput;
+
+	/* Tracking of folders other than the selected one, through
+	 * NOTIFY if the server has it or STATUS sweeps otherwise.
+	 * status_times maps folder names to the monotonic time, in
+	 * seconds, of their last STATUS; status_responses keeps the
+	 * last STATUS of folders which were not open when it came;
+	 * notify_pending holds the folders with a refresh queued.
+	 * All under status_lock. */
+	GMutex status_lock;
+	gboolean watch_mailboxes;
+	gboolean notify_active;
+	gboolean notify_all;
+	guint notify_since;
+	GHashTable *status_times;
+	GHashTable *status_responses;
+	GHashTable *notify_pending;
+
+	/* Signalled whenever a job is unregistered, to wake
+	 * callers waiting in imapx_server_wait_for_job_slot().
+	 * The counters are under QUEUE_LOCK. */
+	GMutex job_slot_lock;
+	GCond job_slot_cond;
+	guint jobs_submitted;
+	guint jobs_coalesced;
+	guint jobs_throttled;
 };
 
 enum {
@@ -438,6 +547,11 @@ static gboolean	imapx_job_fetch_new_messages_start
 						 CamelIMAPXServer *is,
 						 GCancellable *cancellable,
 						 GError **error);
+static gboolean	imapx_job_scan_changes_start
+						(CamelIMAPXJob *job,
+						 CamelIMAPXServer *is,
+						 GCancellable *cancellable,
+						 GError **error);
 static gint	imapx_refresh_info_uid_cmp	(gconstpointer ap,
 						 gconstpointer bp,
 						 gboolean ascending);
@@ -451,6 +565,9 @@ static gboolean	imapx_server_sync_changes	(CamelIMAPXServer *is,
 						 GError **error);
 static void	imapx_sync_free_user		(GArray *user_set);
 
+static void	imapx_copy_messages_apply_copyuid
+						(CamelIMAPXJob *job,
+						 struct _status_info *sinfo);
 static gboolean	imapx_command_copy_messages_step_start
 						(CamelIMAPXServer *is,
 						 CamelIMAPXJob *job,
@@ -602,9 +719,32 @@ refresh_info_data_free (RefreshInfoData *data)
 	camel_folder_change_info_free (data->changes);
 	refresh_info_data_infos_free (data);
 
+	if (data->batch_starts != NULL)
+		g_hash_table_destroy (data->batch_starts);
+
 	g_slice_free (RefreshInfoData, data);
 }
 
+/* Returns the index of the first info any header batch in flight
+ * fetches; the untagged FETCH responses may answer any of them. */
+static gint
+refresh_info_data_first_in_flight (RefreshInfoData *data)
+{
+	GHashTableIter iter;
+	gpointer value;
+	gint first = -1;
+
+	if (data->batch_starts != NULL) {
+		g_hash_table_iter_init (&iter, data->batch_starts);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			if (first == -1 || GPOINTER_TO_INT (value) < first)
+				first = GPOINTER_TO_INT (value);
+		}
+	}
+
+	return MAX (first, 0);
+}
+
 static void
 sync_changes_data_free (SyncChangesData *data)
 {
@@ -630,6 +770,15 @@ append_message_data_free (AppendMessageData *data)
 	g_slice_free (AppendMessageData, data);
 }
 
+static void
+append_messages_data_free (AppendMessagesData *data)
+{
+	g_ptr_array_unref (data->messages);
+	g_hash_table_destroy (data->batches);
+
+	g_slice_free (AppendMessagesData, data);
+}
+
 static void
 copy_messages_data_free (CopyMessagesData *data)
 {
@@ -823,6 +972,7 @@ imapx_command_start (CamelIMAPXServer *is,
 	if (cp_continuation || cp_literal_plus)
 		is->literal = ic;
 
+	ic->start_time = g_get_monotonic_time ();
 	camel_imapx_command_queue_push_tail (is->active, ic);
 
 	stream = camel_imapx_server_ref_stream (is);
@@ -884,6 +1034,40 @@ exit:
 	g_clear_object (&cancellable);
 }
 
+/* Must have QUEUE lock */
+static gboolean
+imapx_has_other_active_job (CamelIMAPXServer *is,
+                            CamelIMAPXJob *job,
+                            guint32 type)
+{
+	CamelFolder *folder;
+	GList *head, *link;
+	gboolean found = FALSE;
+
+	folder = g_weak_ref_get (&is->select_folder);
+
+	head = camel_imapx_command_queue_peek_head_link (is->active);
+
+	for (link = head; link != NULL && !found; link = g_list_next (link)) {
+		CamelIMAPXCommand *ic = link->data;
+		CamelIMAPXJob *active_job;
+
+		active_job = camel_imapx_command_get_job (ic);
+
+		if (active_job == NULL || active_job == job)
+			continue;
+
+		if (!(active_job->type & type))
+			continue;
+
+		found = camel_imapx_job_matches (active_job, folder, NULL);
+	}
+
+	g_clear_object (&folder);
+
+	return found;
+}
+
 static gboolean
 imapx_is_duplicate_fetch_or_refresh (CamelIMAPXServer *is,
                                      CamelIMAPXCommand *ic)
@@ -902,10 +1086,13 @@ imapx_is_duplicate_fetch_or_refresh (CamelIMAPXServer *is,
 	if (job == NULL)
 		return FALSE;
 
-	if ((job->type && job_types) == 0)
+	if ((job->type & job_types) == 0)
 		return FALSE;
 
-	if (imapx_match_active_job (is, job_types, NULL) == NULL)
+	/* Commands of the same job are free to overlap, that's how
+	 * the header fetches get pipelined; only another job's
+	 * fetches over the same folder have to wait their turn. */
+	if (!imapx_has_other_active_job (is, job, job_types))
 		return FALSE;
 
 	c (is->tagprefix, "Not yet sending duplicate fetch/refresh %s command\n", ic->name);
@@ -1628,6 +1815,37 @@ imapx_untagged_flags (CamelIMAPXServer *is,
 	return success;
 }
 
+/* Lets imapx_parse_fetch_full() write a message body straight into
+ * the cache stream of the GET_MESSAGE job waiting for it, instead of
+ * collecting it in memory first. */
+static CamelStream *
+imapx_fetch_body_target (struct _fetch_info *finfo,
+                         gpointer user_data)
+{
+	CamelIMAPXServer *is = CAMEL_IMAPX_SERVER (user_data);
+	CamelIMAPXJob *job;
+	GetMessageData *data;
+
+	job = imapx_match_active_job (
+		is, IMAPX_JOB_GET_MESSAGE, finfo->uid);
+	if (job == NULL)
+		return NULL;
+
+	data = camel_imapx_job_get_data (job);
+	if (data == NULL || data->stream == NULL)
+		return NULL;
+
+	if (data->use_multi_fetch) {
+		data->body_offset = finfo->offset;
+		g_seekable_seek (
+			G_SEEKABLE (data->stream),
+			finfo->offset, G_SEEK_SET,
+			NULL, NULL);
+	}
+
+	return g_object_ref (data->stream);
+}
+
 static gboolean
 imapx_untagged_fetch (CamelIMAPXServer *is,
                       CamelIMAPXStream *stream,
@@ -1638,7 +1856,8 @@ imapx_untagged_fetch (CamelIMAPXServer *is,
 
 	g_return_val_if_fail (CAMEL_IS_IMAPX_SERVER (is), FALSE);
 
-	finfo = imapx_parse_fetch (stream, cancellable, error);
+	finfo = imapx_parse_fetch_full (
+		stream, imapx_fetch_body_target, is, cancellable, error);
 	if (finfo == NULL) {
 		imapx_free_fetch (finfo);
 		return FALSE;
@@ -1658,7 +1877,10 @@ imapx_untagged_fetch (CamelIMAPXServer *is,
 		/* This must've been a get-message request,
 		 * fill out the body stream, in the right spot. */
 
-		if (job != NULL) {
+		if (finfo->got & FETCH_BODY_STREAMED) {
+			/* Already written by imapx_fetch_body_target(). */
+			data->body_len = finfo->body_len;
+		} else if (job != NULL) {
 			if (data->use_multi_fetch) {
 				data->body_offset = finfo->offset;
 				g_seekable_seek (
@@ -1817,7 +2039,7 @@ imapx_untagged_fetch (CamelIMAPXServer *is,
 					data = camel_imapx_job_get_data (job);
 					g_return_val_if_fail (data != NULL, FALSE);
 
-					min = data->last_index;
+					min = refresh_info_data_first_in_flight (data);
 					max = data->index - 1;
 
 					/* array is sorted, so use a binary search */
@@ -2129,6 +2351,294 @@ exit:
 	return success;
 }
 
+/* ESEARCH (RFC 4731) responses carry the result as a compact sequence
+ * set, e.g. "* ESEARCH (TAG "A7") UID ALL 3:1000,1200", which we expand
+ * into the same array of numbers untagged SEARCH data produces. */
+static gboolean
+imapx_untagged_esearch (CamelIMAPXServer *is,
+                        CamelIMAPXStream *stream,
+                        GCancellable *cancellable,
+                        GError **error)
+{
+	GArray *search_results;
+	gint tok;
+	guint len;
+	guchar *token;
+	guint64 number;
+	gboolean success = FALSE;
+
+	search_results = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+	tok = camel_imapx_stream_token (
+		stream, &token, &len, cancellable, error);
+	if (tok == IMAPX_TOK_ERROR)
+		goto exit;
+
+	/* Skip the search correlator. */
+	if (tok == '(') {
+		while (tok != ')') {
+			tok = camel_imapx_stream_token (
+				stream, &token, &len, cancellable, error);
+			if (tok == IMAPX_TOK_ERROR)
+				goto exit;
+			if (tok == '\n') {
+				g_set_error (
+					error, CAMEL_IMAPX_ERROR, 1,
+					"esearch: missing closing ')'");
+				goto exit;
+			}
+		}
+	} else {
+		camel_imapx_stream_ungettoken (stream, tok, token, len);
+	}
+
+	while (TRUE) {
+		tok = camel_imapx_stream_token (
+			stream, &token, &len, cancellable, error);
+		if (tok == '\n')
+			break;
+		if (tok != IMAPX_TOK_TOKEN) {
+			if (tok != IMAPX_TOK_ERROR)
+				g_set_error (
+					error, CAMEL_IMAPX_ERROR, 1,
+					"esearch: expecting return data");
+			goto exit;
+		}
+
+		if (g_ascii_strcasecmp ((gchar *) token, "UID") == 0)
+			continue;
+
+		if (g_ascii_strcasecmp ((gchar *) token, "ALL") == 0) {
+			GPtrArray *uids;
+			guint ii;
+
+			uids = imapx_parse_uids (stream, cancellable, error);
+			if (uids == NULL)
+				goto exit;
+
+			g_array_set_size (search_results, uids->len);
+			for (ii = 0; ii < uids->len; ii++)
+				g_array_index (search_results, guint64, ii) =
+					GPOINTER_TO_UINT (uids->pdata[ii]);
+
+			g_ptr_array_free (uids, TRUE);
+		} else {
+			/* MIN, MAX, COUNT and anything else
+			 * we did not ask for take a number. */
+			if (!camel_imapx_stream_number (
+				stream, &number, cancellable, error))
+				goto exit;
+		}
+	}
+
+	g_mutex_lock (&is->priv->search_results_lock);
+
+	if (is->priv->search_results == NULL)
+		is->priv->search_results = g_array_ref (search_results);
+	else
+		g_warning ("%s: Conflicting search results", G_STRFUNC);
+
+	g_mutex_unlock (&is->priv->search_results_lock);
+
+	success = TRUE;
+
+exit:
+	g_array_unref (search_results);
+
+	return success;
+}
+
+typedef struct _NotifyRefreshData NotifyRefreshData;
+
+struct _NotifyRefreshData {
+	GWeakRef server;
+	CamelFolder *folder;
+};
+
+static void
+notify_refresh_data_free (NotifyRefreshData *data)
+{
+	CamelIMAPXServer *is;
+
+	is = g_weak_ref_get (&data->server);
+
+	if (is != NULL) {
+		g_mutex_lock (&is->priv->status_lock);
+		g_hash_table_remove (
+			is->priv->notify_pending,
+			camel_folder_get_full_name (data->folder));
+		g_mutex_unlock (&is->priv->status_lock);
+
+		g_object_unref (is);
+	}
+
+	g_weak_ref_clear (&data->server);
+	g_object_unref (data->folder);
+
+	g_slice_free (NotifyRefreshData, data);
+}
+
+static void
+imapx_server_notify_refresh_cb (CamelSession *session,
+                                GCancellable *cancellable,
+                                NotifyRefreshData *data,
+                                GError **error)
+{
+	camel_folder_refresh_info_sync (data->folder, cancellable, error);
+}
+
+static gboolean
+imapx_server_has_active_command (CamelIMAPXServer *is,
+                                 const gchar *name)
+{
+	GList *head, *link;
+	gboolean found = FALSE;
+
+	QUEUE_LOCK (is);
+
+	head = camel_imapx_command_queue_peek_head_link (is->active);
+
+	for (link = head; link != NULL && !found; link = g_list_next (link)) {
+		CamelIMAPXCommand *ic = link->data;
+
+		found = (g_strcmp0 (ic->name, name) == 0);
+	}
+
+	QUEUE_UNLOCK (is);
+
+	return found;
+}
+
+/* Records that the server-side counts of @folder are current.  When
+ * the STATUS was an unsolicited NOTIFY event and the counts show
+ * changes the summary lacks, a refresh of @folder is queued. */
+static void
+imapx_server_note_status (CamelIMAPXServer *is,
+                          CamelFolder *folder)
+{
+	CamelIMAPXFolder *ifolder;
+	CamelIMAPXSummary *isum;
+	CamelFolder *select_folder;
+	const gchar *full_name;
+	gboolean notify_active;
+	gboolean changed;
+
+	full_name = camel_folder_get_full_name (folder);
+
+	g_mutex_lock (&is->priv->status_lock);
+	g_hash_table_insert (
+		is->priv->status_times, g_strdup (full_name),
+		GUINT_TO_POINTER (g_get_monotonic_time () / G_USEC_PER_SEC));
+	g_hash_table_remove (is->priv->status_responses, full_name);
+	notify_active = is->priv->notify_active;
+	g_mutex_unlock (&is->priv->status_lock);
+
+	if (!notify_active || imapx_server_has_active_command (is, "STATUS"))
+		return;
+
+	/* The selected folder is kept up to date already. */
+	select_folder = g_weak_ref_get (&is->select_folder);
+	if (select_folder != NULL) {
+		g_object_unref (select_folder);
+		if (select_folder == folder)
+			return;
+	}
+
+	ifolder = CAMEL_IMAPX_FOLDER (folder);
+	isum = CAMEL_IMAPX_SUMMARY (folder->summary);
+
+	changed =
+		camel_folder_summary_count (folder->summary) != ifolder->exists_on_server ||
+		camel_folder_summary_get_unread_count (folder->summary) != ifolder->unread_on_server ||
+		isum->uidnext != ifolder->uidnext_on_server ||
+		(ifolder->modseq_on_server > 0 && isum->modseq != ifolder->modseq_on_server);
+
+	if (!changed)
+		return;
+
+	g_mutex_lock (&is->priv->status_lock);
+
+	if (!g_hash_table_contains (is->priv->notify_pending, full_name)) {
+		CamelIMAPXStore *store;
+		CamelSession *session;
+		NotifyRefreshData *data;
+
+		g_hash_table_add (is->priv->notify_pending, g_strdup (full_name));
+
+		data = g_slice_new0 (NotifyRefreshData);
+		g_weak_ref_init (&data->server, is);
+		data->folder = g_object_ref (folder);
+
+		store = camel_imapx_server_ref_store (is);
+		session = camel_service_ref_session (CAMEL_SERVICE (store));
+
+		c (is->tagprefix, "NOTIFY: queueing refresh of '%s'\n", full_name);
+
+		camel_session_submit_job (
+			session, (CamelSessionCallback)
+			imapx_server_notify_refresh_cb, data,
+			(GDestroyNotify) notify_refresh_data_free);
+
+		g_object_unref (session);
+		g_object_unref (store);
+	}
+
+	g_mutex_unlock (&is->priv->status_lock);
+}
+
+/* Keeps @response for the folder at @folder_path, which is not open.
+ * It is applied by imapx_server_apply_kept_status() if the folder is
+ * refreshed while the response is still fresh. */
+static void
+imapx_server_keep_status (CamelIMAPXServer *is,
+                          const gchar *folder_path,
+                          CamelIMAPXStatusResponse *response)
+{
+	g_mutex_lock (&is->priv->status_lock);
+	g_hash_table_insert (
+		is->priv->status_times, g_strdup (folder_path),
+		GUINT_TO_POINTER (g_get_monotonic_time () / G_USEC_PER_SEC));
+	g_hash_table_insert (
+		is->priv->status_responses, g_strdup (folder_path),
+		g_object_ref (response));
+	g_mutex_unlock (&is->priv->status_lock);
+}
+
+static void
+imapx_server_apply_kept_status (CamelIMAPXServer *is,
+                                CamelFolder *folder)
+{
+	CamelIMAPXStatusResponse *response;
+	CamelIMAPXSummary *isum;
+	const gchar *full_name;
+	guint32 uidvalidity;
+
+	full_name = camel_folder_get_full_name (folder);
+
+	g_mutex_lock (&is->priv->status_lock);
+	response = g_hash_table_lookup (is->priv->status_responses, full_name);
+	if (response != NULL) {
+		g_object_ref (response);
+		g_hash_table_remove (is->priv->status_responses, full_name);
+	}
+	g_mutex_unlock (&is->priv->status_lock);
+
+	if (response == NULL)
+		return;
+
+	isum = CAMEL_IMAPX_SUMMARY (folder->summary);
+	uidvalidity = camel_imapx_status_response_get_uidvalidity (response);
+
+	camel_imapx_folder_process_status_response (
+		CAMEL_IMAPX_FOLDER (folder), response);
+
+	if (uidvalidity > 0 && uidvalidity != isum->validity)
+		camel_imapx_folder_invalidate_local_cache (
+			CAMEL_IMAPX_FOLDER (folder), uidvalidity);
+
+	g_object_unref (response);
+}
+
 static gboolean
 imapx_untagged_status (CamelIMAPXServer *is,
                        CamelIMAPXStream *stream,
@@ -2141,7 +2651,6 @@ imapx_untagged_status (CamelIMAPXServer *is,
 	CamelFolder *folder = NULL;
 	const gchar *mailbox_name;
 	guint32 uidvalidity;
-	GError *local_error = NULL;
 
 	g_return_val_if_fail (CAMEL_IS_IMAPX_SERVER (is), FALSE);
 
@@ -2167,9 +2676,14 @@ imapx_untagged_status (CamelIMAPXServer *is,
 			"Got folder path '%s' for mailbox '%s'\n",
 			folder_path, mailbox_name);
 		if (folder_path != NULL) {
-			folder = camel_store_get_folder_sync (
-				CAMEL_STORE (store), folder_path,
-				0, cancellable, &local_error);
+			/* Don't open folders from the parser thread;
+			 * for the others just keep the counts until
+			 * they get refreshed. */
+			folder = camel_object_bag_peek (
+				CAMEL_STORE (store)->folders, folder_path);
+			if (folder == NULL)
+				imapx_server_keep_status (
+					is, folder_path, response);
 			g_free (folder_path);
 		}
 	}
@@ -2189,19 +2703,17 @@ imapx_untagged_status (CamelIMAPXServer *is,
 		if (uidvalidity > 0 && uidvalidity != imapx_summary->validity)
 			camel_imapx_folder_invalidate_local_cache (
 				imapx_folder, uidvalidity);
+
+		imapx_server_note_status (is, folder);
+		g_object_unref (folder);
 	} else {
 		c (is->tagprefix,
-			"Received STATUS for unknown folder '%s'\n",
+			"Received STATUS for folder '%s' not open\n",
 			mailbox_name);
 	}
 
 	g_object_unref (response);
 
-	if (local_error != NULL) {
-		g_propagate_error (error, local_error);
-		return FALSE;
-	}
-
 	return TRUE;
 }
 
@@ -2236,8 +2748,11 @@ imapx_untagged_bye (CamelIMAPXServer *is,
 	/* Do not disconnect the service if we're still connecting.
 	 * camel_service_disconnect_sync() will cancel the connect
 	 * operation and the server message will get replaced with
-	 * a generic "Operation was cancelled" message. */
-	if (status == CAMEL_SERVICE_CONNECTED)
+	 * a generic "Operation was cancelled" message.  Losing one
+	 * of the additional pooled connections only drops it from
+	 * the pool. */
+	if (status == CAMEL_SERVICE_CONNECTED &&
+	    !camel_imapx_store_discard_server (imapx_store, is))
 		camel_service_disconnect_sync (service, FALSE, NULL, NULL);
 
 	g_object_unref (imapx_store);
@@ -2364,6 +2879,19 @@ imapx_untagged_ok_no_bad (CamelIMAPXServer *is,
 	case IMAPX_PARSE:
 		c (is->tagprefix, "PARSE: %s\n", is->priv->context->sinfo->text);
 		break;
+	case IMAPX_COPYUID:
+		/* UID MOVE reports the new UIDs in an untagged
+		 * OK, ahead of the expunges for the originals. */
+		{
+			CamelIMAPXJob *job;
+
+			job = imapx_match_active_job (
+				is, IMAPX_JOB_COPY_MESSAGE, NULL);
+			if (job != NULL)
+				imapx_copy_messages_apply_copyuid (
+					job, is->priv->context->sinfo);
+		}
+		break;
 	case IMAPX_CAPABILITY:
 		if (is->priv->context->sinfo->u.cinfo) {
 			struct _capability_info *cinfo = is->cinfo;
@@ -2756,6 +3284,19 @@ imapx_completion (CamelIMAPXServer *is,
 	if (is->literal == ic)
 		is->literal = NULL;
 
+	if (ic->start_time > 0) {
+		gint64 latency = g_get_monotonic_time () - ic->start_time;
+
+		/* Exponentially weighted, so it follows recent load. */
+		if (is->priv->latency_average == 0)
+			is->priv->latency_average = latency;
+		else
+			is->priv->latency_average +=
+				(latency - is->priv->latency_average) / 8;
+
+		is->priv->latency_max = MAX (is->priv->latency_max, latency);
+	}
+
 	if (g_list_next (ic->current_part) != NULL) {
 		QUEUE_UNLOCK (is);
 		g_set_error (
@@ -2936,6 +3477,7 @@ imapx_register_job (CamelIMAPXServer *is,
 	if (is->state >= IMAPX_INITIALISED) {
 		QUEUE_LOCK (is);
 		g_queue_push_head (&is->jobs, camel_imapx_job_ref (job));
+		is->priv->jobs_submitted++;
 		QUEUE_UNLOCK (is);
 
 	} else {
@@ -2961,6 +3503,10 @@ imapx_unregister_job (CamelIMAPXServer *is,
 	if (g_queue_remove (&is->jobs, job))
 		camel_imapx_job_unref (job);
 	QUEUE_UNLOCK (is);
+
+	g_mutex_lock (&is->priv->job_slot_lock);
+	g_cond_broadcast (&is->priv->job_slot_cond);
+	g_mutex_unlock (&is->priv->job_slot_lock);
 }
 
 static gboolean
@@ -2974,6 +3520,60 @@ imapx_submit_job (CamelIMAPXServer *is,
 	return camel_imapx_job_run (job, is, error);
 }
 
+/* Blocks while MAX_PENDING_JOBS jobs are pending on @is.  Only to be
+ * used on entry to the public API: a job waiting here for a slot from
+ * within its own start function could deadlock against its peers. */
+static gboolean
+imapx_server_wait_for_job_slot (CamelIMAPXServer *is,
+                                GCancellable *cancellable,
+                                GError **error)
+{
+	gboolean throttled = FALSE;
+	gboolean success = TRUE;
+
+	/* The parser thread is what frees the slots. */
+	if (g_thread_self () == is->priv->parser_thread)
+		return TRUE;
+
+	g_mutex_lock (&is->priv->job_slot_lock);
+
+	while (success) {
+		gint64 end_time;
+		guint n_jobs;
+
+		QUEUE_LOCK (is);
+		n_jobs = g_queue_get_length (&is->jobs);
+		QUEUE_UNLOCK (is);
+
+		if (n_jobs < MAX_PENDING_JOBS)
+			break;
+
+		if (!throttled) {
+			c (is->tagprefix, "%u jobs pending, waiting for one to finish\n", n_jobs);
+			throttled = TRUE;
+		}
+
+		/* Wake up regularly to notice cancellation. */
+		end_time = g_get_monotonic_time () + G_USEC_PER_SEC;
+		g_cond_wait_until (
+			&is->priv->job_slot_cond,
+			&is->priv->job_slot_lock, end_time);
+
+		success = !g_cancellable_set_error_if_cancelled (
+			cancellable, error);
+	}
+
+	g_mutex_unlock (&is->priv->job_slot_lock);
+
+	if (throttled) {
+		QUEUE_LOCK (is);
+		is->priv->jobs_throttled++;
+		QUEUE_UNLOCK (is);
+	}
+
+	return success;
+}
+
 /* ********************************************************************** */
 // IDLE support
 
@@ -4128,6 +4728,7 @@ imapx_reconnect (CamelIMAPXServer *is,
 	CamelSettings *settings;
 	gchar *mechanism;
 	gboolean use_qresync;
+	gboolean check_all;
 	gboolean success = FALSE;
 
 	store = camel_imapx_server_ref_store (is);
@@ -4143,6 +4744,9 @@ imapx_reconnect (CamelIMAPXServer *is,
 	use_qresync = camel_imapx_settings_get_use_qresync (
 		CAMEL_IMAPX_SETTINGS (settings));
 
+	check_all = camel_imapx_settings_get_check_all (
+		CAMEL_IMAPX_SETTINGS (settings));
+
 	g_object_unref (settings);
 
 	if (!imapx_connect_to_server (is, cancellable, error))
@@ -4173,6 +4777,35 @@ imapx_reconnect (CamelIMAPXServer *is,
 	is->state = IMAPX_AUTHENTICATED;
 
 preauthed:
+	/* Compress the rest of the session (if supported). */
+	if (CAMEL_IMAPX_HAVE_CAPABILITY (is->cinfo, COMPRESS_DEFLATE)) {
+		GError *local_error = NULL;
+
+		ic = camel_imapx_command_new (
+			is, "COMPRESS", NULL, "COMPRESS DEFLATE");
+		imapx_command_run (is, ic, cancellable, &local_error);
+
+		/* The server may refuse, e.g. when the TLS layer
+		 * already compresses.  That is not an error. */
+		if (local_error == NULL && ic->status->result == IMAPX_OK) {
+			CamelIMAPXStream *stream;
+
+			stream = camel_imapx_server_ref_stream (is);
+			if (stream != NULL) {
+				camel_imapx_stream_start_compression (
+					stream, &local_error);
+				g_object_unref (stream);
+			}
+		}
+
+		camel_imapx_command_unref (ic);
+
+		if (local_error != NULL) {
+			g_propagate_error (error, local_error);
+			goto exception;
+		}
+	}
+
 	if (imapx_use_idle (is))
 		imapx_init_idle (is);
 
@@ -4210,6 +4843,36 @@ preauthed:
 		is->use_qresync = FALSE;
 	}
 
+	/* Have changes to the other folders pushed to us (if supported).
+	 * Without NOTIFY they are polled by imapx_server_status_sweep(). */
+	if (is->priv->watch_mailboxes &&
+	    CAMEL_IMAPX_HAVE_CAPABILITY (is->cinfo, NOTIFY)) {
+		GError *local_error = NULL;
+
+		ic = camel_imapx_command_new (
+			is, "NOTIFY", NULL,
+			"NOTIFY SET "
+			"(selected (MessageNew MessageExpunge FlagChange)) "
+			"(%t (MessageNew MessageExpunge FlagChange))",
+			check_all ? "personal" : "subscribed");
+		imapx_command_run (is, ic, cancellable, &local_error);
+
+		/* Not fatal, we just keep polling. */
+		if (local_error == NULL && ic->status->result == IMAPX_OK) {
+			g_mutex_lock (&is->priv->status_lock);
+			is->priv->notify_active = TRUE;
+			is->priv->notify_all = check_all;
+			is->priv->notify_since =
+				g_get_monotonic_time () / G_USEC_PER_SEC;
+			g_mutex_unlock (&is->priv->status_lock);
+		} else {
+			c (is->tagprefix, "NOTIFY SET refused, will poll folders\n");
+		}
+
+		g_clear_error (&local_error);
+		camel_imapx_command_unref (ic);
+	}
+
 	if (store->summary->namespaces == NULL) {
 		CamelIMAPXNamespaceList *nsl = NULL;
 		CamelIMAPXStoreNamespace *ns = NULL;
@@ -4468,6 +5131,156 @@ imapx_job_get_message_matches (CamelIMAPXJob *job,
 
 /* ********************************************************************** */
 
+/* Adds the copies reported by a COPYUID response code to the
+ * destination summary, cloned from the source messages, so the
+ * destination does not have to fetch their headers again. */
+static void
+imapx_copy_messages_apply_copyuid (CamelIMAPXJob *job,
+                                   struct _status_info *sinfo)
+{
+	CamelFolder *folder;
+	CamelIMAPXFolder *ifolder;
+	CamelFolderChangeInfo *changes;
+	CopyMessagesData *data;
+	GPtrArray *uids, *copied_uids;
+	gboolean same_validity;
+	guint ii;
+
+	data = camel_imapx_job_get_data (job);
+	g_return_if_fail (data != NULL);
+
+	folder = camel_imapx_job_ref_folder (job);
+	g_return_if_fail (folder != NULL);
+
+	ifolder = CAMEL_IMAPX_FOLDER (data->dest);
+
+	uids = sinfo->u.copyuid.uids;
+	copied_uids = sinfo->u.copyuid.copied_uids;
+
+	same_validity =
+		sinfo->u.copyuid.uidvalidity == ifolder->uidvalidity_on_server &&
+		uids->len == copied_uids->len;
+
+	changes = camel_folder_change_info_new ();
+
+	for (ii = 0; ii < copied_uids->len; ii++) {
+		CamelMessageInfo *info, *mi;
+		gchar *source_uid, *uid;
+
+		uid = g_strdup_printf (
+			"%u", GPOINTER_TO_UINT (copied_uids->pdata[ii]));
+
+		if (!same_validity ||
+		    camel_folder_summary_check_uid (data->dest->summary, uid)) {
+			/* Do not announce the copies as recent messages. */
+			g_hash_table_insert (
+				ifolder->ignore_recent, uid,
+				GINT_TO_POINTER (1));
+			continue;
+		}
+
+		source_uid = g_strdup_printf (
+			"%u", GPOINTER_TO_UINT (uids->pdata[ii]));
+		info = camel_folder_summary_get (folder->summary, source_uid);
+		g_free (source_uid);
+
+		if (info != NULL) {
+			mi = CAMEL_FOLDER_SUMMARY_GET_CLASS (data->dest->summary)->
+				message_info_clone (data->dest->summary, info);
+			mi->uid = camel_pstring_strdup (uid);
+
+			imapx_set_message_info_flags_for_new_message (
+				mi,
+				((CamelIMAPXMessageInfo *) info)->server_flags,
+				((CamelMessageInfoBase *) info)->user_flags,
+				data->dest);
+			camel_folder_summary_add (data->dest->summary, mi);
+			camel_folder_change_info_add_uid (changes, mi->uid);
+
+			camel_message_info_free (info);
+		}
+
+		g_hash_table_insert (
+			ifolder->ignore_recent, uid, GINT_TO_POINTER (1));
+	}
+
+	if (camel_folder_change_info_changed (changes)) {
+		camel_folder_summary_save_to_db (data->dest->summary, NULL);
+		camel_folder_changed (data->dest, changes);
+	}
+
+	camel_folder_change_info_free (changes);
+
+	g_object_unref (folder);
+}
+
+static void
+imapx_command_copy_messages_expunge_done (CamelIMAPXServer *is,
+                                          CamelIMAPXCommand *ic)
+{
+	CamelIMAPXJob *job;
+	GError *local_error = NULL;
+
+	job = camel_imapx_command_get_job (ic);
+	g_return_if_fail (CAMEL_IS_IMAPX_JOB (job));
+
+	job->commands--;
+
+	if (camel_imapx_command_set_error_if_failed (ic, &local_error)) {
+		g_prefix_error (
+			&local_error, "%s: ",
+			_("Error expunging message"));
+		camel_imapx_job_take_error (job, local_error);
+	}
+
+	if (job->commands == 0)
+		imapx_unregister_job (is, job);
+}
+
+/* Without MOVE, but with UIDPLUS, the originals of a copied range are
+ * flagged and then expunged by UID, which leaves alone any other
+ * messages that happen to carry the \Deleted flag in the mailbox. */
+static void
+imapx_copy_messages_expunge_range (CamelIMAPXServer *is,
+                                   CamelIMAPXJob *job,
+                                   CamelFolder *folder,
+                                   gint first,
+                                   gint last)
+{
+	CopyMessagesData *data;
+	CamelIMAPXCommand *ic[2];
+	struct _uidset_state ss[2];
+	gint ii, jj;
+
+	data = camel_imapx_job_get_data (job);
+	g_return_if_fail (data != NULL);
+
+	ic[0] = camel_imapx_command_new (
+		is, "STORE", folder, "UID STORE ");
+	ic[1] = camel_imapx_command_new (
+		is, "EXPUNGE", folder, "UID EXPUNGE ");
+
+	for (jj = 0; jj < 2; jj++) {
+		imapx_uidset_init (&ss[jj], 0, 0);
+		for (ii = first; ii < last; ii++)
+			imapx_uidset_add (&ss[jj], ic[jj], data->uids->pdata[ii]);
+		imapx_uidset_done (&ss[jj], ic[jj]);
+	}
+
+	camel_imapx_command_add (ic[0], " +FLAGS.SILENT (\\Deleted)");
+
+	for (jj = 0; jj < 2; jj++) {
+		ic[jj]->complete = imapx_command_copy_messages_expunge_done;
+		camel_imapx_command_set_job (ic[jj], job);
+		ic[jj]->pri = job->pri;
+		job->commands++;
+
+		imapx_command_queue (is, ic[jj]);
+
+		camel_imapx_command_unref (ic[jj]);
+	}
+}
+
 static void
 imapx_command_copy_messages_step_done (CamelIMAPXServer *is,
                                        CamelIMAPXCommand *ic)
@@ -4488,6 +5301,8 @@ imapx_command_copy_messages_step_done (CamelIMAPXServer *is,
 	folder = camel_imapx_job_ref_folder (job);
 	g_return_if_fail (folder != NULL);
 
+	job->commands--;
+
 	uids = data->uids;
 	i = data->index;
 
@@ -4504,29 +5319,21 @@ imapx_command_copy_messages_step_done (CamelIMAPXServer *is,
 		goto exit;
 	}
 
-	if (data->delete_originals) {
+	/* A plain COPY reports the new UIDs in its tagged response. */
+	if (ic->status && ic->status->condition == IMAPX_COPYUID)
+		imapx_copy_messages_apply_copyuid (job, ic->status);
+
+	if (data->use_uid_expunge) {
+		imapx_copy_messages_expunge_range (
+			is, job, folder, data->last_index, i);
+
+	} else if (data->delete_originals) {
 		gint j;
 
 		for (j = data->last_index; j < i; j++)
 			camel_folder_delete_message (folder, uids->pdata[j]);
 	}
 
-	/* TODO Copy the summary and cached messages to the new folder.
-	 *      We might need a sorted insert to avoid refreshing the dest
-	 *      folder. */
-	if (ic->status && ic->status->condition == IMAPX_COPYUID) {
-		gint i;
-
-		for (i = 0; i < ic->status->u.copyuid.copied_uids->len; i++) {
-			guint32 uid = GPOINTER_TO_UINT (g_ptr_array_index (ic->status->u.copyuid.copied_uids, i));
-			gchar *str = g_strdup_printf ("%d",uid);
-			CamelIMAPXFolder *ifolder = (CamelIMAPXFolder *) data->dest;
-
-			g_hash_table_insert (ifolder->ignore_recent, str, GINT_TO_POINTER (1));
-		}
-
-	}
-
 	if (i < uids->len) {
 		imapx_command_copy_messages_step_start (
 			is, job, i, &local_error);
@@ -4538,7 +5345,8 @@ imapx_command_copy_messages_step_done (CamelIMAPXServer *is,
 exit:
 	g_object_unref (folder);
 
-	imapx_unregister_job (is, job);
+	if (job->commands == 0)
+		imapx_unregister_job (is, job);
 }
 
 static gboolean
@@ -4581,6 +5389,7 @@ imapx_command_copy_messages_step_start (CamelIMAPXServer *is,
 		if (res == 1) {
 			camel_imapx_command_add (ic, " %f", data->dest);
 			data->index = i + 1;
+			job->commands++;
 			imapx_command_queue (is, ic);
 			goto exit;
 		}
@@ -4589,10 +5398,14 @@ imapx_command_copy_messages_step_start (CamelIMAPXServer *is,
 	data->index = i;
 	if (imapx_uidset_done (&data->uidset, ic)) {
 		camel_imapx_command_add (ic, " %f", data->dest);
+		job->commands++;
 		imapx_command_queue (is, ic);
 		goto exit;
 	}
 
+	if (job->commands == 0)
+		imapx_unregister_job (is, job);
+
 exit:
 	camel_imapx_command_unref (ic);
 
@@ -4629,8 +5442,58 @@ imapx_job_copy_messages_start (CamelIMAPXJob *job,
 	return imapx_command_copy_messages_step_start (is, job, 0, error);
 }
 
+static gboolean
+imapx_job_copy_messages_matches (CamelIMAPXJob *job,
+                                 CamelFolder *folder,
+                                 const gchar *uid)
+{
+	return camel_imapx_job_has_folder (job, folder);
+}
+
 /* ********************************************************************** */
 
+/* Append done.  If the server supports UIDPLUS we get an APPENDUID
+ * response with the new uid.  This lets us move the message we have
+ * directly to the cache and also create a correctly numbered
+ * MessageInfo, without losing any information.  Otherwise we have to
+ * wait for the server to let us know it was appended.  Pass 0 as the
+ * @appended_uid when it is not known. */
+static void
+imapx_append_message_finish (CamelIMAPXServer *is,
+                             CamelFolder *folder,
+                             AppendMessageData *data,
+                             guint32 appended_uid,
+                             CamelFolderChangeInfo *changes)
+{
+	CamelIMAPXFolder *ifolder = CAMEL_IMAPX_FOLDER (folder);
+
+	if (appended_uid != 0) {
+		CamelMessageInfo *mi;
+		gchar *cur;
+
+		mi = camel_message_info_clone (data->info);
+
+		data->appended_uid = g_strdup_printf ("%u", (guint) appended_uid);
+		mi->uid = camel_pstring_add (data->appended_uid, FALSE);
+
+		cur = camel_data_cache_get_filename  (ifolder->cache, "cur", mi->uid);
+		g_rename (data->path, cur);
+
+		/* should we update the message count ? */
+		imapx_set_message_info_flags_for_new_message (
+			mi,
+			((CamelMessageInfoBase *) data->info)->flags,
+			((CamelMessageInfoBase *) data->info)->user_flags,
+			folder);
+		camel_folder_summary_add (folder->summary, mi);
+		camel_folder_change_info_add_uid (changes, mi->uid);
+
+		g_free (cur);
+	}
+
+	camel_data_cache_remove (ifolder->cache, "new", data->info->uid, NULL);
+}
+
 static void
 imapx_command_append_message_done (CamelIMAPXServer *is,
                                    CamelIMAPXCommand *ic)
@@ -4638,9 +5501,9 @@ imapx_command_append_message_done (CamelIMAPXServer *is,
 	CamelIMAPXJob *job;
 	CamelIMAPXFolder *ifolder;
 	CamelFolder *folder;
-	CamelMessageInfo *mi;
+	CamelFolderChangeInfo *changes;
 	AppendMessageData *data;
-	gchar *cur, *old_uid;
+	guint32 appended_uid = 0;
 	GError *local_error = NULL;
 
 	job = camel_imapx_command_get_job (ic);
@@ -4654,15 +5517,6 @@ imapx_command_append_message_done (CamelIMAPXServer *is,
 
 	ifolder = CAMEL_IMAPX_FOLDER (folder);
 
-	/* Append done.  If we the server supports UIDPLUS we will get
-	 * an APPENDUID response with the new uid.  This lets us move the
-	 * message we have directly to the cache and also create a correctly
-	 * numbered MessageInfo, without losing any information.  Otherwise
-	 * we have to wait for the server to let us know it was appended. */
-
-	mi = camel_message_info_clone (data->info);
-	old_uid = g_strdup (data->info->uid);
-
 	if (camel_imapx_command_set_error_if_failed (ic, &local_error)) {
 		g_prefix_error (
 			&local_error, "%s: ",
@@ -4672,34 +5526,17 @@ imapx_command_append_message_done (CamelIMAPXServer *is,
 	} else if (ic->status && ic->status->condition == IMAPX_APPENDUID) {
 		c (is->tagprefix, "Got appenduid %d %d\n", (gint) ic->status->u.appenduid.uidvalidity, (gint) ic->status->u.appenduid.uid);
 		if (ic->status->u.appenduid.uidvalidity == ifolder->uidvalidity_on_server) {
-			CamelFolderChangeInfo *changes;
-
-			data->appended_uid = g_strdup_printf ("%u", (guint) ic->status->u.appenduid.uid);
-			mi->uid = camel_pstring_add (data->appended_uid, FALSE);
-
-			cur = camel_data_cache_get_filename  (ifolder->cache, "cur", mi->uid);
-			g_rename (data->path, cur);
-
-			/* should we update the message count ? */
-			imapx_set_message_info_flags_for_new_message (
-				mi,
-				((CamelMessageInfoBase *) data->info)->flags,
-				((CamelMessageInfoBase *) data->info)->user_flags,
-				folder);
-			camel_folder_summary_add (folder->summary, mi);
-			changes = camel_folder_change_info_new ();
-			camel_folder_change_info_add_uid (changes, mi->uid);
-			camel_folder_changed (folder, changes);
-			camel_folder_change_info_free (changes);
-
-			g_free (cur);
+			appended_uid = ic->status->u.appenduid.uid;
 		} else {
 			c (is->tagprefix, "but uidvalidity changed \n");
 		}
 	}
 
-	camel_data_cache_remove (ifolder->cache, "new", old_uid, NULL);
-	g_free (old_uid);
+	changes = camel_folder_change_info_new ();
+	imapx_append_message_finish (is, folder, data, appended_uid, changes);
+	if (camel_folder_change_info_changed (changes))
+		camel_folder_changed (folder, changes);
+	camel_folder_change_info_free (changes);
 
 	g_object_unref (folder);
 
@@ -4743,59 +5580,194 @@ imapx_job_append_message_start (CamelIMAPXJob *job,
 	return TRUE;
 }
 
-/* ********************************************************************** */
-
-static gint
-imapx_refresh_info_uid_cmp (gconstpointer ap,
-                            gconstpointer bp,
-                            gboolean ascending)
+static void
+imapx_command_append_messages_done (CamelIMAPXServer *is,
+                                    CamelIMAPXCommand *ic)
 {
-	guint av, bv;
+	CamelIMAPXJob *job;
+	CamelIMAPXFolder *ifolder;
+	CamelFolder *folder;
+	CamelFolderChangeInfo *changes;
+	AppendMessagesData *data;
+	GPtrArray *appended_uids = NULL;
+	guint first, count, ii;
+	GError *local_error = NULL;
 
-	av = g_ascii_strtoull ((const gchar *) ap, NULL, 10);
-	bv = g_ascii_strtoull ((const gchar *) bp, NULL, 10);
+	job = camel_imapx_command_get_job (ic);
+	g_return_if_fail (CAMEL_IS_IMAPX_JOB (job));
 
-	if (av < bv)
-		return ascending ? -1 : 1;
-	else if (av > bv)
-		return ascending ? 1 : -1;
-	else
-		return 0;
-}
+	data = camel_imapx_job_get_data (job);
+	g_return_if_fail (data != NULL);
 
-static gint
-imapx_uids_array_cmp (gconstpointer ap,
-                      gconstpointer bp)
-{
-	const gchar **a = (const gchar **) ap;
-	const gchar **b = (const gchar **) bp;
+	folder = camel_imapx_job_ref_folder (job);
+	g_return_if_fail (folder != NULL);
 
-	return imapx_refresh_info_uid_cmp (*a, *b, TRUE);
-}
+	ifolder = CAMEL_IMAPX_FOLDER (folder);
 
-static gint
-imapx_refresh_info_cmp (gconstpointer ap,
-                        gconstpointer bp)
-{
-	const struct _refresh_info *a = ap;
-	const struct _refresh_info *b = bp;
+	job->commands--;
 
-	return imapx_refresh_info_uid_cmp (a->uid, b->uid, TRUE);
-}
+	first = GPOINTER_TO_UINT (g_hash_table_lookup (data->batches, ic));
+	g_hash_table_remove (data->batches, ic);
 
-static gint
-imapx_refresh_info_cmp_descending (gconstpointer ap,
-                                   gconstpointer bp)
-{
-	const struct _refresh_info *a = ap;
-	const struct _refresh_info *b = bp;
+	count = MIN (
+		data->messages->len - first,
+		CAMEL_IMAPX_HAVE_CAPABILITY (is->cinfo, MULTIAPPEND) ?
+		MULTIAPPEND_BATCH_SIZE : 1);
 
-	return imapx_refresh_info_uid_cmp (a->uid, b->uid, FALSE);
+	if (camel_imapx_command_set_error_if_failed (ic, &local_error)) {
+		g_prefix_error (
+			&local_error, "%s: ",
+			_("Error appending message"));
+		camel_imapx_job_take_error (job, local_error);
 
-}
+	} else if (ic->status && ic->status->condition == IMAPX_APPENDUID &&
+		   ic->status->u.appenduid.uidvalidity == ifolder->uidvalidity_on_server) {
+		/* For MULTIAPPEND the server returns
+		 * a set of UIDs, in the upload order. */
+		appended_uids = ic->status->u.appenduid.uids;
+		if (appended_uids != NULL && appended_uids->len != count)
+			appended_uids = NULL;
+	}
 
-/* skips over non-server uids (pending appends) */
-static guint
+	changes = camel_folder_change_info_new ();
+
+	for (ii = 0; ii < count; ii++) {
+		AppendMessageData *message;
+		guint32 appended_uid = 0;
+
+		message = g_ptr_array_index (data->messages, first + ii);
+
+		if (appended_uids != NULL)
+			appended_uid = GPOINTER_TO_UINT (appended_uids->pdata[ii]);
+
+		imapx_append_message_finish (
+			is, folder, message, appended_uid, changes);
+	}
+
+	if (camel_folder_change_info_changed (changes))
+		camel_folder_changed (folder, changes);
+	camel_folder_change_info_free (changes);
+
+	g_object_unref (folder);
+
+	if (job->commands == 0)
+		imapx_unregister_job (is, job);
+}
+
+/* Uploads the messages in batches with MULTIAPPEND if the server has
+ * it, or as one APPEND each otherwise.  All the commands are queued
+ * at once, so with LITERAL+ they go out back to back without waiting
+ * for continuation requests or earlier completions. */
+static gboolean
+imapx_job_append_messages_start (CamelIMAPXJob *job,
+                                 CamelIMAPXServer *is,
+                                 GCancellable *cancellable,
+                                 GError **error)
+{
+	CamelFolder *folder;
+	AppendMessagesData *data;
+	guint batch_size, first, ii;
+
+	data = camel_imapx_job_get_data (job);
+	g_return_val_if_fail (data != NULL, FALSE);
+
+	folder = camel_imapx_job_ref_folder (job);
+	g_return_val_if_fail (folder != NULL, FALSE);
+
+	if (CAMEL_IMAPX_HAVE_CAPABILITY (is->cinfo, MULTIAPPEND))
+		batch_size = MULTIAPPEND_BATCH_SIZE;
+	else
+		batch_size = 1;
+
+	for (first = 0; first < data->messages->len; first += batch_size) {
+		CamelIMAPXCommand *ic;
+
+		ic = camel_imapx_command_new (
+			is, "APPEND", NULL, "APPEND %f", folder);
+
+		for (ii = first; ii < data->messages->len && ii < first + batch_size; ii++) {
+			AppendMessageData *message;
+
+			message = g_ptr_array_index (data->messages, ii);
+
+			camel_imapx_command_add (
+				ic, " %F %P",
+				((CamelMessageInfoBase *) message->info)->flags,
+				((CamelMessageInfoBase *) message->info)->user_flags,
+				message->path);
+		}
+
+		ic->complete = imapx_command_append_messages_done;
+		camel_imapx_command_set_job (ic, job);
+		ic->pri = job->pri;
+		job->commands++;
+
+		g_hash_table_insert (
+			data->batches, ic, GUINT_TO_POINTER (first));
+
+		imapx_command_queue (is, ic);
+
+		camel_imapx_command_unref (ic);
+	}
+
+	g_object_unref (folder);
+
+	return TRUE;
+}
+
+/* ********************************************************************** */
+
+static gint
+imapx_refresh_info_uid_cmp (gconstpointer ap,
+                            gconstpointer bp,
+                            gboolean ascending)
+{
+	guint av, bv;
+
+	av = g_ascii_strtoull ((const gchar *) ap, NULL, 10);
+	bv = g_ascii_strtoull ((const gchar *) bp, NULL, 10);
+
+	if (av < bv)
+		return ascending ? -1 : 1;
+	else if (av > bv)
+		return ascending ? 1 : -1;
+	else
+		return 0;
+}
+
+static gint
+imapx_uids_array_cmp (gconstpointer ap,
+                      gconstpointer bp)
+{
+	const gchar **a = (const gchar **) ap;
+	const gchar **b = (const gchar **) bp;
+
+	return imapx_refresh_info_uid_cmp (*a, *b, TRUE);
+}
+
+static gint
+imapx_refresh_info_cmp (gconstpointer ap,
+                        gconstpointer bp)
+{
+	const struct _refresh_info *a = ap;
+	const struct _refresh_info *b = bp;
+
+	return imapx_refresh_info_uid_cmp (a->uid, b->uid, TRUE);
+}
+
+static gint
+imapx_refresh_info_cmp_descending (gconstpointer ap,
+                                   gconstpointer bp)
+{
+	const struct _refresh_info *a = ap;
+	const struct _refresh_info *b = bp;
+
+	return imapx_refresh_info_uid_cmp (a->uid, b->uid, FALSE);
+
+}
+
+/* skips over non-server uids (pending appends) */
+static guint
 imapx_index_next (GPtrArray *uids,
                   CamelFolderSummary *s,
                   guint index)
@@ -4824,70 +5796,155 @@ imapx_index_next (GPtrArray *uids,
 	return index;
 }
 
-static void
-imapx_command_step_fetch_done (CamelIMAPXServer *is,
-                               CamelIMAPXCommand *ic)
+static guint64
+imapx_server_get_bytes_read (CamelIMAPXServer *is)
 {
-	CamelIMAPXFolder *ifolder;
-	CamelIMAPXSummary *isum;
-	CamelIMAPXJob *job;
-	CamelFolder *folder;
-	RefreshInfoData *data;
-	gint i;
-	CamelIMAPXSettings *settings;
-	guint batch_count;
-	gboolean mobile_mode;
-	GError *local_error = NULL;
-
-	job = camel_imapx_command_get_job (ic);
-	g_return_if_fail (CAMEL_IS_IMAPX_JOB (job));
+	CamelIMAPXStream *stream;
+	guint64 bytes_read = 0;
 
-	data = camel_imapx_job_get_data (job);
-	g_return_if_fail (data != NULL);
+	stream = camel_imapx_server_ref_stream (is);
 
-	folder = camel_imapx_job_ref_folder (job);
-	g_return_if_fail (folder != NULL);
+	if (stream != NULL) {
+		camel_imapx_stream_get_compression_stats (
+			stream, NULL, &bytes_read, NULL, NULL);
+		g_object_unref (stream);
+	}
 
-	data->scan_changes = FALSE;
+	return bytes_read;
+}
 
-	ifolder = CAMEL_IMAPX_FOLDER (folder);
-	isum = CAMEL_IMAPX_SUMMARY (folder->summary);
+static guint
+imapx_server_get_fetch_batch_size (CamelIMAPXServer *is)
+{
+	CamelIMAPXSettings *settings;
+	guint max_size;
 
 	settings = camel_imapx_server_ref_settings (is);
-	batch_count = camel_imapx_settings_get_batch_fetch_count (settings);
-	mobile_mode = camel_imapx_settings_get_mobile_mode (settings);
+	max_size = camel_imapx_settings_get_batch_fetch_count (settings);
 	g_object_unref (settings);
 
-	i = data->index;
+	if (max_size == 0)
+		max_size = G_MAXUINT;
 
-	if (camel_imapx_command_set_error_if_failed (ic, &local_error)) {
-		g_prefix_error (
-			&local_error, "%s: ",
-			_("Error fetching message headers"));
-		camel_imapx_job_take_error (job, local_error);
-		goto exit;
+	return MIN (is->priv->fetch_batch_size, max_size);
+}
+
+/* Adjusts the header batch size once a batch completed.  With
+ * several batches in flight the time and bytes are measured from
+ * the previous completion, which gives the sustained throughput
+ * rather than the round trip of a single command. */
+static void
+imapx_server_adapt_fetch_batch (CamelIMAPXServer *is,
+                                CamelIMAPXJob *job,
+                                RefreshInfoData *data,
+                                gboolean success)
+{
+	GCancellable *cancellable;
+	guint64 bytes_read;
+	gint64 now, elapsed;
+	gdouble throughput;
+	guint batch_size;
+
+	now = g_get_monotonic_time ();
+	bytes_read = imapx_server_get_bytes_read (is);
+
+	elapsed = MAX (now - data->batch_mark_time, 1);
+	throughput = (gdouble) (bytes_read - data->batch_mark_bytes) *
+		G_USEC_PER_SEC / elapsed;
+
+	data->batch_mark_time = now;
+	data->batch_mark_bytes = bytes_read;
+
+	batch_size = imapx_server_get_fetch_batch_size (is);
+
+	if (!success) {
+		batch_size /= 2;
+		throughput = 0.0;
+	} else if (elapsed > FETCH_BATCH_TARGET_TIME) {
+		batch_size = (guint) (
+			(gdouble) batch_size *
+			FETCH_BATCH_TARGET_TIME / elapsed);
+	} else if (throughput > is->priv->fetch_throughput * 1.1) {
+		/* Still gaining, so the link is not saturated yet. */
+		batch_size *= 2;
 	}
 
-	if (camel_folder_change_info_changed (data->changes)) {
-		imapx_update_store_summary (folder);
-		camel_folder_summary_save_to_db (folder->summary, NULL);
-		camel_folder_changed (folder, data->changes);
+	is->priv->fetch_batch_size = MAX (batch_size, FETCH_BATCH_MIN);
+	is->priv->fetch_throughput = throughput;
+
+	c (
+		is->tagprefix,
+		"header batch done in %" G_GINT64_FORMAT " ms, "
+		"%.0f bytes/s, next batch %u\n",
+		elapsed / 1000, throughput,
+		imapx_server_get_fetch_batch_size (is));
+
+	/* This is only for pushing status messages. */
+	cancellable = camel_imapx_job_get_cancellable (job);
+
+	if (job->pop_operation_msg && throughput > 0.0) {
+		CamelFolder *folder;
+		gchar *rate;
+
+		folder = camel_imapx_job_ref_folder (job);
+		rate = g_format_size ((guint64) throughput);
+
+		camel_operation_pop_message (cancellable);
+		camel_operation_push_message (
+			cancellable,
+			/* Translators: The second '%s' is a transfer
+			 * rate, like "1.2 MB", followed by "/s". */
+			_("Fetching summary information for new messages in '%s' (%s/s)"),
+			camel_folder_get_display_name (folder), rate);
+
+		g_free (rate);
+		g_object_unref (folder);
 	}
+}
 
-	camel_folder_change_info_clear (data->changes);
+static void	imapx_command_fetch_headers_done
+						(CamelIMAPXServer *is,
+						 CamelIMAPXCommand *ic);
 
-	if (i < data->infos->len) {
+/* Queues the next batch of header fetches.  Returns whether a
+ * command was queued; FALSE once every message is requested. */
+static gboolean
+imapx_refresh_info_queue_batch (CamelIMAPXServer *is,
+                                CamelIMAPXJob *job,
+                                CamelFolder *folder,
+                                gboolean mobile_mode,
+                                guint batch_count)
+{
+	CamelIMAPXCommand *ic;
+	RefreshInfoData *data;
+
+	data = camel_imapx_job_get_data (job);
+	g_return_val_if_fail (data != NULL, FALSE);
+
+	if (data->index < data->infos->len) {
 		gint total = camel_folder_summary_count (folder->summary);
 		gint fetch_limit = data->fetch_msg_limit;
+		gint i = data->index;
 
 		ic = camel_imapx_command_new (
 			is, "FETCH", folder, "UID FETCH ");
-		ic->complete = imapx_command_step_fetch_done;
+		ic->complete = imapx_command_fetch_headers_done;
 		camel_imapx_command_set_job (ic, job);
 		ic->pri = job->pri - 1;
 
-		//printf ("Total: %d: %d, %d, %d\n", total, fetch_limit, i, data->last_index);
-		data->last_index = i;
+		if (data->batch_starts == NULL)
+			data->batch_starts = g_hash_table_new (
+				g_direct_hash, g_direct_equal);
+
+		g_hash_table_insert (
+			data->batch_starts, ic, GINT_TO_POINTER (i));
+
+		if (data->batches_in_flight == 0) {
+			data->batch_mark_time = g_get_monotonic_time ();
+			data->batch_mark_bytes = imapx_server_get_bytes_read (is);
+		}
+
+		data->uidset.total = imapx_server_get_fetch_batch_size (is);
 
 		/* If its mobile client and when total=0 (new account setup)
 		 * fetch only one batch of mails, on futher attempts download
@@ -4906,14 +5963,13 @@ imapx_command_step_fetch_done (CamelIMAPXServer *is,
 				if (res == 1) {
 					camel_imapx_command_add (ic, " (RFC822.SIZE RFC822.HEADER)");
 					data->index = i + 1;
+					data->batches_in_flight++;
 
 					imapx_command_queue (is, ic);
 
 					camel_imapx_command_unref (ic);
 
-					g_object_unref (folder);
-
-					return;
+					return TRUE;
 				}
 			}
 		}
@@ -4922,24 +5978,122 @@ imapx_command_step_fetch_done (CamelIMAPXServer *is,
 		data->index = data->infos->len;
 		if (imapx_uidset_done (&data->uidset, ic)) {
 			camel_imapx_command_add (ic, " (RFC822.SIZE RFC822.HEADER)");
+			data->batches_in_flight++;
 
 			imapx_command_queue (is, ic);
 
 			camel_imapx_command_unref (ic);
 
-			g_object_unref (folder);
-
-			return;
+			return TRUE;
 		}
 
 		/* XXX What fate for our newly-created but unsubmitted
 		 *     CamelIMAPXCommand if we get here?  I guess just
 		 *     discard it and move on?  Also warn so I know if
 		 *     we're actually taking this branch for real. */
+		g_hash_table_remove (data->batch_starts, ic);
 		camel_imapx_command_unref (ic);
 		g_warn_if_reached ();
 	}
 
+	return FALSE;
+}
+
+static void	imapx_command_step_fetch_done
+						(CamelIMAPXServer *is,
+						 CamelIMAPXCommand *ic);
+
+static void
+imapx_command_fetch_headers_done (CamelIMAPXServer *is,
+                                  CamelIMAPXCommand *ic)
+{
+	CamelIMAPXJob *job;
+	RefreshInfoData *data;
+	gboolean success;
+
+	job = camel_imapx_command_get_job (ic);
+	g_return_if_fail (CAMEL_IS_IMAPX_JOB (job));
+
+	data = camel_imapx_job_get_data (job);
+	g_return_if_fail (data != NULL);
+
+	data->batches_in_flight--;
+	g_hash_table_remove (data->batch_starts, ic);
+
+	success = ic->status != NULL && ic->status->result == IMAPX_OK;
+	imapx_server_adapt_fetch_batch (is, job, data, success);
+
+	imapx_command_step_fetch_done (is, ic);
+}
+
+static void
+imapx_command_step_fetch_done (CamelIMAPXServer *is,
+                               CamelIMAPXCommand *ic)
+{
+	CamelIMAPXFolder *ifolder;
+	CamelIMAPXSummary *isum;
+	CamelIMAPXJob *job;
+	CamelFolder *folder;
+	RefreshInfoData *data;
+	CamelIMAPXSettings *settings;
+	guint batch_count;
+	gboolean mobile_mode;
+	GError *local_error = NULL;
+
+	job = camel_imapx_command_get_job (ic);
+	g_return_if_fail (CAMEL_IS_IMAPX_JOB (job));
+
+	data = camel_imapx_job_get_data (job);
+	g_return_if_fail (data != NULL);
+
+	folder = camel_imapx_job_ref_folder (job);
+	g_return_if_fail (folder != NULL);
+
+	data->scan_changes = FALSE;
+
+	ifolder = CAMEL_IMAPX_FOLDER (folder);
+	isum = CAMEL_IMAPX_SUMMARY (folder->summary);
+
+	settings = camel_imapx_server_ref_settings (is);
+	batch_count = camel_imapx_settings_get_batch_fetch_count (settings);
+	mobile_mode = camel_imapx_settings_get_mobile_mode (settings);
+	g_object_unref (settings);
+
+	if (camel_imapx_command_set_error_if_failed (ic, &local_error)) {
+		g_prefix_error (
+			&local_error, "%s: ",
+			_("Error fetching message headers"));
+		camel_imapx_job_take_error (job, local_error);
+		data->batch_failed = TRUE;
+	}
+
+	/* Let the batches still in flight finish before giving up. */
+	if (data->batch_failed) {
+		if (data->batches_in_flight > 0) {
+			g_object_unref (folder);
+			return;
+		}
+		goto exit;
+	}
+
+	if (camel_folder_change_info_changed (data->changes)) {
+		imapx_update_store_summary (folder);
+		camel_folder_summary_save_to_db (folder->summary, NULL);
+		camel_folder_changed (folder, data->changes);
+	}
+
+	camel_folder_change_info_clear (data->changes);
+
+	while (data->batches_in_flight < FETCH_PIPELINE_DEPTH &&
+	       imapx_refresh_info_queue_batch (
+			is, job, folder, mobile_mode, batch_count))
+		;
+
+	if (data->batches_in_flight > 0) {
+		g_object_unref (folder);
+		return;
+	}
+
 	if (camel_folder_summary_count (folder->summary)) {
 		gchar *uid = camel_imapx_dup_uid_from_summary_index (
 			folder,
@@ -5000,6 +6154,7 @@ imapx_job_scan_changes_done (CamelIMAPXServer *is,
 	CamelFolder *folder;
 	RefreshInfoData *data;
 	GCancellable *cancellable;
+	CamelSortType fetch_order;
 	guint uidset_size;
 	gboolean mobile_mode;
 	GError *local_error = NULL;
@@ -5019,6 +6174,7 @@ imapx_job_scan_changes_done (CamelIMAPXServer *is,
 	data->scan_changes = FALSE;
 
 	settings = camel_imapx_server_ref_settings (is);
+	fetch_order = camel_imapx_settings_get_fetch_order (settings);
 	uidset_size = camel_imapx_settings_get_batch_fetch_count (settings);
 	mobile_mode = camel_imapx_settings_get_mobile_mode (settings);
 	g_object_unref (settings);
@@ -5063,10 +6219,49 @@ imapx_job_scan_changes_done (CamelIMAPXServer *is,
 		qsort (data->infos->data, data->infos->len, sizeof (struct _refresh_info), imapx_refresh_info_cmp);
 		g_ptr_array_sort (uids, (GCompareFunc) imapx_uids_array_cmp);
 
-		if (uids->len)
-			s_minfo = camel_folder_summary_get (s, g_ptr_array_index (uids, 0));
+		/* A windowed scan says nothing about older messages. */
+		while (j < uids->len && strtoul (uids->pdata[j], NULL, 10) < data->scan_from)
+			j++;
+
+		if (j < uids->len)
+			s_minfo = camel_folder_summary_get (s, g_ptr_array_index (uids, j));
+
+		/* CHANGEDSINCE only returns the messages which changed,
+		 * so there is nothing to merge; removals are detected
+		 * from the message count below. */
+		if (data->scan_mode == IMAPX_SCAN_CHANGEDSINCE) {
+			if (s_minfo != NULL)
+				camel_message_info_free (s_minfo);
+			s_minfo = NULL;
+			j = uids->len;
+
+			for (i = 0; i < data->infos->len; i++) {
+				struct _refresh_info *r = &g_array_index (data->infos, struct _refresh_info, i);
+
+				info = (CamelIMAPXMessageInfo *)
+					camel_folder_summary_get (s, r->uid);
+
+				if (info == NULL) {
+					fetch_new = TRUE;
+					continue;
+				}
+
+				if (imapx_update_message_info_flags (
+						(CamelMessageInfo *) info,
+						r->server_flags,
+						r->server_user_flags,
+						is->permanentflags,
+						folder, FALSE))
+					camel_folder_change_info_change_uid (
+						data->changes,
+						camel_message_info_uid (info));
+				r->exists = TRUE;
+
+				camel_message_info_free (info);
+			}
+		}
 
-		for (i = 0; i < data->infos->len; i++) {
+		for (i = 0; j < uids->len && i < data->infos->len; i++) {
 			struct _refresh_info *r = &g_array_index (data->infos, struct _refresh_info, i);
 
 			while (s_minfo && uid_cmp (camel_message_info_uid (s_minfo), r->uid, s) < 0) {
@@ -5115,6 +6310,10 @@ imapx_job_scan_changes_done (CamelIMAPXServer *is,
 		if (s_minfo)
 			camel_message_info_free (s_minfo);
 
+		/* Anything past the end of the summary is new. */
+		if (data->scan_mode != IMAPX_SCAN_CHANGEDSINCE && i < data->infos->len)
+			fetch_new = TRUE;
+
 		while (j < uids->len) {
 			s_minfo = camel_folder_summary_get (s, g_ptr_array_index (uids, j));
 
@@ -5151,6 +6350,40 @@ imapx_job_scan_changes_done (CamelIMAPXServer *is,
 
 		camel_folder_summary_free_array (uids);
 
+		/* The partial scans cannot see messages removed outside
+		 * what they covered, but the count tells they are gone.
+		 * Fall back to comparing the whole folder then. */
+		if (data->scan_mode != IMAPX_SCAN_FULL) {
+			guint expected = camel_folder_summary_count (s);
+
+			for (i = 0; i < data->infos->len; i++) {
+				if (!g_array_index (data->infos, struct _refresh_info, i).exists)
+					expected++;
+			}
+
+			if (expected != ifolder->exists_on_server) {
+				c (
+					is->tagprefix,
+					"partial scan of '%s' left %u / %u messages, "
+					"rescanning the whole folder\n",
+					camel_folder_get_full_name (folder),
+					expected, ifolder->exists_on_server);
+
+				data->scan_mode = IMAPX_SCAN_FULL;
+				data->scan_from = 0;
+				camel_imapx_folder_set_windowed_scans (
+					ifolder, 0);
+
+				g_object_unref (folder);
+
+				camel_operation_pop_message (cancellable);
+				imapx_job_scan_changes_start (
+					job, is, cancellable, NULL);
+
+				return;
+			}
+		}
+
 		/* If we have any new messages, download their headers, but only a few (100?) at a time */
 		if (fetch_new) {
 			job->pop_operation_msg = TRUE;
@@ -5165,6 +6398,15 @@ imapx_job_scan_changes_done (CamelIMAPXServer *is,
 			 * update it as they arrive. */
 			data->update_unseen = TRUE;
 
+			/* The infos are sorted oldest first above;
+			 * reverse them if the newest are wanted first. */
+			if (fetch_order == CAMEL_SORT_DESCENDING)
+				qsort (
+					data->infos->data,
+					data->infos->len,
+					sizeof (struct _refresh_info),
+					imapx_refresh_info_cmp_descending);
+
 			g_object_unref (folder);
 
 			return imapx_command_step_fetch_done (is, ic);
@@ -5212,6 +6454,14 @@ imapx_job_scan_changes_start (CamelIMAPXJob *job,
 
 	if (mobile_mode)
 		uid = camel_imapx_dup_uid_from_summary_index (folder, 0);
+	else if (data->scan_mode == IMAPX_SCAN_WINDOW) {
+		guint total = camel_folder_summary_count (folder->summary);
+
+		uid = camel_imapx_dup_uid_from_summary_index (
+			folder, total > SCAN_WINDOW_SIZE ?
+			total - SCAN_WINDOW_SIZE : 0);
+		data->scan_from = uid ? strtoul (uid, NULL, 10) : 0;
+	}
 
 	job->pop_operation_msg = TRUE;
 
@@ -5224,9 +6474,23 @@ imapx_job_scan_changes_start (CamelIMAPXJob *job,
 		'E', "Scanning from %s in %s\n", uid ? uid : "start",
 		camel_folder_get_full_name (folder));
 
-	ic = camel_imapx_command_new (
-		is, "FETCH", folder,
-		"UID FETCH %s:* (UID FLAGS)", uid ? uid : "1");
+	if (data->scan_mode == IMAPX_SCAN_CHANGEDSINCE) {
+		CamelIMAPXSummary *isum;
+		gchar *modseq;
+
+		isum = CAMEL_IMAPX_SUMMARY (folder->summary);
+		modseq = g_strdup_printf ("%" G_GUINT64_FORMAT, isum->modseq);
+
+		ic = camel_imapx_command_new (
+			is, "FETCH", folder,
+			"UID FETCH 1:* (UID FLAGS) (CHANGEDSINCE %t)", modseq);
+
+		g_free (modseq);
+	} else {
+		ic = camel_imapx_command_new (
+			is, "FETCH", folder,
+			"UID FETCH %s:* (UID FLAGS)", uid ? uid : "1");
+	}
 	camel_imapx_command_set_job (ic, job);
 	ic->complete = imapx_job_scan_changes_done;
 
@@ -5393,6 +6657,8 @@ imapx_job_fetch_new_messages_start (CamelIMAPXJob *job,
 
 		data->scan_changes = TRUE;
 
+		/* Both paths go through the adaptive header batches;
+		 * only the order of the batches differs. */
 		if (fetch_order == CAMEL_SORT_DESCENDING)
 			ic->complete = imapx_command_fetch_new_uids_done;
 		else
@@ -5555,6 +6821,243 @@ imapx_job_fetch_messages_start (CamelIMAPXJob *job,
 	return TRUE;
 }
 
+/* Whether the server-side counts of @folder are recent enough to
+ * skip polling it: NOTIFY has been reporting its changes since we
+ * last asked, not too long ago, or a STATUS sweep covered it a
+ * moment ago. */
+static gboolean
+imapx_server_status_is_fresh (CamelIMAPXServer *is,
+                              CamelFolder *folder)
+{
+	const gchar *full_name;
+	gboolean watched = TRUE;
+	gboolean fresh = FALSE;
+	gpointer value;
+	guint now;
+
+	full_name = camel_folder_get_full_name (folder);
+	now = g_get_monotonic_time () / G_USEC_PER_SEC;
+
+	g_mutex_lock (&is->priv->status_lock);
+
+	if (is->priv->notify_active && !is->priv->notify_all) {
+		CamelIMAPXStore *store;
+		CamelStoreSummary *summary;
+		CamelStoreInfo *si;
+
+		store = camel_imapx_server_ref_store (is);
+		summary = CAMEL_STORE_SUMMARY (store->summary);
+
+		si = camel_store_summary_path (summary, full_name);
+		watched = si != NULL &&
+			(si->flags & CAMEL_STORE_INFO_FOLDER_SUBSCRIBED) != 0;
+
+		if (si != NULL)
+			camel_store_summary_info_unref (summary, si);
+		g_object_unref (store);
+	}
+
+	if (g_hash_table_lookup_extended (
+		is->priv->status_times, full_name, NULL, &value)) {
+		guint last = GPOINTER_TO_UINT (value);
+
+		if (is->priv->notify_active && watched)
+			fresh = (last >= is->priv->notify_since) &&
+				(now - last < STATUS_NOTIFY_MAX_AGE);
+		else
+			fresh = (now - last < STATUS_SWEEP_INTERVAL);
+	}
+
+	g_mutex_unlock (&is->priv->status_lock);
+
+	return fresh;
+}
+
+/* Polls @folder with STATUS, together with up to STATUS_SWEEP_BATCH - 1
+ * other checked folders which were not polled recently.  The commands
+ * are pipelined, so the batch costs about one round trip, and their
+ * responses let the refreshes of those folders which usually follow
+ * skip their own STATUS. */
+static gboolean
+imapx_server_status_sweep (CamelIMAPXServer *is,
+                           CamelFolder *folder,
+                           CamelIMAPXJob *job,
+                           GCancellable *cancellable,
+                           GError **error)
+{
+	CamelIMAPXCommand *ic;
+	CamelIMAPXStore *store;
+	CamelIMAPXSettings *settings;
+	CamelStoreSummary *summary;
+	GPtrArray *array, *commands;
+	GArray *cancel_ids;
+	const gchar *attributes;
+	const gchar *full_name;
+	gboolean check_all;
+	gboolean success;
+	guint ii, now;
+
+	if (CAMEL_IMAPX_HAVE_CAPABILITY (is->cinfo, CONDSTORE))
+		attributes = "(MESSAGES UNSEEN UIDVALIDITY UIDNEXT HIGHESTMODSEQ)";
+	else
+		attributes = "(MESSAGES UNSEEN UIDVALIDITY UIDNEXT)";
+
+	settings = camel_imapx_server_ref_settings (is);
+	check_all = camel_imapx_settings_get_check_all (settings);
+	g_object_unref (settings);
+
+	commands = g_ptr_array_new_with_free_func (
+		(GDestroyNotify) camel_imapx_command_unref);
+
+	ic = camel_imapx_command_new (
+		is, "STATUS", NULL, "STATUS %f %t", folder, attributes);
+	g_ptr_array_add (commands, ic);
+
+	full_name = camel_folder_get_full_name (folder);
+	now = g_get_monotonic_time () / G_USEC_PER_SEC;
+
+	store = camel_imapx_server_ref_store (is);
+	summary = CAMEL_STORE_SUMMARY (store->summary);
+	array = camel_store_summary_array (summary);
+
+	g_mutex_lock (&is->priv->status_lock);
+
+	for (ii = 0; ii < array->len && commands->len < STATUS_SWEEP_BATCH; ii++) {
+		CamelStoreInfo *si = g_ptr_array_index (array, ii);
+		const gchar *path;
+		gpointer value;
+		gchar *encoded;
+
+		if (si->flags & CAMEL_STORE_INFO_FOLDER_NOSELECT)
+			continue;
+
+		if (!check_all && !(si->flags & CAMEL_STORE_INFO_FOLDER_SUBSCRIBED))
+			continue;
+
+		path = camel_store_info_path (summary, si);
+		if (path == NULL || g_strcmp0 (path, full_name) == 0)
+			continue;
+
+		if (g_hash_table_lookup_extended (
+			is->priv->status_times, path, NULL, &value) &&
+		    now - GPOINTER_TO_UINT (value) < STATUS_SWEEP_INTERVAL)
+			continue;
+
+		/* Also rate-limits folders whose STATUS fails. */
+		g_hash_table_insert (
+			is->priv->status_times, g_strdup (path),
+			GUINT_TO_POINTER (now));
+
+		encoded = camel_utf8_utf7 (
+			((CamelIMAPXStoreInfo *) si)->mailbox_name);
+		ic = camel_imapx_command_new (
+			is, "STATUS", NULL, "STATUS %s %t", encoded, attributes);
+		g_ptr_array_add (commands, ic);
+		g_free (encoded);
+	}
+
+	g_mutex_unlock (&is->priv->status_lock);
+
+	camel_store_summary_array_free (summary, array);
+	g_object_unref (store);
+
+	c (is->tagprefix, "STATUS sweep of %u folders\n", commands->len);
+
+	cancel_ids = g_array_sized_new (
+		FALSE, FALSE, sizeof (gulong), commands->len);
+
+	/* Queue them all first, then wait for all of them.  As in
+	 * imapx_command_run_sync(), cancelling stops the waits. */
+	for (ii = 0; ii < commands->len; ii++) {
+		gulong cancel_id = 0;
+
+		ic = g_ptr_array_index (commands, ii);
+
+		camel_imapx_command_set_job (ic, job);
+		ic->pri = job->pri;
+		ic->complete = imapx_command_complete;
+
+		if (G_IS_CANCELLABLE (cancellable))
+			cancel_id = g_cancellable_connect (
+				cancellable,
+				G_CALLBACK (imapx_command_cancelled),
+				camel_imapx_command_ref (ic),
+				(GDestroyNotify) camel_imapx_command_unref);
+		g_array_append_val (cancel_ids, cancel_id);
+
+		/* Unref'ed in imapx_command_complete(). */
+		camel_imapx_command_ref (ic);
+
+		imapx_command_queue (is, ic);
+	}
+
+	for (ii = 0; ii < commands->len; ii++)
+		camel_imapx_command_wait (g_ptr_array_index (commands, ii));
+
+	for (ii = 0; ii < cancel_ids->len; ii++) {
+		gulong cancel_id = g_array_index (cancel_ids, gulong, ii);
+
+		if (cancel_id > 0)
+			g_cancellable_disconnect (cancellable, cancel_id);
+	}
+
+	g_array_free (cancel_ids, TRUE);
+
+	/* Only the folder being refreshed matters; the others may
+	 * just have been deleted meanwhile. */
+	if (g_cancellable_set_error_if_cancelled (cancellable, error))
+		success = FALSE;
+	else
+		success = !camel_imapx_command_set_error_if_failed (
+			g_ptr_array_index (commands, 0), error);
+
+	g_ptr_array_unref (commands);
+
+	return success;
+}
+
+/* Picks the cheapest way to bring the flags of @folder up to date.
+ * A refresh which cannot use QRESYNC compares only the messages
+ * changed since the stored HIGHESTMODSEQ with CONDSTORE, or else only
+ * the newest messages, with a full comparison now and then. */
+static IMAPXScanMode
+imapx_server_choose_scan_mode (CamelIMAPXServer *is,
+                               CamelFolder *folder,
+                               gboolean mobile_mode)
+{
+	CamelIMAPXFolder *ifolder;
+	CamelIMAPXSummary *isum;
+	guint windowed_scans;
+	guint total;
+
+	ifolder = CAMEL_IMAPX_FOLDER (folder);
+	isum = CAMEL_IMAPX_SUMMARY (folder->summary);
+
+	total = camel_folder_summary_count (folder->summary);
+
+	/* Mobile mode already limits the scan to the cached range. */
+	if (mobile_mode || total == 0)
+		return IMAPX_SCAN_FULL;
+
+	if (isum->validity != ifolder->uidvalidity_on_server)
+		return IMAPX_SCAN_FULL;
+
+	if (CAMEL_IMAPX_HAVE_CAPABILITY (is->cinfo, CONDSTORE) &&
+	    isum->modseq > 0 && ifolder->modseq_on_server > 0)
+		return IMAPX_SCAN_CHANGEDSINCE;
+
+	windowed_scans = camel_imapx_folder_get_windowed_scans (ifolder) + 1;
+
+	if (total > SCAN_WINDOW_SIZE && windowed_scans < FULL_SCAN_INTERVAL) {
+		camel_imapx_folder_set_windowed_scans (ifolder, windowed_scans);
+		return IMAPX_SCAN_WINDOW;
+	}
+
+	camel_imapx_folder_set_windowed_scans (ifolder, 0);
+
+	return IMAPX_SCAN_FULL;
+}
+
 static gboolean
 imapx_job_refresh_info_start (CamelIMAPXJob *job,
                               CamelIMAPXServer *is,
@@ -5565,6 +7068,7 @@ imapx_job_refresh_info_start (CamelIMAPXJob *job,
 	CamelIMAPXSettings *settings;
 	CamelIMAPXSummary *isum;
 	CamelFolder *folder;
+	RefreshInfoData *data;
 	const gchar *full_name;
 	gboolean need_rescan = FALSE;
 	gboolean is_selected = FALSE;
@@ -5573,6 +7077,9 @@ imapx_job_refresh_info_start (CamelIMAPXJob *job,
 	gboolean success;
 	guint32 total;
 
+	data = camel_imapx_job_get_data (job);
+	g_return_val_if_fail (data != NULL, FALSE);
+
 	folder = camel_imapx_job_ref_folder (job);
 	g_return_val_if_fail (folder != NULL, FALSE);
 
@@ -5643,23 +7150,11 @@ imapx_job_refresh_info_start (CamelIMAPXJob *job,
 			}
 		} else
 		#endif
-		{
-			if (CAMEL_IMAPX_HAVE_CAPABILITY (is->cinfo, CONDSTORE))
-				ic = camel_imapx_command_new (
-					is, "STATUS", NULL,
-					"STATUS %f (MESSAGES UNSEEN UIDVALIDITY UIDNEXT HIGHESTMODSEQ)", folder);
-			else
-				ic = camel_imapx_command_new (
-					is, "STATUS", NULL,
-					"STATUS %f (MESSAGES UNSEEN UIDVALIDITY UIDNEXT)", folder);
-
-			camel_imapx_command_set_job (ic, job);
-			ic->pri = job->pri;
-
-			success = imapx_command_run_sync (
-				is, ic, cancellable, error);
-
-			camel_imapx_command_unref (ic);
+		if (imapx_server_status_is_fresh (is, folder)) {
+			imapx_server_apply_kept_status (is, folder);
+		} else {
+			success = imapx_server_status_sweep (
+				is, folder, job, cancellable, error);
 
 			if (!success) {
 				g_prefix_error (
@@ -5777,6 +7272,10 @@ imapx_job_refresh_info_start (CamelIMAPXJob *job,
 		}
 	}
 
+	data->scan_mode = imapx_server_choose_scan_mode (
+		is, folder, mobile_mode);
+	data->scan_from = 0;
+
 	g_object_unref (folder);
 
 	return imapx_job_scan_changes_start (job, is, cancellable, error);
@@ -5813,13 +7312,15 @@ imapx_command_expunge_done (CamelIMAPXServer *is,
 	folder = camel_imapx_job_ref_folder (job);
 	g_return_if_fail (folder != NULL);
 
+	job->commands--;
+
 	if (camel_imapx_command_set_error_if_failed (ic, &local_error)) {
 		g_prefix_error (
 			&local_error, "%s: ",
 			_("Error expunging message"));
 		camel_imapx_job_take_error (job, local_error);
 
-	} else {
+	} else if (job->commands == 0) {
 		GPtrArray *uids;
 		CamelStore *parent_store;
 		const gchar *full_name;
@@ -5864,7 +7365,68 @@ imapx_command_expunge_done (CamelIMAPXServer *is,
 
 	g_object_unref (folder);
 
-	imapx_unregister_job (is, job);
+	if (job->commands == 0)
+		imapx_unregister_job (is, job);
+}
+
+/* With UIDPLUS only the messages we flagged for deletion ourselves
+ * are expunged.  A plain EXPUNGE would also remove messages other
+ * clients of a shared mailbox flagged, and flood us with untagged
+ * EXPUNGE responses for them. */
+static gboolean
+imapx_job_uid_expunge_start (CamelIMAPXJob *job,
+                             CamelIMAPXServer *is,
+                             CamelFolder *folder)
+{
+	CamelIMAPXCommand *ic = NULL;
+	CamelStore *parent_store;
+	struct _uidset_state ss;
+	const gchar *full_name;
+	GPtrArray *uids;
+	guint ii;
+
+	full_name = camel_folder_get_full_name (folder);
+	parent_store = camel_folder_get_parent_store (folder);
+
+	camel_folder_summary_save_to_db (folder->summary, NULL);
+	uids = camel_db_get_folder_deleted_uids (parent_store->cdb_r, full_name, NULL);
+
+	if (uids == NULL)
+		return FALSE;
+
+	g_ptr_array_sort (uids, (GCompareFunc) imapx_uids_array_cmp);
+	imapx_uidset_init (&ss, 0, MAX_COMMAND_LEN);
+
+	for (ii = 0; ii < uids->len; ii++) {
+		if (ic == NULL) {
+			ic = camel_imapx_command_new (
+				is, "EXPUNGE", folder, "UID EXPUNGE ");
+			ic->complete = imapx_command_expunge_done;
+			camel_imapx_command_set_job (ic, job);
+			ic->pri = job->pri;
+		}
+
+		if (imapx_uidset_add (&ss, ic, uids->pdata[ii]) == 1 ||
+		    (ii == uids->len - 1 && imapx_uidset_done (&ss, ic))) {
+			job->commands++;
+			imapx_command_queue (is, ic);
+			camel_imapx_command_unref (ic);
+			ic = NULL;
+		}
+	}
+
+	/* Only left over if the last UID could not be parsed. */
+	if (ic != NULL)
+		camel_imapx_command_unref (ic);
+
+	g_ptr_array_foreach (uids, (GFunc) camel_pstring_free, NULL);
+	g_ptr_array_free (uids, TRUE);
+
+	/* Nothing of ours to expunge. */
+	if (job->commands == 0)
+		imapx_unregister_job (is, job);
+
+	return TRUE;
 }
 
 static gboolean
@@ -5875,6 +7437,7 @@ imapx_job_expunge_start (CamelIMAPXJob *job,
 {
 	CamelIMAPXCommand *ic;
 	CamelFolder *folder;
+	gboolean use_uid_expunge = FALSE;
 	gboolean success;
 
 	folder = camel_imapx_job_ref_folder (job);
@@ -5883,13 +7446,16 @@ imapx_job_expunge_start (CamelIMAPXJob *job,
 	success = imapx_server_sync_changes (
 		is, folder, job->type, job->pri, cancellable, error);
 
-	if (success) {
-		/* TODO handle UIDPLUS capability */
+	if (success && CAMEL_IMAPX_HAVE_CAPABILITY (is->cinfo, UIDPLUS))
+		use_uid_expunge = imapx_job_uid_expunge_start (job, is, folder);
+
+	if (success && !use_uid_expunge) {
 		ic = camel_imapx_command_new (
 			is, "EXPUNGE", folder, "EXPUNGE");
 		camel_imapx_command_set_job (ic, job);
 		ic->pri = job->pri;
 		ic->complete = imapx_command_expunge_done;
+		job->commands++;
 
 		imapx_command_queue (is, ic);
 
@@ -6356,9 +7922,16 @@ imapx_job_uid_search_start (CamelIMAPXJob *job,
 	folder = camel_imapx_job_ref_folder (job);
 	g_return_val_if_fail (folder != NULL, FALSE);
 
-	ic = camel_imapx_command_new (
-		is, "UID SEARCH", folder,
-		"UID SEARCH %t", data->criteria);
+	/* With ESEARCH the server returns the matches as a
+	 * sequence set, which is much shorter for big folders. */
+	if (CAMEL_IMAPX_HAVE_CAPABILITY (is->cinfo, ESEARCH))
+		ic = camel_imapx_command_new (
+			is, "UID SEARCH", folder,
+			"UID SEARCH RETURN (ALL) %t", data->criteria);
+	else
+		ic = camel_imapx_command_new (
+			is, "UID SEARCH", folder,
+			"UID SEARCH %t", data->criteria);
 	ic->pri = job->pri;
 	camel_imapx_command_set_job (ic, job);
 	ic->complete = imapx_command_uid_search_done;
@@ -6863,10 +8436,12 @@ imapx_parser_thread (gpointer user_data)
 
 	is->priv->parser_quit = FALSE;
 
-	/* Disconnect the CamelService. */
+	/* Disconnect the CamelService, unless this was one of
+	 * the additional connections from the store's pool. */
 	store = camel_imapx_server_ref_store (is);
-	camel_service_disconnect_sync (
-		CAMEL_SERVICE (store), FALSE, NULL, NULL);
+	if (!camel_imapx_store_discard_server (store, is))
+		camel_service_disconnect_sync (
+			CAMEL_SERVICE (store), FALSE, NULL, NULL);
 	g_object_unref (store);
 
 	g_clear_error (&local_error);
@@ -6992,6 +8567,14 @@ imapx_server_finalize (GObject *object)
 	g_hash_table_destroy (is->priv->known_alerts);
 	g_mutex_clear (&is->priv->known_alerts_lock);
 
+	g_hash_table_destroy (is->priv->status_times);
+	g_hash_table_destroy (is->priv->status_responses);
+	g_hash_table_destroy (is->priv->notify_pending);
+	g_mutex_clear (&is->priv->status_lock);
+
+	g_mutex_clear (&is->priv->job_slot_lock);
+	g_cond_clear (&is->priv->job_slot_cond);
+
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (camel_imapx_server_parent_class)->finalize (object);
 }
@@ -7074,6 +8657,27 @@ camel_imapx_server_init (CamelIMAPXServer *is)
 
 	is->state = IMAPX_DISCONNECTED;
 
+	is->priv->fetch_batch_size = FETCH_BATCH_INITIAL;
+
+	g_mutex_init (&is->priv->status_lock);
+	g_mutex_init (&is->priv->job_slot_lock);
+	g_cond_init (&is->priv->job_slot_cond);
+	is->priv->status_times = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) NULL);
+	is->priv->status_responses = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) g_object_unref);
+	is->priv->notify_pending = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) NULL);
+
 	is->changes = camel_folder_change_info_new ();
 
 	is->priv->known_alerts = g_hash_table_new_full (
@@ -7133,15 +8737,147 @@ camel_imapx_server_ref_stream (CamelIMAPXServer *server)
 	return stream;
 }
 
+/**
+ * camel_imapx_server_get_queue_depth:
+ * @is: a #CamelIMAPXServer
+ *
+ * Returns the number of jobs currently queued or running on @is.
+ * #CamelIMAPXStore uses this to spread work over its connections.
+ *
+ * Returns: the number of pending jobs
+ *
+ * Since: 3.10
+ **/
+guint
+camel_imapx_server_get_queue_depth (CamelIMAPXServer *is)
+{
+	guint depth;
+
+	g_return_val_if_fail (CAMEL_IS_IMAPX_SERVER (is), 0);
+
+	QUEUE_LOCK (is);
+	depth = g_queue_get_length (&is->jobs);
+	QUEUE_UNLOCK (is);
+
+	return depth;
+}
+
+/**
+ * camel_imapx_server_get_job_stats:
+ * @is: a #CamelIMAPXServer
+ * @out_submitted: (out) (allow-none): return location for the number of
+ *                 jobs started, or %NULL
+ * @out_coalesced: (out) (allow-none): return location for the number of
+ *                 requests served by a job already pending, or %NULL
+ * @out_throttled: (out) (allow-none): return location for the number of
+ *                 requests which had to wait for pending jobs, or %NULL
+ *
+ * Returns counters of the jobs run on @is since it was created.
+ * Together with camel_imapx_server_get_queue_depth() this shows how
+ * much of a burst of requests was merged or held back.
+ *
+ * Since: 3.10
+ **/
+void
+camel_imapx_server_get_job_stats (CamelIMAPXServer *is,
+                                  guint *out_submitted,
+                                  guint *out_coalesced,
+                                  guint *out_throttled)
+{
+	g_return_if_fail (CAMEL_IS_IMAPX_SERVER (is));
+
+	QUEUE_LOCK (is);
+
+	if (out_submitted != NULL)
+		*out_submitted = is->priv->jobs_submitted;
+
+	if (out_coalesced != NULL)
+		*out_coalesced = is->priv->jobs_coalesced;
+
+	if (out_throttled != NULL)
+		*out_throttled = is->priv->jobs_throttled;
+
+	QUEUE_UNLOCK (is);
+}
+
+/**
+ * camel_imapx_server_get_latency:
+ * @is: a #CamelIMAPXServer
+ * @out_average: (out) (allow-none): return location for the average
+ *               command round-trip time, or %NULL
+ * @out_max: (out) (allow-none): return location for the longest
+ *           command round-trip time seen, or %NULL
+ *
+ * Returns round-trip statistics for the commands sent over @is, from
+ * sending a command to receiving its tagged response, in microseconds.
+ * The average is weighted towards the most recent commands.
+ *
+ * Since: 3.10
+ **/
+void
+camel_imapx_server_get_latency (CamelIMAPXServer *is,
+                                gint64 *out_average,
+                                gint64 *out_max)
+{
+	g_return_if_fail (CAMEL_IS_IMAPX_SERVER (is));
+
+	QUEUE_LOCK (is);
+
+	if (out_average != NULL)
+		*out_average = is->priv->latency_average;
+
+	if (out_max != NULL)
+		*out_max = is->priv->latency_max;
+
+	QUEUE_UNLOCK (is);
+}
+
+/**
+ * camel_imapx_server_set_watch_mailboxes:
+ * @is: a #CamelIMAPXServer
+ * @watch_mailboxes: whether to watch folders other than the selected one
+ *
+ * Sets whether @is asks the server to push changes in all checked
+ * folders, using the NOTIFY extension where available.  Only one
+ * connection per account should do so.  Takes effect the next time
+ * @is connects.
+ *
+ * Since: 3.10
+ **/
+void
+camel_imapx_server_set_watch_mailboxes (CamelIMAPXServer *is,
+                                        gboolean watch_mailboxes)
+{
+	g_return_if_fail (CAMEL_IS_IMAPX_SERVER (is));
+
+	g_mutex_lock (&is->priv->status_lock);
+	is->priv->watch_mailboxes = watch_mailboxes;
+	g_mutex_unlock (&is->priv->status_lock);
+}
+
 static gboolean
 imapx_disconnect (CamelIMAPXServer *is)
 {
 	gboolean ret = TRUE;
 
+	g_mutex_lock (&is->priv->status_lock);
+	is->priv->notify_active = FALSE;
+	g_mutex_unlock (&is->priv->status_lock);
+
 	g_mutex_lock (&is->priv->stream_lock);
 
 	if (is->priv->stream != NULL) {
 		CamelStream *stream = CAMEL_STREAM (is->priv->stream);
+		guint64 bytes_read, bytes_read_uncompressed;
+
+		if (camel_imapx_stream_get_compression_stats (
+			is->priv->stream, &bytes_read,
+			&bytes_read_uncompressed, NULL, NULL))
+			c (
+				is->tagprefix,
+				"read %" G_GUINT64_FORMAT " bytes, "
+				"%" G_GUINT64_FORMAT " uncompressed\n",
+				bytes_read, bytes_read_uncompressed);
 
 		if (camel_stream_close (stream, NULL, NULL) == -1)
 			ret = FALSE;
@@ -7211,6 +8947,9 @@ imapx_server_get_message (CamelIMAPXServer *is,
 	gboolean registered;
 	gboolean success;
 
+	if (!imapx_server_wait_for_job_slot (is, cancellable, error))
+		return NULL;
+
 	QUEUE_LOCK (is);
 
 	job = imapx_is_job_in_queue (is, folder, IMAPX_JOB_GET_MESSAGE, uid);
@@ -7220,10 +8959,14 @@ imapx_server_get_message (CamelIMAPXServer *is,
 		if (pri > job->pri)
 			job->pri = pri;
 
+		camel_imapx_job_ref (job);
+		is->priv->jobs_coalesced++;
+
 		QUEUE_UNLOCK (is);
 
 		/* Wait for the job to finish. */
 		camel_imapx_job_wait (job, NULL);
+		camel_imapx_job_unref (job);
 
 		/* Disregard errors here.  If we failed to retreive the
 		 * message from cache (implying the job we were waiting
@@ -7306,6 +9049,8 @@ camel_imapx_server_sync_message (CamelIMAPXServer *is,
 {
 	gchar *cache_file = NULL;
 	CamelIMAPXFolder *ifolder = (CamelIMAPXFolder *) folder;
+	CamelMimeMessage *message;
+	CamelStore *parent_store;
 	CamelStream *stream;
 	gboolean is_cached;
 	struct stat st;
@@ -7329,6 +9074,32 @@ camel_imapx_server_sync_message (CamelIMAPXServer *is,
 
 	g_object_unref (stream);
 
+	/* Index the body while we have it, so that searches of the
+	 * cache need not open the message again.  Parse a stream of
+	 * our own; the cached one is shared under the stream lock. */
+	parent_store = camel_folder_get_parent_store (folder);
+	if (camel_db_has_body_index_record (
+		parent_store->cdb_r, camel_folder_get_full_name (folder), uid))
+		return TRUE;
+
+	cache_file = camel_data_cache_get_filename (
+		ifolder->cache, "cur", uid);
+	stream = camel_stream_fs_new_with_name (
+		cache_file, O_RDONLY, 0, NULL);
+	g_free (cache_file);
+
+	if (stream == NULL)
+		return TRUE;
+
+	message = camel_mime_message_new ();
+
+	if (camel_data_wrapper_construct_from_stream_sync (
+		CAMEL_DATA_WRAPPER (message), stream, cancellable, NULL))
+		camel_folder_summary_index_message (folder->summary, uid, message);
+
+	g_object_unref (message);
+	g_object_unref (stream);
+
 	return TRUE;
 }
 
@@ -7345,16 +9116,23 @@ camel_imapx_server_copy_message (CamelIMAPXServer *is,
 	CopyMessagesData *data;
 	gint ii;
 
+	if (!imapx_server_wait_for_job_slot (is, cancellable, error))
+		return FALSE;
+
 	data = g_slice_new0 (CopyMessagesData);
 	data->dest = g_object_ref (dest);
 	data->uids = g_ptr_array_new ();
 	data->delete_originals = delete_originals;
 
-	/* If we're moving messages, prefer "UID MOVE" if supported. */
+	/* If we're moving messages, prefer "UID MOVE" if supported,
+	 * or else expunge just the copied originals with UIDPLUS. */
 	if (data->delete_originals) {
 		if (CAMEL_IMAPX_HAVE_CAPABILITY (is->cinfo, MOVE)) {
 			data->delete_originals = FALSE;
 			data->use_move_command = TRUE;
+		} else if (CAMEL_IMAPX_HAVE_CAPABILITY (is->cinfo, UIDPLUS)) {
+			data->delete_originals = FALSE;
+			data->use_uid_expunge = TRUE;
 		}
 	}
 
@@ -7365,6 +9143,7 @@ camel_imapx_server_copy_message (CamelIMAPXServer *is,
 	job->pri = IMAPX_PRIORITY_APPEND_MESSAGE;
 	job->type = IMAPX_JOB_COPY_MESSAGE;
 	job->start = imapx_job_copy_messages_start;
+	job->matches = imapx_job_copy_messages_matches;
 
 	camel_imapx_job_set_folder (job, source);
 
@@ -7374,30 +9153,26 @@ camel_imapx_server_copy_message (CamelIMAPXServer *is,
 	return imapx_submit_job (is, job, error);
 }
 
-gboolean
-camel_imapx_server_append_message (CamelIMAPXServer *is,
-                                   CamelFolder *folder,
-                                   CamelMimeMessage *message,
-                                   const CamelMessageInfo *mi,
-                                   gchar **appended_uid,
-                                   GCancellable *cancellable,
-                                   GError **error)
+/* Append just assumes we have no/a dodgy connection.  We dump
+ * stuff into the 'new' directory, and let the summary know it's
+ * there.  Then we fire off a no-reply job which will asynchronously
+ * upload the message at some point in the future, and fix up the
+ * summary to match */
+static AppendMessageData *
+imapx_server_spool_message (CamelIMAPXServer *is,
+                            CamelFolder *folder,
+                            CamelMimeMessage *message,
+                            const CamelMessageInfo *mi,
+                            GCancellable *cancellable,
+                            GError **error)
 {
 	gchar *uid = NULL, *path = NULL;
 	CamelStream *stream, *filter;
 	CamelIMAPXFolder *ifolder = (CamelIMAPXFolder *) folder;
 	CamelMimeFilter *canon;
-	CamelIMAPXJob *job;
 	CamelMessageInfo *info;
 	AppendMessageData *data;
 	gint res;
-	gboolean success;
-
-	/* Append just assumes we have no/a dodgy connection.  We dump
-	 * stuff into the 'new' directory, and let the summary know it's
-	 * there.  Then we fire off a no-reply job which will asynchronously
-	 * upload the message at some point in the future, and fix up the
-	 * summary to match */
 
 	/* chen cleanup this later */
 	uid = imapx_get_temp_uid ();
@@ -7405,7 +9180,7 @@ camel_imapx_server_append_message (CamelIMAPXServer *is,
 	if (stream == NULL) {
 		g_prefix_error (error, _("Cannot create spool file: "));
 		g_free (uid);
-		return FALSE;
+		return NULL;
 	}
 
 	filter = camel_stream_filter_new (stream);
@@ -7421,7 +9196,7 @@ camel_imapx_server_append_message (CamelIMAPXServer *is,
 		g_prefix_error (error, _("Cannot create spool file: "));
 		camel_data_cache_remove (ifolder->cache, "new", uid, NULL);
 		g_free (uid);
-		return FALSE;
+		return NULL;
 	}
 
 	path = camel_data_cache_get_filename (ifolder->cache, "new", uid);
@@ -7465,6 +9240,30 @@ camel_imapx_server_append_message (CamelIMAPXServer *is,
 	data->path = path;  /* takes ownership */
 	data->appended_uid = NULL;
 
+	return data;
+}
+
+gboolean
+camel_imapx_server_append_message (CamelIMAPXServer *is,
+                                   CamelFolder *folder,
+                                   CamelMimeMessage *message,
+                                   const CamelMessageInfo *mi,
+                                   gchar **appended_uid,
+                                   GCancellable *cancellable,
+                                   GError **error)
+{
+	CamelIMAPXJob *job;
+	AppendMessageData *data;
+	gboolean success;
+
+	if (!imapx_server_wait_for_job_slot (is, cancellable, error))
+		return FALSE;
+
+	data = imapx_server_spool_message (
+		is, folder, message, mi, cancellable, error);
+	if (data == NULL)
+		return FALSE;
+
 	job = camel_imapx_job_new (cancellable);
 	job->pri = IMAPX_PRIORITY_APPEND_MESSAGE;
 	job->type = IMAPX_JOB_APPEND_MESSAGE;
@@ -7488,6 +9287,124 @@ camel_imapx_server_append_message (CamelIMAPXServer *is,
 	return success;
 }
 
+/**
+ * camel_imapx_server_append_messages:
+ * @is: a #CamelIMAPXServer
+ * @folder: a #CamelFolder to append to
+ * @messages: an array of #CamelMimeMessage
+ * @infos: (allow-none): an array of #CamelMessageInfo with the same
+ *         length as @messages, or %NULL
+ * @appended_uids: (out) (allow-none): return location for an array of
+ *                 the new message UIDs, or %NULL
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Uploads all of @messages to @folder.  This is much faster than calling
+ * camel_imapx_server_append_message() for each of them: the messages are
+ * sent in batches with MULTIAPPEND (RFC 3502) if the server supports it,
+ * and otherwise all APPEND commands are sent without waiting for each
+ * other.  With UIDPLUS the summary entries for the new messages are
+ * created right away, without fetching them back.
+ *
+ * Elements of @appended_uids are %NULL for messages whose new UID is
+ * not known.  Free the array with g_ptr_array_unref().
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ *
+ * Since: 3.10
+ **/
+gboolean
+camel_imapx_server_append_messages (CamelIMAPXServer *is,
+                                    CamelFolder *folder,
+                                    GPtrArray *messages,
+                                    GPtrArray *infos,
+                                    GPtrArray **appended_uids,
+                                    GCancellable *cancellable,
+                                    GError **error)
+{
+	CamelIMAPXJob *job;
+	AppendMessagesData *data;
+	gboolean success = TRUE;
+	guint ii;
+
+	g_return_val_if_fail (CAMEL_IS_IMAPX_SERVER (is), FALSE);
+	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), FALSE);
+	g_return_val_if_fail (messages != NULL, FALSE);
+	g_return_val_if_fail (infos == NULL || infos->len == messages->len, FALSE);
+
+	if (!imapx_server_wait_for_job_slot (is, cancellable, error))
+		return FALSE;
+
+	data = g_slice_new0 (AppendMessagesData);
+	data->messages = g_ptr_array_new_with_free_func (
+		(GDestroyNotify) append_message_data_free);
+	data->batches = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	for (ii = 0; ii < messages->len && success; ii++) {
+		AppendMessageData *message;
+
+		message = imapx_server_spool_message (
+			is, folder, messages->pdata[ii],
+			infos != NULL ? infos->pdata[ii] : NULL,
+			cancellable, error);
+
+		if (message != NULL)
+			g_ptr_array_add (data->messages, message);
+		else
+			success = FALSE;
+	}
+
+	if (!success || data->messages->len == 0) {
+		CamelIMAPXFolder *ifolder = CAMEL_IMAPX_FOLDER (folder);
+
+		/* Remove what was spooled already. */
+		for (ii = 0; ii < data->messages->len; ii++) {
+			AppendMessageData *message;
+
+			message = g_ptr_array_index (data->messages, ii);
+			camel_data_cache_remove (
+				ifolder->cache, "new",
+				message->info->uid, NULL);
+		}
+
+		append_messages_data_free (data);
+
+		if (success && appended_uids != NULL)
+			*appended_uids = g_ptr_array_new_with_free_func (g_free);
+
+		return success;
+	}
+
+	job = camel_imapx_job_new (cancellable);
+	job->pri = IMAPX_PRIORITY_APPEND_MESSAGE;
+	job->type = IMAPX_JOB_APPEND_MESSAGE;
+	job->start = imapx_job_append_messages_start;
+	job->noreply = FALSE;
+
+	camel_imapx_job_set_folder (job, folder);
+
+	camel_imapx_job_set_data (
+		job, data, (GDestroyNotify) append_messages_data_free);
+
+	success = imapx_submit_job (is, job, error);
+
+	if (appended_uids != NULL) {
+		*appended_uids = g_ptr_array_new_with_free_func (g_free);
+
+		for (ii = 0; ii < data->messages->len; ii++) {
+			AppendMessageData *message;
+
+			message = g_ptr_array_index (data->messages, ii);
+			g_ptr_array_add (*appended_uids, message->appended_uid);
+			message->appended_uid = NULL;
+		}
+	}
+
+	camel_imapx_job_unref (job);
+
+	return success;
+}
+
 gboolean
 camel_imapx_server_noop (CamelIMAPXServer *is,
                          CamelFolder *folder,
@@ -7530,6 +9447,7 @@ camel_imapx_server_refresh_info (CamelIMAPXServer *is,
 	/* Both RefreshInfo and Fetch messages can't operate simultaneously */
 	if (imapx_is_job_in_queue (is, folder, IMAPX_JOB_REFRESH_INFO, NULL) ||
 		imapx_is_job_in_queue (is, folder, IMAPX_JOB_FETCH_MESSAGES, NULL)) {
+		is->priv->jobs_coalesced++;
 		QUEUE_UNLOCK (is);
 		return TRUE;
 	}
@@ -7608,6 +9526,7 @@ imapx_server_sync_changes (CamelIMAPXServer *is,
 	gboolean use_real_trash_path;
 	gboolean nothing_to_do;
 	gboolean registered;
+	gboolean waited = FALSE;
 	gboolean success = TRUE;
 
 	/* We calculate two masks, a mask of all flags which have been
@@ -7620,6 +9539,10 @@ imapx_server_sync_changes (CamelIMAPXServer *is,
 	 * one for each flag being turned off, including each
 	 * info being turned off, and one for each flag being turned on.
 	 */
+again:
+	on_user = NULL;
+	off_user = NULL;
+
 	changed_uids = camel_folder_summary_get_changed (folder->summary);
 
 	if (changed_uids->len == 0) {
@@ -7759,12 +9682,28 @@ imapx_server_sync_changes (CamelIMAPXServer *is,
 		if (pri > job->pri)
 			job->pri = pri;
 
+		camel_imapx_job_ref (job);
+		is->priv->jobs_coalesced++;
+
 		QUEUE_UNLOCK (is);
 
 		imapx_sync_free_user (on_user);
 		imapx_sync_free_user (off_user);
 		camel_folder_free_uids (folder, changed_uids);
-		return TRUE;
+
+		/* That job collected its changes before ours were made.
+		 * Let it finish, then sync whatever is left in a single
+		 * follow-up job, which everyone who came in meanwhile
+		 * shares.  A job found on the second pass was created
+		 * after our changes, so it covers them. */
+		camel_imapx_job_wait (job, NULL);
+		camel_imapx_job_unref (job);
+
+		if (waited)
+			return TRUE;
+
+		waited = TRUE;
+		goto again;
 	}
 
 	data = g_slice_new0 (SyncChangesData);
@@ -7807,6 +9746,9 @@ camel_imapx_server_sync_changes (CamelIMAPXServer *is,
                                  GCancellable *cancellable,
                                  GError **error)
 {
+	if (!imapx_server_wait_for_job_slot (is, cancellable, error))
+		return FALSE;
+
 	return imapx_server_sync_changes (
 		is, folder,
 		IMAPX_JOB_SYNC_CHANGES,
@@ -7829,6 +9771,7 @@ camel_imapx_server_expunge (CamelIMAPXServer *is,
 	QUEUE_LOCK (is);
 
 	if (imapx_is_job_in_queue (is, folder, IMAPX_JOB_EXPUNGE, NULL)) {
+		is->priv->jobs_coalesced++;
 		QUEUE_UNLOCK (is);
 		return TRUE;
 	}
@@ -8028,6 +9971,7 @@ camel_imapx_server_fetch_messages (CamelIMAPXServer *is,
 	/* Both RefreshInfo and Fetch messages can't operate simultaneously */
 	if (imapx_is_job_in_queue (is, folder, IMAPX_JOB_REFRESH_INFO, NULL) ||
 		imapx_is_job_in_queue (is, folder, IMAPX_JOB_FETCH_MESSAGES, NULL)) {
+		is->priv->jobs_coalesced++;
 		QUEUE_UNLOCK (is);
 		return TRUE;
 	}
@@ -163,6 +163,19 @@ CamelIMAPXStream *
 gboolean	camel_imapx_server_connect	(CamelIMAPXServer *is,
 						 GCancellable *cancellable,
 						 GError **error);
+guint		camel_imapx_server_get_queue_depth
+						(CamelIMAPXServer *is);
+void		camel_imapx_server_get_job_stats
+						(CamelIMAPXServer *is,
+						 guint *out_submitted,
+						 guint *out_coalesced,
+						 guint *out_throttled);
+void		camel_imapx_server_get_latency	(CamelIMAPXServer *is,
+						 gint64 *out_average,
+						 gint64 *out_max);
+void		camel_imapx_server_set_watch_mailboxes
+						(CamelIMAPXServer *is,
+						 gboolean watch_mailboxes);
 gboolean	imapx_connect_to_server		(CamelIMAPXServer *is,
 						 GCancellable *cancellable,
 						 GError **error);
@@ -220,6 +233,14 @@ gboolean	camel_imapx_server_append_message
 						 gchar **append_uid,
 						 GCancellable *cancellable,
 						 GError **error);
+gboolean	camel_imapx_server_append_messages
+						(CamelIMAPXServer *is,
+						 CamelFolder *folder,
+						 GPtrArray *messages,
+						 GPtrArray *infos,
+						 GPtrArray **appended_uids,
+						 GCancellable *cancellable,
+						 GError **error);
 gboolean	camel_imapx_server_sync_message	(CamelIMAPXServer *is,
 						 CamelFolder *folder,
 						 const gchar *uid,
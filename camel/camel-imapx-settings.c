@@ -33,6 +33,7 @@ struct _CamelIMAPXSettingsPrivate {
 	gchar *shell_command;
 
 	guint batch_fetch_count;
+	guint concurrent_connections;
 
 	gboolean check_all;
 	gboolean check_subscribed;
@@ -118,6 +119,12 @@ imapx_settings_set_property (GObject *object,
 				g_value_get_boolean (value));
 			return;
 
+		case PROP_CONCURRENT_CONNECTIONS:
+			camel_imapx_settings_set_concurrent_connections (
+				CAMEL_IMAPX_SETTINGS (object),
+				g_value_get_uint (value));
+			return;
+
 		case PROP_FETCH_ORDER:
 			camel_imapx_settings_set_fetch_order (
 				CAMEL_IMAPX_SETTINGS (object),
@@ -277,6 +284,13 @@ imapx_settings_get_property (GObject *object,
 				CAMEL_IMAPX_SETTINGS (object)));
 			return;
 
+		case PROP_CONCURRENT_CONNECTIONS:
+			g_value_set_uint (
+				value,
+				camel_imapx_settings_get_concurrent_connections (
+				CAMEL_IMAPX_SETTINGS (object)));
+			return;
+
 		case PROP_FETCH_ORDER:
 			g_value_set_enum (
 				value,
@@ -493,6 +507,20 @@ camel_imapx_settings_class_init (CamelIMAPXSettingsClass *class)
 			G_PARAM_CONSTRUCT |
 			G_PARAM_STATIC_STRINGS));
 
+	g_object_class_install_property (
+		object_class,
+		PROP_CONCURRENT_CONNECTIONS,
+		g_param_spec_uint (
+			"concurrent-connections",
+			"Concurrent Connections",
+			"Number of concurrent IMAP connections to use",
+			MIN_CONCURRENT_CONNECTIONS,
+			MAX_CONCURRENT_CONNECTIONS,
+			1,
+			G_PARAM_READWRITE |
+			G_PARAM_CONSTRUCT |
+			G_PARAM_STATIC_STRINGS));
+
 	g_object_class_install_property (
 		object_class,
 		PROP_FETCH_ORDER,
@@ -850,6 +878,56 @@ camel_imapx_settings_set_check_subscribed (CamelIMAPXSettings *settings,
 	g_object_notify (G_OBJECT (settings), "check-subscribed");
 }
 
+/**
+ * camel_imapx_settings_get_concurrent_connections:
+ * @settings: a #CamelIMAPXSettings
+ *
+ * Returns how many concurrent connections to the IMAP server may be
+ * used.  With more than one connection, folders keep to the connection
+ * they were first used on, so they are not selected back and forth, and
+ * one connection is kept free for fetching messages the user asks for.
+ *
+ * Returns: the number of concurrent connections to use
+ *
+ * Since: 3.10
+ **/
+guint
+camel_imapx_settings_get_concurrent_connections (CamelIMAPXSettings *settings)
+{
+	g_return_val_if_fail (CAMEL_IS_IMAPX_SETTINGS (settings), 1);
+
+	return settings->priv->concurrent_connections;
+}
+
+/**
+ * camel_imapx_settings_set_concurrent_connections:
+ * @settings: a #CamelIMAPXSettings
+ * @concurrent_connections: the number of concurrent connections to use
+ *
+ * Sets how many concurrent connections to the IMAP server may be used.
+ * The value is clamped to the range 1 to 7.
+ *
+ * Since: 3.10
+ **/
+void
+camel_imapx_settings_set_concurrent_connections (CamelIMAPXSettings *settings,
+                                                 guint concurrent_connections)
+{
+	g_return_if_fail (CAMEL_IS_IMAPX_SETTINGS (settings));
+
+	concurrent_connections = CLAMP (
+		concurrent_connections,
+		MIN_CONCURRENT_CONNECTIONS,
+		MAX_CONCURRENT_CONNECTIONS);
+
+	if (settings->priv->concurrent_connections == concurrent_connections)
+		return;
+
+	settings->priv->concurrent_connections = concurrent_connections;
+
+	g_object_notify (G_OBJECT (settings), "concurrent-connections");
+}
+
 /**
  * camel_imapx_settings_get_fetch_order:
  * @settings: a #CamelIMAPXSettings
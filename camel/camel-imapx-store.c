@@ -61,6 +61,26 @@ struct _CamelIMAPXStorePrivate {
 	CamelIMAPXServer *connecting_server;
 	GMutex server_lock;
 
+	/* Every server being connected, main or pooled, by the thread
+	 * connecting it, which is the thread authenticate_sync() gets
+	 * called in.  Connections do not wait for each other to log in;
+	 * only two threads opening the same pooled connection do, with
+	 * pool_connecting and pool_cond.  All protected by server_lock. */
+	GHashTable *connecting_servers;
+	guint pool_connecting;
+	GCond pool_cond;
+
+	/* Additional connections, used when the "concurrent-connections"
+	 * setting is greater than one.  Connection 0 is connected_server,
+	 * connection N is server_pool[N - 1] and may be NULL until first
+	 * needed.  Each folder is owned by one connection, which runs all
+	 * of its jobs, so only one parser thread ever updates its summary;
+	 * a folder only moves once its connection is gone.  INBOX belongs
+	 * to the main connection, which selects it to get other folders
+	 * deselected.  Both are protected by server_lock. */
+	GPtrArray *server_pool;
+	GHashTable *folder_connections;
+
 	GHashTable *quota_info;
 	GMutex quota_info_lock;
 
@@ -100,6 +120,14 @@ G_DEFINE_TYPE_WITH_CODE (
 		CAMEL_TYPE_SUBSCRIBABLE,
 		camel_subscribable_init))
 
+static void
+imapx_store_unref_server (gpointer server)
+{
+	/* Pool slots may be empty. */
+	if (server != NULL)
+		g_object_unref (server);
+}
+
 static guint
 imapx_name_hash (gconstpointer key)
 {
@@ -274,6 +302,7 @@ imapx_store_dispose (GObject *object)
 
 	g_clear_object (&imapx_store->priv->connected_server);
 	g_clear_object (&imapx_store->priv->connecting_server);
+	g_ptr_array_set_size (imapx_store->priv->server_pool, 0);
 	g_clear_object (&imapx_store->priv->settings);
 
 	/* Chain up to parent's dispose() method. */
@@ -290,6 +319,11 @@ imapx_store_finalize (GObject *object)
 	g_mutex_clear (&priv->get_finfo_lock);
 
 	g_mutex_clear (&priv->server_lock);
+	g_hash_table_destroy (priv->connecting_servers);
+	g_cond_clear (&priv->pool_cond);
+
+	g_ptr_array_free (priv->server_pool, TRUE);
+	g_hash_table_destroy (priv->folder_connections);
 
 	g_hash_table_destroy (priv->quota_info);
 	g_mutex_clear (&priv->quota_info_lock);
@@ -366,6 +400,13 @@ imapx_connect_sync (CamelService *service,
 	 * variable while connecting to the IMAP server. */
 	g_warn_if_fail (priv->connecting_server == NULL);
 	priv->connecting_server = g_object_ref (imapx_server);
+	g_hash_table_insert (
+		priv->connecting_servers, g_thread_self (),
+		g_object_ref (imapx_server));
+
+	/* Only the main connection watches the other folders,
+	 * the pooled ones would just get the same events again. */
+	camel_imapx_server_set_watch_mailboxes (imapx_server, TRUE);
 
 	g_mutex_unlock (&priv->server_lock);
 
@@ -379,6 +420,7 @@ imapx_connect_sync (CamelService *service,
 		priv->connecting_server == imapx_server);
 
 	g_clear_object (&priv->connecting_server);
+	g_hash_table_remove (priv->connecting_servers, g_thread_self ());
 
 	if (success) {
 		g_clear_object (&priv->connected_server);
@@ -407,6 +449,9 @@ imapx_disconnect_sync (CamelService *service,
 	g_clear_object (&priv->connected_server);
 	g_clear_object (&priv->connecting_server);
 
+	g_ptr_array_set_size (priv->server_pool, 0);
+	g_hash_table_remove_all (priv->folder_connections);
+
 	g_mutex_unlock (&priv->server_lock);
 
 	return TRUE;
@@ -424,11 +469,20 @@ imapx_authenticate_sync (CamelService *service,
 
 	priv = CAMEL_IMAPX_STORE_GET_PRIVATE (service);
 
-	/* This should have been set for us by connect_sync(). */
+	/* This should have been set for us by connect_sync() or
+	 * imapx_store_connect_pooled(), in this same thread. */
 	g_mutex_lock (&priv->server_lock);
-	imapx_server = g_object_ref (priv->connecting_server);
+	imapx_server = g_hash_table_lookup (
+		priv->connecting_servers, g_thread_self ());
+	if (imapx_server == NULL)
+		imapx_server = priv->connecting_server;
+	if (imapx_server != NULL)
+		g_object_ref (imapx_server);
 	g_mutex_unlock (&priv->server_lock);
 
+	g_return_val_if_fail (
+		imapx_server != NULL, CAMEL_AUTHENTICATION_ERROR);
+
 	result = camel_imapx_server_authenticate (
 		imapx_server, mechanism, cancellable, error);
 
@@ -1831,6 +1885,55 @@ exit:
 	return fi;
 }
 
+/* Moves the connection assignments of a renamed folder and its
+ * subfolders to the new names, or forgets them when @new is NULL. */
+static void
+imapx_store_rename_folder_connections (CamelIMAPXStore *store,
+                                       const gchar *old,
+                                       const gchar *new)
+{
+	GHashTableIter iter;
+	GHashTable *renamed;
+	gpointer key, value;
+	gsize old_len = strlen (old);
+
+	renamed = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) NULL);
+
+	g_mutex_lock (&store->priv->server_lock);
+
+	g_hash_table_iter_init (&iter, store->priv->folder_connections);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		const gchar *name = key;
+
+		if (strncmp (name, old, old_len) != 0)
+			continue;
+		if (name[old_len] != '\0' && name[old_len] != '/')
+			continue;
+
+		if (new != NULL)
+			g_hash_table_insert (
+				renamed, g_strconcat (
+				new, name + old_len, NULL), value);
+
+		g_hash_table_iter_remove (&iter);
+	}
+
+	g_hash_table_iter_init (&iter, renamed);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		g_hash_table_iter_steal (&iter);
+		g_hash_table_insert (
+			store->priv->folder_connections, key, value);
+	}
+
+	g_mutex_unlock (&store->priv->server_lock);
+
+	g_hash_table_destroy (renamed);
+}
+
 static gboolean
 imapx_store_delete_folder_sync (CamelStore *store,
                                 const gchar *folder_name,
@@ -1842,7 +1945,11 @@ imapx_store_delete_folder_sync (CamelStore *store,
 	gboolean success = FALSE;
 
 	imapx_store = CAMEL_IMAPX_STORE (store);
-	imapx_server = camel_imapx_store_ref_server (imapx_store, error);
+
+	/* Use the connection which may have the folder selected,
+	 * so the job gets it deselected before deleting it. */
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, folder_name, cancellable, error);
 
 	if (imapx_server != NULL) {
 		success = camel_imapx_server_delete_folder (
@@ -1851,6 +1958,8 @@ imapx_store_delete_folder_sync (CamelStore *store,
 
 	if (success) {
 		imapx_delete_folder_from_cache (imapx_store, folder_name);
+		imapx_store_rename_folder_connections (
+			imapx_store, folder_name, NULL);
 	}
 
 	g_clear_object (&imapx_server);
@@ -1883,7 +1992,8 @@ imapx_store_rename_folder_sync (CamelStore *store,
 	g_object_unref (settings);
 
 	imapx_store = CAMEL_IMAPX_STORE (store);
-	imapx_server = camel_imapx_store_ref_server (imapx_store, error);
+	imapx_server = camel_imapx_store_ref_server_for_folder (
+		imapx_store, old, cancellable, error);
 
 	if (imapx_server != NULL) {
 		if (use_subscriptions)
@@ -1901,6 +2011,7 @@ imapx_store_rename_folder_sync (CamelStore *store,
 
 		/* Rename summary, and handle broken server. */
 		rename_folder_info (imapx_store, old, new);
+		imapx_store_rename_folder_connections (imapx_store, old, new);
 
 		if (use_subscriptions)
 			success = imapx_subscribe_folder (
@@ -2174,6 +2285,21 @@ camel_imapx_store_init (CamelIMAPXStore *store)
 	store->priv->last_refresh_time = 0;
 
 	g_mutex_init (&store->priv->server_lock);
+	g_cond_init (&store->priv->pool_cond);
+
+	store->priv->connecting_servers = g_hash_table_new_full (
+		(GHashFunc) g_direct_hash,
+		(GEqualFunc) g_direct_equal,
+		(GDestroyNotify) NULL,
+		(GDestroyNotify) g_object_unref);
+
+	store->priv->server_pool =
+		g_ptr_array_new_with_free_func (imapx_store_unref_server);
+	store->priv->folder_connections = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) NULL);
 
 	store->priv->quota_info = g_hash_table_new_full (
 		(GHashFunc) g_str_hash,
@@ -2235,6 +2361,295 @@ camel_imapx_store_ref_server (CamelIMAPXStore *store,
 	return server;
 }
 
+/* Must hold server_lock. */
+static CamelIMAPXServer *
+imapx_store_ref_connection_locked (CamelIMAPXStore *store,
+                                   guint connection)
+{
+	CamelIMAPXServer *server = NULL;
+
+	if (connection == 0)
+		server = store->priv->connected_server;
+	else if (connection <= store->priv->server_pool->len)
+		server = g_ptr_array_index (
+			store->priv->server_pool, connection - 1);
+
+	return (server != NULL) ? g_object_ref (server) : NULL;
+}
+
+/* Must hold server_lock. */
+static guint
+imapx_store_pick_connection_locked (CamelIMAPXStore *store,
+                                    const gchar *folder_name,
+                                    guint n_connections)
+{
+	CamelIMAPXServer *owner;
+	gpointer value;
+	guint best = 0, best_cost = G_MAXUINT;
+	guint ii;
+
+	if (g_ascii_strcasecmp (folder_name, "INBOX") == 0)
+		return 0;
+
+	/* Keep the owner while it is connected, even when the setting
+	 * got lowered since; it may still have the folder selected. */
+	if (g_hash_table_lookup_extended (
+		store->priv->folder_connections, folder_name, NULL, &value)) {
+		guint connection = GPOINTER_TO_UINT (value);
+
+		if (connection < n_connections)
+			return connection;
+
+		owner = imapx_store_ref_connection_locked (store, connection);
+		if (owner != NULL) {
+			g_object_unref (owner);
+			return connection;
+		}
+	}
+
+	/* Prefer an idle connection, then one not connected yet,
+	 * and only then the least busy of the rest. */
+	for (ii = 0; ii < n_connections; ii++) {
+		CamelIMAPXServer *server;
+		guint cost;
+
+		server = imapx_store_ref_connection_locked (store, ii);
+
+		if (server != NULL) {
+			cost = 2 * camel_imapx_server_get_queue_depth (server);
+			g_object_unref (server);
+		} else {
+			cost = 1;
+		}
+
+		if (cost < best_cost) {
+			best = ii;
+			best_cost = cost;
+		}
+	}
+
+	g_hash_table_insert (
+		store->priv->folder_connections,
+		g_strdup (folder_name), GUINT_TO_POINTER (best));
+
+	return best;
+}
+
+static CamelIMAPXServer *
+imapx_store_connect_pooled (CamelIMAPXStore *store,
+                            guint connection,
+                            GCancellable *cancellable)
+{
+	CamelIMAPXStorePrivate *priv = store->priv;
+	CamelIMAPXServer *imapx_server;
+	CamelIMAPXServer *existing;
+	GError *local_error = NULL;
+	gboolean success;
+	guint bit;
+
+	g_return_val_if_fail (connection > 0, NULL);
+
+	bit = 1 << connection;
+
+	g_mutex_lock (&priv->server_lock);
+
+	/* Another thread may be connecting it, or have connected it
+	 * in the meantime.  Other connections are not waited for. */
+	while (priv->pool_connecting & bit)
+		g_cond_wait (&priv->pool_cond, &priv->server_lock);
+
+	existing = imapx_store_ref_connection_locked (store, connection);
+
+	if (existing != NULL || priv->connected_server == NULL) {
+		g_mutex_unlock (&priv->server_lock);
+		return existing;
+	}
+
+	imapx_server = camel_imapx_server_new (store);
+
+	priv->pool_connecting |= bit;
+	g_hash_table_insert (
+		priv->connecting_servers, g_thread_self (),
+		g_object_ref (imapx_server));
+
+	g_mutex_unlock (&priv->server_lock);
+
+	success = camel_imapx_server_connect (
+		imapx_server, cancellable, &local_error);
+
+	g_mutex_lock (&priv->server_lock);
+
+	g_hash_table_remove (priv->connecting_servers, g_thread_self ());
+	priv->pool_connecting &= ~bit;
+	g_cond_broadcast (&priv->pool_cond);
+
+	/* Do not add to the pool if the store got disconnected. */
+	if (success && priv->connected_server != NULL) {
+		if (priv->server_pool->len < connection)
+			g_ptr_array_set_size (priv->server_pool, connection);
+
+		g_ptr_array_index (priv->server_pool, connection - 1) =
+			g_object_ref (imapx_server);
+	} else {
+		g_clear_object (&imapx_server);
+	}
+
+	g_mutex_unlock (&priv->server_lock);
+
+	if (local_error != NULL) {
+		g_warning (
+			"%s: Failed to open IMAP connection %u: %s",
+			G_STRFUNC, connection, local_error->message);
+		g_error_free (local_error);
+	}
+
+	return imapx_server;
+}
+
+/* Moves the folders owned by a connection which is gone, or which
+ * could not be opened, to the main connection.  Must hold server_lock. */
+static void
+imapx_store_release_connection_locked (CamelIMAPXStore *store,
+                                       guint connection)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init (&iter, store->priv->folder_connections);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		if (GPOINTER_TO_UINT (value) == connection)
+			g_hash_table_iter_replace (&iter, GUINT_TO_POINTER (0));
+	}
+}
+
+/**
+ * camel_imapx_store_ref_server_for_folder:
+ * @store: a #CamelIMAPXStore
+ * @folder_name: the full name of the folder to work on, or %NULL
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Like camel_imapx_store_ref_server(), but picks one of the connections
+ * in @store's connection pool, as configured by the
+ * #CamelIMAPXSettings:concurrent-connections setting.
+ *
+ * Each folder is owned by the connection it was first assigned to,
+ * which is the least busy connection at that time.  All jobs for the
+ * folder, message fetches included, run on that connection, so the
+ * folder is never selected on two connections at once and only one
+ * connection updates its summary.  A message fetch still goes ahead
+ * of the folder's other queued jobs by its priority.
+ *
+ * Additional connections are opened on first use.  If that fails, the
+ * folder moves to the main connection, which is returned instead.
+ *
+ * The returned #CamelIMAPXServer is referenced for thread-safety and must
+ * be unreferenced with g_object_unref() when finished with it.
+ *
+ * Returns: a #CamelIMAPXServer, or %NULL
+ *
+ * Since: 3.10
+ **/
+CamelIMAPXServer *
+camel_imapx_store_ref_server_for_folder (CamelIMAPXStore *store,
+                                         const gchar *folder_name,
+                                         GCancellable *cancellable,
+                                         GError **error)
+{
+	CamelIMAPXServer *server;
+	CamelIMAPXServer *pooled;
+	CamelSettings *settings;
+	guint n_connections;
+	guint connection;
+
+	g_return_val_if_fail (CAMEL_IS_IMAPX_STORE (store), NULL);
+
+	server = camel_imapx_store_ref_server (store, error);
+
+	if (server == NULL || folder_name == NULL)
+		return server;
+
+	settings = camel_service_ref_settings (CAMEL_SERVICE (store));
+	n_connections = camel_imapx_settings_get_concurrent_connections (
+		CAMEL_IMAPX_SETTINGS (settings));
+	g_object_unref (settings);
+
+	if (n_connections < 2)
+		return server;
+
+	g_mutex_lock (&store->priv->server_lock);
+
+	connection = imapx_store_pick_connection_locked (
+		store, folder_name, n_connections);
+
+	pooled = imapx_store_ref_connection_locked (store, connection);
+
+	g_mutex_unlock (&store->priv->server_lock);
+
+	if (pooled == NULL && connection > 0)
+		pooled = imapx_store_connect_pooled (
+			store, connection, cancellable);
+
+	if (pooled != NULL) {
+		g_object_unref (server);
+		server = pooled;
+	} else if (connection > 0) {
+		g_mutex_lock (&store->priv->server_lock);
+		imapx_store_release_connection_locked (store, connection);
+		g_mutex_unlock (&store->priv->server_lock);
+	}
+
+	return server;
+}
+
+/**
+ * camel_imapx_store_discard_server:
+ * @store: a #CamelIMAPXStore
+ * @server: a #CamelIMAPXServer which lost its connection
+ *
+ * Removes @server from @store's connection pool.  The next job for the
+ * folders assigned to it will open a new connection.
+ *
+ * Returns: %TRUE if @server was an additional connection, %FALSE if it
+ *          is the main connection, in which case the whole store needs
+ *          to be disconnected
+ *
+ * Since: 3.10
+ **/
+gboolean
+camel_imapx_store_discard_server (CamelIMAPXStore *store,
+                                  CamelIMAPXServer *server)
+{
+	CamelIMAPXStorePrivate *priv;
+	gboolean pooled = TRUE;
+	guint ii;
+
+	g_return_val_if_fail (CAMEL_IS_IMAPX_STORE (store), FALSE);
+	g_return_val_if_fail (CAMEL_IS_IMAPX_SERVER (server), FALSE);
+
+	priv = store->priv;
+
+	g_mutex_lock (&priv->server_lock);
+
+	if (server == priv->connected_server)
+		pooled = FALSE;
+
+	if (server == priv->connecting_server)
+		pooled = FALSE;
+
+	for (ii = 0; ii < priv->server_pool->len; ii++) {
+		if (g_ptr_array_index (priv->server_pool, ii) == server) {
+			g_ptr_array_index (priv->server_pool, ii) = NULL;
+			g_object_unref (server);
+			imapx_store_release_connection_locked (store, ii + 1);
+		}
+	}
+
+	g_mutex_unlock (&priv->server_lock);
+
+	return pooled;
+}
+
 CamelFolderQuotaInfo *
 camel_imapx_store_dup_quota_info (CamelIMAPXStore *store,
                                   const gchar *quota_root_name)
@@ -74,6 +74,15 @@ GType		camel_imapx_store_get_type	(void);
 CamelIMAPXServer *
 		camel_imapx_store_ref_server	(CamelIMAPXStore *store,
 						 GError **error);
+CamelIMAPXServer *
+		camel_imapx_store_ref_server_for_folder
+						(CamelIMAPXStore *store,
+						 const gchar *folder_name,
+						 GCancellable *cancellable,
+						 GError **error);
+gboolean	camel_imapx_store_discard_server
+						(CamelIMAPXStore *store,
+						 CamelIMAPXServer *server);
 CamelFolderQuotaInfo *
 		camel_imapx_store_dup_quota_info
 						(CamelIMAPXStore *store,
@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <errno.h>
+#include <zlib.h>
 
 #include <glib/gi18n-lib.h>
 
@@ -43,6 +44,9 @@
 #define t(...) camel_imapx_debug(token, __VA_ARGS__)
 #define io(...) camel_imapx_debug(io, __VA_ARGS__)
 
+/* Size of the buffers holding compressed data, see RFC 4978. */
+#define COMPRESS_BUFFER_SIZE 4096
+
 struct _CamelIMAPXStreamPrivate {
 	CamelStream *source;
 
@@ -56,6 +60,23 @@ struct _CamelIMAPXStreamPrivate {
 
 	guchar *tokenbuf;
 	guint bufsize;
+
+	/* COMPRESS=DEFLATE state, NULL until enabled. */
+	z_stream *inflate;
+	z_stream *deflate;
+	guchar *inflate_buf;
+	guchar *deflate_buf;
+
+	/* The last inflate() filled the whole output buffer, so
+	 * zlib may hold more output even with no input left. */
+	gboolean inflate_pending;
+
+	/* Bytes on the wire and bytes seen by the parser,
+	 * which differ only once compression is enabled. */
+	guint64 bytes_read;
+	guint64 bytes_read_uncompressed;
+	guint64 bytes_written;
+	guint64 bytes_written_uncompressed;
 };
 
 enum {
@@ -65,6 +86,129 @@ enum {
 
 G_DEFINE_TYPE (CamelIMAPXStream, camel_imapx_stream, CAMEL_TYPE_STREAM)
 
+static gssize
+imapx_stream_read_source (CamelIMAPXStream *is,
+                          gchar *buffer,
+                          gsize n,
+                          GCancellable *cancellable,
+                          GError **error)
+{
+	z_stream *zs = is->priv->inflate;
+	gssize nread;
+
+	if (zs == NULL) {
+		nread = camel_stream_read (
+			is->priv->source, buffer, n, cancellable, error);
+		if (nread > 0) {
+			is->priv->bytes_read += nread;
+			is->priv->bytes_read_uncompressed += nread;
+		}
+		return nread;
+	}
+
+	zs->next_out = (Bytef *) buffer;
+	zs->avail_out = n;
+
+	/* Inflate first, zlib may still hold output from what was
+	 * received already, and only block on the source when that
+	 * gives nothing at all. */
+	while (TRUE) {
+		gint zerr;
+
+		zerr = inflate (zs, Z_SYNC_FLUSH);
+		if (zerr != Z_OK && zerr != Z_BUF_ERROR) {
+			g_set_error (
+				error, CAMEL_IMAPX_ERROR, 1,
+				"Failed to decompress server data: %s",
+				zs->msg != NULL ? zs->msg : "unknown error");
+			return -1;
+		}
+
+		is->priv->inflate_pending = (zs->avail_out == 0);
+
+		if (zs->avail_out != n)
+			break;
+
+		/* inflate() stops early only when out of output
+		 * space, so with no output all input is used up. */
+		if (zs->avail_in == 0) {
+			nread = camel_stream_read (
+				is->priv->source,
+				(gchar *) is->priv->inflate_buf,
+				COMPRESS_BUFFER_SIZE, cancellable, error);
+			if (nread <= 0)
+				return nread;
+
+			is->priv->bytes_read += nread;
+			zs->next_in = is->priv->inflate_buf;
+			zs->avail_in = nread;
+		}
+	}
+
+	nread = n - zs->avail_out;
+	is->priv->bytes_read_uncompressed += nread;
+
+	return nread;
+}
+
+static gssize
+imapx_stream_write_source (CamelIMAPXStream *is,
+                           const gchar *buffer,
+                           gsize n,
+                           GCancellable *cancellable,
+                           GError **error)
+{
+	z_stream *zs = is->priv->deflate;
+	gssize nwritten;
+
+	if (zs == NULL) {
+		nwritten = camel_stream_write (
+			is->priv->source, buffer, n, cancellable, error);
+		if (nwritten > 0) {
+			is->priv->bytes_written += nwritten;
+			is->priv->bytes_written_uncompressed += nwritten;
+		}
+		return nwritten;
+	}
+
+	zs->next_in = (Bytef *) buffer;
+	zs->avail_in = n;
+
+	/* Flush after every write, the server has to see each
+	 * command line and literal as soon as we send it. */
+	do {
+		gsize len;
+		gint zerr;
+
+		zs->next_out = is->priv->deflate_buf;
+		zs->avail_out = COMPRESS_BUFFER_SIZE;
+
+		zerr = deflate (zs, Z_SYNC_FLUSH);
+		if (zerr != Z_OK && zerr != Z_BUF_ERROR) {
+			g_set_error (
+				error, CAMEL_IMAPX_ERROR, 1,
+				"Failed to compress data: %s",
+				zs->msg != NULL ? zs->msg : "unknown error");
+			return -1;
+		}
+
+		len = COMPRESS_BUFFER_SIZE - zs->avail_out;
+		if (len > 0) {
+			nwritten = camel_stream_write (
+				is->priv->source,
+				(gchar *) is->priv->deflate_buf,
+				len, cancellable, error);
+			if (nwritten == -1)
+				return -1;
+			is->priv->bytes_written += nwritten;
+		}
+	} while (zs->avail_out == 0);
+
+	is->priv->bytes_written_uncompressed += n;
+
+	return n;
+}
+
 static gint
 imapx_stream_fill (CamelIMAPXStream *is,
                    GCancellable *cancellable,
@@ -77,8 +221,8 @@ imapx_stream_fill (CamelIMAPXStream *is,
 		memcpy (is->priv->buf, is->priv->ptr, left);
 		is->priv->end = is->priv->buf + left;
 		is->priv->ptr = is->priv->buf;
-		left = camel_stream_read (
-			is->priv->source,
+		left = imapx_stream_read_source (
+			is,
 			(gchar *) is->priv->end,
 			is->priv->bufsize - (is->priv->end - is->priv->buf),
 			cancellable, error);
@@ -176,6 +320,18 @@ imapx_stream_finalize (GObject *object)
 	g_free (stream->priv->buf);
 	g_free (stream->priv->tokenbuf);
 
+	if (stream->priv->inflate != NULL) {
+		inflateEnd (stream->priv->inflate);
+		g_free (stream->priv->inflate);
+		g_free (stream->priv->inflate_buf);
+	}
+
+	if (stream->priv->deflate != NULL) {
+		deflateEnd (stream->priv->deflate);
+		g_free (stream->priv->deflate);
+		g_free (stream->priv->deflate_buf);
+	}
+
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (camel_imapx_stream_parent_class)->finalize (object);
 }
@@ -201,9 +357,8 @@ imapx_stream_read (CamelStream *stream,
 		is->priv->ptr += max;
 	} else {
 		max = MIN (is->priv->literal, n);
-		max = camel_stream_read (
-			is->priv->source,
-			buffer, max, cancellable, error);
+		max = imapx_stream_read_source (
+			is, buffer, max, cancellable, error);
 		if (max <= 0)
 			return max;
 	}
@@ -230,9 +385,8 @@ imapx_stream_write (CamelStream *stream,
 		io (is->tagprefix, "camel_imapx_write: '%.*s'\n", (gint) n, buffer);
 	}
 
-	return camel_stream_write (
-		is->priv->source,
-		buffer, n, cancellable, error);
+	return imapx_stream_write_source (
+		is, buffer, n, cancellable, error);
 }
 
 static gint
@@ -372,9 +526,139 @@ camel_imapx_stream_ref_source (CamelIMAPXStream *is)
 gint
 camel_imapx_stream_buffered (CamelIMAPXStream *is)
 {
+	gint buffered;
+
 	g_return_val_if_fail (CAMEL_IS_IMAPX_STREAM (is), 0);
 
-	return is->priv->end - is->priv->ptr;
+	buffered = is->priv->end - is->priv->ptr;
+
+	/* Compressed data already received has not been inflated
+	 * yet, or zlib holds inflated output it could not return,
+	 * but the source won't report either. */
+	if (is->priv->inflate != NULL) {
+		buffered += is->priv->inflate->avail_in;
+		if (is->priv->inflate_pending)
+			buffered++;
+	}
+
+	return buffered;
+}
+
+/**
+ * camel_imapx_stream_start_compression:
+ * @is: a #CamelIMAPXStream
+ * @error: return location for a #GError, or %NULL
+ *
+ * Starts DEFLATE compression of all data read from and written to the
+ * source stream, as negotiated by the IMAP COMPRESS command (RFC 4978).
+ * This must be called right after the tagged OK response to COMPRESS
+ * has been read; anything buffered past it is treated as compressed.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ *
+ * Since: 3.10
+ **/
+gboolean
+camel_imapx_stream_start_compression (CamelIMAPXStream *is,
+                                      GError **error)
+{
+	z_stream *zinflate;
+	z_stream *zdeflate;
+	gsize buffered;
+
+	g_return_val_if_fail (CAMEL_IS_IMAPX_STREAM (is), FALSE);
+	g_return_val_if_fail (is->priv->inflate == NULL, FALSE);
+
+	zinflate = g_new0 (z_stream, 1);
+	zdeflate = g_new0 (z_stream, 1);
+
+	/* Raw DEFLATE, without zlib headers. */
+	if (inflateInit2 (zinflate, -15) != Z_OK) {
+		g_set_error (
+			error, CAMEL_IMAPX_ERROR, 1,
+			"Failed to initialize decompression");
+		g_free (zinflate);
+		g_free (zdeflate);
+		return FALSE;
+	}
+
+	if (deflateInit2 (
+		zdeflate, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+		-15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		g_set_error (
+			error, CAMEL_IMAPX_ERROR, 1,
+			"Failed to initialize compression");
+		inflateEnd (zinflate);
+		g_free (zinflate);
+		g_free (zdeflate);
+		return FALSE;
+	}
+
+	/* The server may have sent compressed data right behind the
+	 * COMPRESS response, in which case we already read some of it.
+	 * Move it to the compressed input buffer. */
+	buffered = is->priv->end - is->priv->ptr;
+
+	is->priv->inflate_buf = g_malloc (MAX (COMPRESS_BUFFER_SIZE, buffered));
+	is->priv->deflate_buf = g_malloc (COMPRESS_BUFFER_SIZE);
+
+	memcpy (is->priv->inflate_buf, is->priv->ptr, buffered);
+	zinflate->next_in = is->priv->inflate_buf;
+	zinflate->avail_in = buffered;
+	is->priv->ptr = is->priv->end = is->priv->buf;
+
+	is->priv->inflate = zinflate;
+	is->priv->deflate = zdeflate;
+
+	return TRUE;
+}
+
+/**
+ * camel_imapx_stream_get_compression_stats:
+ * @is: a #CamelIMAPXStream
+ * @out_bytes_read: (out) (allow-none): return location for the number
+ *                  of bytes read from the source stream, or %NULL
+ * @out_bytes_read_uncompressed: (out) (allow-none): return location
+ *                               for the number of bytes after
+ *                               decompression, or %NULL
+ * @out_bytes_written: (out) (allow-none): return location for the
+ *                     number of bytes written to the source stream,
+ *                     or %NULL
+ * @out_bytes_written_uncompressed: (out) (allow-none): return location
+ *                                  for the number of bytes before
+ *                                  compression, or %NULL
+ *
+ * Returns the traffic counters of @is.  Without compression the pairs
+ * of compressed and uncompressed counters are equal.
+ *
+ * Returns: %TRUE if compression is enabled on @is
+ *
+ * Since: 3.10
+ **/
+gboolean
+camel_imapx_stream_get_compression_stats (CamelIMAPXStream *is,
+                                          guint64 *out_bytes_read,
+                                          guint64 *out_bytes_read_uncompressed,
+                                          guint64 *out_bytes_written,
+                                          guint64 *out_bytes_written_uncompressed)
+{
+	g_return_val_if_fail (CAMEL_IS_IMAPX_STREAM (is), FALSE);
+
+	if (out_bytes_read != NULL)
+		*out_bytes_read = is->priv->bytes_read;
+
+	if (out_bytes_read_uncompressed != NULL)
+		*out_bytes_read_uncompressed =
+			is->priv->bytes_read_uncompressed;
+
+	if (out_bytes_written != NULL)
+		*out_bytes_written = is->priv->bytes_written;
+
+	if (out_bytes_written_uncompressed != NULL)
+		*out_bytes_written_uncompressed =
+			is->priv->bytes_written_uncompressed;
+
+	return is->priv->inflate != NULL;
 }
 
 /* FIXME: these should probably handle it themselves,
@@ -531,6 +815,50 @@ camel_imapx_stream_nstring (CamelIMAPXStream *is,
 	}
 }
 
+/* Writes a literal of @len bytes to @dest straight from the read
+ * buffer, without bouncing it through an intermediate buffer. */
+static gssize
+imapx_stream_literal_to_stream (CamelIMAPXStream *is,
+                                guint len,
+                                CamelStream *dest,
+                                GCancellable *cancellable,
+                                GError **error)
+{
+	GError *local_error = NULL;
+	gssize total = 0;
+	gboolean write_failed = FALSE;
+	guchar *start;
+	guint inlen;
+	gint ret;
+
+	camel_imapx_stream_set_literal (is, len);
+
+	do {
+		ret = camel_imapx_stream_getl (
+			is, &start, &inlen, cancellable, error);
+		if (ret < 0)
+			return -1;
+
+		/* After a failed write keep reading, so the
+		 * protocol stream stays in sync. */
+		if (inlen > 0 && !write_failed) {
+			if (camel_stream_write (
+				dest, (gchar *) start, inlen,
+				cancellable, &local_error) == -1)
+				write_failed = TRUE;
+			else
+				total += inlen;
+		}
+	} while (ret > 0);
+
+	if (local_error != NULL) {
+		g_propagate_error (error, local_error);
+		return -1;
+	}
+
+	return total;
+}
+
 /* parse an nstring as a stream */
 gboolean
 camel_imapx_stream_nstring_stream (CamelIMAPXStream *is,
@@ -561,11 +889,12 @@ camel_imapx_stream_nstring_stream (CamelIMAPXStream *is,
 			return TRUE;
 
 		case IMAPX_TOK_LITERAL:
-			/* If len is big, we could
-			 * automatically use a file backing. */
-			camel_imapx_stream_set_literal (is, len);
-			mem = camel_stream_mem_new ();
-			if (camel_stream_write_to_stream ((CamelStream *) is, mem, cancellable, error) == -1) {
+			/* Callers which know where the data should end up
+			 * use camel_imapx_stream_nstring_to_stream() instead,
+			 * so this is only used for small literals. */
+			mem = camel_stream_mem_new_with_byte_array (
+				g_byte_array_sized_new (len));
+			if (imapx_stream_literal_to_stream (is, len, mem, cancellable, error) == -1) {
 				g_object_unref (mem);
 				return FALSE;
 			}
@@ -594,6 +923,80 @@ camel_imapx_stream_nstring_stream (CamelIMAPXStream *is,
 	}
 }
 
+/**
+ * camel_imapx_stream_nstring_to_stream:
+ * @is: a #CamelIMAPXStream
+ * @dest: a #CamelStream to write the string to
+ * @out_len: (out) (allow-none): return location for the number of
+ *           bytes written to @dest, or %NULL
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Like camel_imapx_stream_nstring_stream(), but writes the string
+ * directly to @dest instead of collecting it in memory first.  Literals
+ * are copied from the read buffer to @dest as they arrive, so fetching
+ * a large message needs only constant memory.  NIL writes nothing.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ *
+ * Since: 3.10
+ **/
+gboolean
+camel_imapx_stream_nstring_to_stream (CamelIMAPXStream *is,
+                                      CamelStream *dest,
+                                      gsize *out_len,
+                                      GCancellable *cancellable,
+                                      GError **error)
+{
+	camel_imapx_token_t tok;
+	guchar *token;
+	guint len;
+	gssize written = 0;
+
+	g_return_val_if_fail (CAMEL_IS_IMAPX_STREAM (is), FALSE);
+	g_return_val_if_fail (CAMEL_IS_STREAM (dest), FALSE);
+
+	tok = camel_imapx_stream_token (is, &token, &len, cancellable, error);
+
+	switch (tok) {
+		case IMAPX_TOK_ERROR:
+			return FALSE;
+
+		case IMAPX_TOK_STRING:
+			written = camel_stream_write (
+				dest, (gchar *) token, len,
+				cancellable, error);
+			break;
+
+		case IMAPX_TOK_LITERAL:
+			written = imapx_stream_literal_to_stream (
+				is, len, dest, cancellable, error);
+			break;
+
+		case IMAPX_TOK_TOKEN:
+			if (toupper (token[0]) == 'N' &&
+			    toupper (token[1]) == 'I' &&
+			    toupper (token[2]) == 'L' &&
+			    token[3] == 0)
+				break;
+			/* fall through */
+
+		default:
+			g_set_error (
+				error, CAMEL_IMAPX_ERROR, 1,
+				"nstring: token not string");
+			return FALSE;
+	}
+
+	if (written == -1)
+		return FALSE;
+
+	if (out_len != NULL)
+		*out_len = written;
+
+	return TRUE;
+}
+
 gboolean
 camel_imapx_stream_number (CamelIMAPXStream *is,
                            guint64 *number,
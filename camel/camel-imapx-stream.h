@@ -81,6 +81,15 @@ GQuark		camel_imapx_error_quark		(void) G_GNUC_CONST;
 CamelStream *	camel_imapx_stream_new		(CamelStream *source);
 CamelStream *	camel_imapx_stream_ref_source	(CamelIMAPXStream *is);
 gint		camel_imapx_stream_buffered	(CamelIMAPXStream *is);
+gboolean	camel_imapx_stream_start_compression
+						(CamelIMAPXStream *is,
+						 GError **error);
+gboolean	camel_imapx_stream_get_compression_stats
+						(CamelIMAPXStream *is,
+						 guint64 *out_bytes_read,
+						 guint64 *out_bytes_read_uncompressed,
+						 guint64 *out_bytes_written,
+						 guint64 *out_bytes_written_uncompressed);
 
 camel_imapx_token_t
 		camel_imapx_stream_token	(CamelIMAPXStream *is,
@@ -128,6 +137,13 @@ gboolean	camel_imapx_stream_nstring_stream
 						 CamelStream **stream,
 						 GCancellable *cancellable,
 						 GError **error);
+/* gets a NIL or string, writing it to dest */
+gboolean	camel_imapx_stream_nstring_to_stream
+						(CamelIMAPXStream *is,
+						 CamelStream *dest,
+						 gsize *out_len,
+						 GCancellable *cancellable,
+						 GError **error);
 /* gets 'text' */
 gboolean	camel_imapx_stream_text		(CamelIMAPXStream *is,
 						 guchar **text,
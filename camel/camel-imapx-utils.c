@@ -439,7 +439,11 @@ struct {
 	{ "LIST-EXTENDED", IMAPX_CAPABILITY_LIST_EXTENDED },
 	{ "LIST-STATUS", IMAPX_CAPABILITY_LIST_STATUS },
 	{ "QUOTA", IMAPX_CAPABILITY_QUOTA },
-	{ "MOVE", IMAPX_CAPABILITY_MOVE }
+	{ "MOVE", IMAPX_CAPABILITY_MOVE },
+	{ "COMPRESS=DEFLATE", IMAPX_CAPABILITY_COMPRESS_DEFLATE },
+	{ "ESEARCH", IMAPX_CAPABILITY_ESEARCH },
+	{ "MULTIAPPEND", IMAPX_CAPABILITY_MULTIAPPEND },
+	{ "NOTIFY", IMAPX_CAPABILITY_NOTIFY }
 };
 
 static GMutex capa_htable_lock;         /* capabilities lookup table lock */
@@ -1603,6 +1607,8 @@ imapx_dump_fetch (struct _fetch_info *finfo)
 static gboolean
 imapx_parse_fetch_body (CamelIMAPXStream *is,
                         struct _fetch_info *finfo,
+                        IMAPXFetchBodyFunc body_func,
+                        gpointer body_func_data,
                         GCancellable *cancellable,
                         GError **error)
 {
@@ -1627,6 +1633,7 @@ imapx_parse_fetch_body (CamelIMAPXStream *is,
 	}
 
 	if (tok == '[') {
+		CamelStream *target = NULL;
 		gboolean success;
 
 		finfo->section = imapx_parse_section (is, cancellable, error);
@@ -1649,6 +1656,22 @@ imapx_parse_fetch_body (CamelIMAPXStream *is,
 			camel_imapx_stream_ungettoken (is, tok, token, len);
 		}
 
+		if (body_func != NULL && (finfo->got & FETCH_UID) != 0)
+			target = body_func (finfo, body_func_data);
+
+		if (target != NULL) {
+			success = camel_imapx_stream_nstring_to_stream (
+				is, target, &finfo->body_len,
+				cancellable, error);
+
+			g_object_unref (target);
+
+			if (success)
+				finfo->got |= FETCH_BODY | FETCH_BODY_STREAMED;
+
+			return success;
+		}
+
 		success = camel_imapx_stream_nstring_stream (
 			is, &finfo->body, cancellable, error);
 
@@ -1840,6 +1863,16 @@ struct _fetch_info *
 imapx_parse_fetch (CamelIMAPXStream *is,
                    GCancellable *cancellable,
                    GError **error)
+{
+	return imapx_parse_fetch_full (is, NULL, NULL, cancellable, error);
+}
+
+struct _fetch_info *
+imapx_parse_fetch_full (CamelIMAPXStream *is,
+                        IMAPXFetchBodyFunc body_func,
+                        gpointer body_func_data,
+                        GCancellable *cancellable,
+                        GError **error)
 {
 	gint tok;
 	guint len;
@@ -1872,7 +1905,8 @@ imapx_parse_fetch (CamelIMAPXStream *is,
 		switch (imapx_tokenise ((gchar *) token, len)) {
 			case IMAPX_BODY:
 				success = imapx_parse_fetch_body (
-					is, finfo, cancellable, error);
+					is, finfo, body_func, body_func_data,
+					cancellable, error);
 				break;
 
 			case IMAPX_BODYSTRUCTURE:
@@ -2009,6 +2043,7 @@ imapx_parse_status_appenduid (CamelIMAPXStream *is,
                               GCancellable *cancellable,
                               GError **error)
 {
+	GPtrArray *uids;
 	guint64 number;
 
 	if (!camel_imapx_stream_number (is, &number, cancellable, error))
@@ -2016,10 +2051,21 @@ imapx_parse_status_appenduid (CamelIMAPXStream *is,
 
 	sinfo->u.appenduid.uidvalidity = number;
 
-	if (!camel_imapx_stream_number (is, &number, cancellable, error))
+	/* A single UID, or a UID set after a MULTIAPPEND. */
+	uids = imapx_parse_uids (is, cancellable, error);
+	if (uids == NULL)
+		return FALSE;
+
+	if (uids->len == 0) {
+		g_set_error (
+			error, CAMEL_IMAPX_ERROR, 1,
+			"appenduid: expecting uid");
+		g_ptr_array_free (uids, TRUE);
 		return FALSE;
+	}
 
-	sinfo->u.appenduid.uid = (guint32) number;
+	sinfo->u.appenduid.uid = GPOINTER_TO_UINT (uids->pdata[0]);
+	sinfo->u.appenduid.uids = uids;
 
 	return TRUE;
 }
@@ -2348,6 +2394,14 @@ imapx_copy_status (struct _status_info *sinfo)
 		out->u.newname.oldname = g_strdup (out->u.newname.oldname);
 		out->u.newname.newname = g_strdup (out->u.newname.newname);
 	}
+	if (out->condition == IMAPX_APPENDUID && out->u.appenduid.uids) {
+		GPtrArray *uids = out->u.appenduid.uids;
+		guint ii;
+
+		out->u.appenduid.uids = g_ptr_array_sized_new (uids->len);
+		for (ii = 0; ii < uids->len; ii++)
+			g_ptr_array_add (out->u.appenduid.uids, uids->pdata[ii]);
+	}
 
 	return out;
 }
@@ -2363,6 +2417,10 @@ imapx_free_status (struct _status_info *sinfo)
 		g_free (sinfo->u.newname.oldname);
 		g_free (sinfo->u.newname.newname);
 		break;
+	case IMAPX_APPENDUID:
+		if (sinfo->u.appenduid.uids)
+			g_ptr_array_free (sinfo->u.appenduid.uids, TRUE);
+		break;
 	case IMAPX_COPYUID:
 		g_ptr_array_free (sinfo->u.copyuid.uids, FALSE);
 		g_ptr_array_free (sinfo->u.copyuid.copied_uids, FALSE);
@@ -106,6 +106,7 @@ typedef enum _camel_imapx_id_t {
 #define CAMEL_IMAPX_UNTAGGED_BAD        "BAD"
 #define CAMEL_IMAPX_UNTAGGED_BYE        "BYE"
 #define CAMEL_IMAPX_UNTAGGED_CAPABILITY "CAPABILITY"
+#define CAMEL_IMAPX_UNTAGGED_ESEARCH    "ESEARCH"
 #define CAMEL_IMAPX_UNTAGGED_EXISTS     "EXISTS"
 #define CAMEL_IMAPX_UNTAGGED_EXPUNGE    "EXPUNGE"
 #define CAMEL_IMAPX_UNTAGGED_FETCH      "FETCH"
@@ -186,7 +187,11 @@ enum {
 	IMAPX_CAPABILITY_LIST_STATUS		= (1 << 10),
 	IMAPX_CAPABILITY_LIST_EXTENDED		= (1 << 11),
 	IMAPX_CAPABILITY_QUOTA			= (1 << 12),
-	IMAPX_CAPABILITY_MOVE			= (1 << 13)
+	IMAPX_CAPABILITY_MOVE			= (1 << 13),
+	IMAPX_CAPABILITY_COMPRESS_DEFLATE	= (1 << 14),
+	IMAPX_CAPABILITY_ESEARCH		= (1 << 15),
+	IMAPX_CAPABILITY_MULTIAPPEND		= (1 << 16),
+	IMAPX_CAPABILITY_NOTIFY			= (1 << 17)
 };
 
 struct _capability_info {
@@ -249,6 +254,7 @@ struct _fetch_info {
 	gchar *date;		/* INTERNALDATE */
 	gchar *section;		/* section for a BODY[section] request */
 	gchar *uid;		/* UID */
+	gsize body_len;		/* bytes of BODY[] written to a target stream */
 };
 
 #define FETCH_BODY (1 << 0)
@@ -263,11 +269,25 @@ struct _fetch_info {
 #define FETCH_SECTION (1 << 9)
 #define FETCH_UID (1 << 10)
 #define FETCH_MODSEQ (1 << 11)
+#define FETCH_BODY_STREAMED (1 << 12)	/* body went to a target stream */
+
+/* Returns a new reference to the stream a BODY[] response should be
+ * written to directly, or NULL to have it collected in finfo->body.
+ * Only consulted when the UID precedes the body in the response. */
+typedef CamelStream *
+		(*IMAPXFetchBodyFunc)		(struct _fetch_info *finfo,
+						 gpointer user_data);
 
 struct _fetch_info *
 		imapx_parse_fetch		(struct _CamelIMAPXStream *is,
 						 GCancellable *cancellable,
 						 GError **error);
+struct _fetch_info *
+		imapx_parse_fetch_full		(struct _CamelIMAPXStream *is,
+						 IMAPXFetchBodyFunc body_func,
+						 gpointer body_func_data,
+						 GCancellable *cancellable,
+						 GError **error);
 void		imapx_free_fetch		(struct _fetch_info *finfo);
 void		imapx_dump_fetch		(struct _fetch_info *finfo);
 
@@ -290,6 +310,7 @@ struct _status_info {
 		struct {
 			guint64 uidvalidity;
 			guint32 uid;
+			GPtrArray *uids;	/* all of them, for MULTIAPPEND */
 		} appenduid;
 		struct {
 			guint64 uidvalidity;
@@ -51,8 +51,28 @@
 	(G_TYPE_INSTANCE_GET_PRIVATE \
 	((obj), CAMEL_TYPE_PARTITION_TABLE, CamelPartitionTablePrivate))
 
+/* Bloom filter per key block, on the key hashes, so lookups of keys
+ * which are not in the table mostly need not read the key block */
+#define PARTITION_BLOOM_ORDER (10)
+#define PARTITION_BLOOM_BITS (1 << PARTITION_BLOOM_ORDER)
+#define PARTITION_BLOOM_HASHES (3)
+
+/* In-memory copy of the partition map, one entry per key block in
+ * hash order, so finding the partition of a key is one binary search */
+struct _CamelPartitionDir {
+	camel_hash_t hashid;
+	GList *link;	/* map block this entry is in */
+	gint index;	/* and its index there */
+};
+
 struct _CamelPartitionTablePrivate {
 	GMutex lock;	/* for locking partition */
+
+	GArray *dir;	/* of struct _CamelPartitionDir */
+	gboolean dir_valid;
+
+	/* key block id -> Bloom filter, built when a block is first read */
+	GHashTable *blooms;
 };
 
 G_DEFINE_TYPE (CamelPartitionTable, camel_partition_table, CAMEL_TYPE_OBJECT)
@@ -73,6 +93,9 @@ partition_table_finalize (GObject *object)
 		g_object_unref (table->blocks);
 	}
 
+	g_array_free (table->priv->dir, TRUE);
+	g_hash_table_destroy (table->priv->blooms);
+
 	g_mutex_clear (&table->priv->lock);
 
 	/* Chain up to parent's finalize() method. */
@@ -97,6 +120,9 @@ camel_partition_table_init (CamelPartitionTable *cpi)
 
 	g_queue_init (&cpi->partition);
 	g_mutex_init (&cpi->priv->lock);
+
+	cpi->priv->dir = g_array_new (FALSE, FALSE, sizeof (struct _CamelPartitionDir));
+	cpi->priv->blooms = g_hash_table_new_full (NULL, NULL, NULL, g_free);
 }
 
 /* ********************************************************************** */
@@ -130,50 +156,130 @@ static camel_hash_t hash_key (const gchar *key)
 	return hash;
 }
 
+static void
+partition_bloom_positions (camel_hash_t hashid,
+                           guint *pos)
+{
+	guint32 h1, h2;
+	gint i;
+
+	/* hashid is all we have, so mix it two ways and combine those */
+	h1 = hashid * 0x9e3779b1;
+	h2 = ((hashid >> 16) ^ hashid) * 0x85ebca6b;
+
+	for (i = 0; i < PARTITION_BLOOM_HASHES; i++)
+		pos[i] = (h1 + i * h2) >> (32 - PARTITION_BLOOM_ORDER);
+}
+
+static void
+partition_bloom_add (guint8 *bloom,
+                     camel_hash_t hashid)
+{
+	guint pos[PARTITION_BLOOM_HASHES];
+	gint i;
+
+	partition_bloom_positions (hashid, pos);
+	for (i = 0; i < PARTITION_BLOOM_HASHES; i++)
+		bloom[pos[i] / 8] |= 1 << (pos[i] % 8);
+}
+
+static gboolean
+partition_bloom_test (const guint8 *bloom,
+                      camel_hash_t hashid)
+{
+	guint pos[PARTITION_BLOOM_HASHES];
+	gint i;
+
+	partition_bloom_positions (hashid, pos);
+	for (i = 0; i < PARTITION_BLOOM_HASHES; i++) {
+		if ((bloom[pos[i] / 8] & (1 << (pos[i] % 8))) == 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
 /* Call with lock held */
-static GList *
-find_partition (CamelPartitionTable *cpi,
-                camel_hash_t id,
-                gint *indexp)
+static void
+partition_bloom_rebuild (CamelPartitionTable *cpi,
+                         camel_block_t blockid,
+                         CamelPartitionKeyBlock *pkb)
+{
+	guint8 *bloom;
+	gint i;
+
+	bloom = g_hash_table_lookup (cpi->priv->blooms, GUINT_TO_POINTER (blockid));
+	if (bloom == NULL) {
+		bloom = g_malloc0 (PARTITION_BLOOM_BITS / 8);
+		g_hash_table_insert (cpi->priv->blooms, GUINT_TO_POINTER (blockid), bloom);
+	} else {
+		memset (bloom, 0, PARTITION_BLOOM_BITS / 8);
+	}
+
+	for (i = 0; i < pkb->used; i++)
+		partition_bloom_add (bloom, pkb->keys[i].hashid);
+}
+
+/* Call with lock held */
+static void
+partition_dir_rebuild (CamelPartitionTable *cpi)
 {
-	gint index, jump;
-	CamelPartitionMapBlock *ptb;
-	CamelPartitionMap *part;
 	GList *head, *link;
+	gint i;
+
+	g_array_set_size (cpi->priv->dir, 0);
 
-	/* first, find the block this key might be in, then binary search the block */
 	head = g_queue_peek_head_link (&cpi->partition);
 
 	for (link = head; link != NULL; link = g_list_next (link)) {
 		CamelBlock *bl = link->data;
+		CamelPartitionMapBlock *ptb = (CamelPartitionMapBlock *) &bl->data;
 
-		ptb = (CamelPartitionMapBlock *) &bl->data;
-		part = ptb->partition;
-		if (ptb->used > 0 && id <= part[ptb->used - 1].hashid) {
-			index = ptb->used / 2;
-			jump = ptb->used / 4;
+		for (i = 0; i < ptb->used; i++) {
+			struct _CamelPartitionDir entry;
 
-			if (jump == 0)
-				jump = 1;
+			entry.hashid = ptb->partition[i].hashid;
+			entry.link = link;
+			entry.index = i;
+			g_array_append_val (cpi->priv->dir, entry);
+		}
+	}
 
-			while (1) {
-				if (id <= part[index].hashid) {
-					if (index == 0 || id > part[index - 1].hashid)
-						break;
-					index -= jump;
-				} else {
-					if (index >= ptb->used - 1)
-						break;
-					index += jump;
-				}
-				jump = jump / 2;
-				if (jump == 0)
-					jump = 1;
-			}
-			*indexp = index;
+	cpi->priv->dir_valid = TRUE;
+}
 
-			return link;
-		}
+/* Call with lock held */
+static GList *
+find_partition (CamelPartitionTable *cpi,
+                camel_hash_t id,
+                gint *indexp)
+{
+	GArray *dir;
+	guint lo, hi, mid;
+
+	if (!cpi->priv->dir_valid)
+		partition_dir_rebuild (cpi);
+
+	dir = cpi->priv->dir;
+
+	/* the partition is the first one whose top hashid is not below id */
+	lo = 0;
+	hi = dir->len;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (g_array_index (dir, struct _CamelPartitionDir, mid).hashid < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < dir->len) {
+		struct _CamelPartitionDir *entry;
+
+		entry = &g_array_index (dir, struct _CamelPartitionDir, lo);
+		*indexp = entry->index;
+
+		return entry->link;
 	}
 
 	g_warning ("could not find a partition that could fit!  partition table corrupt!");
@@ -233,6 +339,8 @@ camel_partition_table_new (CamelBlockFile *bs,
 		g_queue_push_tail (&cpi->partition, block);
 	} while (root);
 
+	partition_dir_rebuild (cpi);
+
 	return cpi;
 
 fail:
@@ -278,8 +386,10 @@ camel_partition_table_lookup (CamelPartitionTable *cpi,
 	CamelPartitionMapBlock *ptb;
 	CamelBlock *block, *ptblock;
 	camel_hash_t hashid;
+	camel_block_t blockid;
 	camel_key_t keyid = 0;
 	GList *ptblock_link;
+	guint8 *bloom;
 	gint index, i;
 
 	g_return_val_if_fail (CAMEL_IS_PARTITION_TABLE (cpi), 0);
@@ -297,14 +407,23 @@ camel_partition_table_lookup (CamelPartitionTable *cpi,
 
 	ptblock = (CamelBlock *) ptblock_link->data;
 	ptb = (CamelPartitionMapBlock *) &ptblock->data;
-	block = camel_block_file_get_block (
-		cpi->blocks, ptb->partition[index].blockid);
+	blockid = ptb->partition[index].blockid;
+
+	bloom = g_hash_table_lookup (cpi->priv->blooms, GUINT_TO_POINTER (blockid));
+	if (bloom != NULL && !partition_bloom_test (bloom, hashid)) {
+		CAMEL_PARTITION_TABLE_UNLOCK (cpi, lock);
+		return 0;
+	}
+
+	block = camel_block_file_get_block (cpi->blocks, blockid);
 	if (block == NULL) {
 		CAMEL_PARTITION_TABLE_UNLOCK (cpi, lock);
 		return 0;
 	}
 
 	pkb = (CamelPartitionKeyBlock *) &block->data;
+	if (bloom == NULL)
+		partition_bloom_rebuild (cpi, blockid, pkb);
 
 	/* What to do about duplicate hash's? */
 	for (i = 0; i < pkb->used; i++) {
@@ -331,7 +450,9 @@ camel_partition_table_remove (CamelPartitionTable *cpi,
 	CamelPartitionMapBlock *ptb;
 	CamelBlock *block, *ptblock;
 	camel_hash_t hashid;
+	camel_block_t blockid;
 	GList *ptblock_link;
+	guint8 *bloom;
 	gint index, i;
 
 	g_return_val_if_fail (CAMEL_IS_PARTITION_TABLE (cpi), FALSE);
@@ -349,8 +470,17 @@ camel_partition_table_remove (CamelPartitionTable *cpi,
 
 	ptblock = (CamelBlock *) ptblock_link->data;
 	ptb = (CamelPartitionMapBlock *) &ptblock->data;
-	block = camel_block_file_get_block (
-		cpi->blocks, ptb->partition[index].blockid);
+	blockid = ptb->partition[index].blockid;
+
+	/* bits are never cleared, so a removed key stays a false positive
+	 * until the block is next split */
+	bloom = g_hash_table_lookup (cpi->priv->blooms, GUINT_TO_POINTER (blockid));
+	if (bloom != NULL && !partition_bloom_test (bloom, hashid)) {
+		CAMEL_PARTITION_TABLE_UNLOCK (cpi, lock);
+		return TRUE;
+	}
+
+	block = camel_block_file_get_block (cpi->blocks, blockid);
 	if (block == NULL) {
 		CAMEL_PARTITION_TABLE_UNLOCK (cpi, lock);
 		return FALSE;
@@ -396,12 +526,13 @@ keys_cmp (gconstpointer ap,
 	return 0;
 }
 
-gint
-camel_partition_table_add (CamelPartitionTable *cpi,
-                           const gchar *key,
-                           camel_key_t keyid)
+/* Call with lock held */
+static gint
+partition_table_add_hash (CamelPartitionTable *cpi,
+                          camel_hash_t hashid,
+                          camel_key_t keyid)
 {
-	camel_hash_t hashid, partid;
+	camel_hash_t partid;
 	gint index, newindex = 0; /* initialisation of this and pkb/nkb is just to silence compiler */
 	CamelPartitionMapBlock *ptb, *ptn;
 	CamelPartitionKeyBlock *kb, *newkb, *nkb = NULL, *pkb = NULL;
@@ -409,28 +540,18 @@ camel_partition_table_add (CamelPartitionTable *cpi,
 	gint i, half, len;
 	CamelPartitionKey keys[CAMEL_BLOCK_SIZE / 4];
 	GList *ptblock_link;
-	gint ret = -1;
-
-	g_return_val_if_fail (CAMEL_IS_PARTITION_TABLE (cpi), -1);
-	g_return_val_if_fail (key != NULL, -1);
+	guint8 *bloom;
 
-	hashid = hash_key (key);
-
-	CAMEL_PARTITION_TABLE_LOCK (cpi, lock);
 	ptblock_link = find_partition (cpi, hashid, &index);
-	if (ptblock_link == NULL) {
-		CAMEL_PARTITION_TABLE_UNLOCK (cpi, lock);
+	if (ptblock_link == NULL)
 		return -1;
-	}
 
 	ptblock = (CamelBlock *) ptblock_link->data;
 	ptb = (CamelPartitionMapBlock *) &ptblock->data;
 	block = camel_block_file_get_block (
 		cpi->blocks, ptb->partition[index].blockid);
-	if (block == NULL) {
-		CAMEL_PARTITION_TABLE_UNLOCK (cpi, lock);
+	if (block == NULL)
 		return -1;
-	}
 	kb = (CamelPartitionKeyBlock *) &block->data;
 
 	/* TODO: Keep the key array in sorted order, cheaper lookups and split operation */
@@ -440,6 +561,10 @@ camel_partition_table_add (CamelPartitionTable *cpi,
 		kb->keys[kb->used].hashid = hashid;
 		kb->keys[kb->used].keyid = keyid;
 		kb->used++;
+
+		bloom = g_hash_table_lookup (cpi->priv->blooms, GUINT_TO_POINTER (block->id));
+		if (bloom != NULL)
+			partition_bloom_add (bloom, hashid);
 	} else {
 		CamelBlock *newblock = NULL, *nblock = NULL, *pblock = NULL;
 
@@ -513,6 +638,7 @@ camel_partition_table_add (CamelPartitionTable *cpi,
 				g_queue_insert_after (
 					&cpi->partition,
 					ptblock_link, ptnblock);
+				cpi->priv->dir_valid = FALSE;
 
 				/* write in right order to ensure structure */
 				camel_block_file_touch_block (cpi->blocks, ptnblock);
@@ -601,6 +727,11 @@ camel_partition_table_add (CamelPartitionTable *cpi,
 #ifdef SYNC_UPDATES
 		camel_block_file_sync_block (cpi->blocks, ptblock);
 #endif
+		/* keys moved between the two blocks, and the map changed */
+		partition_bloom_rebuild (cpi, block->id, kb);
+		partition_bloom_rebuild (cpi, newblock->id, newkb);
+		cpi->priv->dir_valid = FALSE;
+
 		camel_block_file_touch_block (cpi->blocks, newblock);
 		camel_block_file_unref_block (cpi->blocks, newblock);
 	}
@@ -608,13 +739,144 @@ camel_partition_table_add (CamelPartitionTable *cpi,
 	camel_block_file_touch_block (cpi->blocks, block);
 	camel_block_file_unref_block (cpi->blocks, block);
 
-	ret = 0;
+	return 0;
+
 fail:
+	camel_block_file_unref_block (cpi->blocks, block);
+
+	return -1;
+}
+
+/* Call with lock held.  Appends the leading keys of the sorted @keys
+ * which fall into the same partition as the first one, for as long as
+ * its key block has room.  Returns how many were added, 0 if the block
+ * is full and needs splitting, or -1 on error. */
+static gint
+partition_table_add_sorted (CamelPartitionTable *cpi,
+                            const CamelPartitionKey *keys,
+                            guint n_keys)
+{
+	CamelPartitionKeyBlock *kb;
+	CamelPartitionMapBlock *ptb;
+	CamelBlock *block, *ptblock;
+	camel_hash_t partid;
+	GList *ptblock_link;
+	guint8 *bloom;
+	gint index;
+	guint i;
+
+	ptblock_link = find_partition (cpi, keys[0].hashid, &index);
+	if (ptblock_link == NULL)
+		return -1;
+
+	ptblock = (CamelBlock *) ptblock_link->data;
+	ptb = (CamelPartitionMapBlock *) &ptblock->data;
+	partid = ptb->partition[index].hashid;
+	block = camel_block_file_get_block (
+		cpi->blocks, ptb->partition[index].blockid);
+	if (block == NULL)
+		return -1;
+	kb = (CamelPartitionKeyBlock *) &block->data;
+
+	bloom = g_hash_table_lookup (cpi->priv->blooms, GUINT_TO_POINTER (block->id));
+
+	for (i = 0; i < n_keys && keys[i].hashid <= partid && kb->used < G_N_ELEMENTS (kb->keys); i++) {
+		kb->keys[kb->used] = keys[i];
+		kb->used++;
+		if (bloom != NULL)
+			partition_bloom_add (bloom, keys[i].hashid);
+	}
+
+	if (i > 0)
+		camel_block_file_touch_block (cpi->blocks, block);
+	camel_block_file_unref_block (cpi->blocks, block);
+
+	return i;
+}
+
+gint
+camel_partition_table_add (CamelPartitionTable *cpi,
+                           const gchar *key,
+                           camel_key_t keyid)
+{
+	gint ret;
+
+	g_return_val_if_fail (CAMEL_IS_PARTITION_TABLE (cpi), -1);
+	g_return_val_if_fail (key != NULL, -1);
+
+	CAMEL_PARTITION_TABLE_LOCK (cpi, lock);
+	ret = partition_table_add_hash (cpi, hash_key (key), keyid);
 	CAMEL_PARTITION_TABLE_UNLOCK (cpi, lock);
 
 	return ret;
 }
 
+/**
+ * camel_partition_table_add_many:
+ * @cpi: a #CamelPartitionTable
+ * @keys: (array length=n_keys): the keys to add
+ * @keyids: (array length=n_keys): the key ids for @keys
+ * @n_keys: the number of entries in @keys and @keyids
+ *
+ * Adds several keys at once, as if by calling camel_partition_table_add()
+ * for each of them.  The keys are sorted by hash and applied one partition
+ * at a time, so a key block is read and written once for all the keys
+ * which fall into it rather than once for each key.
+ *
+ * Returns: 0 on success, -1 on error
+ *
+ * Since: 3.10
+ **/
+gint
+camel_partition_table_add_many (CamelPartitionTable *cpi,
+                                const gchar * const *keys,
+                                const camel_key_t *keyids,
+                                guint n_keys)
+{
+	CamelPartitionKey *sorted;
+	guint i;
+	gint added, ret = 0;
+
+	g_return_val_if_fail (CAMEL_IS_PARTITION_TABLE (cpi), -1);
+	g_return_val_if_fail (keys != NULL || n_keys == 0, -1);
+	g_return_val_if_fail (keyids != NULL || n_keys == 0, -1);
+
+	if (n_keys == 0)
+		return 0;
+
+	sorted = g_new (CamelPartitionKey, n_keys);
+	for (i = 0; i < n_keys; i++) {
+		sorted[i].hashid = hash_key (keys[i]);
+		sorted[i].keyid = keyids[i];
+	}
+	qsort (sorted, n_keys, sizeof (sorted[0]), keys_cmp);
+
+	CAMEL_PARTITION_TABLE_LOCK (cpi, lock);
+
+	i = 0;
+	while (i < n_keys) {
+		added = partition_table_add_sorted (cpi, sorted + i, n_keys - i);
+		if (added == 0) {
+			/* the partition is full, split it with the next key */
+			if (partition_table_add_hash (cpi, sorted[i].hashid, sorted[i].keyid) == 0)
+				added = 1;
+			else
+				added = -1;
+		}
+		if (added == -1) {
+			ret = -1;
+			break;
+		}
+		i += added;
+	}
+
+	CAMEL_PARTITION_TABLE_UNLOCK (cpi, lock);
+
+	g_free (sorted);
+
+	return ret;
+}
+
 /* ********************************************************************** */
 
 #define CAMEL_KEY_TABLE_GET_PRIVATE(obj) \
@@ -344,10 +344,13 @@ store_finalize (GObject *object)
 
 	g_rec_mutex_clear (&store->priv->folder_lock);
 
+	if (store->cdb_w != NULL && store->cdb_w != store->cdb_r)
+		camel_db_close (store->cdb_w);
+	store->cdb_w = NULL;
+
 	if (store->cdb_r != NULL) {
 		camel_db_close (store->cdb_r);
 		store->cdb_r = NULL;
-		store->cdb_w = NULL;
 	}
 
 	/* Chain up to parent's finalize() method. */
@@ -1166,6 +1169,20 @@ store_noop_finish (CamelStore *store,
 	return !g_simple_async_result_propagate_error (simple, error);
 }
 
+static gint
+store_journal_mode_cb (gpointer data,
+                       gint ncol,
+                       gchar **colvalues,
+                       gchar **colnames)
+{
+	gchar **journal_mode = data;
+
+	if (ncol > 0 && colvalues[0] != NULL && *journal_mode == NULL)
+		*journal_mode = g_strdup (colvalues[0]);
+
+	return 0;
+}
+
 static gboolean
 store_initable_init (GInitable *initable,
                      GCancellable *cancellable,
@@ -1174,6 +1191,7 @@ store_initable_init (GInitable *initable,
 	CamelStore *store;
 	CamelService *service;
 	const gchar *user_dir;
+	gchar *journal_mode = NULL;
 	gchar *filename;
 
 	store = CAMEL_STORE (initable);
@@ -1207,8 +1225,21 @@ store_initable_init (GInitable *initable,
 	if (camel_db_create_folders_table (store->cdb_r, error))
 		return FALSE;
 
-	/* keep cb_w to not break the ABI */
-	store->cdb_w = store->cdb_r;
+	/* Summary writes go through their own connection, so that in
+	 * WAL mode folders can be read while others are being saved.
+	 * Without WAL a second connection would only add lock waits
+	 * between the two, so share the reader then, as also when the
+	 * clone can't be opened. */
+	camel_db_select (
+		store->cdb_r, "PRAGMA main.journal_mode",
+		store_journal_mode_cb, &journal_mode, NULL);
+
+	if (journal_mode != NULL && g_ascii_strcasecmp (journal_mode, "wal") == 0)
+		store->cdb_w = camel_db_clone (store->cdb_r, NULL);
+	if (store->cdb_w == NULL)
+		store->cdb_w = store->cdb_r;
+
+	g_free (journal_mode);
 
 	return TRUE;
 }
@@ -39,6 +39,7 @@
 #include "camel-mempool.h"
 #include "camel-object.h"
 #include "camel-partition-table.h"
+#include "camel-search-private.h"
 #include "camel-text-index.h"
 
 #define w(x)
@@ -50,12 +51,19 @@
 
 #define CAMEL_TEXT_INDEX_MAX_WORDLEN  (36)
 
+/* most names written to one key file block, see camel_key_file_write_packed () */
+#define CAMEL_TEXT_INDEX_MAX_CHUNK (1024)
+
+/* key file blocks merged by one incremental compaction pass */
+#define CAMEL_TEXT_INDEX_COMPACT_BUDGET (4096)
+
 #define CAMEL_TEXT_INDEX_LOCK(kf, lock) \
 	(g_rec_mutex_lock (&((CamelTextIndex *) kf)->priv->lock))
 #define CAMEL_TEXT_INDEX_UNLOCK(kf, lock) \
 	(g_rec_mutex_unlock (&((CamelTextIndex *) kf)->priv->lock))
 
 static gint text_index_compress_nosync (CamelIndex *idx);
+static gint text_index_compact_words (CamelIndex *idx, guint budget);
 
 /* ********************************************************************** */
 
@@ -78,18 +86,16 @@ CamelTextIndexName *camel_text_index_name_new (CamelTextIndex *idx, const gchar
 	((obj), CAMEL_TYPE_TEXT_INDEX_CURSOR, CamelTextIndexCursorPrivate))
 
 struct _CamelTextIndexCursorPrivate {
-	camel_block_t first;
-	camel_block_t next;
-
-	gint record_index;
-
-	gsize record_count;
-	camel_key_t *records;
-
-	gchar *current;
+	/* name ids read when the cursor was created, so later writes
+	 * do not change what it returns; names are looked up as they
+	 * are returned, and a compression remaps the ids */
+	GArray *keys;
+	guint index;
+	gchar *name;
 };
 
-CamelTextIndexCursor *camel_text_index_cursor_new (CamelTextIndex *idx, camel_block_t data);
+CamelTextIndexCursor *camel_text_index_cursor_new (CamelTextIndex *idx, GArray *keys);
+static void text_index_cursor_remap (CamelTextIndexCursor *idc, GHashTable *remap);
 
 /* ****************************** */
 
@@ -110,8 +116,8 @@ CamelTextIndexKeyCursor *camel_text_index_key_cursor_new (CamelTextIndex *idx, C
 
 /* ********************************************************************** */
 
-#define CAMEL_TEXT_INDEX_VERSION "TEXT.000"
-#define CAMEL_TEXT_INDEX_KEY_VERSION "KEYS.000"
+#define CAMEL_TEXT_INDEX_VERSION "TEXT.001"
+#define CAMEL_TEXT_INDEX_KEY_VERSION "KEYS.001"
 
 #define CAMEL_TEXT_INDEX_GET_PRIVATE(obj) \
 	(G_TYPE_INSTANCE_GET_PRIVATE \
@@ -132,6 +138,16 @@ struct _CamelTextIndexPrivate {
 	GQueue word_cache;
 	GHashTable *words;
 	GRecMutex lock;
+
+	/* Writers serialise on 'lock'.  Lookups only take this for
+	 * reading, the tables below it do their own locking, so they
+	 * run alongside a writer; it is only taken for writing while
+	 * a full compression swaps the files underneath. */
+	GRWLock swap_lock;
+
+	/* name cursors still open, their ids change with the files */
+	GMutex cursors_lock;
+	GSList *cursors;
 };
 
 /* Root block of text index */
@@ -149,6 +165,10 @@ struct _CamelTextIndexRoot {
 	guint32 names;		/* total names */
 	guint32 deleted;	/* deleted names */
 	guint32 keys;		/* total key 'chunks' written, used with deleted to determine fragmentation */
+
+	camel_key_t compact_word; /* word the next incremental compaction starts after */
+	guint32 records;	/* name references in live key chunks */
+	guint32 dead;		/* name references in chunks replaced by incremental compaction */
 };
 
 struct _CamelTextIndexWord {
@@ -223,11 +243,142 @@ text_index_finalize (GObject *object)
 	g_hash_table_destroy (priv->words);
 
 	g_rec_mutex_clear (&priv->lock);
+	g_rw_lock_clear (&priv->swap_lock);
+	g_mutex_clear (&priv->cursors_lock);
 
 	/* Chain up to parent's finalize () method. */
 	G_OBJECT_CLASS (camel_text_index_parent_class)->finalize (object);
 }
 
+static gint
+text_index_key_compare (gconstpointer a,
+                        gconstpointer b)
+{
+	camel_key_t ka = *((const camel_key_t *) a);
+	camel_key_t kb = *((const camel_key_t *) b);
+
+	return ka < kb ? -1 : ka > kb ? 1 : 0;
+}
+
+/* sorts @keys and drops duplicates, returns the new length */
+static gsize
+text_index_sort_keys (camel_key_t *keys,
+                      gsize len)
+{
+	gsize ii, used;
+
+	if (len < 2)
+		return len;
+
+	qsort (keys, len, sizeof (camel_key_t), text_index_key_compare);
+
+	for (ii = 1, used = 1; ii < len; ii++) {
+		if (keys[ii] != keys[used - 1])
+			keys[used++] = keys[ii];
+	}
+
+	return used;
+}
+
+/* Reads the whole chain of key blocks starting at @data, appending the
+ * names to @keys, which is left sorted.  Returns the number of blocks
+ * read, or -1 if one could not be read. */
+static gint
+text_index_read_postings (CamelTextIndexPrivate *p,
+                          camel_block_t data,
+                          GArray *keys)
+{
+	camel_key_t *records;
+	gsize count;
+	gint blocks = 0;
+
+	while (data) {
+		if (camel_key_file_read_packed (p->links, &data, &count, &records) == -1) {
+			blocks = -1;
+			break;
+		}
+		g_array_append_vals (keys, records, count);
+		g_free (records);
+		blocks++;
+	}
+
+	/* a single block is already sorted */
+	if (blocks != 1)
+		g_array_set_size (
+			keys, text_index_sort_keys (
+			(camel_key_t *) keys->data, keys->len));
+
+	return blocks;
+}
+
+/* Writes the sorted @keys as a new chain of key blocks, which @data is
+ * set to point to.  Returns the number of blocks written, or -1. call locked */
+static gint
+text_index_write_postings (CamelTextIndexPrivate *p,
+                           camel_block_t *data,
+                           GArray *keys)
+{
+	guint ii, len;
+	gint blocks = 0;
+
+	for (ii = 0; ii < keys->len; ii += len) {
+		len = MIN (keys->len - ii, CAMEL_TEXT_INDEX_MAX_CHUNK);
+		if (camel_key_file_write_packed (p->links, data, len, &g_array_index (keys, camel_key_t, ii)) == -1)
+			return -1;
+		blocks++;
+	}
+
+	return blocks;
+}
+
+/* call locked */
+static gint
+text_index_flush_word (CamelTextIndexPrivate *p,
+                       struct _CamelTextIndexWord *w)
+{
+	struct _CamelTextIndexRoot *rb = (struct _CamelTextIndexRoot *) p->blocks->root;
+	gsize used;
+
+	used = text_index_sort_keys (w->names, w->used);
+
+	io (printf ("writing key file entry '%s' [%x]\n", w->word, w->data));
+	if (camel_key_file_write_packed (p->links, &w->data, used, w->names) == -1)
+		return -1;
+
+	io (printf ("  new data [%x]\n", w->data));
+	rb->keys++;
+	rb->records += used;
+	camel_block_file_touch_block (p->blocks, p->blocks->root_block);
+	/* if this call fails - we still point to the old data - not fatal */
+	camel_key_table_set_data (p->word_index, w->wordid, w->data);
+
+	return 0;
+}
+
+/* Looks up the names of @keys, skipping deleted ones */
+static GPtrArray *
+text_index_resolve_names (CamelTextIndexPrivate *p,
+                          GArray *keys)
+{
+	GPtrArray *names;
+	gchar *name;
+	guint ii, flags;
+
+	names = g_ptr_array_new_full (keys->len, g_free);
+
+	for (ii = 0; ii < keys->len; ii++) {
+		camel_key_table_lookup (
+			p->name_index, g_array_index (keys, camel_key_t, ii),
+			&name, &flags);
+		if (name != NULL && (flags & 1) == 0)
+			g_ptr_array_add (names, name);
+		else
+			g_free (name);
+	}
+
+	return names;
+}
+
 /* call locked */
 static void
 text_index_add_name_to_word (CamelIndex *idx,
@@ -290,14 +441,7 @@ text_index_add_name_to_word (CamelIndex *idx,
 		while (link != NULL && length > p->word_cache_limit) {
 			struct _CamelTextIndexWord *ww = link->data;
 
-			io (printf ("writing key file entry '%s' [%x]\n", ww->word, ww->data));
-			if (camel_key_file_write (p->links, &ww->data, ww->used, ww->names) != -1) {
-				io (printf ("  new data [%x]\n", ww->data));
-				rb->keys++;
-				camel_block_file_touch_block (p->blocks, p->blocks->root_block);
-				/* if this call fails - we still point to the old data - not fatal */
-				camel_key_table_set_data (
-					p->word_index, ww->wordid, ww->data);
+			if (text_index_flush_word (p, ww) != -1) {
 				g_hash_table_remove (p->words, ww->word);
 				g_queue_push_tail (&trash, link);
 				link->data = NULL;
@@ -319,14 +463,7 @@ text_index_add_name_to_word (CamelIndex *idx,
 		w->names[w->used] = nameid;
 		w->used++;
 		if (w->used == G_N_ELEMENTS (w->names)) {
-			io (printf ("writing key file entry '%s' [%x]\n", w->word, w->data));
-			if (camel_key_file_write (p->links, &w->data, w->used, w->names) != -1) {
-				rb->keys++;
-				camel_block_file_touch_block (p->blocks, p->blocks->root_block);
-				/* if this call fails - we still point to the old data - not fatal */
-				camel_key_table_set_data (
-					p->word_index, w->wordid, w->data);
-			}
+			text_index_flush_word (p, w);
 			/* FIXME: what to on error?  lost data? */
 			w->used = 0;
 		}
@@ -361,16 +498,8 @@ text_index_sync (CamelIndex *idx)
 
 	while ((ww = g_queue_pop_head (&p->word_cache))) {
 		if (ww->used > 0) {
-			io (printf ("writing key file entry '%s' [%x]\n", ww->word, ww->data));
-			if (camel_key_file_write (p->links, &ww->data, ww->used, ww->names) != -1) {
-				io (printf ("  new data [%x]\n", ww->data));
-				rb->keys++;
-				camel_block_file_touch_block (p->blocks, p->blocks->root_block);
-				camel_key_table_set_data (
-					p->word_index, ww->wordid, ww->data);
-			} else {
+			if (text_index_flush_word (p, ww) == -1)
 				ret = -1;
-			}
 			ww->used = 0;
 		}
 		g_hash_table_remove (p->words, ww->word);
@@ -389,9 +518,14 @@ text_index_sync (CamelIndex *idx)
 	nfrag = rb->names ? ((rb->deleted * 100) / rb->names) : 0;
 	d (printf ("  words = %d, keys = %d\n", rb->words, rb->keys));
 
+	/* Merging fragmented words is cheap and done a bit at a time, a
+	 * full compression is only needed to drop deleted names or once
+	 * most of the data file is chunks replaced by those merges. */
 	if (ret == 0) {
-		if (wfrag > 30 || nfrag > 20)
+		if (nfrag > 20 || rb->dead > rb->records)
 			ret = text_index_compress_nosync (idx);
+		else if (wfrag > 30)
+			ret = text_index_compact_words (idx, CAMEL_TEXT_INDEX_COMPACT_BUDGET);
 	}
 
 	ret = camel_block_file_sync (p->blocks);
@@ -401,6 +535,67 @@ text_index_sync (CamelIndex *idx)
 	return ret;
 }
 
+/* Merges the key chunks of fragmented words into single sorted chains,
+ * reading at most @budget chunks and starting after the word the previous
+ * pass stopped at.  The replaced chunks stay in the data file until the
+ * next full compression.  call locked */
+static gint
+text_index_compact_words (CamelIndex *idx,
+                          guint budget)
+{
+	CamelTextIndexPrivate *p = CAMEL_TEXT_INDEX_GET_PRIVATE (idx);
+	struct _CamelTextIndexRoot *rb = (struct _CamelTextIndexRoot *) p->blocks->root;
+	camel_key_t keyid, last;
+	camel_block_t data;
+	GArray *keys;
+	guint flags;
+	gint read, written, ret = 0;
+
+	keys = g_array_new (FALSE, FALSE, sizeof (camel_key_t));
+	keyid = rb->compact_word;
+
+	while (budget > 0) {
+		last = keyid;
+		keyid = camel_key_table_next (p->word_index, keyid, NULL, &flags, &data);
+		if (keyid == 0)
+			break;
+		if (data == 0 || (flags & 1) != 0)
+			continue;
+
+		g_array_set_size (keys, 0);
+		read = text_index_read_postings (p, data, keys);
+		if (read == -1) {
+			keyid = last;
+			ret = -1;
+			break;
+		}
+
+		budget -= MIN (budget, read);
+		if (read < 2)
+			continue;
+
+		data = 0;
+		written = text_index_write_postings (p, &data, keys);
+		if (written == -1) {
+			keyid = last;
+			ret = -1;
+			break;
+		}
+
+		c (printf ("compacted word %08x: %d blocks to %d\n", keyid, read, written));
+		camel_key_table_set_data (p->word_index, keyid, data);
+		rb->keys -= read - written;
+		rb->dead += keys->len;
+	}
+
+	rb->compact_word = keyid;
+	camel_block_file_touch_block (p->blocks, p->blocks->root_block);
+
+	g_array_free (keys, TRUE);
+
+	return ret;
+}
+
 static void tmp_name (const gchar *in, gchar *o)
 {
 	gchar *s;
@@ -445,8 +640,10 @@ text_index_compress_nosync (CamelIndex *idx)
 	gchar *name = NULL;
 	guint flags;
 	gchar *newpath, *savepath, *oldpath;
-	gsize count, newcount;
-	camel_key_t *records, newrecords[256];
+	GArray *records = NULL, *newrecords = NULL;
+	GPtrArray *hash_keys = NULL;
+	GArray *hash_ids = NULL;
+	gint written;
 	struct _CamelTextIndexRoot *rb;
 
 	i = strlen (idx->path) + 16;
@@ -492,6 +689,9 @@ text_index_compress_nosync (CamelIndex *idx)
 	/* Copy undeleted names to new index file, creating new indices */
 	io (printf ("Copying undeleted names to new file\n"));
 	remap = g_hash_table_new (NULL, NULL);
+	/* the hash entries are added in one batch per table at the end */
+	hash_keys = g_ptr_array_new_with_free_func (g_free);
+	hash_ids = g_array_new (FALSE, FALSE, sizeof (camel_key_t));
 	oldkeyid = 0;
 	deleted = 0;
 	while ((oldkeyid = camel_key_table_next (oldp->name_index, oldkeyid, &name, &flags, &data))) {
@@ -502,8 +702,9 @@ text_index_compress_nosync (CamelIndex *idx)
 			if (newkeyid == 0)
 				goto fail;
 			rb->names++;
-			camel_partition_table_add (
-				newp->name_hash, name, newkeyid);
+			g_ptr_array_add (hash_keys, name);
+			g_array_append_val (hash_ids, newkeyid);
+			name = NULL;
 			g_hash_table_insert (remap, GINT_TO_POINTER (oldkeyid), GINT_TO_POINTER (newkeyid));
 		} else {
 			io (printf ("deleted name '%s'\n", name));
@@ -513,56 +714,64 @@ text_index_compress_nosync (CamelIndex *idx)
 		deleted |= flags;
 	}
 
+	if (camel_partition_table_add_many (
+		newp->name_hash, (const gchar * const *) hash_keys->pdata,
+		(camel_key_t *) hash_ids->data, hash_ids->len) == -1)
+		goto fail;
+	g_ptr_array_set_size (hash_keys, 0);
+	g_array_set_size (hash_ids, 0);
+
 	/* Copy word data across, remapping/deleting and create new index for it */
-	/* We re-block the data into 256 entry lots while we're at it, since we only
-	 * have to do 1 at a time and its cheap */
+	/* Each word ends up as one sorted chain of full key blocks */
+	records = g_array_new (FALSE, FALSE, sizeof (camel_key_t));
+	newrecords = g_array_new (FALSE, FALSE, sizeof (camel_key_t));
 	oldkeyid = 0;
 	while ((oldkeyid = camel_key_table_next (oldp->word_index, oldkeyid, &name, &flags, &data))) {
 		io (printf ("copying word '%s'\n", name));
 		newdata = 0;
-		newcount = 0;
-		if (data) {
+		if (data)
 			rb->words++;
-			rb->keys++;
+
+		g_array_set_size (records, 0);
+		g_array_set_size (newrecords, 0);
+		if (text_index_read_postings (oldp, data, records) == -1) {
+			io (printf ("could not read from old keys at %d for word '%s'\n", (gint) data, name));
+			goto fail;
 		}
-		while (data) {
-			if (camel_key_file_read (oldp->links, &data, &count, &records) == -1) {
-				io (printf ("could not read from old keys at %d for word '%s'\n", (gint) data, name));
-				goto fail;
-			}
-			for (i = 0; i < count; i++) {
-				newkeyid = (camel_key_t) GPOINTER_TO_INT (g_hash_table_lookup (remap, GINT_TO_POINTER (records[i])));
-				if (newkeyid) {
-					newrecords[newcount++] = newkeyid;
-					if (newcount == G_N_ELEMENTS (newrecords)) {
-						if (camel_key_file_write (newp->links, &newdata, newcount, newrecords) == -1) {
-							g_free (records);
-							goto fail;
-						}
-						newcount = 0;
-					}
-				}
-			}
-			g_free (records);
+		for (i = 0; i < records->len; i++) {
+			newkeyid = (camel_key_t) GPOINTER_TO_INT (g_hash_table_lookup (remap, GINT_TO_POINTER (g_array_index (records, camel_key_t, i))));
+			if (newkeyid)
+				g_array_append_val (newrecords, newkeyid);
 		}
 
-		if (newcount > 0) {
-			if (camel_key_file_write (newp->links, &newdata, newcount, newrecords) == -1)
-				goto fail;
-		}
+		/* the new keys are not in the same order as the old ones */
+		g_array_set_size (
+			newrecords, text_index_sort_keys (
+			(camel_key_t *) newrecords->data, newrecords->len));
+		written = text_index_write_postings (newp, &newdata, newrecords);
+		if (written == -1)
+			goto fail;
+		rb->keys += written;
+		rb->records += newrecords->len;
 
 		if (newdata != 0) {
 			newkeyid = camel_key_table_add (
 				newp->word_index, name, newdata, flags);
 			if (newkeyid == 0)
 				goto fail;
-			camel_partition_table_add (
-				newp->word_hash, name, newkeyid);
+			g_ptr_array_add (hash_keys, name);
+			g_array_append_val (hash_ids, newkeyid);
+			name = NULL;
 		}
 		g_free (name);
 		name = NULL;
 	}
 
+	if (camel_partition_table_add_many (
+		newp->word_hash, (const gchar * const *) hash_keys->pdata,
+		(camel_key_t *) hash_ids->data, hash_ids->len) == -1)
+		goto fail;
+
 	camel_block_file_touch_block (newp->blocks, newp->blocks->root_block);
 
 	if (camel_index_sync (CAMEL_INDEX (newidx)) == -1)
@@ -580,6 +789,7 @@ text_index_compress_nosync (CamelIndex *idx)
 	/* Poke the private data across to the new object */
 	/* And change the fd's over, etc? */
 	/* Yes: This is a hack */
+	g_rw_lock_writer_lock (&oldp->swap_lock);
 	myswap (newp->blocks, oldp->blocks);
 	myswap (newp->links, oldp->links);
 	myswap (newp->word_index, oldp->word_index);
@@ -587,6 +797,11 @@ text_index_compress_nosync (CamelIndex *idx)
 	myswap (newp->name_index, oldp->name_index);
 	myswap (newp->name_hash, oldp->name_hash);
 	myswap (((CamelIndex *) newidx)->path, ((CamelIndex *) idx)->path);
+
+	g_mutex_lock (&oldp->cursors_lock);
+	g_slist_foreach (oldp->cursors, (GFunc) text_index_cursor_remap, remap);
+	g_mutex_unlock (&oldp->cursors_lock);
+	g_rw_lock_writer_unlock (&oldp->swap_lock);
 #undef myswap
 
 	ret = 0;
@@ -598,6 +813,14 @@ fail:
 	g_object_unref (newidx);
 	g_free (name);
 	g_hash_table_destroy (remap);
+	if (records != NULL)
+		g_array_free (records, TRUE);
+	if (newrecords != NULL)
+		g_array_free (newrecords, TRUE);
+	if (hash_keys != NULL)
+		g_ptr_array_unref (hash_keys);
+	if (hash_ids != NULL)
+		g_array_free (hash_ids, TRUE);
 
 	/* clean up temp files always */
 	sprintf (savepath, "%s~.index", oldpath);
@@ -664,8 +887,13 @@ text_index_has_name (CamelIndex *idx,
                      const gchar *name)
 {
 	CamelTextIndexPrivate *p = CAMEL_TEXT_INDEX_GET_PRIVATE (idx);
+	gint has;
+
+	g_rw_lock_reader_lock (&p->swap_lock);
+	has = camel_partition_table_lookup (p->name_hash, name) != 0;
+	g_rw_lock_reader_unlock (&p->swap_lock);
 
-	return camel_partition_table_lookup (p->name_hash, name) != 0;
+	return has;
 }
 
 static CamelIndexName *
@@ -784,9 +1012,11 @@ text_index_find (CamelIndex *idx,
 	camel_key_t keyid;
 	camel_block_t data = 0;
 	guint flags;
-	CamelIndexCursor *idc;
+	GArray *keys;
 
-	CAMEL_TEXT_INDEX_LOCK (idx, lock);
+	keys = g_array_new (FALSE, FALSE, sizeof (camel_key_t));
+
+	g_rw_lock_reader_lock (&p->swap_lock);
 
 	keyid = camel_partition_table_lookup (p->word_hash, word);
 	if (keyid != 0) {
@@ -796,11 +1026,13 @@ text_index_find (CamelIndex *idx,
 			data = 0;
 	}
 
-	CAMEL_TEXT_INDEX_UNLOCK (idx, lock);
+	/* on a read error we return what could be read; the names
+	 * are only looked up by the cursor, most searches stop early */
+	text_index_read_postings (p, data, keys);
 
-	idc = (CamelIndexCursor *) camel_text_index_cursor_new ((CamelTextIndex *) idx, data);
+	g_rw_lock_reader_unlock (&p->swap_lock);
 
-	return idc;
+	return (CamelIndexCursor *) camel_text_index_cursor_new ((CamelTextIndex *) idx, keys);
 }
 
 static CamelIndexCursor *
@@ -860,6 +1092,8 @@ camel_text_index_init (CamelTextIndex *text_index)
 	text_index->priv->word_cache_limit = 4096; /* 1024 = 128K */
 
 	g_rec_mutex_init (&text_index->priv->lock);
+	g_rw_lock_init (&text_index->priv->swap_lock);
+	g_mutex_init (&text_index->priv->cursors_lock);
 }
 
 static gchar *
@@ -1051,6 +1285,136 @@ camel_text_index_remove (const gchar *old)
 	return ret;
 }
 
+static gint
+text_index_compare_length (gconstpointer a,
+                           gconstpointer b)
+{
+	const GArray *aa = *((GArray * const *) a);
+	const GArray *ab = *((GArray * const *) b);
+
+	return aa->len < ab->len ? -1 : aa->len > ab->len ? 1 : 0;
+}
+
+static void
+text_index_array_free (GArray *array)
+{
+	g_array_free (array, TRUE);
+}
+
+/* Keeps in the sorted @a only the keys also in the sorted @b */
+static void
+text_index_intersect (GArray *a,
+                      GArray *b)
+{
+	guint ia = 0, ib = 0, used = 0;
+
+	while (ia < a->len && ib < b->len) {
+		camel_key_t ka = g_array_index (a, camel_key_t, ia);
+		camel_key_t kb = g_array_index (b, camel_key_t, ib);
+
+		if (ka < kb) {
+			ia++;
+		} else if (ka > kb) {
+			ib++;
+		} else {
+			g_array_index (a, camel_key_t, used++) = ka;
+			ia++;
+			ib++;
+		}
+	}
+
+	g_array_set_size (a, used);
+}
+
+/**
+ * camel_text_index_find_all:
+ * @idx: a #CamelTextIndex
+ * @terms: a %NULL-terminated array of search terms
+ *
+ * Finds the names which, for every one of @terms, contain at least one
+ * word with that term in it, ignoring case.  The vocabulary is scanned
+ * once and the sorted lists of names are merged, so only the names
+ * matching all of @terms are ever looked up.
+ *
+ * Returns: (transfer full) (element-type utf8): the matching names, free
+ * with g_ptr_array_unref()
+ *
+ * Since: 3.10
+ **/
+GPtrArray *
+camel_text_index_find_all (CamelTextIndex *idx,
+                           const gchar * const *terms)
+{
+	CamelTextIndexPrivate *p;
+	GPtrArray *hits, *names;
+	GArray *keys, *result;
+	camel_key_t keyid;
+	camel_block_t data;
+	gchar *word;
+	guint ii, n_terms, flags;
+	gboolean have_keys;
+
+	g_return_val_if_fail (CAMEL_IS_TEXT_INDEX (idx), NULL);
+	g_return_val_if_fail (terms != NULL, NULL);
+
+	p = CAMEL_TEXT_INDEX_GET_PRIVATE (idx);
+
+	n_terms = g_strv_length ((gchar **) terms);
+	if (n_terms == 0)
+		return g_ptr_array_new_with_free_func (g_free);
+
+	hits = g_ptr_array_new_with_free_func ((GDestroyNotify) text_index_array_free);
+	for (ii = 0; ii < n_terms; ii++)
+		g_ptr_array_add (hits, g_array_new (FALSE, FALSE, sizeof (camel_key_t)));
+	keys = g_array_new (FALSE, FALSE, sizeof (camel_key_t));
+
+	g_rw_lock_reader_lock (&p->swap_lock);
+
+	keyid = 0;
+	while ((keyid = camel_key_table_next (p->word_index, keyid, &word, &flags, &data))) {
+		have_keys = FALSE;
+
+		for (ii = 0; ii < n_terms && data != 0 && (flags & 1) == 0; ii++) {
+			if (camel_ustrstrcase (word, terms[ii]) == NULL)
+				continue;
+
+			if (!have_keys) {
+				g_array_set_size (keys, 0);
+				text_index_read_postings (p, data, keys);
+				have_keys = TRUE;
+			}
+
+			g_array_append_vals (hits->pdata[ii], keys->data, keys->len);
+		}
+
+		g_free (word);
+	}
+
+	/* every term now has the names of all its words, sort those
+	 * and merge them, starting with the shortest */
+	for (ii = 0; ii < n_terms; ii++) {
+		result = hits->pdata[ii];
+		g_array_set_size (
+			result, text_index_sort_keys (
+			(camel_key_t *) result->data, result->len));
+	}
+
+	g_ptr_array_sort (hits, text_index_compare_length);
+
+	result = hits->pdata[0];
+	for (ii = 1; ii < n_terms && result->len > 0; ii++)
+		text_index_intersect (result, hits->pdata[ii]);
+
+	names = text_index_resolve_names (p, result);
+
+	g_rw_lock_reader_unlock (&p->swap_lock);
+
+	g_array_free (keys, TRUE);
+	g_ptr_array_unref (hits);
+
+	return names;
+}
+
 /* Debug */
 void
 camel_text_index_info (CamelTextIndex *idx)
@@ -1066,6 +1430,8 @@ camel_text_index_info (CamelTextIndex *idx)
 	printf ("Total names: %u\n", rb->names);
 	printf ("Total deleted: %u\n", rb->deleted);
 	printf ("Total key blocks: %u\n", rb->keys);
+	printf ("Total name references: %u\n", rb->records);
+	printf ("Replaced name references: %u\n", rb->dead);
 
 	if (rb->words > 0) {
 		frag = ((rb->keys - rb->words) * 100)/ rb->words;
@@ -1419,7 +1785,7 @@ camel_text_index_validate (CamelTextIndex *idx)
 
 		while (data) {
 			printf (" data %x ", data);
-			if (camel_key_file_read (p->links, &data, &count, &records) == -1) {
+			if (camel_key_file_read_packed (p->links, &data, &count, &records) == -1) {
 				printf ("Warning, read failed for word '%s', at data '%u'\n", word, data);
 				data = 0;
 			} else {
@@ -1633,6 +1999,24 @@ camel_text_index_name_new (CamelTextIndex *idx,
 
 G_DEFINE_TYPE (CamelTextIndexCursor, camel_text_index_cursor, CAMEL_TYPE_INDEX_CURSOR)
 
+static void
+text_index_cursor_dispose (GObject *object)
+{
+	CamelIndexCursor *idc = CAMEL_INDEX_CURSOR (object);
+
+	/* the parent drops the index */
+	if (idc->index != NULL) {
+		CamelTextIndexPrivate *ip = CAMEL_TEXT_INDEX_GET_PRIVATE (idc->index);
+
+		g_mutex_lock (&ip->cursors_lock);
+		ip->cursors = g_slist_remove (ip->cursors, object);
+		g_mutex_unlock (&ip->cursors_lock);
+	}
+
+	/* Chain up to parent's dispose() method. */
+	G_OBJECT_CLASS (camel_text_index_cursor_parent_class)->dispose (object);
+}
+
 static void
 text_index_cursor_finalize (GObject *object)
 {
@@ -1640,8 +2024,8 @@ text_index_cursor_finalize (GObject *object)
 
 	priv = CAMEL_TEXT_INDEX_CURSOR_GET_PRIVATE (object);
 
-	g_free (priv->records);
-	g_free (priv->current);
+	g_array_free (priv->keys, TRUE);
+	g_free (priv->name);
 
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (camel_text_index_cursor_parent_class)->finalize (object);
@@ -1651,35 +2035,49 @@ static const gchar *
 text_index_cursor_next (CamelIndexCursor *idc)
 {
 	CamelTextIndexCursorPrivate *p = CAMEL_TEXT_INDEX_CURSOR_GET_PRIVATE (idc);
-	CamelTextIndexPrivate *tip = CAMEL_TEXT_INDEX_GET_PRIVATE (idc->index);
+	CamelTextIndexPrivate *ip = CAMEL_TEXT_INDEX_GET_PRIVATE (idc->index);
+	camel_key_t keyid;
 	guint flags;
 
-	c (printf ("Going to next cursor for word with data '%08x' next %08x\n", p->first, p->next));
-
-	do {
-		while (p->record_index >= p->record_count) {
-			g_free (p->records);
-			p->records = NULL;
-			p->record_index = 0;
-			p->record_count = 0;
-			if (p->next == 0)
-				return NULL;
-			if (camel_key_file_read (tip->links, &p->next, &p->record_count, &p->records) == -1)
-				return NULL;
-		}
+	c (printf ("Going to next cursor name %u of %u\n", p->index, p->keys->len));
 
-		g_free (p->current);
-		camel_key_table_lookup (
-			tip->name_index, p->records[p->record_index],
-			&p->current, &flags);
+	g_free (p->name);
+	p->name = NULL;
+
+	g_rw_lock_reader_lock (&ip->swap_lock);
+
+	/* skip names deleted since, or dropped by a compression */
+	while (p->name == NULL && p->index < p->keys->len) {
+		keyid = g_array_index (p->keys, camel_key_t, p->index++);
+		if (keyid == 0)
+			continue;
+
+		camel_key_table_lookup (ip->name_index, keyid, &p->name, &flags);
 		if (flags & 1) {
-			g_free (p->current);
-			p->current = NULL;
+			g_free (p->name);
+			p->name = NULL;
 		}
-		p->record_index++;
-	} while (p->current == NULL);
+	}
 
-	return p->current;
+	g_rw_lock_reader_unlock (&ip->swap_lock);
+
+	return p->name;
+}
+
+/* Called with the index's swap_lock held for writing, once the new
+ * files are in place; 'remap' maps the old name ids to the new ones */
+static void
+text_index_cursor_remap (CamelTextIndexCursor *idc,
+                         GHashTable *remap)
+{
+	CamelTextIndexCursorPrivate *p = CAMEL_TEXT_INDEX_CURSOR_GET_PRIVATE (idc);
+	guint ii;
+
+	for (ii = 0; ii < p->keys->len; ii++) {
+		camel_key_t *keyid = &g_array_index (p->keys, camel_key_t, ii);
+
+		*keyid = GPOINTER_TO_INT (g_hash_table_lookup (remap, GINT_TO_POINTER (*keyid)));
+	}
 }
 
 static void
@@ -1687,13 +2085,7 @@ text_index_cursor_reset (CamelIndexCursor *idc)
 {
 	CamelTextIndexCursorPrivate *p = CAMEL_TEXT_INDEX_CURSOR_GET_PRIVATE (idc);
 
-	g_free (p->records);
-	p->records = NULL;
-	g_free (p->current);
-	p->current = NULL;
-	p->record_count = 0;
-	p->record_index = 0;
-	p->next = p->first;
+	p->index = 0;
 }
 
 static void
@@ -1705,6 +2097,7 @@ camel_text_index_cursor_class_init (CamelTextIndexCursorClass *class)
 	g_type_class_add_private (class, sizeof (CamelTextIndexCursorPrivate));
 
 	object_class = G_OBJECT_CLASS (class);
+	object_class->dispose = text_index_cursor_dispose;
 	object_class->finalize = text_index_cursor_finalize;
 
 	index_cursor_class = CAMEL_INDEX_CURSOR_CLASS (class);
@@ -1719,19 +2112,23 @@ camel_text_index_cursor_init (CamelTextIndexCursor *text_index_cursor)
 		CAMEL_TEXT_INDEX_CURSOR_GET_PRIVATE (text_index_cursor);
 }
 
+/* takes ownership of @keys */
 CamelTextIndexCursor *
 camel_text_index_cursor_new (CamelTextIndex *idx,
-                             camel_block_t data)
+                             GArray *keys)
 {
 	CamelTextIndexCursor *idc = g_object_new (CAMEL_TYPE_TEXT_INDEX_CURSOR, NULL);
 	CamelIndexCursor *cic = &idc->parent;
 	CamelTextIndexCursorPrivate *p = CAMEL_TEXT_INDEX_CURSOR_GET_PRIVATE (idc);
+	CamelTextIndexPrivate *ip = CAMEL_TEXT_INDEX_GET_PRIVATE (idx);
 
 	cic->index = g_object_ref (idx);
-	p->first = data;
-	p->next = data;
-	p->record_count = 0;
-	p->record_index = 0;
+	p->keys = keys;
+	p->index = 0;
+
+	g_mutex_lock (&ip->cursors_lock);
+	ip->cursors = g_slist_prepend (ip->cursors, idc);
+	g_mutex_unlock (&ip->cursors_lock);
 
 	return idc;
 }
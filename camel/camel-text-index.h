@@ -175,6 +175,8 @@ struct _CamelTextIndexClass {
 GType		camel_text_index_get_type	(void);
 CamelTextIndex *camel_text_index_new		(const gchar *path,
 						 gint flags);
+GPtrArray *	camel_text_index_find_all	(CamelTextIndex *idx,
+						 const gchar * const *terms);
 
 /* static utility functions */
 gint		camel_text_index_check		(const gchar *path);
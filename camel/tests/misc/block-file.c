@@ -0,0 +1,134 @@
+/* Writes a few thousand blocks through CamelBlockFile, with a block
+ * cache much smaller than that, and checks they read back the same
+ * before and after the file is reopened. */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "camel-test.h"
+
+#define N_BLOCKS 3000
+#define VERSION "TEST.000"
+
+static void
+fill_block (CamelBlock *bl,
+            gint index)
+{
+	guint32 *words = (guint32 *) bl->data;
+	guint ii;
+
+	for (ii = 0; ii < CAMEL_BLOCK_SIZE / sizeof (guint32); ii++)
+		words[ii] = index * 7919 + ii;
+}
+
+static gboolean
+check_block (CamelBlock *bl,
+             gint index)
+{
+	guint32 *words = (guint32 *) bl->data;
+	guint ii;
+
+	for (ii = 0; ii < CAMEL_BLOCK_SIZE / sizeof (guint32); ii++) {
+		if (words[ii] != index * 7919 + ii)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+check_blocks (CamelBlockFile *bs,
+              camel_block_t *ids)
+{
+	CamelBlock *bl;
+	gint ii;
+
+	for (ii = 0; ii < N_BLOCKS; ii++) {
+		bl = camel_block_file_get_block (bs, ids[ii]);
+		check (bl != NULL);
+		check_msg (check_block (bl, ii), "block %d (%08x) differs", ii, ids[ii]);
+		camel_block_file_unref_block (bs, bl);
+	}
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelBlockFile *bs;
+	CamelBlock *bl;
+	camel_block_t ids[N_BLOCKS], last;
+	guint hits, misses, writes, syncs;
+	gchar *path;
+	gint ii;
+
+	camel_test_init (argc, argv);
+
+	path = g_build_filename (g_get_tmp_dir (), "camel-block-file-test", NULL);
+
+	camel_test_start ("Block file");
+
+	camel_test_push ("writing %d blocks", N_BLOCKS);
+	bs = camel_block_file_new (path, O_RDWR | O_CREAT | O_TRUNC, VERSION, CAMEL_BLOCK_SIZE);
+	check (bs != NULL);
+	bs->block_cache_limit = 64;
+
+	for (ii = 0; ii < N_BLOCKS; ii++) {
+		bl = camel_block_file_new_block (bs);
+		check (bl != NULL);
+		ids[ii] = bl->id;
+		fill_block (bl, ii);
+		camel_block_file_touch_block (bs, bl);
+		camel_block_file_unref_block (bs, bl);
+	}
+	check (camel_block_file_sync (bs) == 0);
+
+	camel_block_file_get_stats (bs, NULL, NULL, &writes, &syncs);
+	check (writes >= N_BLOCKS);
+	check (syncs > 0);
+	camel_test_pull ();
+
+	camel_test_push ("reading them back");
+	check_blocks (bs, ids);
+
+	bl = camel_block_file_get_block (bs, ids[N_BLOCKS - 1]);
+	check (bl != NULL);
+	camel_block_file_unref_block (bs, bl);
+
+	camel_block_file_get_stats (bs, &hits, &misses, NULL, NULL);
+	check (hits > 0);
+	check (misses > N_BLOCKS / 2);
+	camel_test_pull ();
+
+	camel_test_push ("rewriting some and reopening");
+	for (ii = 0; ii < N_BLOCKS; ii += 3) {
+		bl = camel_block_file_get_block (bs, ids[ii]);
+		check (bl != NULL);
+		fill_block (bl, ii);
+		camel_block_file_touch_block (bs, bl);
+		camel_block_file_unref_block (bs, bl);
+	}
+
+	last = bs->root->last;
+	g_object_unref (bs);
+
+	bs = camel_block_file_new (path, O_RDWR, VERSION, CAMEL_BLOCK_SIZE);
+	check (bs != NULL);
+	/* the root block would have been reset if the file did not validate */
+	check (bs->root->last == last);
+	check_blocks (bs, ids);
+	camel_test_pull ();
+
+	camel_block_file_delete (bs);
+	g_object_unref (bs);
+
+	camel_test_end ();
+
+	g_free (path);
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+/* Indexes message bodies with camel_db_write_body_index_record (),
+ * checks what camel_db_search_body_index () finds before and after
+ * some of the messages are deleted, and prints how long a search
+ * takes.  Also checks the words and texts read back from the index. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "camel-test.h"
+
+#define N_MESSAGES 20000
+#define FOLDER_NAME "body-index"
+
+static const gchar *words[] = {
+	"invoice", "meeting", "holiday", "release", "report",
+	"budget", "schedule", "review", "lunch", "travel"
+};
+
+static gchar *
+message_text (gint index)
+{
+	return g_strdup_printf (
+		"Hello,\nthis is about the %s and the %s, number %d.\n",
+		words[index % G_N_ELEMENTS (words)],
+		words[(index / 10) % G_N_ELEMENTS (words)],
+		index);
+}
+
+static guint
+search_count (CamelDB *cdb,
+              const gchar *match)
+{
+	GPtrArray *uids;
+	guint count;
+
+	uids = camel_db_search_body_index (cdb, FOLDER_NAME, match, NULL);
+	check (uids != NULL);
+
+	count = uids->len;
+	g_ptr_array_unref (uids);
+
+	return count;
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelDB *cdb;
+	GHashTable *indexed;
+	GPtrArray *terms;
+	GList *deleted = NULL;
+	GTimer *timer;
+	gchar *path, *text, *expected;
+	gint ii, ret = 0;
+
+	camel_test_init (argc, argv);
+
+	path = g_build_filename (g_get_tmp_dir (), "camel-db-body-index-test.db", NULL);
+	g_unlink (path);
+
+	cdb = camel_db_open (path, NULL);
+	check (cdb != NULL);
+
+	check (camel_db_prepare_message_info_table (cdb, FOLDER_NAME, NULL) == 0);
+
+	camel_test_start ("Full-text index of message bodies");
+
+	camel_test_push ("indexing %d messages", N_MESSAGES);
+	check (camel_db_begin_transaction (cdb, NULL) == 0);
+	for (ii = 0; ii < N_MESSAGES && ret == 0; ii++) {
+		gchar *uid = g_strdup_printf ("%d", ii);
+		gchar *text = message_text (ii);
+
+		ret = camel_db_write_body_index_record (cdb, FOLDER_NAME, uid, text, NULL);
+
+		g_free (text);
+		g_free (uid);
+	}
+	check (camel_db_end_transaction (cdb, NULL) == 0);
+	camel_test_pull ();
+
+	if (ret != 0) {
+		/* SQLite without FTS4, nothing more to check */
+		printf ("Full-text search is not available, skipping\n");
+		camel_test_end ();
+		goto exit;
+	}
+
+	camel_test_push ("searching");
+	check (camel_db_has_body_index_record (cdb, FOLDER_NAME, "0"));
+	check (!camel_db_has_body_index_record (cdb, FOLDER_NAME, "no-such-uid"));
+
+	timer = g_timer_new ();
+	check (search_count (cdb, "\"invoice\"") == N_MESSAGES / 10 + N_MESSAGES / 10 - N_MESSAGES / 100);
+	printf (
+		"%d messages: one word found in %.3fs\n",
+		N_MESSAGES, g_timer_elapsed (timer, NULL));
+	g_timer_destroy (timer);
+
+	check (search_count (cdb, "\"invoice\" \"meeting\"") == N_MESSAGES / 100 * 2);
+	check (search_count (cdb, "\"holi*\"") == N_MESSAGES / 10 + N_MESSAGES / 10 - N_MESSAGES / 100);
+	check (search_count (cdb, "\"nothing-like-this\"") == 0);
+	camel_test_pull ();
+
+	camel_test_push ("reading words and texts");
+	terms = camel_db_get_body_index_words (cdb, FOLDER_NAME, NULL);
+	check (terms != NULL);
+	for (ii = 0; ii < terms->len; ii++) {
+		check_msg (strcmp (terms->pdata[ii], "Hello") != 0, "word not in lower case");
+		if (strcmp (terms->pdata[ii], "hello") == 0)
+			break;
+	}
+	check (ii < terms->len);
+	g_ptr_array_unref (terms);
+
+	expected = message_text (1);
+	text = camel_db_read_body_index_text (cdb, FOLDER_NAME, "1", NULL);
+	check (g_strcmp0 (text, expected) == 0);
+	g_free (expected);
+	g_free (text);
+	check (camel_db_read_body_index_text (cdb, FOLDER_NAME, "no-such-uid", NULL) == NULL);
+	camel_test_pull ();
+
+	camel_test_push ("replacing and deleting");
+	check (camel_db_begin_transaction (cdb, NULL) == 0);
+	check (camel_db_write_body_index_record (cdb, FOLDER_NAME, "0", "Replaced text", NULL) == 0);
+	check (camel_db_end_transaction (cdb, NULL) == 0);
+	check (search_count (cdb, "\"replaced\"") == 1);
+
+	for (ii = 1; ii < 100; ii++)
+		deleted = g_list_prepend (deleted, g_strdup_printf ("%d", ii));
+	check (camel_db_delete_uids (cdb, FOLDER_NAME, deleted, NULL) == 0);
+	g_list_free_full (deleted, g_free);
+
+	indexed = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify) camel_pstring_free, NULL);
+	check (camel_db_get_body_index_uids (cdb, FOLDER_NAME, indexed, NULL) == 0);
+	check (g_hash_table_size (indexed) == N_MESSAGES - 99);
+	check (!g_hash_table_contains (indexed, "50"));
+	g_hash_table_destroy (indexed);
+	camel_test_pull ();
+
+	camel_test_end ();
+
+ exit:
+	camel_db_close (cdb);
+	g_unlink (path);
+	g_free (path);
+
+	return 0;
+}
@@ -0,0 +1,194 @@
+/* Walks a folder a window at a time with camel_db_get_folder_uids_range (),
+ * by date and by uid, and checks that every uid comes exactly once and in
+ * order, also when the last uid of a window is deleted before the next
+ * window is read. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "camel-test.h"
+
+#define N_RECORDS 1000
+#define WINDOW 64
+#define FOLDER_NAME "uids-range"
+
+/* three messages share each date, so the uid has to break ties */
+static gint64
+record_dsent (gint index)
+{
+	return 1356998400 + (index / 3) * 60;
+}
+
+static gint64
+uid_dsent (const gchar *uid)
+{
+	return record_dsent (strtol (uid, NULL, 10) - 1);
+}
+
+static void
+write_records (CamelDB *cdb)
+{
+	gint ii;
+
+	check (camel_db_prepare_message_info_table (cdb, FOLDER_NAME, NULL) == 0);
+	check (camel_db_begin_transaction (cdb, NULL) == 0);
+
+	/* written in reverse, so the rowid order is no help */
+	for (ii = N_RECORDS - 1; ii >= 0; ii--) {
+		CamelMIRecord record;
+
+		memset (&record, 0, sizeof (CamelMIRecord));
+		record.uid = g_strdup_printf ("%d", ii + 1);
+		record.dsent = record_dsent (ii);
+		record.dreceived = record.dsent;
+
+		check (camel_db_write_message_info_record (cdb, FOLDER_NAME, &record, NULL) == 0);
+
+		g_free (record.uid);
+	}
+
+	check (camel_db_end_transaction (cdb, NULL) == 0);
+}
+
+/* Reads the whole folder, checking the order, and returns how
+ * many uids it has */
+static guint
+walk_folder (CamelDB *cdb,
+             const gchar *sort_by,
+             gboolean ascending)
+{
+	GHashTable *seen;
+	gchar *after_uid = NULL;
+	gint64 last_dsent = ascending ? G_MININT64 : G_MAXINT64;
+	guint count;
+
+	seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	while (TRUE) {
+		GPtrArray *uids;
+		guint ii;
+
+		uids = camel_db_get_folder_uids_range (
+			cdb, FOLDER_NAME, sort_by, NULL, ascending,
+			after_uid, NULL, WINDOW, NULL);
+		check (uids != NULL);
+		check (uids->len <= WINDOW);
+
+		for (ii = 0; ii < uids->len; ii++) {
+			const gchar *uid = uids->pdata[ii];
+
+			check_msg (!g_hash_table_contains (seen, uid), "uid '%s' returned twice", uid);
+			g_hash_table_add (seen, g_strdup (uid));
+
+			if (sort_by != NULL) {
+				gint64 dsent = uid_dsent (uid);
+
+				check_msg (
+					ascending ? dsent >= last_dsent : dsent <= last_dsent,
+					"uid '%s' out of order", uid);
+				last_dsent = dsent;
+			} else if (after_uid != NULL || ii > 0) {
+				const gchar *prev = ii > 0 ? uids->pdata[ii - 1] : after_uid;
+
+				check_msg (
+					ascending ? strcmp (uid, prev) > 0 : strcmp (uid, prev) < 0,
+					"uid '%s' out of order", uid);
+			}
+		}
+
+		if (uids->len == 0) {
+			g_ptr_array_unref (uids);
+			break;
+		}
+
+		g_free (after_uid);
+		after_uid = g_strdup (uids->pdata[uids->len - 1]);
+		g_ptr_array_unref (uids);
+	}
+
+	count = g_hash_table_size (seen);
+
+	g_hash_table_destroy (seen);
+	g_free (after_uid);
+
+	return count;
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelDB *cdb;
+	GPtrArray *first, *next, *after;
+	GError *error = NULL;
+	gchar *path, *anchor, *anchor_value;
+
+	camel_test_init (argc, argv);
+
+	path = g_build_filename (g_get_tmp_dir (), "camel-db-uids-range-test.db", NULL);
+	g_unlink (path);
+
+	cdb = camel_db_open (path, NULL);
+	check (cdb != NULL);
+
+	camel_test_start ("Reading uid ranges");
+
+	write_records (cdb);
+
+	camel_test_push ("by date");
+	check (walk_folder (cdb, "dsent", TRUE) == N_RECORDS);
+	check (walk_folder (cdb, "dsent", FALSE) == N_RECORDS);
+	camel_test_pull ();
+
+	camel_test_push ("by uid");
+	check (walk_folder (cdb, NULL, TRUE) == N_RECORDS);
+	check (walk_folder (cdb, NULL, FALSE) == N_RECORDS);
+	camel_test_pull ();
+
+	camel_test_push ("after a deleted uid");
+	first = camel_db_get_folder_uids_range (
+		cdb, FOLDER_NAME, "dsent", NULL, TRUE, NULL, NULL, WINDOW, NULL);
+	check (first != NULL && first->len == WINDOW);
+
+	anchor = g_strdup (first->pdata[WINDOW - 1]);
+	anchor_value = g_strdup_printf ("%" G_GINT64_FORMAT, uid_dsent (anchor));
+
+	next = camel_db_get_folder_uids_range (
+		cdb, FOLDER_NAME, "dsent", NULL, TRUE, anchor, NULL, WINDOW, NULL);
+	check (next != NULL && next->len == WINDOW);
+
+	check (camel_db_delete_uid (cdb, FOLDER_NAME, anchor, NULL) == 0);
+
+	after = camel_db_get_folder_uids_range (
+		cdb, FOLDER_NAME, "dsent", NULL, TRUE, anchor, NULL, WINDOW, &error);
+	check (after == NULL);
+	check (error != NULL);
+	g_clear_error (&error);
+
+	after = camel_db_get_folder_uids_range (
+		cdb, FOLDER_NAME, "dsent", NULL, TRUE, anchor, anchor_value, WINDOW, NULL);
+	check (after != NULL && after->len == WINDOW);
+	check_msg (
+		strcmp (after->pdata[0], next->pdata[0]) == 0,
+		"window continues at '%s' rather than '%s'",
+		(gchar *) after->pdata[0], (gchar *) next->pdata[0]);
+
+	g_ptr_array_unref (first);
+	g_ptr_array_unref (next);
+	g_ptr_array_unref (after);
+	g_free (anchor);
+	g_free (anchor_value);
+	camel_test_pull ();
+
+	camel_test_end ();
+
+	camel_db_close (cdb);
+	g_unlink (path);
+	g_free (path);
+
+	return 0;
+}
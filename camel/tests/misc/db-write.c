@@ -0,0 +1,167 @@
+/* Writes message info records into a CamelDB, once with the SQL text
+ * built for every record, the way write_mir () used to, and once
+ * through camel_db_write_message_info_record () with its prepared
+ * statements, and prints how long either takes. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "camel-test.h"
+
+#define N_RECORDS 100000
+
+static void
+fill_record (CamelMIRecord *record,
+             gint index)
+{
+	memset (record, 0, sizeof (CamelMIRecord));
+
+	record->uid = g_strdup_printf ("%d", index + 1);
+	record->flags = index % 64;
+	record->read = index % 2;
+	record->junk = (index % 17) == 0;
+	record->size = 1024 + index;
+	record->dsent = 1356998400 + index * 60;
+	record->dreceived = record->dsent + 30;
+	record->subject = g_strdup_printf ("Message number %d", index);
+	record->from = g_strdup ("Sender <sender@example.com>");
+	record->to = g_strdup ("Recipient <recipient@example.com>");
+	record->part = g_strdup_printf ("1 %d 2 3 4", index);
+	record->bodystructure = g_strdup ("(\"TEXT\" \"PLAIN\" NIL NIL NIL \"7BIT\" 10 1)");
+}
+
+static gint
+write_mir_text (CamelDB *cdb,
+                const gchar *folder_name,
+                CamelMIRecord *record)
+{
+	gchar *query;
+	gint ret;
+
+	query = sqlite3_mprintf (
+		"INSERT OR REPLACE INTO %Q VALUES ("
+		"%Q, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, "
+		"%lld, %lld, %Q, %Q, %Q, %Q, %Q, %Q, %Q, %Q, "
+		"%Q, %Q, %Q, %Q, %Q, "
+		"strftime(\"%%s\", 'now'), "
+		"strftime(\"%%s\", 'now') )",
+		folder_name, record->uid, record->flags, record->msg_type,
+		record->read, record->deleted, record->replied,
+		record->important, record->junk, record->attachment,
+		record->dirty, record->size,
+		(gint64) record->dsent, (gint64) record->dreceived,
+		record->subject, record->from, record->to, record->cc,
+		record->mlist, record->followup_flag,
+		record->followup_completed_on, record->followup_due_by,
+		record->part, record->labels, record->usertags,
+		record->cinfo, record->bdata);
+	ret = camel_db_add_to_transaction (cdb, query, NULL);
+	sqlite3_free (query);
+
+	if (ret == 0) {
+		query = sqlite3_mprintf (
+			"INSERT OR REPLACE INTO '%q_bodystructure' VALUES (%Q, %Q )",
+			folder_name, record->uid, record->bodystructure);
+		ret = camel_db_add_to_transaction (cdb, query, NULL);
+		sqlite3_free (query);
+	}
+
+	return ret;
+}
+
+static gdouble
+write_records (CamelDB *cdb,
+               const gchar *folder_name,
+               gboolean prepared)
+{
+	GTimer *timer;
+	gdouble elapsed;
+	guint32 count = 0;
+	gint ii;
+
+	check (camel_db_prepare_message_info_table (cdb, folder_name, NULL) == 0);
+
+	timer = g_timer_new ();
+
+	check (camel_db_begin_transaction (cdb, NULL) == 0);
+
+	for (ii = 0; ii < N_RECORDS; ii++) {
+		CamelMIRecord record;
+		gint ret;
+
+		fill_record (&record, ii);
+
+		if (prepared)
+			ret = camel_db_write_message_info_record (cdb, folder_name, &record, NULL);
+		else
+			ret = write_mir_text (cdb, folder_name, &record);
+
+		check (ret == 0);
+
+		g_free (record.uid);
+		g_free (record.subject);
+		g_free (record.from);
+		g_free (record.to);
+		g_free (record.part);
+		g_free (record.bodystructure);
+	}
+
+	check (camel_db_end_transaction (cdb, NULL) == 0);
+
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	check (camel_db_count_total_message_info (cdb, folder_name, &count, NULL) == 0);
+	check (count == N_RECORDS);
+
+	count = 0;
+	check (camel_db_count_junk_message_info (cdb, folder_name, &count, NULL) == 0);
+	check (count == (N_RECORDS + 16) / 17);
+
+	return elapsed;
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelDB *cdb;
+	gchar *path;
+	gdouble text_time, prepared_time;
+
+	camel_test_init (argc, argv);
+
+	path = g_build_filename (g_get_tmp_dir (), "camel-db-write-test.db", NULL);
+	g_unlink (path);
+
+	cdb = camel_db_open (path, NULL);
+	check (cdb != NULL);
+
+	camel_test_start ("Writing message info records");
+
+	camel_test_push ("SQL text per record");
+	text_time = write_records (cdb, "text", FALSE);
+	camel_test_pull ();
+
+	camel_test_push ("prepared statements");
+	prepared_time = write_records (cdb, "prepared", TRUE);
+	camel_test_pull ();
+
+	printf (
+		"%d records: SQL text %.3fs (%.0f/s), prepared %.3fs (%.0f/s)\n",
+		N_RECORDS,
+		text_time, N_RECORDS / text_time,
+		prepared_time, N_RECORDS / prepared_time);
+
+	camel_test_end ();
+
+	camel_db_close (cdb);
+	g_unlink (path);
+	g_free (path);
+
+	return 0;
+}
@@ -0,0 +1,140 @@
+/* Adds keys to a CamelPartitionTable, half of them one at a time and
+ * half in one batch, enough for both the key blocks and the partition
+ * map to split, and checks lookups of present, missing and removed
+ * keys before and after the file is reopened. */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "camel-test.h"
+
+#define N_KEYS 20000
+#define VERSION "TEST.000"
+
+static gchar *
+key_name (gint index)
+{
+	return g_strdup_printf ("key-%d", index);
+}
+
+static void
+check_keys (CamelPartitionTable *cpi,
+            gboolean removed)
+{
+	gint ii;
+
+	for (ii = 0; ii < N_KEYS; ii++) {
+		gchar *key = key_name (ii);
+		camel_key_t keyid = camel_partition_table_lookup (cpi, key);
+
+		if (removed && ii % 10 == 0)
+			check_msg (keyid == 0, "removed key '%s' found", key);
+		else
+			check_msg (keyid == ii + 1, "key '%s' maps to %u", key, keyid);
+		g_free (key);
+
+		key = g_strdup_printf ("missing-%d", ii);
+		check_msg (camel_partition_table_lookup (cpi, key) == 0, "missing key '%s' found", key);
+		g_free (key);
+	}
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelBlockFile *bs;
+	CamelPartitionTable *cpi;
+	CamelBlock *bl;
+	camel_block_t root;
+	GPtrArray *keys;
+	GArray *keyids;
+	GTimer *timer;
+	gchar *path;
+	gint ii;
+
+	camel_test_init (argc, argv);
+
+	path = g_build_filename (g_get_tmp_dir (), "camel-partition-table-test", NULL);
+
+	camel_test_start ("Partition table");
+
+	camel_test_push ("adding %d keys", N_KEYS);
+	bs = camel_block_file_new (path, O_RDWR | O_CREAT | O_TRUNC, VERSION, CAMEL_BLOCK_SIZE);
+	check (bs != NULL);
+
+	bl = camel_block_file_new_block (bs);
+	check (bl != NULL);
+	root = bl->id;
+	camel_block_file_unref_block (bs, bl);
+
+	cpi = camel_partition_table_new (bs, root);
+	check (cpi != NULL);
+
+	for (ii = 0; ii < N_KEYS / 2; ii++) {
+		gchar *key = key_name (ii);
+
+		check (camel_partition_table_add (cpi, key, ii + 1) == 0);
+		g_free (key);
+	}
+
+	keys = g_ptr_array_new_with_free_func (g_free);
+	keyids = g_array_new (FALSE, FALSE, sizeof (camel_key_t));
+	for (; ii < N_KEYS; ii++) {
+		camel_key_t keyid = ii + 1;
+
+		g_ptr_array_add (keys, key_name (ii));
+		g_array_append_val (keyids, keyid);
+	}
+	check (camel_partition_table_add_many (
+		cpi, (const gchar * const *) keys->pdata,
+		(camel_key_t *) keyids->data, keyids->len) == 0);
+	g_ptr_array_unref (keys);
+	g_array_free (keyids, TRUE);
+	camel_test_pull ();
+
+	camel_test_push ("lookups");
+	timer = g_timer_new ();
+	check_keys (cpi, FALSE);
+	printf (
+		"%d keys: %d lookups in %.3fs\n",
+		N_KEYS, N_KEYS * 2, g_timer_elapsed (timer, NULL));
+	g_timer_destroy (timer);
+	camel_test_pull ();
+
+	camel_test_push ("lookups after removing keys");
+	for (ii = 0; ii < N_KEYS; ii += 10) {
+		gchar *key = key_name (ii);
+
+		check (camel_partition_table_remove (cpi, key));
+		g_free (key);
+	}
+	check_keys (cpi, TRUE);
+	camel_test_pull ();
+
+	camel_test_push ("lookups after reopening");
+	check (camel_partition_table_sync (cpi) == 0);
+	g_object_unref (cpi);
+	g_object_unref (bs);
+
+	bs = camel_block_file_new (path, O_RDWR, VERSION, CAMEL_BLOCK_SIZE);
+	check (bs != NULL);
+	cpi = camel_partition_table_new (bs, root);
+	check (cpi != NULL);
+	check_keys (cpi, TRUE);
+	camel_test_pull ();
+
+	g_object_unref (cpi);
+	camel_block_file_delete (bs);
+	g_object_unref (bs);
+
+	camel_test_end ();
+
+	g_free (path);
+
+	return 0;
+}
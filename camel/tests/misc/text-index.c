@@ -0,0 +1,275 @@
+/* Indexes a generated corpus with CamelTextIndex, in several synced
+ * batches so the word lists get fragmented and compacted, and checks
+ * what single and multi-word lookups find, also through a cursor
+ * opened before a compression.  Given the path of a maildir
+ * it indexes the messages in it instead and prints how long indexing
+ * and a few lookups take. */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "camel-test.h"
+
+#define N_MESSAGES 20000
+#define N_BATCHES 5
+
+static const gchar *words[] = {
+	"invoice", "meeting", "holiday", "release", "report",
+	"budget", "schedule", "review", "lunch", "travel"
+};
+
+static void
+index_text (CamelIndex *idx,
+            const gchar *name,
+            const gchar *text,
+            gsize len)
+{
+	CamelIndexName *idn;
+
+	idn = camel_index_add_name (idx, name);
+	camel_index_name_add_buffer (idn, text, len);
+	camel_index_write_name (idx, idn);
+	g_object_unref (idn);
+}
+
+static guint
+count_find (CamelIndex *idx,
+            const gchar *word)
+{
+	CamelIndexCursor *idc;
+	guint count = 0;
+
+	idc = camel_index_find (idx, word);
+	while (camel_index_cursor_next (idc) != NULL)
+		count++;
+	g_object_unref (idc);
+
+	return count;
+}
+
+static guint
+count_find_all (CamelIndex *idx,
+                const gchar *first,
+                ...)
+{
+	GPtrArray *terms, *names;
+	const gchar *term;
+	va_list ap;
+	guint count;
+
+	terms = g_ptr_array_new ();
+	va_start (ap, first);
+	for (term = first; term != NULL; term = va_arg (ap, const gchar *))
+		g_ptr_array_add (terms, (gpointer) term);
+	va_end (ap);
+	g_ptr_array_add (terms, NULL);
+
+	names = camel_text_index_find_all (CAMEL_TEXT_INDEX (idx), (const gchar * const *) terms->pdata);
+	check (names != NULL);
+	count = names->len;
+
+	g_ptr_array_unref (names);
+	g_ptr_array_free (terms, TRUE);
+
+	return count;
+}
+
+/* With @deleted, names 1 to 99 are gone: 18 of them had invoice,
+ * 10 and 1 had both invoice and meeting. */
+static void
+check_generated (CamelIndex *idx,
+                 gboolean deleted)
+{
+	/* one in ten messages has a word first, one in ten second,
+	 * one in a hundred both */
+	check_msg (
+		count_find (idx, "invoice") == N_MESSAGES / 5 - N_MESSAGES / 100 - (deleted ? 18 : 0),
+		"invoice found %u times", count_find (idx, "invoice"));
+	check (count_find (idx, "hello") == N_MESSAGES - (deleted ? 99 : 0));
+	check (count_find (idx, "nothing") == 0);
+
+	check (count_find_all (idx, "voic", NULL) == count_find (idx, "invoice"));
+	check (count_find_all (idx, "invoice", "meeting", NULL) == N_MESSAGES / 100 * 2 - (deleted ? 2 : 0));
+	check (count_find_all (idx, "INVOICE", "hello", NULL) == count_find (idx, "invoice"));
+	check (count_find_all (idx, "invoice", "nothing", NULL) == 0);
+}
+
+static void
+test_generated (const gchar *path)
+{
+	CamelIndex *idx;
+	CamelIndexCursor *idc;
+	const gchar *found;
+	guint count;
+	gint ii, batch;
+
+	camel_test_start ("Text index of a generated corpus");
+
+	camel_test_push ("indexing %d messages in %d batches", N_MESSAGES, N_BATCHES);
+	idx = (CamelIndex *) camel_text_index_new (path, O_RDWR | O_CREAT | O_TRUNC);
+	check (idx != NULL);
+
+	for (batch = 0; batch < N_BATCHES; batch++) {
+		for (ii = batch; ii < N_MESSAGES; ii += N_BATCHES) {
+			gchar *name = g_strdup_printf ("%d", ii);
+			gchar *text = g_strdup_printf (
+				"Hello, this is about the %s and the %s.\n",
+				words[ii % G_N_ELEMENTS (words)],
+				words[(ii / 10) % G_N_ELEMENTS (words)]);
+
+			index_text (idx, name, text, strlen (text));
+
+			g_free (text);
+			g_free (name);
+		}
+		check (camel_index_sync (idx) == 0);
+	}
+	camel_test_pull ();
+
+	camel_test_push ("lookups");
+	check_generated (idx, FALSE);
+	camel_test_pull ();
+
+	camel_test_push ("lookups after deleting names");
+	for (ii = 1; ii < 100; ii++) {
+		gchar *name = g_strdup_printf ("%d", ii);
+
+		camel_index_delete_name (idx, name);
+		g_free (name);
+	}
+	check (!camel_index_has_name (idx, "50"));
+	check (camel_index_has_name (idx, "100"));
+	check_generated (idx, TRUE);
+	check (camel_index_sync (idx) == 0);
+	check_generated (idx, TRUE);
+	camel_test_pull ();
+
+	camel_test_push ("a cursor across a compression");
+	idc = camel_index_find (idx, "hello");
+	check (camel_index_cursor_next (idc) != NULL);
+	check (camel_index_compress (idx) == 0);
+	for (count = 1; (found = camel_index_cursor_next (idc)) != NULL; count++)
+		check_msg (camel_index_has_name (idx, found), "cursor returned unknown name '%s'", found);
+	check_msg (count == N_MESSAGES - 99, "cursor returned %u names", count);
+	g_object_unref (idc);
+	camel_test_pull ();
+
+	camel_test_push ("lookups after reopening");
+	g_object_unref (idx);
+	check (camel_text_index_check (path) == 0);
+	idx = (CamelIndex *) camel_text_index_new (path, O_RDWR);
+	check (idx != NULL);
+	check_generated (idx, TRUE);
+	camel_test_pull ();
+
+	camel_index_delete (idx);
+	g_object_unref (idx);
+
+	camel_test_end ();
+}
+
+static void
+index_maildir (CamelIndex *idx,
+               const gchar *maildir,
+               const gchar *sub,
+               guint *count)
+{
+	gchar *dirname;
+	const gchar *name;
+	GDir *dir;
+
+	dirname = g_build_filename (maildir, sub, NULL);
+	dir = g_dir_open (dirname, 0, NULL);
+
+	while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+		gchar *filename, *contents;
+		gsize len;
+
+		filename = g_build_filename (dirname, name, NULL);
+		if (g_file_get_contents (filename, &contents, &len, NULL)) {
+			index_text (idx, name, contents, len);
+			g_free (contents);
+			(*count)++;
+		}
+		g_free (filename);
+	}
+
+	if (dir != NULL)
+		g_dir_close (dir);
+	g_free (dirname);
+}
+
+static void
+benchmark_maildir (const gchar *path,
+                   const gchar *maildir)
+{
+	static const gchar *queries[][3] = {
+		{ "the", NULL },
+		{ "meeting", NULL },
+		{ "meet", "tomorrow", NULL }
+	};
+	CamelIndex *idx;
+	GTimer *timer;
+	guint count = 0, ii;
+
+	idx = (CamelIndex *) camel_text_index_new (path, O_RDWR | O_CREAT | O_TRUNC);
+	check (idx != NULL);
+
+	timer = g_timer_new ();
+	index_maildir (idx, maildir, "cur", &count);
+	index_maildir (idx, maildir, "new", &count);
+	check (camel_index_sync (idx) == 0);
+	printf ("indexed %u messages in %.3fs\n", count, g_timer_elapsed (timer, NULL));
+
+	for (ii = 0; ii < G_N_ELEMENTS (queries); ii++) {
+		GPtrArray *names;
+
+		g_timer_start (timer);
+		names = camel_text_index_find_all (CAMEL_TEXT_INDEX (idx), queries[ii]);
+		printf (
+			"'%s%s%s' found in %u messages in %.3fs\n",
+			queries[ii][0], queries[ii][1] ? "' '" : "",
+			queries[ii][1] ? queries[ii][1] : "",
+			names->len, g_timer_elapsed (timer, NULL));
+		g_ptr_array_unref (names);
+	}
+
+	camel_text_index_info (CAMEL_TEXT_INDEX (idx));
+
+	g_timer_destroy (timer);
+	camel_index_delete (idx);
+	g_object_unref (idx);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	const gchar *maildir = NULL;
+	gchar *path;
+	gint ii;
+
+	camel_test_init (argc, argv);
+
+	for (ii = 1; ii < argc; ii++) {
+		if (argv[ii][0] != '-')
+			maildir = argv[ii];
+	}
+
+	path = g_build_filename (g_get_tmp_dir (), "camel-text-index-test", NULL);
+
+	if (maildir != NULL)
+		benchmark_maildir (path, maildir);
+	else
+		test_generated (path);
+
+	camel_text_index_remove (path);
+	g_free (path);
+
+	return 0;
+}
@@ -0,0 +1,328 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/* Checks ECalBackendFreeBusy against expanding every component for
+ * each request, the way the file backend did it before, and prints
+ * how long either takes for the same set of queries. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <libical/ical.h>
+#include <libedata-cal/libedata-cal.h>
+
+#define NUM_COMPONENTS 500
+#define NUM_QUERIES 200
+#define DAY (24 * 60 * 60)
+
+/* 2013-01-01 00:00:00 UTC */
+#define WINDOW_START ((time_t) 1356998400)
+#define WINDOW_END (WINDOW_START + 365 * DAY)
+
+typedef struct {
+	time_t start;
+	time_t end;
+} Interval;
+
+static GRand *myrand = NULL;
+
+static ECalComponent *
+create_test_component (gint index)
+{
+	ECalComponent *comp;
+	icalcomponent *icalcomp;
+	struct icaltimetype tt;
+	gchar *str, *dtstart, *dtend;
+	time_t start;
+
+	start = WINDOW_START + g_rand_int_range (myrand, 0, 300) * DAY +
+		g_rand_int_range (myrand, 0, 24) * 60 * 60;
+
+	tt = icaltime_from_timet_with_zone (start, FALSE, icaltimezone_get_utc_timezone ());
+	dtstart = icaltime_as_ical_string_r (tt);
+	tt = icaltime_from_timet_with_zone (
+		start + g_rand_int_range (myrand, 1, 5) * 30 * 60,
+		FALSE, icaltimezone_get_utc_timezone ());
+	dtend = icaltime_as_ical_string_r (tt);
+
+	str = g_strdup_printf (
+		"BEGIN:VEVENT\r\n"
+		"UID:free-busy-test-%d\r\n"
+		"DTSTART:%s\r\n"
+		"DTEND:%s\r\n"
+		"%s"
+		"%s"
+		"END:VEVENT\r\n",
+		index, dtstart, dtend,
+		(index % 3) == 0 ? "RRULE:FREQ=WEEKLY;COUNT=20\r\n" :
+		(index % 3) == 1 ? "RRULE:FREQ=DAILY;INTERVAL=3;COUNT=30\r\n" : "",
+		(index % 7) == 0 ? "TRANSP:TRANSPARENT\r\n" : "");
+
+	icalcomp = icalcomponent_new_from_string (str);
+	g_assert (icalcomp != NULL);
+
+	comp = e_cal_component_new_from_icalcomponent (icalcomp);
+	g_assert (comp != NULL);
+
+	g_free (str);
+	g_free (dtstart);
+	g_free (dtend);
+
+	return comp;
+}
+
+static gint
+interval_compare (gconstpointer a,
+                  gconstpointer b)
+{
+	const Interval *ia = a, *ib = b;
+
+	if (ia->start != ib->start)
+		return ia->start < ib->start ? -1 : 1;
+
+	return ia->end < ib->end ? -1 : ia->end > ib->end ? 1 : 0;
+}
+
+static gboolean
+collect_instance (ECalComponent *comp,
+                  time_t instance_start,
+                  time_t instance_end,
+                  gpointer user_data)
+{
+	GArray *instances = user_data;
+	Interval iv;
+
+	if (instance_end > instance_start) {
+		iv.start = instance_start;
+		iv.end = instance_end;
+		g_array_append_val (instances, iv);
+	}
+
+	return TRUE;
+}
+
+/* Expands every component, as create_user_free_busy () does without
+ * an index, then merges and clips the instances to the query. */
+static GArray *
+expand_free_busy (GPtrArray *comps,
+                  time_t start,
+                  time_t end)
+{
+	GArray *instances, *merged;
+	guint ii;
+
+	instances = g_array_new (FALSE, FALSE, sizeof (Interval));
+	merged = g_array_new (FALSE, FALSE, sizeof (Interval));
+
+	for (ii = 0; ii < comps->len; ii++) {
+		ECalComponent *comp = g_ptr_array_index (comps, ii);
+		ECalComponentTransparency transp;
+
+		e_cal_component_get_transparency (comp, &transp);
+		if (transp == E_CAL_COMPONENT_TRANSP_TRANSPARENT)
+			continue;
+
+		e_cal_recur_generate_instances (
+			comp, start, end, collect_instance, instances,
+			NULL, NULL, icaltimezone_get_utc_timezone ());
+	}
+
+	g_array_sort (instances, interval_compare);
+
+	for (ii = 0; ii < instances->len; ii++) {
+		Interval iv = g_array_index (instances, Interval, ii);
+
+		if (iv.end <= start || iv.start >= end)
+			continue;
+
+		iv.start = MAX (iv.start, start);
+		iv.end = MIN (iv.end, end);
+
+		if (merged->len > 0) {
+			Interval *tail = &g_array_index (merged, Interval, merged->len - 1);
+
+			if (iv.start <= tail->end) {
+				tail->end = MAX (tail->end, iv.end);
+				continue;
+			}
+		}
+
+		g_array_append_val (merged, iv);
+	}
+
+	g_array_free (instances, TRUE);
+
+	return merged;
+}
+
+static GArray *
+read_vfreebusy (icalcomponent *vfb)
+{
+	GArray *periods;
+	icalproperty *prop;
+
+	periods = g_array_new (FALSE, FALSE, sizeof (Interval));
+
+	for (prop = icalcomponent_get_first_property (vfb, ICAL_FREEBUSY_PROPERTY);
+	     prop != NULL;
+	     prop = icalcomponent_get_next_property (vfb, ICAL_FREEBUSY_PROPERTY)) {
+		struct icalperiodtype ipt = icalproperty_get_freebusy (prop);
+		Interval iv;
+
+		iv.start = icaltime_as_timet_with_zone (ipt.start, icaltimezone_get_utc_timezone ());
+		iv.end = icaltime_as_timet_with_zone (ipt.end, icaltimezone_get_utc_timezone ());
+
+		g_array_append_val (periods, iv);
+	}
+
+	return periods;
+}
+
+static void
+compare_results (GArray *expected,
+                 GArray *periods)
+{
+	guint ii;
+
+	g_assert_cmpuint (expected->len, ==, periods->len);
+
+	for (ii = 0; ii < expected->len; ii++) {
+		g_assert_cmpint (
+			g_array_index (expected, Interval, ii).start, ==,
+			g_array_index (periods, Interval, ii).start);
+		g_assert_cmpint (
+			g_array_index (expected, Interval, ii).end, ==,
+			g_array_index (periods, Interval, ii).end);
+	}
+}
+
+static void
+run_queries (ECalBackendFreeBusy *free_busy,
+             GPtrArray *comps)
+{
+	GTimer *timer;
+	gdouble expand_time = 0.0, index_time = 0.0;
+	gint ii;
+
+	timer = g_timer_new ();
+
+	for (ii = 0; ii < NUM_QUERIES; ii++) {
+		GArray *expected, *periods;
+		icalcomponent *vfb;
+		time_t start, end;
+
+		start = WINDOW_START + g_rand_int_range (myrand, 0, 330) * DAY;
+		end = start + g_rand_int_range (myrand, 1, 30) * DAY;
+
+		g_timer_start (timer);
+		expected = expand_free_busy (comps, start, end);
+		expand_time += g_timer_elapsed (timer, NULL);
+
+		g_timer_start (timer);
+		vfb = e_cal_backend_free_busy_get_vfreebusy (free_busy, NULL, NULL, start, end);
+		index_time += g_timer_elapsed (timer, NULL);
+
+		periods = read_vfreebusy (vfb);
+		compare_results (expected, periods);
+
+		icalcomponent_free (vfb);
+		g_array_free (expected, TRUE);
+		g_array_free (periods, TRUE);
+	}
+
+	g_print (
+		"%d queries over %u components: expansion %.3fs, index %.3fs\n",
+		NUM_QUERIES, comps->len, expand_time, index_time);
+
+	g_timer_destroy (timer);
+}
+
+static void
+test_free_busy (void)
+{
+	ECalBackendFreeBusy *free_busy;
+	GPtrArray *comps;
+	GTimer *timer;
+	gint ii;
+
+	free_busy = e_cal_backend_free_busy_new (WINDOW_START, WINDOW_END);
+	comps = g_ptr_array_new_with_free_func (g_object_unref);
+
+	timer = g_timer_new ();
+
+	for (ii = 0; ii < NUM_COMPONENTS; ii++) {
+		ECalComponent *comp = create_test_component (ii);
+
+		e_cal_backend_free_busy_add_component (
+			free_busy, comp, NULL, NULL,
+			icaltimezone_get_utc_timezone ());
+		g_ptr_array_add (comps, comp);
+	}
+
+	g_print (
+		"Indexed %d components into %u intervals in %.3fs\n",
+		NUM_COMPONENTS, e_cal_backend_free_busy_get_n_intervals (free_busy),
+		g_timer_elapsed (timer, NULL));
+
+	g_timer_destroy (timer);
+
+	g_assert (e_cal_backend_free_busy_covers (free_busy, WINDOW_START, WINDOW_END));
+	g_assert (!e_cal_backend_free_busy_covers (free_busy, WINDOW_START - 1, WINDOW_END));
+
+	run_queries (free_busy, comps);
+
+	/* remove a third of the components, which forces a rebuild */
+	for (ii = comps->len - 1; ii >= 0; ii -= 3) {
+		ECalComponent *comp = g_ptr_array_index (comps, ii);
+		const gchar *uid = NULL;
+
+		e_cal_component_get_uid (comp, &uid);
+		g_assert (e_cal_backend_free_busy_remove_component (free_busy, uid, NULL));
+		g_ptr_array_remove_index (comps, ii);
+	}
+
+	run_queries (free_busy, comps);
+
+	/* re-adding a component replaces its previous instances */
+	for (ii = 0; ii < comps->len; ii += 5)
+		e_cal_backend_free_busy_add_component (
+			free_busy, g_ptr_array_index (comps, ii), NULL, NULL,
+			icaltimezone_get_utc_timezone ());
+
+	run_queries (free_busy, comps);
+
+	e_cal_backend_free_busy_clear (free_busy);
+	g_assert_cmpuint (e_cal_backend_free_busy_get_n_intervals (free_busy), ==, 0);
+
+	g_ptr_array_unref (comps);
+	g_object_unref (free_busy);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	g_type_init ();
+
+	myrand = g_rand_new_with_seed (1234);
+	test_free_busy ();
+	g_rand_free (myrand);
+
+	g_print ("Everything OK\n");
+
+	return 0;
+}